@@ -114,12 +114,18 @@
 #include "pvr_helper.h"
 #include "pkm_helper.h"
 #include "jo_jpeg.h"
+#include "thread_helper.h"
+#include "file_helper.h"
 
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
-/*	error reporting	*/
-const char *result_string_pointer = "SOIL initialized";
+/*	error reporting, each thread gets its own result	*/
+SOIL_THREAD_LOCAL const char *result_string_pointer = "SOIL initialized";
 
 /*	for loading cube maps	*/
 enum{
@@ -128,6 +134,7 @@ enum{
 	SOIL_CAPABILITY_PRESENT = 1
 };
 static int has_cubemap_capability = SOIL_CAPABILITY_UNKNOWN;
+static thread_once_flag cubemap_capability_once = THREAD_ONCE_INIT;
 int query_cubemap_capability( void );
 #define SOIL_TEXTURE_WRAP_R					0x8072
 #define SOIL_CLAMP_TO_EDGE					0x812F
@@ -146,14 +153,17 @@ int query_cubemap_capability( void );
 /*	for non-power-of-two texture	*/
 #define SOIL_IS_POW2( v ) ( ( v & ( v - 1 ) ) == 0 )
 static int has_NPOT_capability = SOIL_CAPABILITY_UNKNOWN;
+static thread_once_flag NPOT_capability_once = THREAD_ONCE_INIT;
 int query_NPOT_capability( void );
 /*	for texture rectangles	*/
 static int has_tex_rectangle_capability = SOIL_CAPABILITY_UNKNOWN;
+static thread_once_flag tex_rectangle_capability_once = THREAD_ONCE_INIT;
 int query_tex_rectangle_capability( void );
 #define SOIL_TEXTURE_RECTANGLE_ARB				0x84F5
 #define SOIL_MAX_RECTANGLE_TEXTURE_SIZE_ARB		0x84F8
 /*	for using DXT compression	*/
 static int has_DXT_capability = SOIL_CAPABILITY_UNKNOWN;
+static thread_once_flag DXT_capability_once = THREAD_ONCE_INIT;
 int query_DXT_capability( void );
 #define SOIL_GL_SRGB			0x8C40
 #define SOIL_GL_SRGB_ALPHA		0x8C42
@@ -164,7 +174,26 @@ int query_DXT_capability( void );
 #define SOIL_GL_COMPRESSED_SRGB_S3TC_DXT1_EXT  0x8C4C
 #define SOIL_GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
 static int has_sRGB_capability = SOIL_CAPABILITY_UNKNOWN;
+static thread_once_flag sRGB_capability_once = THREAD_ONCE_INIT;
 int query_sRGB_capability( void );
+/*	for using BC4 / BC5 (RGTC) compression	*/
+static int has_RGTC_capability = SOIL_CAPABILITY_UNKNOWN;
+static thread_once_flag RGTC_capability_once = THREAD_ONCE_INIT;
+int query_RGTC_capability( void );
+#define SOIL_COMPRESSED_RED_RGTC1	0x8DBB
+#define SOIL_COMPRESSED_RG_RGTC2	0x8DBD
+#define SOIL_COMPRESSED_SIGNED_RED_RGTC1	0x8DBC
+#define SOIL_COMPRESSED_SIGNED_RG_RGTC2	0x8DBE
+/*	for uploading BC6H / BC7 (BPTC) DDS files	*/
+static int has_BPTC_capability = SOIL_CAPABILITY_UNKNOWN;
+static thread_once_flag BPTC_capability_once = THREAD_ONCE_INIT;
+int query_BPTC_capability( void );
+#define SOIL_COMPRESSED_RGBA_BPTC_UNORM	0x8E8C
+#define SOIL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM	0x8E8D
+#define SOIL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT	0x8E8E
+#define SOIL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT	0x8E8F
+#define SOIL_GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT	0x8C4D
+#define SOIL_GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT	0x8C4E
 typedef void (APIENTRY * P_SOIL_GLCOMPRESSEDTEXIMAGE2DPROC) (GLenum target, GLint level, GLenum internalformat, GLsizei width, GLsizei height, GLint border, GLsizei imageSize, const GLvoid * data);
 static P_SOIL_GLCOMPRESSEDTEXIMAGE2DPROC soilGlCompressedTexImage2D = NULL;
 
@@ -172,15 +201,49 @@ typedef void (APIENTRY *P_SOIL_GLGENERATEMIPMAPPROC)(GLenum target);
 static P_SOIL_GLGENERATEMIPMAPPROC soilGlGenerateMipmap = NULL;
 
 static int has_gen_mipmap_capability = SOIL_CAPABILITY_UNKNOWN;
+static thread_once_flag gen_mipmap_capability_once = THREAD_ONCE_INIT;
 static int query_gen_mipmap_capability( void );
 
 static int has_PVR_capability = SOIL_CAPABILITY_UNKNOWN;
+static thread_once_flag PVR_capability_once = THREAD_ONCE_INIT;
 int query_PVR_capability( void );
 static int has_BGRA8888_capability = SOIL_CAPABILITY_UNKNOWN;
+static thread_once_flag BGRA8888_capability_once = THREAD_ONCE_INIT;
 int query_BGRA8888_capability( void );
 static int has_ETC1_capability = SOIL_CAPABILITY_UNKNOWN;
+static thread_once_flag ETC1_capability_once = THREAD_ONCE_INIT;
 int query_ETC1_capability( void );
 
+/*	pixel pack buffers and fences, for the asynchronous screenshots	*/
+#define SOIL_GL_PIXEL_PACK_BUFFER	0x88EB
+#define SOIL_GL_STREAM_READ	0x88E1
+#define SOIL_GL_READ_ONLY	0x88B8
+#define SOIL_GL_SYNC_GPU_COMMANDS_COMPLETE	0x9117
+#define SOIL_GL_TIMEOUT_EXPIRED	0x911B
+typedef struct SOIL_GLsync_s *P_SOIL_GLsync;
+typedef void (APIENTRY *P_SOIL_GLGENBUFFERSPROC)(GLsizei n, GLuint *buffers);
+typedef void (APIENTRY *P_SOIL_GLDELETEBUFFERSPROC)(GLsizei n, const GLuint *buffers);
+typedef void (APIENTRY *P_SOIL_GLBINDBUFFERPROC)(GLenum target, GLuint buffer);
+typedef void (APIENTRY *P_SOIL_GLBUFFERDATAPROC)(GLenum target, ptrdiff_t size, const GLvoid *data, GLenum usage);
+typedef void *(APIENTRY *P_SOIL_GLMAPBUFFERPROC)(GLenum target, GLenum access);
+typedef GLboolean (APIENTRY *P_SOIL_GLUNMAPBUFFERPROC)(GLenum target);
+typedef P_SOIL_GLsync (APIENTRY *P_SOIL_GLFENCESYNCPROC)(GLenum condition, GLbitfield flags);
+typedef GLenum (APIENTRY *P_SOIL_GLCLIENTWAITSYNCPROC)(P_SOIL_GLsync sync, GLbitfield flags, unsigned long long timeout);
+typedef void (APIENTRY *P_SOIL_GLDELETESYNCPROC)(P_SOIL_GLsync sync);
+static P_SOIL_GLGENBUFFERSPROC soilGlGenBuffers = NULL;
+static P_SOIL_GLDELETEBUFFERSPROC soilGlDeleteBuffers = NULL;
+static P_SOIL_GLBINDBUFFERPROC soilGlBindBuffer = NULL;
+static P_SOIL_GLBUFFERDATAPROC soilGlBufferData = NULL;
+static P_SOIL_GLMAPBUFFERPROC soilGlMapBuffer = NULL;
+static P_SOIL_GLUNMAPBUFFERPROC soilGlUnmapBuffer = NULL;
+static P_SOIL_GLFENCESYNCPROC soilGlFenceSync = NULL;
+static P_SOIL_GLCLIENTWAITSYNCPROC soilGlClientWaitSync = NULL;
+static P_SOIL_GLDELETESYNCPROC soilGlDeleteSync = NULL;
+
+static int has_PBO_capability = SOIL_CAPABILITY_UNKNOWN;
+static thread_once_flag PBO_capability_once = THREAD_ONCE_INIT;
+static int query_PBO_capability( void );
+
 /* GL_IMG_texture_compression_pvrtc */
 #define SOIL_COMPRESSED_RGB_PVRTC_4BPPV1_IMG                      0x8C00
 #define SOIL_COMPRESSED_RGB_PVRTC_2BPPV1_IMG                      0x8C01
@@ -192,15 +255,23 @@ int query_ETC1_capability( void );
 typedef const GLubyte *(APIENTRY * P_SOIL_glGetStringiFunc) (GLenum, GLuint);
 static P_SOIL_glGetStringiFunc soilGlGetStringiFunc = NULL;
 
-static int isAtLeastGL3()
+static int is_gl3 = SOIL_CAPABILITY_UNKNOWN;
+static thread_once_flag is_gl3_once = THREAD_ONCE_INIT;
+
+static void probeGL3()
 {
-	static int is_gl3 = SOIL_CAPABILITY_UNKNOWN;
+	const char * verstr	= (const char *) glGetString( GL_VERSION );
+	is_gl3				= ( verstr && ( atoi(verstr) >= 3 ) );
 
-	if ( SOIL_CAPABILITY_UNKNOWN == is_gl3 )
+	if ( is_gl3 )
 	{
-		const char * verstr	= (const char *) glGetString( GL_VERSION );
-		is_gl3				= ( verstr && ( atoi(verstr) >= 3 ) );
+		soilGlGetStringiFunc = (P_SOIL_glGetStringiFunc)SOIL_GL_GetProcAddress("glGetStringi");
 	}
+}
+
+static int isAtLeastGL3()
+{
+	run_once( &is_gl3_once, probeGL3 );
 
 	return is_gl3;
 }
@@ -293,12 +364,7 @@ int SOIL_GL_ExtensionSupported(const char *extension)
 
 		if ( NULL == soilGlGetStringiFunc )
 		{
-			soilGlGetStringiFunc = (P_SOIL_glGetStringiFunc)SOIL_GL_GetProcAddress("glGetStringi");
-
-			if ( NULL == soilGlGetStringiFunc )
-			{
-				return 0;
-			}
+			return 0;
 		}
 
 		#ifndef GL_NUM_EXTENSIONS
@@ -1323,6 +1389,29 @@ void check_for_GL_errors( const char *calling_location )
 }
 #endif
 
+/*	compresses the image into the block format of internal_texture_format	*/
+static unsigned char *SOIL_internal_compress_image(
+		const unsigned char *const img,
+		int width, int height, int channels,
+		unsigned int internal_texture_format,
+		int *out_size )
+{
+	switch( internal_texture_format )
+	{
+	case SOIL_COMPRESSED_RED_RGTC1:
+		return convert_image_to_BC4( img, width, height, channels, out_size );
+	case SOIL_COMPRESSED_RG_RGTC2:
+		return convert_image_to_BC5( img, width, height, channels, out_size );
+	case SOIL_RGB_S3TC_DXT1:
+	case SOIL_GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+		/*	RGB, use DXT1	*/
+		return convert_image_to_DXT1( img, width, height, channels, out_size );
+	default:
+		/*	RGBA, use DXT5	*/
+		return convert_image_to_DXT5( img, width, height, channels, out_size );
+	}
+}
+
 static void createMipmaps(const unsigned char *const img,
 		int width, int height, int channels,
 		unsigned int flags,
@@ -1355,18 +1444,9 @@ static void createMipmaps(const unsigned char *const img,
 			{
 				/*	user wants me to do the DXT conversion!	*/
 				int DDS_size;
-				unsigned char *DDS_data = NULL;
-				if( (channels & 1) == 1 )
-				{
-					/*	RGB, use DXT1	*/
-					DDS_data = convert_image_to_DXT1(
-							resampled, MIPwidth, MIPheight, channels, &DDS_size );
-				} else
-				{
-					/*	RGBA, use DXT5	*/
-					DDS_data = convert_image_to_DXT5(
-							resampled, MIPwidth, MIPheight, channels, &DDS_size );
-				}
+				unsigned char *DDS_data = SOIL_internal_compress_image(
+						resampled, MIPwidth, MIPheight, channels,
+						internal_texture_format, &DDS_size );
 				if( DDS_data )
 				{
 					soilGlCompressedTexImage2D(
@@ -1634,6 +1714,22 @@ unsigned int
 			break;
 		}
 		internal_texture_format = original_texture_format;
+		/*	does the user want 1 and 2 channel images as BC4 / BC5?	*/
+		if( (flags & SOIL_FLAG_COMPRESS_TO_RGTC) && (channels <= 2) &&
+			(query_RGTC_capability() == SOIL_CAPABILITY_PRESENT) )
+		{
+			/*	sampled as red / red-green, not luminance	*/
+			if( channels == 1 )
+			{
+				original_texture_format = GL_RED;
+				internal_texture_format = SOIL_COMPRESSED_RED_RGTC1;
+			} else
+			{
+				original_texture_format = GL_RG;
+				internal_texture_format = SOIL_COMPRESSED_RG_RGTC2;
+			}
+			DXT_mode = SOIL_CAPABILITY_PRESENT;
+		} else
 		/*	does the user want me to, and can I, save as DXT?	*/
 		if( flags & SOIL_FLAG_COMPRESS_TO_DXT )
 		{
@@ -1681,16 +1777,9 @@ unsigned int
 		{
 			/*	user wants me to do the DXT conversion!	*/
 			int DDS_size;
-			unsigned char *DDS_data = NULL;
-			if( (channels & 1) == 1 )
-			{
-				/*	RGB, use DXT1	*/
-				DDS_data = convert_image_to_DXT1( NULL != img ? img : data, iwidth, iheight, channels, &DDS_size );
-			} else
-			{
-				/*	RGBA, use DXT5	*/
-				DDS_data = convert_image_to_DXT5( NULL != img ? img : data, iwidth, iheight, channels, &DDS_size );
-			}
+			unsigned char *DDS_data = SOIL_internal_compress_image(
+					NULL != img ? img : data, iwidth, iheight, channels,
+					internal_texture_format, &DDS_size );
 			if( DDS_data )
 			{
 				soilGlCompressedTexImage2D(
@@ -1782,6 +1871,27 @@ unsigned int
 	return tex_id;
 }
 
+/*	turns the rows upside down, swapping them a piece at a time	*/
+static void flip_rows( unsigned char *pixels, size_t row_size, int height )
+{
+	unsigned char temp[512];
+	unsigned char *top, *bottom;
+	size_t done, n;
+	int j;
+	for( j = 0; j < height / 2; ++j )
+	{
+		top = pixels + j * row_size;
+		bottom = pixels + (height - 1 - j) * row_size;
+		for( done = 0; done < row_size; done += n )
+		{
+			n = row_size - done < sizeof( temp ) ? row_size - done : sizeof( temp );
+			memcpy( temp, top + done, n );
+			memcpy( top + done, bottom + done, n );
+			memcpy( bottom + done, temp, n );
+		}
+	}
+}
+
 int
 	SOIL_save_screenshot
 	(
@@ -1792,7 +1902,7 @@ int
 	)
 {
 	unsigned char *pixel_data;
-	int i, j;
+	GLint pack_alignment = 4;
 	int save_result;
 
 	/*	error checks	*/
@@ -1812,24 +1922,20 @@ int
 		return 0;
 	}
 
-	/*  Get the data from OpenGL	*/
-	pixel_data = (unsigned char*)malloc( 3*width*height );
+	/*  Get the data from OpenGL, with rows packed as tight as the buffer	*/
+	pixel_data = (unsigned char*)malloc( (size_t)3*width*height );
+	if( NULL == pixel_data )
+	{
+		result_string_pointer = "Out of memory";
+		return 0;
+	}
+	glGetIntegerv( GL_PACK_ALIGNMENT, &pack_alignment );
+	glPixelStorei( GL_PACK_ALIGNMENT, 1 );
 	glReadPixels (x, y, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixel_data);
+	glPixelStorei( GL_PACK_ALIGNMENT, pack_alignment );
 
 	/*	invert the image	*/
-	for( j = 0; j*2 < height; ++j )
-	{
-		int index1 = j * width * 3;
-		int index2 = (height - 1 - j) * width * 3;
-		for( i = width * 3; i > 0; --i )
-		{
-			unsigned char temp = pixel_data[index1];
-			pixel_data[index1] = pixel_data[index2];
-			pixel_data[index2] = temp;
-			++index1;
-			++index2;
-		}
-	}
+	flip_rows( pixel_data, (size_t)3*width, height );
 
 	/*	save the image	*/
 	save_result = SOIL_save_image( filename, image_type, width, height, 3, pixel_data);
@@ -1839,151 +1945,1680 @@ int
 	return save_result;
 }
 
-unsigned char*
-	SOIL_load_image
-	(
-		const char *filename,
-		int *width, int *height, int *channels,
-		int force_channels
-	)
+/*	a screenshot on its way to the disk	*/
+typedef struct
 {
-	unsigned char *result = stbi_load( filename,
-			width, height, channels, force_channels );
-	if( result == NULL )
+	char *filename;
+	FILE *stream;	/*	or the YUV4MPEG2 stream to add it to as a frame	*/
+	int image_type;
+	int width, height;
+	unsigned char *pixels;	/*	RGBA, top row first	*/
+	SOIL_screenshot_queue *queue;
+}
+screenshot_job;
+
+/*	a pixel pack buffer of the ring	*/
+typedef struct
+{
+	unsigned int buffer;
+	size_t buffer_size;
+	P_SOIL_GLsync fence;
+	screenshot_job *job;	/*	the screenshot read into the buffer, NULL when free	*/
+}
+screenshot_slot;
+
+struct SOIL_screenshot_queue
+{
+	screenshot_slot *slots;
+	int slot_count;
+	int next_slot;	/*	the next to use, so the oldest one in use	*/
+	int use_PBO;
+	int drop_when_busy;
+	int dropped;
+	int read_failures;
+	/*	counted by the worker, read with atomic_read	*/
+	volatile long saved;
+	volatile long save_failures;
+	background_worker *worker;
+};
+
+static void free_screenshot_job( screenshot_job *job )
+{
+	free( job->filename );
+	free( job->pixels );
+	free( job );
+}
+
+static screenshot_job *create_screenshot_job( const char *filename, FILE *stream, int image_type, int width, int height )
+{
+	screenshot_job *job = (screenshot_job*)calloc( 1, sizeof( screenshot_job ) );
+	if( NULL == job )
 	{
-		result_string_pointer = stbi_failure_reason();
+		return NULL;
+	}
+	if( NULL != filename )
+	{
+		job->filename = (char*)malloc( strlen( filename ) + 1 );
+		if( NULL == job->filename )
+		{
+			free_screenshot_job( job );
+			return NULL;
+		}
+		strcpy( job->filename, filename );
+	}
+	job->pixels = (unsigned char*)malloc( (size_t)4*width*height );
+	if( NULL == job->pixels )
+	{
+		free_screenshot_job( job );
+		return NULL;
+	}
+	job->stream = stream;
+	job->image_type = image_type;
+	job->width = width;
+	job->height = height;
+	return job;
+}
+
+/*	the RGBA pixels as the Y, Cb and Cr planes of a 4:4:4 frame,
+	BT.601 studio range	*/
+static int write_Y4M_frame( FILE *stream, const unsigned char *pixels, int width, int height )
+{
+	unsigned char *row;
+	const unsigned char *p;
+	int plane, x, y, ok;
+	row = (unsigned char*)malloc( width );
+	if( NULL == row )
+	{
+		return 0;
+	}
+	ok = ( fwrite( "FRAME\n", 1, 6, stream ) == 6 );
+	for( plane = 0; ok && (plane < 3); ++plane )
+	{
+		for( y = 0; ok && (y < height); ++y )
+		{
+			p = pixels + (size_t)4*width*y;
+			for( x = 0; x < width; ++x, p += 4 )
+			{
+				int r = p[0], g = p[1], b = p[2];
+				switch( plane )
+				{
+				case 0:
+					row[x] = (unsigned char)( ( ( 66*r + 129*g + 25*b + 128 ) >> 8 ) + 16 );
+					break;
+				case 1:
+					row[x] = (unsigned char)( ( -38*r - 74*g + 112*b + 128 + (128 << 8) ) >> 8 );
+					break;
+				default:
+					row[x] = (unsigned char)( ( 112*r - 94*g - 18*b + 128 + (128 << 8) ) >> 8 );
+					break;
+				}
+			}
+			ok = ( fwrite( row, 1, width, stream ) == (size_t)width );
+		}
+	}
+	free( row );
+	return ok;
+}
+
+/*	runs on the worker thread	*/
+static void save_screenshot_job( void *arg )
+{
+	screenshot_job *job = (screenshot_job*)arg;
+	size_t i, count = (size_t)job->width * job->height;
+	int saved;
+	if( NULL != job->stream )
+	{
+		saved = write_Y4M_frame( job->stream, job->pixels, job->width, job->height );
 	} else
 	{
-		result_string_pointer = "Image loaded";
+		/*	drop the alpha, in place: a pixel never moves up	*/
+		for( i = 0; i < count; ++i )
+		{
+			job->pixels[i*3+0] = job->pixels[i*4+0];
+			job->pixels[i*3+1] = job->pixels[i*4+1];
+			job->pixels[i*3+2] = job->pixels[i*4+2];
+		}
+		saved = SOIL_save_image( job->filename, job->image_type, job->width, job->height, 3, job->pixels );
 	}
-	return result;
+	if( saved )
+	{
+		atomic_increment( &job->queue->saved );
+	} else
+	{
+		atomic_increment( &job->queue->save_failures );
+	}
+	free_screenshot_job( job );
 }
 
-unsigned char*
-	SOIL_load_image_from_memory
-	(
-		const unsigned char *const buffer,
-		int buffer_length,
-		int *width, int *height, int *channels,
-		int force_channels
-	)
+static void submit_screenshot_job( SOIL_screenshot_queue *queue, screenshot_job *job )
 {
-	unsigned char *result = stbi_load_from_memory(
-				buffer, buffer_length,
-				width, height, channels,
-				force_channels );
-	if( result == NULL )
+	job->queue = queue;
+	/*	with max_pending screenshots waiting already, wait for the worker or drop it	*/
+	if( !submit_background_job( queue->worker, save_screenshot_job, job, !queue->drop_when_busy ) )
 	{
-		result_string_pointer = stbi_failure_reason();
+		++queue->dropped;
+		free_screenshot_job( job );
+	}
+}
+
+/*	hands the screenshot in the slot over to the worker, once the GPU wrote
+	it when wait is 0, else waiting for it.  returns 1 if the slot is free	*/
+static int collect_screenshot_slot( SOIL_screenshot_queue *queue, screenshot_slot *slot, int wait )
+{
+	screenshot_job *job = slot->job;
+	const unsigned char *mapped;
+	size_t row_size;
+	int row;
+	if( NULL == job )
+	{
+		return 1;
+	}
+	if( NULL != slot->fence )
+	{
+		/*	mapping the buffer waits anyway	*/
+		if( !wait && (soilGlClientWaitSync( slot->fence, 0, 0 ) == SOIL_GL_TIMEOUT_EXPIRED) )
+		{
+			return 0;
+		}
+		soilGlDeleteSync( slot->fence );
+		slot->fence = NULL;
+	}
+	slot->job = NULL;
+	soilGlBindBuffer( SOIL_GL_PIXEL_PACK_BUFFER, slot->buffer );
+	mapped = (const unsigned char*)soilGlMapBuffer( SOIL_GL_PIXEL_PACK_BUFFER, SOIL_GL_READ_ONLY );
+	if( NULL != mapped )
+	{
+		/*	OpenGL has the bottom row first, copying the rows backwards flips it	*/
+		row_size = (size_t)4 * job->width;
+		for( row = 0; row < job->height; ++row )
+		{
+			memcpy( job->pixels + (job->height - 1 - row) * row_size, mapped + row * row_size, row_size );
+		}
+		soilGlUnmapBuffer( SOIL_GL_PIXEL_PACK_BUFFER );
+	}
+	soilGlBindBuffer( SOIL_GL_PIXEL_PACK_BUFFER, 0 );
+	if( NULL == mapped )
+	{
+		++queue->read_failures;
+		free_screenshot_job( job );
+		return 1;
+	}
+	submit_screenshot_job( queue, job );
+	return 1;
+}
+
+/*	a queue with buffer_count pixel pack buffers, and max_pending
+	screenshots that may wait for the worker	*/
+static SOIL_screenshot_queue *create_capture_queue( int buffer_count, int max_pending, int drop_when_busy )
+{
+	SOIL_screenshot_queue *queue;
+	int i;
+	queue = (SOIL_screenshot_queue*)calloc( 1, sizeof( SOIL_screenshot_queue ) );
+	if( NULL == queue )
+	{
+		return NULL;
+	}
+	queue->slot_count = buffer_count > 0 ? buffer_count : 3;
+	queue->drop_when_busy = drop_when_busy;
+	queue->slots = (screenshot_slot*)calloc( queue->slot_count, sizeof( screenshot_slot ) );
+	queue->worker = create_background_worker( max_pending > 0 ? max_pending : queue->slot_count );
+	if( (NULL == queue->slots) || (NULL == queue->worker) )
+	{
+		destroy_background_worker( queue->worker );
+		free( queue->slots );
+		free( queue );
+		return NULL;
+	}
+	queue->use_PBO = ( query_PBO_capability() == SOIL_CAPABILITY_PRESENT );
+	if( queue->use_PBO )
+	{
+		for( i = 0; i < queue->slot_count; ++i )
+		{
+			soilGlGenBuffers( 1, &queue->slots[i].buffer );
+		}
+	}
+	return queue;
+}
+
+/*	starts reading the pixels of the job, see SOIL_queue_screenshot	*/
+static void capture_screenshot( SOIL_screenshot_queue *queue, screenshot_job *job, int x, int y )
+{
+	screenshot_slot *slot;
+	size_t size;
+	/*	RGBA rows need no pack alignment, and it is the fast read for most drivers	*/
+	if( queue->use_PBO )
+	{
+		/*	the oldest screenshot still in the ring has to move on first	*/
+		slot = &queue->slots[queue->next_slot];
+		collect_screenshot_slot( queue, slot, 1 );
+		size = (size_t)4*job->width*job->height;
+		soilGlBindBuffer( SOIL_GL_PIXEL_PACK_BUFFER, slot->buffer );
+		if( slot->buffer_size != size )
+		{
+			soilGlBufferData( SOIL_GL_PIXEL_PACK_BUFFER, (ptrdiff_t)size, NULL, SOIL_GL_STREAM_READ );
+			slot->buffer_size = size;
+		}
+		/*	into the buffer, this returns without waiting for the GPU	*/
+		glReadPixels( x, y, job->width, job->height, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)0 );
+		soilGlBindBuffer( SOIL_GL_PIXEL_PACK_BUFFER, 0 );
+		slot->fence = soilGlFenceSync( SOIL_GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+		slot->job = job;
+		queue->next_slot = (queue->next_slot + 1) % queue->slot_count;
 	} else
 	{
-		result_string_pointer = "Image loaded from memory";
+		/*	no pixel buffers, read it now and only save in the background	*/
+		glReadPixels( x, y, job->width, job->height, GL_RGBA, GL_UNSIGNED_BYTE, job->pixels );
+		flip_rows( job->pixels, (size_t)4*job->width, job->height );
+		submit_screenshot_job( queue, job );
 	}
-	return result;
 }
 
+/*	hands over what the GPU has finished, see SOIL_update_screenshot_queue	*/
+static int update_capture_queue( SOIL_screenshot_queue *queue )
+{
+	int i, collected = 0;
+	if( !queue->use_PBO )
+	{
+		return 0;
+	}
+	/*	oldest first, up to the first one the GPU is still working on	*/
+	for( i = 0; i < queue->slot_count; ++i )
+	{
+		screenshot_slot *slot = &queue->slots[(queue->next_slot + i) % queue->slot_count];
+		if( NULL == slot->job )
+		{
+			continue;
+		}
+		if( !collect_screenshot_slot( queue, slot, 0 ) )
+		{
+			break;
+		}
+		++collected;
+	}
+	return collected;
+}
+
+/*	waits until everything queued is saved, and frees the GL objects and
+	the worker, the counts stay	*/
+static void finish_capture_queue( SOIL_screenshot_queue *queue )
+{
+	int i;
+	for( i = 0; i < queue->slot_count; ++i )
+	{
+		screenshot_slot *slot = &queue->slots[(queue->next_slot + i) % queue->slot_count];
+		if( queue->use_PBO )
+		{
+			collect_screenshot_slot( queue, slot, 1 );
+			soilGlDeleteBuffers( 1, &slot->buffer );
+		}
+	}
+	/*	this lets the worker finish what it has got first	*/
+	destroy_background_worker( queue->worker );
+	queue->worker = NULL;
+	free( queue->slots );
+	queue->slots = NULL;
+}
 
-int
-	SOIL_save_image
+SOIL_screenshot_queue *
+	SOIL_create_screenshot_queue
 	(
-		const char *filename,
-		int image_type,
-		int width, int height, int channels,
-		const unsigned char *const data
+		int buffer_count
 	)
 {
-	return SOIL_save_image_quality( filename, image_type, width, height, channels, data, 80 );
+	SOIL_screenshot_queue *queue = create_capture_queue( buffer_count, 0, 0 );
+	result_string_pointer = queue ? "Screenshot queue created" : "Out of memory";
+	return queue;
 }
 
 int
-	SOIL_save_image_quality
+	SOIL_queue_screenshot
 	(
+		SOIL_screenshot_queue *queue,
 		const char *filename,
 		int image_type,
-		int width, int height, int channels,
-		const unsigned char *const data,
-		int quality
+		int x, int y,
+		int width, int height
 	)
 {
-	int save_result;
+	screenshot_job *job;
 
-	/*	error check	*/
-	if( (width < 1) || (height < 1) ||
-		(channels < 1) || (channels > 4) ||
-		(data == NULL) ||
-		(filename == NULL) )
+	/*	error checks	*/
+	if( NULL == queue )
 	{
+		result_string_pointer = "Invalid screenshot queue";
 		return 0;
 	}
-	if( image_type == SOIL_SAVE_TYPE_BMP )
-	{
-		save_result = stbi_write_bmp( filename,
-				width, height, channels, (void*)data );
-	} else
-	if( image_type == SOIL_SAVE_TYPE_TGA )
-	{
-		save_result = stbi_write_tga( filename,
-				width, height, channels, (void*)data );
-	} else
-	if( image_type == SOIL_SAVE_TYPE_DDS )
-	{
-		save_result = save_image_as_DDS( filename,
-				width, height, channels, (const unsigned char *const)data );
-	} else
-	if( image_type == SOIL_SAVE_TYPE_PNG )
+	if( (width < 1) || (height < 1) )
 	{
-		save_result = stbi_write_png( filename,
-				width, height, channels, (const unsigned char *const)data, 0 );
-	} else
-	if ( image_type == SOIL_SAVE_TYPE_JPG )
+		result_string_pointer = "Invalid screenshot dimensions";
+		return 0;
+	}
+	if( (x < 0) || (y < 0) )
 	{
-		save_result = jo_write_jpg( filename, (const void*)data, width, height, channels, quality );
+		result_string_pointer = "Invalid screenshot location";
+		return 0;
 	}
-	else
+	if( filename == NULL )
 	{
-		save_result = 0;
+		result_string_pointer = "Invalid screenshot filename";
+		return 0;
 	}
 
-	if( save_result == 0 )
-	{
-		result_string_pointer = "Saving the image failed";
-	} else
+	job = create_screenshot_job( filename, NULL, image_type, width, height );
+	if( NULL == job )
 	{
-		result_string_pointer = "Image saved";
+		result_string_pointer = "Out of memory";
+		return 0;
 	}
-	return save_result;
+	capture_screenshot( queue, job, x, y );
+	result_string_pointer = "Screenshot queued";
+	return 1;
 }
 
-void
-	SOIL_free_image_data
+int
+	SOIL_update_screenshot_queue
 	(
-		unsigned char *img_data
+		SOIL_screenshot_queue *queue
 	)
 {
-	if ( img_data )
-		free( (void*)img_data );
+	if( NULL == queue )
+	{
+		return 0;
+	}
+	return update_capture_queue( queue );
 }
 
-const char*
-	SOIL_last_result
+int
+	SOIL_destroy_screenshot_queue
 	(
-		void
+		SOIL_screenshot_queue *queue
 	)
 {
-	return result_string_pointer;
+	int saved;
+	if( NULL == queue )
+	{
+		return 0;
+	}
+	finish_capture_queue( queue );
+	saved = (0 == queue->read_failures) && (0 == atomic_read( &queue->save_failures ));
+	free( queue );
+	result_string_pointer = saved ? "Screenshots saved" : "Saving a screenshot failed";
+	return saved;
 }
 
-unsigned int SOIL_direct_load_DDS_from_memory(
-		const unsigned char *const buffer,
-		int buffer_length,
-		unsigned int reuse_texture_ID,
-		int flags,
-		int loading_as_cubemap )
+struct SOIL_recorder
 {
-	/*	variables	*/
-	DDS_header header;
-	unsigned int buffer_index = 0;
-	unsigned int tex_ID = 0;
+	SOIL_screenshot_queue *queue;
+	char *filename;	/*	the pattern of the image names, or the stream's name	*/
+	FILE *stream;
+	int image_type;
+	int x, y, width, height;
+	int frame_interval;
+	int frames_seen;
+	int frames_captured;
+};
+
+/*	one %d for the frame number, with at most a 0 flag and 2 digits of width,
+	and no other conversion	*/
+static int is_frame_number_pattern( const char *pattern )
+{
+	int conversions = 0;
+	const char *p;
+	for( p = strchr( pattern, '%' ); NULL != p; p = strchr( p, '%' ) )
+	{
+		++p;
+		if( '0' == *p )
+		{
+			++p;
+		}
+		if( (*p >= '1') && (*p <= '9') )
+		{
+			++p;
+			if( (*p >= '0') && (*p <= '9') )
+			{
+				++p;
+			}
+		}
+		if( 'd' != *p )
+		{
+			return 0;
+		}
+		++conversions;
+	}
+	return 1 == conversions;
+}
+
+SOIL_recorder *
+	SOIL_create_recorder
+	(
+		const char *filename,
+		int image_type,
+		int x, int y,
+		int width, int height,
+		int frame_interval,
+		int frames_per_second,
+		int max_pending_frames,
+		int backpressure
+	)
+{
+	SOIL_recorder *recorder;
+
+	/*	error checks	*/
+	if( (width < 1) || (height < 1) )
+	{
+		result_string_pointer = "Invalid recording dimensions";
+		return NULL;
+	}
+	if( (x < 0) || (y < 0) )
+	{
+		result_string_pointer = "Invalid recording location";
+		return NULL;
+	}
+	if( (NULL == filename) ||
+		((SOIL_RECORD_Y4M != image_type) && !is_frame_number_pattern( filename )) )
+	{
+		result_string_pointer = "Invalid recording filename";
+		return NULL;
+	}
+
+	recorder = (SOIL_recorder*)calloc( 1, sizeof( SOIL_recorder ) );
+	if( NULL == recorder )
+	{
+		result_string_pointer = "Out of memory";
+		return NULL;
+	}
+	recorder->filename = (char*)malloc( strlen( filename ) + 1 );
+	if( NULL == recorder->filename )
+	{
+		free( recorder );
+		result_string_pointer = "Out of memory";
+		return NULL;
+	}
+	strcpy( recorder->filename, filename );
+	recorder->image_type = image_type;
+	recorder->x = x;
+	recorder->y = y;
+	recorder->width = width;
+	recorder->height = height;
+	recorder->frame_interval = frame_interval > 1 ? frame_interval : 1;
+	if( SOIL_RECORD_Y4M == image_type )
+	{
+		recorder->stream = fopen( filename, "wb" );
+		if( NULL == recorder->stream )
+		{
+			free( recorder->filename );
+			free( recorder );
+			result_string_pointer = "Unable to open the recording file";
+			return NULL;
+		}
+		/*	the frame rate of the recording, every frame_interval-th frame	*/
+		fprintf( recorder->stream, "YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 C444\n",
+				width, height, frames_per_second > 0 ? frames_per_second : 60, recorder->frame_interval );
+	}
+	/*	two buffers cover a frame or two of GPU latency	*/
+	recorder->queue = create_capture_queue( 2, max_pending_frames, SOIL_RECORD_DROP == backpressure );
+	if( NULL == recorder->queue )
+	{
+		if( NULL != recorder->stream )
+		{
+			fclose( recorder->stream );
+		}
+		free( recorder->filename );
+		free( recorder );
+		result_string_pointer = "Out of memory";
+		return NULL;
+	}
+	result_string_pointer = "Recording started";
+	return recorder;
+}
+
+int
+	SOIL_record_frame
+	(
+		SOIL_recorder *recorder
+	)
+{
+	screenshot_job *job;
+	char *name = NULL;
+	int frame;
+	if( NULL == recorder )
+	{
+		return 0;
+	}
+	frame = recorder->frames_seen++;
+	update_capture_queue( recorder->queue );
+	if( 0 != frame % recorder->frame_interval )
+	{
+		return 0;
+	}
+	if( NULL == recorder->stream )
+	{
+		/*	the pattern has a single %d of at most 99 characters	*/
+		name = (char*)malloc( strlen( recorder->filename ) + 100 );
+		if( NULL == name )
+		{
+			result_string_pointer = "Out of memory";
+			return 0;
+		}
+		sprintf( name, recorder->filename, frame / recorder->frame_interval );
+	}
+	job = create_screenshot_job( name, recorder->stream, recorder->image_type, recorder->width, recorder->height );
+	free( name );
+	if( NULL == job )
+	{
+		result_string_pointer = "Out of memory";
+		return 0;
+	}
+	++recorder->frames_captured;
+	capture_screenshot( recorder->queue, job, recorder->x, recorder->y );
+	return 1;
+}
+
+static void get_recorder_stats( const SOIL_recorder *recorder, SOIL_recorder_stats *stats )
+{
+	stats->frames_seen = recorder->frames_seen;
+	stats->frames_captured = recorder->frames_captured;
+	stats->frames_dropped = recorder->queue->dropped;
+	stats->frames_written = (int)atomic_read( &recorder->queue->saved );
+	stats->write_failures = recorder->queue->read_failures + (int)atomic_read( &recorder->queue->save_failures );
+}
+
+void
+	SOIL_get_recorder_stats
+	(
+		const SOIL_recorder *recorder,
+		SOIL_recorder_stats *stats
+	)
+{
+	if( (NULL != recorder) && (NULL != stats) )
+	{
+		get_recorder_stats( recorder, stats );
+	}
+}
+
+int
+	SOIL_destroy_recorder
+	(
+		SOIL_recorder *recorder,
+		SOIL_recorder_stats *stats
+	)
+{
+	SOIL_recorder_stats final_stats;
+	if( NULL == recorder )
+	{
+		return 0;
+	}
+	finish_capture_queue( recorder->queue );
+	get_recorder_stats( recorder, &final_stats );
+	if( (NULL != recorder->stream) && (0 != fclose( recorder->stream )) )
+	{
+		++final_stats.write_failures;
+	}
+	if( NULL != stats )
+	{
+		*stats = final_stats;
+	}
+	free( recorder->queue );
+	free( recorder->filename );
+	free( recorder );
+	result_string_pointer = final_stats.write_failures ? "Writing a recorded frame failed" : "Recording saved";
+	return 0 == final_stats.write_failures;
+}
+
+unsigned char*
+	SOIL_load_image
+	(
+		const char *filename,
+		int *width, int *height, int *channels,
+		int force_channels
+	)
+{
+	unsigned char *result;
+	mapped_file file;
+	/*	decode straight from the mapped file rather than through stdio	*/
+	if( map_file( filename, FILE_ACCESS_SEQUENTIAL, &file ) &&
+		(file.size <= (size_t)INT_MAX) )
+	{
+		result = stbi_load_from_memory( file.data, (int)file.size,
+				width, height, channels, force_channels );
+	} else
+	{
+		result = stbi_load( filename,
+				width, height, channels, force_channels );
+	}
+	unmap_file( &file );
+	if( result == NULL )
+	{
+		result_string_pointer = stbi_failure_reason();
+	} else
+	{
+		result_string_pointer = "Image loaded";
+	}
+	return result;
+}
+
+unsigned char*
+	SOIL_load_image_from_memory
+	(
+		const unsigned char *const buffer,
+		int buffer_length,
+		int *width, int *height, int *channels,
+		int force_channels
+	)
+{
+	unsigned char *result = stbi_load_from_memory(
+				buffer, buffer_length,
+				width, height, channels,
+				force_channels );
+	if( result == NULL )
+	{
+		result_string_pointer = stbi_failure_reason();
+	} else
+	{
+		result_string_pointer = "Image loaded from memory";
+	}
+	return result;
+}
+
+/*	stbi_load_scaled only reduces JPEGs, box filter the rest	*/
+static unsigned char*
+	reduce_scaled_image
+	(
+		unsigned char *img,
+		int scale,
+		int full_width, int full_height,
+		int *width, int *height, int channels
+	)
+{
+	unsigned char *reduced;
+	int reduced_width, reduced_height;
+	if( (NULL == img) || (scale <= 1) ||
+		(*width != full_width) || (*height != full_height) )
+	{
+		return img;
+	}
+	reduced_width = full_width / scale > 1 ? full_width / scale : 1;
+	reduced_height = full_height / scale > 1 ? full_height / scale : 1;
+	reduced = (unsigned char*)malloc( (size_t)reduced_width * reduced_height * channels );
+	if( NULL == reduced )
+	{
+		SOIL_free_image_data( img );
+		result_string_pointer = "Out of memory";
+		return NULL;
+	}
+	mipmap_image( img, full_width, full_height, channels, reduced, scale, scale );
+	SOIL_free_image_data( img );
+	*width = reduced_width;
+	*height = reduced_height;
+	return reduced;
+}
+
+unsigned char*
+	SOIL_load_image_scaled
+	(
+		const char *filename,
+		int scale,
+		int *width, int *height, int *channels,
+		int force_channels
+	)
+{
+	unsigned char *result;
+	int full_width = 0, full_height = 0, full_channels;
+	mapped_file file;
+	if( map_file( filename, FILE_ACCESS_SEQUENTIAL, &file ) &&
+		(file.size <= (size_t)INT_MAX) )
+	{
+		stbi_info_from_memory( file.data, (int)file.size, &full_width, &full_height, &full_channels );
+		result = stbi_load_scaled_from_memory( file.data, (int)file.size, scale,
+				width, height, channels, force_channels );
+	} else
+	{
+		stbi_info( filename, &full_width, &full_height, &full_channels );
+		result = stbi_load_scaled( filename, scale,
+				width, height, channels, force_channels );
+	}
+	unmap_file( &file );
+	if( result == NULL )
+	{
+		result_string_pointer = stbi_failure_reason();
+		return NULL;
+	}
+	result_string_pointer = "Image loaded";
+	return reduce_scaled_image( result, scale, full_width, full_height,
+			width, height, force_channels ? force_channels : *channels );
+}
+
+unsigned char*
+	SOIL_load_image_scaled_from_memory
+	(
+		const unsigned char *const buffer,
+		int buffer_length,
+		int scale,
+		int *width, int *height, int *channels,
+		int force_channels
+	)
+{
+	unsigned char *result;
+	int full_width = 0, full_height = 0, full_channels;
+	stbi_info_from_memory( buffer, buffer_length, &full_width, &full_height, &full_channels );
+	result = stbi_load_scaled_from_memory(
+				buffer, buffer_length, scale,
+				width, height, channels,
+				force_channels );
+	if( result == NULL )
+	{
+		result_string_pointer = stbi_failure_reason();
+		return NULL;
+	}
+	result_string_pointer = "Image loaded from memory";
+	return reduce_scaled_image( result, scale, full_width, full_height,
+			width, height, force_channels ? force_channels : *channels );
+}
+
+unsigned char*
+	SOIL_load_image_region
+	(
+		const char *filename,
+		int x, int y, int region_width, int region_height,
+		int *width, int *height, int *channels,
+		int force_channels
+	)
+{
+	unsigned char *result;
+	mapped_file file;
+	if( map_file( filename, FILE_ACCESS_PARTIAL, &file ) &&
+		(file.size <= (size_t)INT_MAX) )
+	{
+		result = stbi_load_region_from_memory( file.data, (int)file.size,
+				x, y, region_width, region_height,
+				width, height, channels, force_channels );
+	} else
+	{
+		result = stbi_load_region( filename,
+				x, y, region_width, region_height,
+				width, height, channels, force_channels );
+	}
+	unmap_file( &file );
+	if( result == NULL )
+	{
+		result_string_pointer = stbi_failure_reason();
+	} else
+	{
+		result_string_pointer = "Image loaded";
+	}
+	return result;
+}
+
+unsigned char*
+	SOIL_load_image_region_from_memory
+	(
+		const unsigned char *const buffer,
+		int buffer_length,
+		int x, int y, int region_width, int region_height,
+		int *width, int *height, int *channels,
+		int force_channels
+	)
+{
+	unsigned char *result = stbi_load_region_from_memory(
+				buffer, buffer_length,
+				x, y, region_width, region_height,
+				width, height, channels,
+				force_channels );
+	if( result == NULL )
+	{
+		result_string_pointer = stbi_failure_reason();
+	} else
+	{
+		result_string_pointer = "Image loaded from memory";
+	}
+	return result;
+}
+
+int
+	SOIL_load_image_rows
+	(
+		const char *filename,
+		SOIL_row_callback callback,
+		void *user,
+		int *width, int *height, int *channels,
+		int force_channels
+	)
+{
+	int result;
+	mapped_file file;
+	if( map_file( filename, FILE_ACCESS_SEQUENTIAL, &file ) &&
+		(file.size <= (size_t)INT_MAX) )
+	{
+		result = stbi_load_rows_from_memory( file.data, (int)file.size,
+				callback, user, width, height, channels, force_channels );
+	} else
+	{
+		result = stbi_load_rows( filename,
+				callback, user, width, height, channels, force_channels );
+	}
+	unmap_file( &file );
+	if( result == 0 )
+	{
+		result_string_pointer = stbi_failure_reason();
+	} else
+	{
+		result_string_pointer = "Image loaded";
+	}
+	return result;
+}
+
+int
+	SOIL_load_image_rows_from_memory
+	(
+		const unsigned char *const buffer,
+		int buffer_length,
+		SOIL_row_callback callback,
+		void *user,
+		int *width, int *height, int *channels,
+		int force_channels
+	)
+{
+	int result = stbi_load_rows_from_memory( buffer, buffer_length,
+				callback, user, width, height, channels, force_channels );
+	if( result == 0 )
+	{
+		result_string_pointer = stbi_failure_reason();
+	} else
+	{
+		result_string_pointer = "Image loaded from memory";
+	}
+	return result;
+}
+
+int
+	SOIL_get_image_info
+	(
+		const char *filename,
+		int *width, int *height, int *channels
+	)
+{
+	int result = stbi_info( filename, width, height, channels );
+	if( result == 0 )
+	{
+		result_string_pointer = stbi_failure_reason();
+	} else
+	{
+		result_string_pointer = "Image info read";
+	}
+	return result;
+}
+
+int
+	SOIL_get_image_info_from_memory
+	(
+		const unsigned char *const buffer,
+		int buffer_length,
+		int *width, int *height, int *channels
+	)
+{
+	int result = stbi_info_from_memory( buffer, buffer_length,
+				width, height, channels );
+	if( result == 0 )
+	{
+		result_string_pointer = stbi_failure_reason();
+	} else
+	{
+		result_string_pointer = "Image info read from memory";
+	}
+	return result;
+}
+
+/*	the format of an image, from its first bytes	*/
+static int
+	SOIL_internal_image_format
+	(
+		const unsigned char *header,
+		int length
+	)
+{
+	if( (length >= 3) && (header[0] == 0xFF) && (header[1] == 0xD8) && (header[2] == 0xFF) )
+	{
+		return SOIL_IMAGE_FORMAT_JPG;
+	}
+	if( (length >= 8) && (0 == memcmp( header, "\x89PNG\r\n\x1A\n", 8 )) )
+	{
+		return SOIL_IMAGE_FORMAT_PNG;
+	}
+	if( (length >= 4) && (0 == memcmp( header, "DDS ", 4 )) )
+	{
+		return SOIL_IMAGE_FORMAT_DDS;
+	}
+	if( (length >= 4) && (0 == memcmp( header, "PKM ", 4 )) )
+	{
+		return SOIL_IMAGE_FORMAT_PKM;
+	}
+	if( (length >= 4) && (0 == memcmp( header, "qoif", 4 )) )
+	{
+		return SOIL_IMAGE_FORMAT_QOI;
+	}
+	if( (length >= (int)sizeof( PVR_Texture_Header )) &&
+		(((const PVR_Texture_Header*)header)->dwPVR == PVRTEX_IDENTIFIER) )
+	{
+		return SOIL_IMAGE_FORMAT_PVR;
+	}
+	if( (length >= 4) && (0 == memcmp( header, "GIF8", 4 )) )
+	{
+		return SOIL_IMAGE_FORMAT_GIF;
+	}
+	if( (length >= 4) && (0 == memcmp( header, "8BPS", 4 )) )
+	{
+		return SOIL_IMAGE_FORMAT_PSD;
+	}
+	if( (length >= 4) && (0 == memcmp( header, "\x53\x80\xF6\x34", 4 )) )
+	{
+		return SOIL_IMAGE_FORMAT_PIC;
+	}
+	if( (length >= 2) && (0 == memcmp( header, "#?", 2 )) )
+	{
+		return SOIL_IMAGE_FORMAT_HDR;
+	}
+	if( (length >= 2) && (header[0] == 'P') && ((header[1] == '5') || (header[1] == '6')) )
+	{
+		return SOIL_IMAGE_FORMAT_PNM;
+	}
+	if( (length >= 2) && (header[0] == 'B') && (header[1] == 'M') )
+	{
+		return SOIL_IMAGE_FORMAT_BMP;
+	}
+	/*	TGA has no signature, stb_image only tries it last as well	*/
+	return SOIL_IMAGE_FORMAT_TGA;
+}
+
+/*	fills in the rest of info once stb_image has accepted the image	*/
+static void
+	SOIL_internal_fill_image_info
+	(
+		const unsigned char *header,
+		int length,
+		SOIL_image_info *info
+	)
+{
+	info->format = SOIL_internal_image_format( header, length );
+	info->mipmaps = 1;
+	info->is_compressed = 0;
+	info->is_cubemap = 0;
+	if( (info->format == SOIL_IMAGE_FORMAT_DDS) && (length >= (int)sizeof( DDS_header )) )
+	{
+		DDS_header dds;
+		memcpy( &dds, header, sizeof( DDS_header ) );
+		if( (dds.sCaps.dwCaps1 & DDSCAPS_MIPMAP) && (dds.dwMipMapCount > 1) )
+		{
+			info->mipmaps = dds.dwMipMapCount;
+		}
+		info->is_compressed = (dds.sPixelFormat.dwFlags & DDPF_FOURCC) != 0;
+		info->is_cubemap = (dds.sCaps.dwCaps2 & DDSCAPS2_CUBEMAP) != 0;
+		if( (dds.sPixelFormat.dwFlags & DDPF_FOURCC) &&
+			(dds.sPixelFormat.dwFourCC == (('D' << 0) | ('X' << 8) | ('1' << 16) | ('0' << 24))) &&
+			(length >= (int)(sizeof( DDS_header ) + sizeof( DDS_header_DX10 ))) )
+		{
+			DDS_header_DX10 dx10;
+			memcpy( &dx10, header + sizeof( DDS_header ), sizeof( DDS_header_DX10 ) );
+			info->is_cubemap = (dx10.miscFlag & DDS_RESOURCE_MISC_TEXTURECUBE) != 0;
+		}
+	} else
+	if( info->format == SOIL_IMAGE_FORMAT_PVR )
+	{
+		const PVR_Texture_Header *pvr = (const PVR_Texture_Header*)header;
+		int w, h, c, is_compressed = 0;
+		if( pvr->dwpfFlags & PVRTEX_MIPMAP )
+		{
+			info->mipmaps = pvr->dwMipMapCount + 1;
+		}
+		info->is_cubemap = (pvr->dwpfFlags & PVRTEX_CUBEMAP) != 0;
+		stbi__pvr_info_from_memory( header, length, &w, &h, &c, &is_compressed );
+		info->is_compressed = is_compressed;
+	} else
+	if( info->format == SOIL_IMAGE_FORMAT_PKM )
+	{
+		info->is_compressed = 1;
+	}
+}
+
+/*	enough for every header SOIL_internal_fill_image_info looks at	*/
+#define SOIL_IMAGE_HEADER_PROBE_SIZE	256
+
+int
+	SOIL_probe_image
+	(
+		const char *filename,
+		SOIL_image_info *info
+	)
+{
+	unsigned char header[SOIL_IMAGE_HEADER_PROBE_SIZE];
+	int length, result;
+	FILE *f;
+	if( (NULL == filename) || (NULL == info) )
+	{
+		result_string_pointer = "NULL filename or info";
+		return 0;
+	}
+	memset( info, 0, sizeof( SOIL_image_info ) );
+	f = fopen( filename, "rb" );
+	if( NULL == f )
+	{
+		result_string_pointer = "Can not open image file";
+		return 0;
+	}
+	length = (int)fread( header, 1, sizeof( header ), f );
+	fseek( f, 0, SEEK_SET );
+	result = stbi_info_from_file( f, &info->width, &info->height, &info->channels );
+	fclose( f );
+	if( result == 0 )
+	{
+		result_string_pointer = stbi_failure_reason();
+		return 0;
+	}
+	SOIL_internal_fill_image_info( header, length, info );
+	result_string_pointer = "Image info read";
+	return 1;
+}
+
+int
+	SOIL_probe_image_from_memory
+	(
+		const unsigned char *const buffer,
+		int buffer_length,
+		SOIL_image_info *info
+	)
+{
+	if( (NULL == buffer) || (NULL == info) )
+	{
+		result_string_pointer = "NULL buffer or info";
+		return 0;
+	}
+	memset( info, 0, sizeof( SOIL_image_info ) );
+	if( !stbi_info_from_memory( buffer, buffer_length,
+			&info->width, &info->height, &info->channels ) )
+	{
+		result_string_pointer = stbi_failure_reason();
+		return 0;
+	}
+	SOIL_internal_fill_image_info( buffer,
+		buffer_length < SOIL_IMAGE_HEADER_PROBE_SIZE ? buffer_length : SOIL_IMAGE_HEADER_PROBE_SIZE,
+		info );
+	result_string_pointer = "Image info read from memory";
+	return 1;
+}
+
+/*	image index: an open addressed hash table of path -> info, which
+	is saved as one text line per file	*/
+#define SOIL_IMAGE_INDEX_HEADER	"SOIL2 image index 1"
+
+typedef struct
+{
+	char *path;
+	unsigned int hash;
+	double mtime;
+	double size;
+	SOIL_image_info info;
+}
+SOIL_image_index_entry;
+
+struct SOIL_image_index
+{
+	char *filename;
+	SOIL_image_index_entry *entries;
+	int capacity;
+	int count;
+	int changed;
+};
+
+static unsigned int
+	SOIL_internal_hash_path
+	(
+		const char *path
+	)
+{
+	/*	FNV-1a	*/
+	unsigned int hash = 2166136261u;
+	while( *path )
+	{
+		hash = (hash ^ (unsigned char)*path++) * 16777619u;
+	}
+	return hash;
+}
+
+/*	the slot holding path, or the empty slot where it would go	*/
+static SOIL_image_index_entry*
+	SOIL_internal_index_slot
+	(
+		SOIL_image_index *index,
+		const char *path,
+		unsigned int hash
+	)
+{
+	int i = (int)(hash & (unsigned int)(index->capacity - 1));
+	while( index->entries[i].path &&
+		((index->entries[i].hash != hash) || strcmp( index->entries[i].path, path )) )
+	{
+		i = (i + 1) & (index->capacity - 1);
+	}
+	return &index->entries[i];
+}
+
+/*	adds ( or replaces ) the entry for path, keeping the table at most half full	*/
+static int
+	SOIL_internal_index_insert
+	(
+		SOIL_image_index *index,
+		const char *path,
+		double mtime, double size,
+		const SOIL_image_info *info
+	)
+{
+	unsigned int hash = SOIL_internal_hash_path( path );
+	SOIL_image_index_entry *slot;
+	if( (index->count + 1) * 2 > index->capacity )
+	{
+		SOIL_image_index_entry *old_entries = index->entries;
+		int old_capacity = index->capacity, i;
+		int capacity = old_capacity ? old_capacity * 2 : 64;
+		SOIL_image_index_entry *entries = (SOIL_image_index_entry*)calloc( capacity, sizeof( SOIL_image_index_entry ) );
+		if( NULL == entries )
+		{
+			return 0;
+		}
+		index->entries = entries;
+		index->capacity = capacity;
+		for( i = 0; i < old_capacity; ++i )
+		{
+			if( old_entries[i].path )
+			{
+				*SOIL_internal_index_slot( index, old_entries[i].path, old_entries[i].hash ) = old_entries[i];
+			}
+		}
+		free( old_entries );
+	}
+	slot = SOIL_internal_index_slot( index, path, hash );
+	if( NULL == slot->path )
+	{
+		slot->path = (char*)malloc( strlen( path ) + 1 );
+		if( NULL == slot->path )
+		{
+			return 0;
+		}
+		strcpy( slot->path, path );
+		slot->hash = hash;
+		++index->count;
+	}
+	slot->mtime = mtime;
+	slot->size = size;
+	slot->info = *info;
+	return 1;
+}
+
+SOIL_image_index*
+	SOIL_open_image_index
+	(
+		const char *index_filename
+	)
+{
+	SOIL_image_index *index = (SOIL_image_index*)calloc( 1, sizeof( SOIL_image_index ) );
+	FILE *f;
+	char line[4096];
+	if( NULL == index )
+	{
+		result_string_pointer = "malloc failed";
+		return NULL;
+	}
+	if( NULL == index_filename )
+	{
+		result_string_pointer = "Image index created";
+		return index;
+	}
+	index->filename = (char*)malloc( strlen( index_filename ) + 1 );
+	if( NULL == index->filename )
+	{
+		free( index );
+		result_string_pointer = "malloc failed";
+		return NULL;
+	}
+	strcpy( index->filename, index_filename );
+	f = fopen( index_filename, "r" );
+	if( NULL == f )
+	{
+		/*	no index yet, it is written on the first save	*/
+		result_string_pointer = "Image index created";
+		return index;
+	}
+	if( fgets( line, sizeof( line ), f ) &&
+		(0 == strncmp( line, SOIL_IMAGE_INDEX_HEADER, strlen( SOIL_IMAGE_INDEX_HEADER ) )) )
+	{
+		while( fgets( line, sizeof( line ), f ) )
+		{
+			SOIL_image_info info;
+			double mtime, size;
+			int path_start = 0;
+			size_t path_end;
+			if( (sscanf( line, "%lf %lf %d %d %d %d %d %d %d %n",
+					&mtime, &size, &info.width, &info.height, &info.channels,
+					&info.format, &info.mipmaps, &info.is_compressed, &info.is_cubemap,
+					&path_start ) < 9) || (path_start == 0) )
+			{
+				continue;
+			}
+			path_end = strlen( line );
+			while( (path_end > (size_t)path_start) &&
+				((line[path_end-1] == '\n') || (line[path_end-1] == '\r')) )
+			{
+				line[--path_end] = 0;
+			}
+			if( path_end > (size_t)path_start )
+			{
+				SOIL_internal_index_insert( index, line + path_start, mtime, size, &info );
+			}
+		}
+	}
+	fclose( f );
+	result_string_pointer = "Image index loaded";
+	return index;
+}
+
+int
+	SOIL_image_index_probe
+	(
+		SOIL_image_index *index,
+		const char *filename,
+		SOIL_image_info *info
+	)
+{
+	struct stat file_stat;
+	SOIL_image_index_entry *slot;
+	double mtime, size;
+	if( (NULL == index) || (NULL == filename) || (NULL == info) )
+	{
+		result_string_pointer = "NULL index, filename or info";
+		return 0;
+	}
+	if( 0 != stat( filename, &file_stat ) )
+	{
+		result_string_pointer = "Can not find image file";
+		return 0;
+	}
+	mtime = (double)file_stat.st_mtime;
+	size = (double)file_stat.st_size;
+	if( index->capacity > 0 )
+	{
+		slot = SOIL_internal_index_slot( index, filename, SOIL_internal_hash_path( filename ) );
+		if( slot->path && (slot->mtime == mtime) && (slot->size == size) )
+		{
+			*info = slot->info;
+			result_string_pointer = "Image info read from index";
+			return 1;
+		}
+	}
+	if( !SOIL_probe_image( filename, info ) )
+	{
+		return 0;
+	}
+	if( SOIL_internal_index_insert( index, filename, mtime, size, info ) )
+	{
+		index->changed = 1;
+	}
+	return 1;
+}
+
+int
+	SOIL_save_image_index
+	(
+		SOIL_image_index *index
+	)
+{
+	FILE *f;
+	int i, result;
+	if( (NULL == index) || (NULL == index->filename) )
+	{
+		result_string_pointer = "Image index has no file";
+		return 0;
+	}
+	if( !index->changed )
+	{
+		result_string_pointer = "Image index unchanged";
+		return 1;
+	}
+	f = fopen( index->filename, "w" );
+	if( NULL == f )
+	{
+		result_string_pointer = "Can not write image index";
+		return 0;
+	}
+	fprintf( f, "%s\n", SOIL_IMAGE_INDEX_HEADER );
+	for( i = 0; i < index->capacity; ++i )
+	{
+		const SOIL_image_index_entry *entry = &index->entries[i];
+		if( entry->path )
+		{
+			fprintf( f, "%.0f %.0f %d %d %d %d %d %d %d %s\n",
+				entry->mtime, entry->size,
+				entry->info.width, entry->info.height, entry->info.channels,
+				entry->info.format, entry->info.mipmaps,
+				entry->info.is_compressed, entry->info.is_cubemap,
+				entry->path );
+		}
+	}
+	result = !ferror( f );
+	if( fclose( f ) != 0 )
+	{
+		result = 0;
+	}
+	if( result )
+	{
+		index->changed = 0;
+		result_string_pointer = "Image index saved";
+	} else
+	{
+		result_string_pointer = "Can not write image index";
+	}
+	return result;
+}
+
+void
+	SOIL_close_image_index
+	(
+		SOIL_image_index *index
+	)
+{
+	int i;
+	if( NULL == index )
+	{
+		return;
+	}
+	for( i = 0; i < index->capacity; ++i )
+	{
+		free( index->entries[i].path );
+	}
+	free( index->entries );
+	free( index->filename );
+	free( index );
+}
+
+int
+	SOIL_load_image_into
+	(
+		const char *filename,
+		unsigned char *out, int out_size,
+		int row_stride,
+		unsigned int flags,
+		int *width, int *height, int *channels,
+		int force_channels
+	)
+{
+	int result;
+	mapped_file file;
+	if( map_file( filename, FILE_ACCESS_SEQUENTIAL, &file ) &&
+		(file.size <= (size_t)INT_MAX) )
+	{
+		result = stbi_load_into_from_memory( file.data, (int)file.size,
+				out, out_size, row_stride, (flags & SOIL_FLAG_INVERT_Y) != 0,
+				width, height, channels, force_channels );
+	} else
+	{
+		result = stbi_load_into( filename,
+				out, out_size, row_stride, (flags & SOIL_FLAG_INVERT_Y) != 0,
+				width, height, channels, force_channels );
+	}
+	unmap_file( &file );
+	if( result == 0 )
+	{
+		result_string_pointer = stbi_failure_reason();
+	} else
+	{
+		result_string_pointer = "Image loaded";
+	}
+	return result;
+}
+
+int
+	SOIL_load_image_into_from_memory
+	(
+		const unsigned char *const buffer,
+		int buffer_length,
+		unsigned char *out, int out_size,
+		int row_stride,
+		unsigned int flags,
+		int *width, int *height, int *channels,
+		int force_channels
+	)
+{
+	int result = stbi_load_into_from_memory(
+				buffer, buffer_length,
+				out, out_size, row_stride, (flags & SOIL_FLAG_INVERT_Y) != 0,
+				width, height, channels,
+				force_channels );
+	if( result == 0 )
+	{
+		result_string_pointer = stbi_failure_reason();
+	} else
+	{
+		result_string_pointer = "Image loaded from memory";
+	}
+	return result;
+}
+
+void
+	SOIL_set_scratch_allocator
+	(
+		void *(*alloc_fn)( void *user, size_t size ),
+		void *(*realloc_fn)( void *user, void *p, size_t old_size, size_t new_size ),
+		void (*free_fn)( void *user, void *p ),
+		void *user
+	)
+{
+	stbi_allocator allocator;
+	allocator.alloc_fn = alloc_fn;
+	allocator.realloc_fn = realloc_fn;
+	allocator.free_fn = free_fn;
+	allocator.user = user;
+	stbi_set_scratch_allocator_thread( &allocator );
+}
+
+void
+	SOIL_get_load_memory_stats
+	(
+		int *allocations,
+		size_t *bytes_allocated,
+		size_t *peak_bytes
+	)
+{
+	stbi_alloc_stats stats;
+	stbi_get_alloc_stats_thread( &stats );
+	if( allocations )
+	{
+		*allocations = stats.allocations;
+	}
+	if( bytes_allocated )
+	{
+		*bytes_allocated = stats.bytes_allocated;
+	}
+	if( peak_bytes )
+	{
+		*peak_bytes = stats.peak_bytes;
+	}
+}
+
+
+int
+	SOIL_save_image
+	(
+		const char *filename,
+		int image_type,
+		int width, int height, int channels,
+		const unsigned char *const data
+	)
+{
+	return SOIL_save_image_quality( filename, image_type, width, height, channels, data, 80 );
+}
+
+int
+	SOIL_save_image_quality
+	(
+		const char *filename,
+		int image_type,
+		int width, int height, int channels,
+		const unsigned char *const data,
+		int quality
+	)
+{
+	int save_result;
+
+	/*	error check	*/
+	if( (width < 1) || (height < 1) ||
+		(channels < 1) || (channels > 4) ||
+		(data == NULL) ||
+		(filename == NULL) )
+	{
+		return 0;
+	}
+	if( image_type == SOIL_SAVE_TYPE_BMP )
+	{
+		save_result = stbi_write_bmp( filename,
+				width, height, channels, (void*)data );
+	} else
+	if( image_type == SOIL_SAVE_TYPE_TGA )
+	{
+		save_result = stbi_write_tga( filename,
+				width, height, channels, (void*)data );
+	} else
+	if( (image_type == SOIL_SAVE_TYPE_DDS) ||
+		(image_type == SOIL_SAVE_TYPE_DDS_BC4) ||
+		(image_type == SOIL_SAVE_TYPE_DDS_BC5) ||
+		(image_type == SOIL_SAVE_TYPE_DDS_BC7) )
+	{
+		/*	quality < 34 picks the fast encoders, 90+ the slow ones	*/
+		int DXT_quality = DXT_QUALITY_DEFAULT;
+		int DDS_format = DDS_FORMAT_AUTO;
+		if( quality < 34 )
+		{
+			DXT_quality = DXT_QUALITY_FAST;
+		} else if( quality >= 90 )
+		{
+			DXT_quality = DXT_QUALITY_HIGH;
+		}
+		switch( image_type )
+		{
+		case SOIL_SAVE_TYPE_DDS_BC4:
+			DDS_format = DDS_FORMAT_BC4;
+			break;
+		case SOIL_SAVE_TYPE_DDS_BC5:
+			DDS_format = DDS_FORMAT_BC5;
+			break;
+		case SOIL_SAVE_TYPE_DDS_BC7:
+			DDS_format = DDS_FORMAT_BC7;
+			break;
+		}
+		save_result = save_image_as_DDS_format( filename,
+				width, height, channels, (const unsigned char *const)data,
+				DDS_format, DXT_quality );
+	} else
+	if( image_type == SOIL_SAVE_TYPE_PNG )
+	{
+		/*	quality / 10 is the deflate level: 0 stores, 1 only packs runs, 9 is the smallest	*/
+		int PNG_level = quality < 0 ? 0 : (quality >= 90 ? 9 : quality / 10);
+		save_result = stbi_write_png_level( filename,
+				width, height, channels, (const unsigned char *const)data, 0, PNG_level );
+	} else
+	if ( image_type == SOIL_SAVE_TYPE_JPG )
+	{
+		save_result = jo_write_jpg( filename, (const void*)data, width, height, channels, quality );
+	} else
+	if( image_type == SOIL_SAVE_TYPE_QOI )
+	{
+		/*	lossless, 1 and 2 channel images are stored as RGB / RGBA	*/
+		save_result = stbi_write_qoi( filename,
+				width, height, channels, (const unsigned char *const)data );
+	}
+	else
+	{
+		save_result = 0;
+	}
+
+	if( save_result == 0 )
+	{
+		result_string_pointer = "Saving the image failed";
+	} else
+	{
+		result_string_pointer = "Image saved";
+	}
+	return save_result;
+}
+
+int
+	SOIL_save_image_JPG
+	(
+		const char *filename,
+		int width, int height, int channels,
+		const unsigned char *const data,
+		int quality,
+		int flags
+	)
+{
+	int JPG_flags = 0;
+	int save_result;
+
+	/*	error check	*/
+	if( (width < 1) || (height < 1) ||
+		(channels < 1) || (channels > 4) ||
+		(data == NULL) ||
+		(filename == NULL) )
+	{
+		return 0;
+	}
+	if( flags & SOIL_JPG_SUBSAMPLE )
+	{
+		JPG_flags |= JO_JPEG_SUBSAMPLE;
+	}
+	if( flags & SOIL_JPG_OPTIMIZE )
+	{
+		JPG_flags |= JO_JPEG_OPTIMIZE;
+	}
+	save_result = jo_write_jpg_ex( filename, (const void*)data, width, height, channels, quality, JPG_flags );
+	if( save_result == 0 )
+	{
+		result_string_pointer = "Saving the image failed";
+	} else
+	{
+		result_string_pointer = "Image saved";
+	}
+	return save_result;
+}
+
+void
+	SOIL_free_image_data
+	(
+		unsigned char *img_data
+	)
+{
+	if ( img_data )
+		free( (void*)img_data );
+}
+
+const char*
+	SOIL_last_result
+	(
+		void
+	)
+{
+	return result_string_pointer;
+}
+
+unsigned int SOIL_direct_load_DDS_from_memory(
+		const unsigned char *const buffer,
+		int buffer_length,
+		unsigned int reuse_texture_ID,
+		int flags,
+		int loading_as_cubemap )
+{
+	/*	variables	*/
+	DDS_header header;
+	DDS_header_DX10 header_DX10;
+	int is_DX10;
+	unsigned int buffer_index = 0;
+	unsigned int tex_ID = 0;
 	/*	file reading variables	*/
 	unsigned int S3TC_type = 0;
 	unsigned char *DDS_data;
@@ -2002,7 +3637,7 @@ unsigned int SOIL_direct_load_DDS_from_memory(
 		result_string_pointer = "NULL buffer";
 		return 0;
 	}
-	if( buffer_length < sizeof( DDS_header ) )
+	if( (buffer_length < 0) || ((size_t)buffer_length < sizeof( DDS_header )) )
 	{
 		/*	we can't do it!	*/
 		result_string_pointer = "DDS file was too small to contain the DDS header";
@@ -2034,11 +3669,31 @@ unsigned int SOIL_direct_load_DDS_from_memory(
 		!(
 		(header.sPixelFormat.dwFourCC == (('D'<<0)|('X'<<8)|('T'<<16)|('1'<<24))) ||
 		(header.sPixelFormat.dwFourCC == (('D'<<0)|('X'<<8)|('T'<<16)|('3'<<24))) ||
-		(header.sPixelFormat.dwFourCC == (('D'<<0)|('X'<<8)|('T'<<16)|('5'<<24)))
+		(header.sPixelFormat.dwFourCC == (('D'<<0)|('X'<<8)|('T'<<16)|('5'<<24))) ||
+		(header.sPixelFormat.dwFourCC == (('A'<<0)|('T'<<8)|('I'<<16)|('1'<<24))) ||
+		(header.sPixelFormat.dwFourCC == (('A'<<0)|('T'<<8)|('I'<<16)|('2'<<24))) ||
+		(header.sPixelFormat.dwFourCC == (('B'<<0)|('C'<<8)|('4'<<16)|('U'<<24))) ||
+		(header.sPixelFormat.dwFourCC == (('B'<<0)|('C'<<8)|('5'<<16)|('U'<<24))) ||
+		(header.sPixelFormat.dwFourCC == (('D'<<0)|('X'<<8)|('1'<<16)|('0'<<24)))
 		) )
 	{
 		goto quick_exit;
 	}
+	/*	DX10 files keep the real format in a second header	*/
+	is_DX10 = (header.sPixelFormat.dwFlags & DDPF_FOURCC) &&
+		(header.sPixelFormat.dwFourCC == (('D'<<0)|('X'<<8)|('1'<<16)|('0'<<24)));
+	if( is_DX10 )
+	{
+		if( (size_t)buffer_length < sizeof( DDS_header ) + sizeof( DDS_header_DX10 ) ) {goto quick_exit;}
+		memcpy ( (void*)(&header_DX10), (const void *)(&buffer[buffer_index]), sizeof( DDS_header_DX10 ) );
+		buffer_index += sizeof( DDS_header_DX10 );
+		if( header_DX10.resourceDimension != DDS_DIMENSION_TEXTURE2D ) {goto quick_exit;}
+		if( header_DX10.miscFlag & DDS_RESOURCE_MISC_TEXTURECUBE )
+		{
+			header.sCaps.dwCaps2 |= DDSCAPS2_CUBEMAP;
+		}
+		/*	for texture arrays only the 1st element gets uploaded	*/
+	}
 	/*	OK, validated the header, let's load the image data	*/
 	result_string_pointer = "DDS header loaded and validated";
 	width = header.dwWidth;
@@ -2055,6 +3710,104 @@ unsigned int SOIL_direct_load_DDS_from_memory(
 			block_size = 4;
 		}
 		DDS_main_size = width * height * block_size;
+	} else if( is_DX10 )
+	{
+		/*	the DXGI format picks the block format, and the extension it needs	*/
+		int capability = SOIL_CAPABILITY_NONE;
+		block_size = 16;
+		switch( header_DX10.dxgiFormat )
+		{
+		case DDS_DXGI_FORMAT_BC1_UNORM:
+			S3TC_type = SOIL_RGBA_S3TC_DXT1;
+			block_size = 8;
+			capability = query_DXT_capability();
+			break;
+		case DDS_DXGI_FORMAT_BC1_UNORM_SRGB:
+			S3TC_type = SOIL_GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT;
+			block_size = 8;
+			capability = query_sRGB_capability() == SOIL_CAPABILITY_PRESENT ? query_DXT_capability() : SOIL_CAPABILITY_NONE;
+			break;
+		case DDS_DXGI_FORMAT_BC2_UNORM:
+			S3TC_type = SOIL_RGBA_S3TC_DXT3;
+			capability = query_DXT_capability();
+			break;
+		case DDS_DXGI_FORMAT_BC2_UNORM_SRGB:
+			S3TC_type = SOIL_GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT;
+			capability = query_sRGB_capability() == SOIL_CAPABILITY_PRESENT ? query_DXT_capability() : SOIL_CAPABILITY_NONE;
+			break;
+		case DDS_DXGI_FORMAT_BC3_UNORM:
+			S3TC_type = SOIL_RGBA_S3TC_DXT5;
+			capability = query_DXT_capability();
+			break;
+		case DDS_DXGI_FORMAT_BC3_UNORM_SRGB:
+			S3TC_type = SOIL_GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+			capability = query_sRGB_capability() == SOIL_CAPABILITY_PRESENT ? query_DXT_capability() : SOIL_CAPABILITY_NONE;
+			break;
+		case DDS_DXGI_FORMAT_BC4_UNORM:
+			S3TC_type = SOIL_COMPRESSED_RED_RGTC1;
+			block_size = 8;
+			capability = query_RGTC_capability();
+			break;
+		case DDS_DXGI_FORMAT_BC4_SNORM:
+			S3TC_type = SOIL_COMPRESSED_SIGNED_RED_RGTC1;
+			block_size = 8;
+			capability = query_RGTC_capability();
+			break;
+		case DDS_DXGI_FORMAT_BC5_UNORM:
+			S3TC_type = SOIL_COMPRESSED_RG_RGTC2;
+			capability = query_RGTC_capability();
+			break;
+		case DDS_DXGI_FORMAT_BC5_SNORM:
+			S3TC_type = SOIL_COMPRESSED_SIGNED_RG_RGTC2;
+			capability = query_RGTC_capability();
+			break;
+		case DDS_DXGI_FORMAT_BC6H_UF16:
+			S3TC_type = SOIL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT;
+			capability = query_BPTC_capability();
+			break;
+		case DDS_DXGI_FORMAT_BC6H_SF16:
+			S3TC_type = SOIL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT;
+			capability = query_BPTC_capability();
+			break;
+		case DDS_DXGI_FORMAT_BC7_UNORM:
+			S3TC_type = SOIL_COMPRESSED_RGBA_BPTC_UNORM;
+			capability = query_BPTC_capability();
+			break;
+		case DDS_DXGI_FORMAT_BC7_UNORM_SRGB:
+			S3TC_type = SOIL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM;
+			capability = query_BPTC_capability();
+			break;
+		default:
+			result_string_pointer = "DDS DX10 format is not block compressed";
+			return 0;
+		}
+		if( capability != SOIL_CAPABILITY_PRESENT )
+		{
+			/*	we can't do it!	*/
+			result_string_pointer = "Direct upload of this DX10 DDS format not supported by the OpenGL driver";
+			return 0;
+		}
+		DDS_main_size = ((width+3)>>2)*((height+3)>>2)*block_size;
+	} else if( ((header.sPixelFormat.dwFourCC >> 0) & 255) != 'D' )
+	{
+		/*	BC4 / BC5 (ATI1 / ATI2 or BC4U / BC5U)	*/
+		if( query_RGTC_capability() != SOIL_CAPABILITY_PRESENT )
+		{
+			/*	we can't do it!	*/
+			result_string_pointer = "Direct upload of RGTC images not supported by the OpenGL driver";
+			return 0;
+		}
+		if( ((header.sPixelFormat.dwFourCC >> 24) & 255) == '1' ||
+			((header.sPixelFormat.dwFourCC >> 8) & 255) == '4' )
+		{
+			S3TC_type = SOIL_COMPRESSED_RED_RGTC1;
+			block_size = 8;
+		} else
+		{
+			S3TC_type = SOIL_COMPRESSED_RG_RGTC2;
+			block_size = 16;
+		}
+		DDS_main_size = ((width+3)>>2)*((height+3)>>2)*block_size;
 	} else
 	{
 		/*	can we even handle direct uploading to OpenGL DXT compressed images?	*/
@@ -2148,7 +3901,18 @@ unsigned int SOIL_direct_load_DDS_from_memory(
 		mipmaps = 0;
 		DDS_full_size = DDS_main_size;
 	}
-	DDS_data = (unsigned char*)malloc( DDS_full_size );
+	/*	compressed data is uploaded straight from the buffer ( which may be a
+		mapped file ), only uncompressed data needs a copy to swizzle	*/
+	DDS_data = NULL;
+	if( uncompressed )
+	{
+		DDS_data = (unsigned char*)malloc( DDS_full_size );
+		if( NULL == DDS_data )
+		{
+			result_string_pointer = "malloc failed";
+			return 0;
+		}
+	}
 	/*	got the image data RAM, create or use an existing OpenGL texture handle	*/
 	tex_ID = reuse_texture_ID;
 	if( tex_ID == 0 )
@@ -2163,11 +3927,13 @@ unsigned int SOIL_direct_load_DDS_from_memory(
 		if( buffer_index + DDS_full_size <= (unsigned int)buffer_length )
 		{
 			unsigned int byte_offset = DDS_main_size;
-			memcpy( (void*)DDS_data, (const void*)(&buffer[buffer_index]), DDS_full_size );
+			const unsigned char *face_data = &buffer[buffer_index];
 			buffer_index += DDS_full_size;
 			/*	upload the main chunk	*/
 			if( uncompressed )
 			{
+				memcpy( (void*)DDS_data, (const void*)face_data, DDS_full_size );
+				face_data = DDS_data;
 				/*	and remember, DXT uncompressed uses BGR(A),
 					so swap to RGB(A) for ALL MIPmap levels	*/
 				for( i = 0; i < (int)DDS_full_size; i += block_size )
@@ -2179,13 +3945,13 @@ unsigned int SOIL_direct_load_DDS_from_memory(
 				glTexImage2D(
 					cf_target, 0,
 					S3TC_type, width, height, 0,
-					S3TC_type, GL_UNSIGNED_BYTE, DDS_data );
+					S3TC_type, GL_UNSIGNED_BYTE, face_data );
 			} else
 			{
 				soilGlCompressedTexImage2D(
 					cf_target, 0,
 					S3TC_type, width, height, 0,
-					DDS_main_size, DDS_data );
+					DDS_main_size, face_data );
 			}
 			/*	upload the mipmaps, if we have them	*/
 			for( i = 1; i <= mipmaps; ++i )
@@ -2208,14 +3974,14 @@ unsigned int SOIL_direct_load_DDS_from_memory(
 					glTexImage2D(
 						cf_target, i,
 						S3TC_type, w, h, 0,
-						S3TC_type, GL_UNSIGNED_BYTE, &DDS_data[byte_offset] );
+						S3TC_type, GL_UNSIGNED_BYTE, &face_data[byte_offset] );
 				} else
 				{
 					mip_size = ((w+3)/4)*((h+3)/4)*block_size;
 					soilGlCompressedTexImage2D(
 						cf_target, i,
 						S3TC_type, w, h, 0,
-						mip_size, &DDS_data[byte_offset] );
+						mip_size, &face_data[byte_offset] );
 				}
 				/*	and move to the next mipmap	*/
 				byte_offset += mip_size;
@@ -2272,9 +4038,7 @@ unsigned int SOIL_direct_load_DDS(
 		int flags,
 		int loading_as_cubemap )
 {
-	FILE *f;
-	unsigned char *buffer;
-	size_t buffer_length, bytes_read;
+	mapped_file file;
 	unsigned int tex_ID = 0;
 	/*	error checks	*/
 	if( NULL == filename )
@@ -2282,35 +4046,24 @@ unsigned int SOIL_direct_load_DDS(
 		result_string_pointer = "NULL filename";
 		return 0;
 	}
-	f = fopen( filename, "rb" );
-	if( NULL == f )
+	/*	map the file, the compressed data is uploaded straight from the mapping	*/
+	if( !map_file( filename, FILE_ACCESS_SEQUENTIAL, &file ) )
 	{
 		/*	the file doesn't seem to exist (or be open-able)	*/
 		result_string_pointer = "Can not find DDS file";
 		return 0;
 	}
-	fseek( f, 0, SEEK_END );
-	buffer_length = ftell( f );
-	fseek( f, 0, SEEK_SET );
-	buffer = (unsigned char *) malloc( buffer_length );
-	if( NULL == buffer )
+	if( file.size > (size_t)INT_MAX )
 	{
-		result_string_pointer = "malloc failed";
-		fclose( f );
+		result_string_pointer = "DDS file too big";
+		unmap_file( &file );
 		return 0;
 	}
-	bytes_read = fread( (void*)buffer, 1, buffer_length, f );
-	fclose( f );
-	if( bytes_read < buffer_length )
-	{
-		/*	huh?	*/
-		buffer_length = bytes_read;
-	}
 	/*	now try to do the loading	*/
 	tex_ID = SOIL_direct_load_DDS_from_memory(
-		(const unsigned char *const)buffer, (int)buffer_length,
+		file.data, (int)file.size,
 		reuse_texture_ID, flags, loading_as_cubemap );
-	SOIL_free_image_data( buffer );
+	unmap_file( &file );
 	return tex_ID;
 }
 
@@ -2589,9 +4342,7 @@ unsigned int SOIL_direct_load_PVR(
 		int flags,
 		int loading_as_cubemap )
 {
-	FILE *f;
-	unsigned char *buffer;
-	size_t buffer_length, bytes_read;
+	mapped_file file;
 	unsigned int tex_ID = 0;
 	/*	error checks	*/
 	if( NULL == filename )
@@ -2599,35 +4350,24 @@ unsigned int SOIL_direct_load_PVR(
 		result_string_pointer = "NULL filename";
 		return 0;
 	}
-	f = fopen( filename, "rb" );
-	if( NULL == f )
+	/*	map the file, the compressed data is uploaded straight from the mapping	*/
+	if( !map_file( filename, FILE_ACCESS_SEQUENTIAL, &file ) )
 	{
 		/*	the file doesn't seem to exist (or be open-able)	*/
 		result_string_pointer = "Can not find PVR file";
 		return 0;
 	}
-	fseek( f, 0, SEEK_END );
-	buffer_length = ftell( f );
-	fseek( f, 0, SEEK_SET );
-	buffer = (unsigned char *) malloc( buffer_length );
-	if( NULL == buffer )
+	if( file.size > (size_t)INT_MAX )
 	{
-		result_string_pointer = "malloc failed";
-		fclose( f );
+		result_string_pointer = "PVR file too big";
+		unmap_file( &file );
 		return 0;
 	}
-	bytes_read = fread( (void*)buffer, 1, buffer_length, f );
-	fclose( f );
-	if( bytes_read < buffer_length )
-	{
-		/*	huh?	*/
-		buffer_length = bytes_read;
-	}
 	/*	now try to do the loading	*/
 	tex_ID = SOIL_direct_load_PVR_from_memory(
-		(const unsigned char *const)buffer, (int)buffer_length,
+		file.data, (int)file.size,
 		reuse_texture_ID, flags, loading_as_cubemap );
-	SOIL_free_image_data( buffer );
+	unmap_file( &file );
 	return tex_ID;
 }
 
@@ -2726,9 +4466,7 @@ unsigned int SOIL_direct_load_ETC1(const char *filename,
 		unsigned int reuse_texture_ID,
 		int flags )
 {
-	FILE *f;
-	unsigned char *buffer;
-	size_t buffer_length, bytes_read;
+	mapped_file file;
 	unsigned int tex_ID = 0;
 	/*	error checks	*/
 	if( NULL == filename )
@@ -2736,39 +4474,28 @@ unsigned int SOIL_direct_load_ETC1(const char *filename,
 		result_string_pointer = "NULL filename";
 		return 0;
 	}
-	f = fopen( filename, "rb" );
-	if( NULL == f )
+	/*	map the file, the compressed data is uploaded straight from the mapping	*/
+	if( !map_file( filename, FILE_ACCESS_SEQUENTIAL, &file ) )
 	{
 		/*	the file doesn't seem to exist (or be open-able)	*/
 		result_string_pointer = "Can not find PVR file";
 		return 0;
 	}
-	fseek( f, 0, SEEK_END );
-	buffer_length = ftell( f );
-	fseek( f, 0, SEEK_SET );
-	buffer = (unsigned char *) malloc( buffer_length );
-	if( NULL == buffer )
+	if( file.size > (size_t)INT_MAX )
 	{
-		result_string_pointer = "malloc failed";
-		fclose( f );
+		result_string_pointer = "ETC1 file too big";
+		unmap_file( &file );
 		return 0;
 	}
-	bytes_read = fread( (void*)buffer, 1, buffer_length, f );
-	fclose( f );
-	if( bytes_read < buffer_length )
-	{
-		/*	huh?	*/
-		buffer_length = bytes_read;
-	}
 	/*	now try to do the loading	*/
 	tex_ID = SOIL_direct_load_ETC1_from_memory(
-		(const unsigned char *const)buffer, (int)buffer_length,
+		file.data, (int)file.size,
 		reuse_texture_ID, flags );
-	SOIL_free_image_data( buffer );
+	unmap_file( &file );
 	return tex_ID;
 }
 
-int query_NPOT_capability( void )
+static void probe_NPOT_capability( void )
 {
 	/*	check for the capability	*/
 	if( has_NPOT_capability == SOIL_CAPABILITY_UNKNOWN )
@@ -2790,11 +4517,16 @@ int query_NPOT_capability( void )
 			has_NPOT_capability = SOIL_CAPABILITY_PRESENT;
 		}
 	}
-	/*	let the user know if we can do non-power-of-two textures or not	*/
+}
+
+int query_NPOT_capability( void )
+{
+	/*	probed only once, by whichever thread asks first	*/
+	run_once( &NPOT_capability_once, probe_NPOT_capability );
 	return has_NPOT_capability;
 }
 
-int query_tex_rectangle_capability( void )
+static void probe_tex_rectangle_capability( void )
 {
 	/*	check for the capability	*/
 	if( has_tex_rectangle_capability == SOIL_CAPABILITY_UNKNOWN )
@@ -2819,11 +4551,16 @@ int query_tex_rectangle_capability( void )
 			has_tex_rectangle_capability = SOIL_CAPABILITY_PRESENT;
 		}
 	}
-	/*	let the user know if we can do texture rectangles or not	*/
+}
+
+int query_tex_rectangle_capability( void )
+{
+	/*	probed only once, by whichever thread asks first	*/
+	run_once( &tex_rectangle_capability_once, probe_tex_rectangle_capability );
 	return has_tex_rectangle_capability;
 }
 
-int query_cubemap_capability( void )
+static void probe_cubemap_capability( void )
 {
 	/*	check for the capability	*/
 	if( has_cubemap_capability == SOIL_CAPABILITY_UNKNOWN )
@@ -2845,7 +4582,12 @@ int query_cubemap_capability( void )
 			has_cubemap_capability = SOIL_CAPABILITY_PRESENT;
 		}
 	}
-	/*	let the user know if we can do cubemaps or not	*/
+}
+
+int query_cubemap_capability( void )
+{
+	/*	probed only once, by whichever thread asks first	*/
+	run_once( &cubemap_capability_once, probe_cubemap_capability );
 	return has_cubemap_capability;
 }
 
@@ -2863,7 +4605,7 @@ static P_SOIL_GLCOMPRESSEDTEXIMAGE2DPROC get_glCompressedTexImage2D_addr()
 	return ext_addr;
 }
 
-int query_DXT_capability( void )
+static void probe_DXT_capability( void )
 {
 	/*	check for the capability	*/
 	if( has_DXT_capability == SOIL_CAPABILITY_UNKNOWN )
@@ -2904,11 +4646,16 @@ int query_DXT_capability( void )
 			}
 		}
 	}
-	/*	let the user know if we can do DXT or not	*/
+}
+
+int query_DXT_capability( void )
+{
+	/*	probed only once, by whichever thread asks first	*/
+	run_once( &DXT_capability_once, probe_DXT_capability );
 	return has_DXT_capability;
 }
 
-int query_PVR_capability( void )
+static void probe_PVR_capability( void )
 {
 	/*	check for the capability	*/
 	if( has_PVR_capability == SOIL_CAPABILITY_UNKNOWN )
@@ -2929,11 +4676,16 @@ int query_PVR_capability( void )
 			has_PVR_capability = SOIL_CAPABILITY_PRESENT;
 		}
 	}
-	/*	let the user know if we can do cubemaps or not	*/
+}
+
+int query_PVR_capability( void )
+{
+	/*	probed only once, by whichever thread asks first	*/
+	run_once( &PVR_capability_once, probe_PVR_capability );
 	return has_PVR_capability;
 }
 
-int query_BGRA8888_capability( void )
+static void probe_BGRA8888_capability( void )
 {
 	/*	check for the capability	*/
 	if( has_BGRA8888_capability == SOIL_CAPABILITY_UNKNOWN )
@@ -2950,11 +4702,68 @@ int query_BGRA8888_capability( void )
 			has_BGRA8888_capability = SOIL_CAPABILITY_PRESENT;
 		}
 	}
-	/*	let the user know if we can do cubemaps or not	*/
+}
+
+int query_BGRA8888_capability( void )
+{
+	/*	probed only once, by whichever thread asks first	*/
+	run_once( &BGRA8888_capability_once, probe_BGRA8888_capability );
 	return has_BGRA8888_capability;
 }
 
-int query_sRGB_capability( void )
+static void probe_RGTC_capability( void )
+{
+	if( has_RGTC_capability == SOIL_CAPABILITY_UNKNOWN )
+	{
+		if( (0 == SOIL_GL_ExtensionSupported(
+				"GL_ARB_texture_compression_rgtc" ) &&
+			 0 == SOIL_GL_ExtensionSupported(
+				"GL_EXT_texture_compression_rgtc" ) ) ||
+			NULL == get_glCompressedTexImage2D_addr() )
+		{
+			has_RGTC_capability = SOIL_CAPABILITY_NONE;
+		} else
+		{
+			soilGlCompressedTexImage2D = get_glCompressedTexImage2D_addr();
+			has_RGTC_capability = SOIL_CAPABILITY_PRESENT;
+		}
+	}
+}
+
+int query_RGTC_capability( void )
+{
+	/*	probed only once, by whichever thread asks first	*/
+	run_once( &RGTC_capability_once, probe_RGTC_capability );
+	return has_RGTC_capability;
+}
+
+static void probe_BPTC_capability( void )
+{
+	if( has_BPTC_capability == SOIL_CAPABILITY_UNKNOWN )
+	{
+		if( (0 == SOIL_GL_ExtensionSupported(
+				"GL_ARB_texture_compression_bptc" ) &&
+			 0 == SOIL_GL_ExtensionSupported(
+				"GL_EXT_texture_compression_bptc" ) ) ||
+			NULL == get_glCompressedTexImage2D_addr() )
+		{
+			has_BPTC_capability = SOIL_CAPABILITY_NONE;
+		} else
+		{
+			soilGlCompressedTexImage2D = get_glCompressedTexImage2D_addr();
+			has_BPTC_capability = SOIL_CAPABILITY_PRESENT;
+		}
+	}
+}
+
+int query_BPTC_capability( void )
+{
+	/*	probed only once, by whichever thread asks first	*/
+	run_once( &BPTC_capability_once, probe_BPTC_capability );
+	return has_BPTC_capability;
+}
+
+static void probe_sRGB_capability( void )
 {
 	if ( has_sRGB_capability == SOIL_CAPABILITY_UNKNOWN )
 	{
@@ -2973,11 +4782,16 @@ int query_sRGB_capability( void )
 			has_sRGB_capability = SOIL_CAPABILITY_PRESENT;
 		}
 	}
+}
 
+int query_sRGB_capability( void )
+{
+	/*	probed only once, by whichever thread asks first	*/
+	run_once( &sRGB_capability_once, probe_sRGB_capability );
 	return has_sRGB_capability;
 }
 
-int query_ETC1_capability( void )
+static void probe_ETC1_capability( void )
 {
 	/*	check for the capability	*/
 	if( has_ETC1_capability == SOIL_CAPABILITY_UNKNOWN )
@@ -2998,11 +4812,16 @@ int query_ETC1_capability( void )
 			has_ETC1_capability = SOIL_CAPABILITY_PRESENT;
 		}
 	}
-	/*	let the user know if we can do cubemaps or not	*/
+}
+
+int query_ETC1_capability( void )
+{
+	/*	probed only once, by whichever thread asks first	*/
+	run_once( &ETC1_capability_once, probe_ETC1_capability );
 	return has_ETC1_capability;
 }
 
-int query_gen_mipmap_capability( void )
+static void probe_gen_mipmap_capability( void )
 {
 	/* check for the capability   */
 	P_SOIL_GLGENERATEMIPMAPPROC ext_addr = NULL;
@@ -3050,6 +4869,70 @@ int query_gen_mipmap_capability( void )
 			soilGlGenerateMipmap = ext_addr;
 		}
 	}
+}
 
+int query_gen_mipmap_capability( void )
+{
+	/*	probed only once, by whichever thread asks first	*/
+	run_once( &gen_mipmap_capability_once, probe_gen_mipmap_capability );
 	return has_gen_mipmap_capability;
 }
+
+#if !defined( SOIL_GLES1 ) && !defined( SOIL_GLES2 )
+static int gl_version_at_least( int major, int minor )
+{
+	const char *version = (const char *)glGetString( GL_VERSION );
+	const char *dot;
+	int version_major, version_minor = 0;
+	if( NULL == version )
+	{
+		return 0;
+	}
+	version_major = atoi( version );
+	dot = strchr( version, '.' );
+	if( NULL != dot )
+	{
+		version_minor = atoi( dot + 1 );
+	}
+	return ( version_major > major ) || ( ( version_major == major ) && ( version_minor >= minor ) );
+}
+#endif
+
+static void probe_PBO_capability( void )
+{
+	if( has_PBO_capability == SOIL_CAPABILITY_UNKNOWN )
+	{
+		has_PBO_capability = SOIL_CAPABILITY_NONE;
+		#if !defined( SOIL_GLES1 ) && !defined( SOIL_GLES2 )
+		/*	pixel buffer objects are core since 2.1, fences since 3.2	*/
+		if( ( gl_version_at_least( 2, 1 ) ||
+				SOIL_GL_ExtensionSupported( "GL_ARB_pixel_buffer_object" ) ) &&
+			( gl_version_at_least( 3, 2 ) ||
+				SOIL_GL_ExtensionSupported( "GL_ARB_sync" ) ) )
+		{
+			soilGlGenBuffers = (P_SOIL_GLGENBUFFERSPROC)SOIL_GL_GetProcAddress( "glGenBuffers" );
+			soilGlDeleteBuffers = (P_SOIL_GLDELETEBUFFERSPROC)SOIL_GL_GetProcAddress( "glDeleteBuffers" );
+			soilGlBindBuffer = (P_SOIL_GLBINDBUFFERPROC)SOIL_GL_GetProcAddress( "glBindBuffer" );
+			soilGlBufferData = (P_SOIL_GLBUFFERDATAPROC)SOIL_GL_GetProcAddress( "glBufferData" );
+			soilGlMapBuffer = (P_SOIL_GLMAPBUFFERPROC)SOIL_GL_GetProcAddress( "glMapBuffer" );
+			soilGlUnmapBuffer = (P_SOIL_GLUNMAPBUFFERPROC)SOIL_GL_GetProcAddress( "glUnmapBuffer" );
+			soilGlFenceSync = (P_SOIL_GLFENCESYNCPROC)SOIL_GL_GetProcAddress( "glFenceSync" );
+			soilGlClientWaitSync = (P_SOIL_GLCLIENTWAITSYNCPROC)SOIL_GL_GetProcAddress( "glClientWaitSync" );
+			soilGlDeleteSync = (P_SOIL_GLDELETESYNCPROC)SOIL_GL_GetProcAddress( "glDeleteSync" );
+			if( soilGlGenBuffers && soilGlDeleteBuffers && soilGlBindBuffer && soilGlBufferData &&
+				soilGlMapBuffer && soilGlUnmapBuffer &&
+				soilGlFenceSync && soilGlClientWaitSync && soilGlDeleteSync )
+			{
+				has_PBO_capability = SOIL_CAPABILITY_PRESENT;
+			}
+		}
+		#endif
+	}
+}
+
+static int query_PBO_capability( void )
+{
+	/*	probed only once, by whichever thread asks first	*/
+	run_once( &PBO_capability_once, probe_PBO_capability );
+	return has_PBO_capability;
+}
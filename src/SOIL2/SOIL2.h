@@ -35,6 +35,8 @@
 	- compressed texture S3TC formats (if supported)
 	- can pre-multiply alpha for you, for better compositing
 	- can flip image about the y-axis (except pre-compressed DDS files)
+	- safe to call from several threads: per-thread results, the OpenGL
+	  capabilities are probed only once
 
 	Thanks to:
 	* Sean Barret - for the awesome stb_image
@@ -45,6 +47,8 @@
 #ifndef HEADER_SIMPLE_OPENGL_IMAGE_LIBRARY
 #define HEADER_SIMPLE_OPENGL_IMAGE_LIBRARY
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -97,6 +101,8 @@ enum
 	SOIL_FLAG_CoCg_Y: Google YCoCg; RGB=>CoYCg, RGBA=>CoCgAY
 	SOIL_FLAG_TEXTURE_RECTANGE: uses ARB_texture_rectangle ; pixel indexed & no repeat or MIPmaps or cubemaps
 	SOIL_FLAG_PVR_LOAD_DIRECT: will load PVR files directly without _ANY_ additional processing ( if supported )
+	SOIL_FLAG_COMPRESS_TO_RGTC: if the card can display them, will convert 1 channel images to BC4 (RGTC1) and 2 channel images to BC5 (RGTC2),
+		sampled as red / red-green instead of luminance / luminance-alpha ( for normal maps and masks; other images follow SOIL_FLAG_COMPRESS_TO_DXT )
 **/
 enum
 {
@@ -113,7 +119,8 @@ enum
 	SOIL_FLAG_PVR_LOAD_DIRECT = 1024,
 	SOIL_FLAG_ETC1_LOAD_DIRECT = 2048,
 	SOIL_FLAG_GL_MIPMAPS = 4096,
-	SOIL_FLAG_SRGB_COLOR_SPACE = 8192
+	SOIL_FLAG_SRGB_COLOR_SPACE = 8192,
+	SOIL_FLAG_COMPRESS_TO_RGTC = 16384
 };
 
 /**
@@ -122,6 +129,10 @@ enum
 	(BMP supports uncompressed RGB)
 	(DDS supports DXT1 and DXT5)
 	(PNG supports RGB / RGBA)
+	(DDS_BC4 saves the 1st channel as BC4, DDS_BC5 saves the first two channels as BC5 red / green;
+	 loaded with 1 or 2 channels they come back as saved, with 3 or 4 as red / green)
+	(DDS_BC7 saves RGBA as BC7, 8 bits per pixel, in a DDS file with a DX10 header)
+	(QOI supports lossless RGB / RGBA, larger than PNG but many times faster to save and load)
 **/
 enum
 {
@@ -129,9 +140,56 @@ enum
 	SOIL_SAVE_TYPE_BMP = 1,
 	SOIL_SAVE_TYPE_PNG = 2,
 	SOIL_SAVE_TYPE_DDS = 3,
-	SOIL_SAVE_TYPE_JPG = 4
+	SOIL_SAVE_TYPE_JPG = 4,
+	SOIL_SAVE_TYPE_DDS_BC4 = 5,
+	SOIL_SAVE_TYPE_DDS_BC5 = 6,
+	SOIL_SAVE_TYPE_DDS_BC7 = 7,
+	SOIL_SAVE_TYPE_QOI = 8
 };
 
+/**
+	The file formats SOIL_probe_image can report.
+**/
+enum
+{
+	SOIL_IMAGE_FORMAT_UNKNOWN = 0,
+	SOIL_IMAGE_FORMAT_JPG = 1,
+	SOIL_IMAGE_FORMAT_PNG = 2,
+	SOIL_IMAGE_FORMAT_BMP = 3,
+	SOIL_IMAGE_FORMAT_TGA = 4,
+	SOIL_IMAGE_FORMAT_GIF = 5,
+	SOIL_IMAGE_FORMAT_PSD = 6,
+	SOIL_IMAGE_FORMAT_HDR = 7,
+	SOIL_IMAGE_FORMAT_PIC = 8,
+	SOIL_IMAGE_FORMAT_PNM = 9,
+	SOIL_IMAGE_FORMAT_DDS = 10,
+	SOIL_IMAGE_FORMAT_PVR = 11,
+	SOIL_IMAGE_FORMAT_PKM = 12,
+	SOIL_IMAGE_FORMAT_QOI = 13
+};
+
+/**
+	What SOIL_probe_image finds out from an image header.
+	channels is the channel count of the decoded image, mipmaps
+	the number of levels stored in the file ( 1 without MIPmaps ).
+**/
+typedef struct
+{
+	int width;
+	int height;
+	int channels;
+	int format;
+	int mipmaps;
+	int is_compressed;
+	int is_cubemap;
+}
+SOIL_image_info;
+
+/**
+	A cache of SOIL_image_info for many files, see SOIL_open_image_index.
+**/
+typedef struct SOIL_image_index SOIL_image_index;
+
 /**
 	Defines the order of faces in a DDS cubemap.
 	I recommend that you use the same order in single
@@ -368,13 +426,186 @@ int
 		int width, int height
 	);
 
+/**
+	Asynchronous screenshots.  SOIL_queue_screenshot only starts the
+	read of the pixels, into one of a ring of pixel pack buffers, and
+	SOIL_update_screenshot_queue picks them up a frame or two later
+	when the GPU has written them, so rendering does not stall.  They
+	are then saved to disk by a thread of the queue.  Without pixel
+	pack buffers and fences ( OpenGL 2.1 and 3.2, or their ARB
+	extensions ) the pixels are read right away, but still saved in
+	the background.  All the functions need the OpenGL context of
+	the capture to be current.
+**/
+typedef struct SOIL_screenshot_queue SOIL_screenshot_queue;
+
+/**
+	Creates a queue for asynchronous screenshots.
+	\param buffer_count how many screenshots can be on their way from
+	the GPU at a time, 0 for the default of 3.  As many more can wait
+	for the thread that saves them.
+	\return the queue, or NULL if out of memory
+**/
+SOIL_screenshot_queue *
+	SOIL_create_screenshot_queue
+	(
+		int buffer_count
+	);
+
+/**
+	Starts capturing the OpenGL window (RGB) to be saved to disk, like
+	SOIL_save_screenshot.  If every buffer is still in use this waits
+	for the oldest screenshot first.
+	\return 0 if it failed, otherwise returns 1
+**/
+int
+	SOIL_queue_screenshot
+	(
+		SOIL_screenshot_queue *queue,
+		const char *filename,
+		int image_type,
+		int x, int y,
+		int width, int height
+	);
+
+/**
+	Hands the screenshots the GPU has finished to the thread that saves
+	them, without waiting.  Call it once a frame, after the buffers
+	were swapped for example.
+	\return the number of screenshots handed over
+**/
+int
+	SOIL_update_screenshot_queue
+	(
+		SOIL_screenshot_queue *queue
+	);
+
+/**
+	Waits until every queued screenshot is saved, then frees the queue.
+	\return 1 if every screenshot was saved, otherwise 0
+**/
+int
+	SOIL_destroy_screenshot_queue
+	(
+		SOIL_screenshot_queue *queue
+	);
+
+/**
+	Recording: SOIL_record_frame captures every frame_interval-th frame
+	the way SOIL_queue_screenshot does, into numbered images or a
+	YUV4MPEG2 stream.  At most max_pending_frames captured frames wait
+	for the thread writing them, the backpressure policy says what
+	happens to a frame when that many already wait: SOIL_RECORD_BLOCK
+	waits for the writer, SOIL_RECORD_DROP drops the frame.
+**/
+typedef struct SOIL_recorder SOIL_recorder;
+
+/**
+	The image type to record a 4:4:4 YUV4MPEG2 (.y4m) stream, which
+	ffmpeg and most video tools read.
+**/
+enum
+{
+	SOIL_RECORD_Y4M = -1
+};
+
+/**
+	The backpressure policies of a recorder.
+**/
+enum
+{
+	SOIL_RECORD_BLOCK = 0,
+	SOIL_RECORD_DROP = 1
+};
+
+/**
+	What a recorder has done so far.  The frames written and the
+	failures lag behind while the recording runs.
+**/
+typedef struct
+{
+	int frames_seen;	/*	calls of SOIL_record_frame	*/
+	int frames_captured;	/*	the frames read from the window	*/
+	int frames_dropped;	/*	captured, but dropped with SOIL_RECORD_DROP	*/
+	int frames_written;
+	int write_failures;
+}
+SOIL_recorder_stats;
+
+/**
+	Starts a recording of a part of the OpenGL window.
+	\param filename for images a pattern with one %d for the frame
+	number (up to a 0 flag and a width of 2 digits, like
+	"frames/qa_%05d.png"), the frames are numbered by capture, so a
+	dropped frame leaves a gap.  For SOIL_RECORD_Y4M the stream's name.
+	\param image_type SOIL_SAVE_TYPE_QOI ( lossless and the cheapest to
+	write ), SOIL_SAVE_TYPE_PNG, SOIL_SAVE_TYPE_JPG ( or any other save
+	type ), or SOIL_RECORD_Y4M
+	\param frame_interval capture every frame_interval-th frame, 1 for all
+	\param frames_per_second the rendering rate, for the stream header
+	of SOIL_RECORD_Y4M, which gets frames_per_second / frame_interval
+	\param max_pending_frames how many captured frames may wait for the
+	writer, each takes width * height * 4 bytes ( 0 for 2 )
+	\param backpressure SOIL_RECORD_BLOCK or SOIL_RECORD_DROP
+	\return the recorder, or NULL if the arguments are invalid, the
+	stream can not be created or memory runs out
+**/
+SOIL_recorder *
+	SOIL_create_recorder
+	(
+		const char *filename,
+		int image_type,
+		int x, int y,
+		int width, int height,
+		int frame_interval,
+		int frames_per_second,
+		int max_pending_frames,
+		int backpressure
+	);
+
+/**
+	Call it once for every rendered frame, before the buffers are
+	swapped.  It hands what the GPU has finished to the writer, and
+	captures the frame if it is one to record.
+	\return 1 if the frame was captured, otherwise 0
+**/
+int
+	SOIL_record_frame
+	(
+		SOIL_recorder *recorder
+	);
+
+/**
+	Fills stats with what the recorder has done so far.
+**/
+void
+	SOIL_get_recorder_stats
+	(
+		const SOIL_recorder *recorder,
+		SOIL_recorder_stats *stats
+	);
+
+/**
+	Waits until every captured frame is written, closes the stream
+	and frees the recorder.
+	\param stats if not NULL, gets the final statistics
+	\return 1 if every frame that was not dropped was written, otherwise 0
+**/
+int
+	SOIL_destroy_recorder
+	(
+		SOIL_recorder *recorder,
+		SOIL_recorder_stats *stats
+	);
+
 /**
 	Loads an image from disk into an array of unsigned chars.
 	Note that *channels return the original channel count of the
 	image.  If force_channels was other than SOIL_LOAD_AUTO,
 	the resulting image has force_channels, but *channels may be
 	different (if the original image had a different channel
-	count).
+	count).  The file is memory mapped and decoded in place where the
+	system allows it ( define SOIL_NO_MMAP to read it with stdio ).
 	\return 0 if failed, otherwise returns 1
 **/
 unsigned char*
@@ -403,9 +634,302 @@ unsigned char*
 		int force_channels
 	);
 
+/**
+	Loads an image from disk at 1/2, 1/4 or 1/8 of its size, e.g. for
+	a low LOD or the smaller mipmaps.  JPEGs are decoded straight at
+	the reduced size ( rounded up ), which costs much less than a full
+	decode; other formats are loaded in full and box filtered down
+	( rounded down ).  *width and *height return the reduced size,
+	the rest works as in SOIL_load_image.
+	\param scale 1, 2, 4 or 8
+	\return 0 if failed, otherwise returns 1
+**/
+unsigned char*
+	SOIL_load_image_scaled
+	(
+		const char *filename,
+		int scale,
+		int *width, int *height, int *channels,
+		int force_channels
+	);
+
+/**
+	Loads an image from memory at 1/2, 1/4 or 1/8 of its size, see
+	SOIL_load_image_scaled.
+	\param scale 1, 2, 4 or 8
+	\return 0 if failed, otherwise returns 1
+**/
+unsigned char*
+	SOIL_load_image_scaled_from_memory
+	(
+		const unsigned char *const buffer,
+		int buffer_length,
+		int scale,
+		int *width, int *height, int *channels,
+		int force_channels
+	);
+
+/**
+	Loads only a rectangle of an image from disk, e.g. one tile of an
+	atlas or a cropped preview.  The rectangle is clipped to the image
+	and *width, *height return its clipped size.  JPEGs skip the work
+	outside the region and non-interlaced PNGs stop inflating after its
+	last row, keeping memory to about the region's size; other formats
+	are loaded in full and cropped.  The rest works as in SOIL_load_image.
+	x and y may be negative, the part left of or above the image is
+	clipped off.  They count from the top left of the image as it is
+	stored, also when loads are flipped vertically; only the returned
+	rectangle is flipped then.
+	\return 0 if failed (or the region is outside the image), otherwise returns 1
+**/
+unsigned char*
+	SOIL_load_image_region
+	(
+		const char *filename,
+		int x, int y, int region_width, int region_height,
+		int *width, int *height, int *channels,
+		int force_channels
+	);
+
+/**
+	Loads only a rectangle of an image from memory, see
+	SOIL_load_image_region.
+	\return 0 if failed (or the region is outside the image), otherwise returns 1
+**/
+unsigned char*
+	SOIL_load_image_region_from_memory
+	(
+		const unsigned char *const buffer,
+		int buffer_length,
+		int x, int y, int region_width, int region_height,
+		int *width, int *height, int *channels,
+		int force_channels
+	);
+
+/**
+	Receives the rows of SOIL_load_image_rows.  pixels holds
+	rows tightly packed rows of width pixels with channels bytes each,
+	starting at image row y, and is only valid during the call.
+	\return 1 to keep going, 0 to stop the load
+**/
+typedef int (*SOIL_row_callback)( void *user, const unsigned char *pixels,
+		int width, int height, int channels, int y, int rows );
+
+/**
+	Decodes an image from disk and hands it to callback a few rows at a
+	time instead of returning it, so a huge image can be written out or
+	tiled without ever holding all of it.  Sequential JPEGs, non-interlaced
+	PNGs, BMP, TGA and HDR are decoded one MCU row or scanline at a time;
+	other formats are loaded in full and passed on in a single call.
+	Rows arrive in file order (bottom-up for most BMPs and TGAs), and
+	each row is handed out exactly once.
+	\param callback called with every batch of decoded rows
+	\param user passed on to callback
+	\param force_channels 0-image format, 1-luminous, 2-luminous/alpha, 3-RGB, 4-RGBA
+	\return 0 if failed (or callback stopped the load), otherwise returns 1
+**/
+int
+	SOIL_load_image_rows
+	(
+		const char *filename,
+		SOIL_row_callback callback,
+		void *user,
+		int *width, int *height, int *channels,
+		int force_channels
+	);
+
+/**
+	Decodes an image from memory a few rows at a time, see
+	SOIL_load_image_rows.
+	\return 0 if failed (or callback stopped the load), otherwise returns 1
+**/
+int
+	SOIL_load_image_rows_from_memory
+	(
+		const unsigned char *const buffer,
+		int buffer_length,
+		SOIL_row_callback callback,
+		void *user,
+		int *width, int *height, int *channels,
+		int force_channels
+	);
+
+/**
+	Reads the size and channel count of an image on disk without
+	decoding it, e.g. to size the buffer for SOIL_load_image_into.
+	\return 0 if failed, otherwise returns 1
+**/
+int
+	SOIL_get_image_info
+	(
+		const char *filename,
+		int *width, int *height, int *channels
+	);
+
+/**
+	Same as SOIL_get_image_info, for an image in memory.
+	\return 0 if failed, otherwise returns 1
+**/
+int
+	SOIL_get_image_info_from_memory
+	(
+		const unsigned char *const buffer,
+		int buffer_length,
+		int *width, int *height, int *channels
+	);
+
+/**
+	Reads the header of an image on disk ( any format SOIL can load ) and
+	reports its size, channels, format and the MIPmap levels and cubemap
+	faces stored in DDS and PVR files, without decoding any pixels.
+	\return 0 if failed, otherwise returns 1
+**/
+int
+	SOIL_probe_image
+	(
+		const char *filename,
+		SOIL_image_info *info
+	);
+
+/**
+	Same as SOIL_probe_image, for an image in memory.
+	\return 0 if failed, otherwise returns 1
+**/
+int
+	SOIL_probe_image_from_memory
+	(
+		const unsigned char *const buffer,
+		int buffer_length,
+		SOIL_image_info *info
+	);
+
+/**
+	Opens a persistent index of image headers, so a program can plan its
+	textures at start up without opening every file.  Entries are keyed by
+	path and are only trusted while the file's size and modification time
+	still match, which is a stat() and no open().  The index is not thread
+	safe, give each thread its own or lock around it.
+	\param index_filename the index file, read now if it exists and written
+	by SOIL_save_image_index. NULL keeps the index in memory only.
+	\return the index, or NULL if out of memory
+**/
+SOIL_image_index*
+	SOIL_open_image_index
+	(
+		const char *index_filename
+	);
+
+/**
+	Same as SOIL_probe_image, answered from the index when the entry for
+	filename is still current, otherwise the file is probed and the entry
+	updated.
+	\return 0 if failed, otherwise returns 1
+**/
+int
+	SOIL_image_index_probe
+	(
+		SOIL_image_index *index,
+		const char *filename,
+		SOIL_image_info *info
+	);
+
+/**
+	Writes the index back to its file, if anything changed.
+	\return 0 if failed, otherwise returns 1
+**/
+int
+	SOIL_save_image_index
+	(
+		SOIL_image_index *index
+	);
+
+/**
+	Frees the index ( without saving it ).
+**/
+void
+	SOIL_close_image_index
+	(
+		SOIL_image_index *index
+	);
+
+/**
+	Loads an image from disk into caller supplied memory (a mapped
+	PBO, a pooled staging buffer...) instead of a new allocation.
+	Rows are row_stride bytes apart, 0 meaning width * channels.
+	The buffer must hold row_stride * (height - 1) + width * channels
+	bytes, see SOIL_get_image_info.  *channels works as in SOIL_load_image.
+	\param flags SOIL_FLAG_INVERT_Y stores the bottom row first
+	\return 0 if failed (or the buffer is too small), otherwise returns 1
+**/
+int
+	SOIL_load_image_into
+	(
+		const char *filename,
+		unsigned char *out, int out_size,
+		int row_stride,
+		unsigned int flags,
+		int *width, int *height, int *channels,
+		int force_channels
+	);
+
+/**
+	Same as SOIL_load_image_into, for an image in memory.
+	\return 0 if failed (or the buffer is too small), otherwise returns 1
+**/
+int
+	SOIL_load_image_into_from_memory
+	(
+		const unsigned char *const buffer,
+		int buffer_length,
+		unsigned char *out, int out_size,
+		int row_stride,
+		unsigned int flags,
+		int *width, int *height, int *channels,
+		int force_channels
+	);
+
+/**
+	Sets the calling thread's allocator for the decoder's scratch memory
+	(JPEG component planes, zlib output, PNG filter rows...).  It is used by
+	SOIL_load_image_into*, where everything it hands out is returned before
+	the call ends, so an arena can simply be reset after every image.
+	realloc_fn and free_fn may be NULL; old_size is 0 when it is unknown.
+	Pass a NULL alloc_fn to go back to malloc.
+**/
+void
+	SOIL_set_scratch_allocator
+	(
+		void *(*alloc_fn)( void *user, size_t size ),
+		void *(*realloc_fn)( void *user, void *p, size_t old_size, size_t new_size ),
+		void (*free_fn)( void *user, void *p ),
+		void *user
+	);
+
+/**
+	Reports the decoder memory use of the calling thread's last image load.
+	Any of the pointers may be NULL.
+	\param allocations the number of malloc and realloc calls
+	\param bytes_allocated the sum of all requested sizes
+	\param peak_bytes the most memory in use at the same time
+**/
+void
+	SOIL_get_load_memory_stats
+	(
+		int *allocations,
+		size_t *bytes_allocated,
+		size_t *peak_bytes
+	);
+
 /**
 	Saves an image from an array of unsigned chars (RGBA) to disk
-	\param quality parameter only used for SOIL_SAVE_TYPE_JPG files, values accepted between 0 and 100.
+	\param quality parameter only used for SOIL_SAVE_TYPE_JPG, SOIL_SAVE_TYPE_PNG and the SOIL_SAVE_TYPE_DDS* files, values accepted between 0 and 100.
+	For PNG files quality / 10 is the compression level: below 10 the image is stored uncompressed, 10 to 19 only
+	compresses runs (fast, for screenshots), higher values search longer for smaller files, 90 and above is the smallest.
+	JPG files are written with the standard Huffman tables and full resolution color, SOIL_save_image_JPG can
+	make smaller ones.
+	For DDS files it selects the DXT encoder: below 34 a fast range fit, 90 and above a slow, high quality cluster fit,
+	anything in between ( SOIL_save_image uses 80 ) the default encoder.
+	For BC7 below 34 only tries mode 6, higher values also try 2 subset partitions, 90 and above tries more of them.
 	\return 0 if failed, otherwise returns 1
 **/
 int
@@ -418,6 +942,35 @@ int
 		int quality
 	);
 
+/**
+	Options for SOIL_save_image_JPG, they can be combined.
+	SOIL_JPG_SUBSAMPLE: stores the color at half the resolution (4:2:0), much smaller files that lose
+	some color detail
+	SOIL_JPG_OPTIMIZE: builds Huffman tables for the image in a second pass, smaller files with the same
+	pixels, about 1.5 times slower to save
+**/
+enum
+{
+	SOIL_JPG_SUBSAMPLE = 1,
+	SOIL_JPG_OPTIMIZE = 2
+};
+
+/**
+	Saves an image as a JPG file with the SOIL_JPG_* options.
+	\param quality values accepted between 0 and 100
+	\param flags SOIL_JPG_SUBSAMPLE and / or SOIL_JPG_OPTIMIZE, 0 writes the same file as SOIL_save_image_quality
+	\return 0 if failed, otherwise returns 1
+**/
+int
+	SOIL_save_image_JPG
+	(
+		const char *filename,
+		int width, int height, int channels,
+		const unsigned char *const data,
+		int quality,
+		int flags
+	);
+
 int
 	SOIL_save_image
 	(
@@ -441,7 +994,9 @@ void
 /**
 	This function resturn a pointer to a string describing the last thing
 	that happened inside SOIL.  It can be used to determine why an image
-	failed to load.
+	failed to load.  Each thread has its own last result, so loader threads
+	can call SOIL at the same time ( OpenGL uploads still need the thread's
+	context to be current ).
 **/
 const char*
 	SOIL_last_result
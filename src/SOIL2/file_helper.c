@@ -0,0 +1,222 @@
+/*
+    File helper functions
+
+    MIT license
+*/
+
+#include "file_helper.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined( SOIL_NO_MMAP )
+	#if defined( __WIN32__ ) || defined( _WIN32 ) || defined( WIN32 )
+		#define FILE_HELPER_WIN32
+		#define WIN32_LEAN_AND_MEAN
+		#include <windows.h>
+	#elif defined( __unix__ ) || defined( __APPLE__ )
+		#define FILE_HELPER_POSIX
+		#include <sys/types.h>
+		#include <sys/stat.h>
+		#include <sys/mman.h>
+		#include <fcntl.h>
+		#include <unistd.h>
+	#endif
+#endif
+
+/*	sequential files up to this size are read ahead in full when mapped	*/
+#define FILE_HELPER_PREFETCH_LIMIT	(64 * 1024 * 1024)
+
+/*	the plain stdio way, used when mapping is not available.  reads to
+	the end instead of trusting the length, pipes and /proc files have none	*/
+static int read_whole_file( const char *filename, mapped_file *file )
+{
+	FILE *f;
+	long length;
+	size_t capacity, size = 0;
+	unsigned char *buffer, *grown;
+	f = fopen( filename, "rb" );
+	if( NULL == f )
+	{
+		return 0;
+	}
+	capacity = 64 * 1024;
+	if( (0 == fseek( f, 0, SEEK_END )) && ((length = ftell( f )) > 0) &&
+		((unsigned long)length < (size_t)-1) )
+	{
+		/*	one more than the length, so the end shows without growing	*/
+		capacity = (size_t)length + 1;
+	}
+	fseek( f, 0, SEEK_SET );
+	buffer = (unsigned char*)malloc( capacity );
+	if( (NULL == buffer) && (capacity > 64 * 1024) )
+	{
+		/*	the length may be bogus, let the loop find the real one	*/
+		capacity = 64 * 1024;
+		buffer = (unsigned char*)malloc( capacity );
+	}
+	while( NULL != buffer )
+	{
+		size += fread( (void*)(buffer + size), 1, capacity - size, f );
+		if( size < capacity )
+		{
+			break;
+		}
+		grown = NULL;
+		if( capacity <= (size_t)-1 / 2 )
+		{
+			capacity *= 2;
+			grown = (unsigned char*)realloc( buffer, capacity );
+		}
+		if( NULL == grown )
+		{
+			free( buffer );
+		}
+		buffer = grown;
+	}
+	if( (NULL == buffer) || ferror( f ) || (0 == size) )
+	{
+		free( buffer );
+		fclose( f );
+		return 0;
+	}
+	fclose( f );
+	file->data = buffer;
+	file->size = size;
+	file->is_mapped = 0;
+	return 1;
+}
+
+int
+	map_file
+	(
+		const char *filename,
+		int access,
+		mapped_file *file
+	)
+{
+	if( NULL == file )
+	{
+		return 0;
+	}
+	memset( file, 0, sizeof( mapped_file ) );
+	if( NULL == filename )
+	{
+		return 0;
+	}
+#if defined( FILE_HELPER_WIN32 )
+	{
+		HANDLE handle, mapping;
+		LARGE_INTEGER length;
+		void *view;
+		handle = CreateFileA( filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+				access != FILE_ACCESS_RANDOM ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS, NULL );
+		if( INVALID_HANDLE_VALUE == handle )
+		{
+			return 0;
+		}
+		if( !GetFileSizeEx( handle, &length ) ||
+			((ULONGLONG)length.QuadPart > (ULONGLONG)(size_t)-1) )
+		{
+			CloseHandle( handle );
+			return 0;
+		}
+		/*	an empty file can not be mapped, leave it to the stdio path	*/
+		mapping = NULL;
+		if( length.QuadPart > 0 )
+		{
+			mapping = CreateFileMappingA( handle, NULL, PAGE_READONLY, 0, 0, NULL );
+		}
+		/*	the view keeps the file open, the handles can go	*/
+		CloseHandle( handle );
+		if( NULL != mapping )
+		{
+			view = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+			CloseHandle( mapping );
+			if( NULL != view )
+			{
+				file->data = (const unsigned char*)view;
+				file->size = (size_t)length.QuadPart;
+				file->is_mapped = 1;
+				return 1;
+			}
+		}
+	}
+#elif defined( FILE_HELPER_POSIX )
+	{
+		struct stat info;
+		void *view;
+		int fd = open( filename, O_RDONLY );
+		if( fd < 0 )
+		{
+			return 0;
+		}
+		if( (fstat( fd, &info ) != 0) || S_ISDIR( info.st_mode ) ||
+			((unsigned long long)info.st_size > (unsigned long long)(size_t)-1) )
+		{
+			/*	too big to address, or to read in one piece either	*/
+			close( fd );
+			return 0;
+		}
+		view = MAP_FAILED;
+		/*	pipes, devices and /proc files (size 0) are read instead	*/
+		if( S_ISREG( info.st_mode ) && (info.st_size > 0) )
+		{
+			view = mmap( NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+		}
+		/*	the mapping keeps the file open, the descriptor can go	*/
+		close( fd );
+		if( MAP_FAILED != view )
+		{
+#if defined( MADV_SEQUENTIAL ) && defined( MADV_WILLNEED ) && defined( MADV_RANDOM )
+			/*	the advice values are not flags, each needs its own call	*/
+			if( access != FILE_ACCESS_RANDOM )
+			{
+				madvise( view, (size_t)info.st_size, MADV_SEQUENTIAL );
+				/*	prefetching the whole of a huge file would only push
+					out the pages that are still needed	*/
+				if( (access == FILE_ACCESS_SEQUENTIAL) &&
+					((size_t)info.st_size <= FILE_HELPER_PREFETCH_LIMIT) )
+				{
+					madvise( view, (size_t)info.st_size, MADV_WILLNEED );
+				}
+			} else
+			{
+				madvise( view, (size_t)info.st_size, MADV_RANDOM );
+			}
+#endif
+			file->data = (const unsigned char*)view;
+			file->size = (size_t)info.st_size;
+			file->is_mapped = 1;
+			return 1;
+		}
+	}
+#endif
+	/*	could not map it (a pipe, an odd file system...), read it	*/
+	(void)access;
+	return read_whole_file( filename, file );
+}
+
+void
+	unmap_file
+	(
+		mapped_file *file
+	)
+{
+	if( (NULL == file) || (NULL == file->data) )
+	{
+		return;
+	}
+	if( file->is_mapped )
+	{
+#if defined( FILE_HELPER_WIN32 )
+		UnmapViewOfFile( (LPCVOID)file->data );
+#elif defined( FILE_HELPER_POSIX )
+		munmap( (void*)file->data, file->size );
+#endif
+	} else
+	{
+		free( (void*)file->data );
+	}
+	memset( file, 0, sizeof( mapped_file ) );
+}
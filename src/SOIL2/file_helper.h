@@ -0,0 +1,71 @@
+/*
+    File helper functions
+
+    Read only access to whole files, memory mapped where the system
+    allows it, so the decoders and the compressed texture uploads can
+    work straight from the page cache without a copy.
+    Define SOIL_NO_MMAP to always read the file into memory instead.
+
+    MIT license
+*/
+
+#ifndef HEADER_FILE_HELPER
+#define HEADER_FILE_HELPER
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+	A file opened by map_file.  data and size are valid until
+	unmap_file is called, the rest is private.
+**/
+typedef struct
+{
+	const unsigned char *data;
+	size_t size;
+	int is_mapped;
+}
+mapped_file;
+
+/**
+	Access hints for map_file.
+**/
+#define FILE_ACCESS_RANDOM		0
+#define FILE_ACCESS_SEQUENTIAL	1
+#define FILE_ACCESS_PARTIAL		2
+
+/**
+	Maps the whole file read only.  If it can not be mapped (or
+	SOIL_NO_MMAP is defined) it is read into a malloc'ed buffer.
+	\param access FILE_ACCESS_SEQUENTIAL if the data will be read front to
+	back once, so the system can read ahead and drop pages behind,
+	FILE_ACCESS_PARTIAL if it is read front to back but may stop early
+	( a region of an image ), so it is not prefetched in full
+	\return 1 on success, 0 if the file can not be opened, is empty or
+	memory runs out
+**/
+int
+	map_file
+	(
+		const char *filename,
+		int access,
+		mapped_file *file
+	);
+
+/**
+	Releases a file from map_file and clears it.
+**/
+void
+	unmap_file
+	(
+		mapped_file *file
+	);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HEADER_FILE_HELPER	*/
@@ -0,0 +1,643 @@
+/*
+	BC7 (BPTC) block compression
+
+	Only two of the eight BC7 modes are searched:
+	mode 6 (one RGBA subset, 7777.1 endpoints, 4 bit indices) and
+	mode 1 (two RGB subsets, 666.1 endpoints with a shared p-bit,
+	3 bit indices).  Endpoints come from the principal axis of each
+	subset, then get refined by least squares on the chosen indices.
+
+	public domain
+*/
+
+#include "image_BC7.h"
+#include "image_DXT.h"
+#include <math.h>
+#include <string.h>
+
+/*	the 2 subset partitions, bit i is set when texel i is in subset 1	*/
+static const unsigned short BC7_partition2[64] =
+{
+	0xCCCC, 0x8888, 0xEEEE, 0xECC8, 0xC880, 0xFEEC, 0xFEC8, 0xEC80,
+	0xC800, 0xFFEC, 0xFE80, 0xE800, 0xFFE8, 0xFF00, 0xFFF0, 0xF000,
+	0xF710, 0x008E, 0x7100, 0x08CE, 0x008C, 0x7310, 0x3100, 0x8CCE,
+	0x088C, 0x3110, 0x6666, 0x366C, 0x17E8, 0x0FF0, 0x718E, 0x399C,
+	0xAAAA, 0xF0F0, 0x5A5A, 0x33CC, 0x3C3C, 0x55AA, 0x9696, 0xA55A,
+	0x73CE, 0x13C8, 0x324C, 0x3BDC, 0x6996, 0xC33C, 0x9966, 0x0660,
+	0x0272, 0x04E4, 0x4E40, 0x2720, 0xC936, 0x936C, 0x39C6, 0x639C,
+	0x9336, 0x9CC6, 0x817E, 0xE718, 0xCCF0, 0x0FCC, 0x7744, 0xEE22
+};
+
+/*	the texel of subset 1 whose index is stored without its top bit
+	(texel 0 is always the anchor of subset 0)	*/
+static const unsigned char BC7_anchor2[64] =
+{
+	15, 15, 15, 15, 15, 15, 15, 15,
+	15, 15, 15, 15, 15, 15, 15, 15,
+	15,  2,  8,  2,  2,  8,  8, 15,
+	 2,  8,  2,  2,  8,  8,  2,  2,
+	15, 15,  6,  8,  2,  8, 15, 15,
+	 2,  8,  2,  2,  2, 15, 15,  6,
+	 6,  2,  6,  8, 15, 15,  2,  2,
+	15, 15, 15, 15, 15,  2,  2, 15
+};
+
+static const int BC7_weights3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+static const int BC7_weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+/*	the parts of a BC7 mode the encoder needs to know	*/
+typedef struct
+{
+	/*	bits per color component, not counting the p-bit	*/
+	int color_bits;
+	/*	1 for one p-bit per subset, 0 for one per endpoint	*/
+	int shared_pbit;
+	int index_bits;
+	/*	3 for RGB modes (alpha is 255), 4 for RGBA	*/
+	int channels;
+}
+BC7_mode_info;
+
+static const BC7_mode_info BC7_mode1 = { 6, 1, 3, 3 };
+static const BC7_mode_info BC7_mode6 = { 7, 0, 4, 4 };
+
+/*	the endpoints of one subset, as stored and as decoded	*/
+typedef struct
+{
+	int code[2][4];
+	int pbit[2];
+	int color[2][4];
+}
+BC7_endpoints;
+
+/*	how many mode 1 partitions get a full encode, per quality level	*/
+#define BC7_PARTITIONS_DEFAULT	2
+#define BC7_PARTITIONS_HIGH		8
+
+/********* Helper Functions *********/
+static int BC7_unquantize( int code, int pbit, int color_bits )
+{
+	int n = color_bits + 1;
+	int c = ((code << 1) | pbit) << (8 - n);
+	return c | (c >> n);
+}
+
+/*	finds the code (for the given p-bit) that decodes closest to value	*/
+static int BC7_quantize( float value, int pbit, int color_bits )
+{
+	const int max_code = (1 << color_bits) - 1;
+	const int n = color_bits + 1;
+	int guess = (int)floor( (value * ((1 << n) - 1) / 255.0f - pbit) * 0.5f + 0.5f );
+	int best = 0, best_error = 1 << 30;
+	int q;
+	for( q = guess - 1; q <= guess + 1; ++q )
+	{
+		if( (q >= 0) && (q <= max_code) )
+		{
+			float d = BC7_unquantize( q, pbit, color_bits ) - value;
+			int error = (int)(d * d * 16.0f);
+			if( error < best_error )
+			{
+				best_error = error;
+				best = q;
+			}
+		}
+	}
+	return best;
+}
+
+static void BC7_quantize_endpoints(
+		const float ends[2][4],
+		const BC7_mode_info *mode,
+		int pbit0, int pbit1,
+		BC7_endpoints *ep )
+{
+	int e, c;
+	ep->pbit[0] = pbit0;
+	ep->pbit[1] = pbit1;
+	for( e = 0; e < 2; ++e )
+	{
+		for( c = 0; c < 4; ++c )
+		{
+			if( c < mode->channels )
+			{
+				ep->code[e][c] = BC7_quantize( ends[e][c], ep->pbit[e], mode->color_bits );
+				ep->color[e][c] = BC7_unquantize( ep->code[e][c], ep->pbit[e], mode->color_bits );
+			} else
+			{
+				ep->code[e][c] = 0;
+				ep->color[e][c] = 255;
+			}
+		}
+	}
+}
+
+/*	picks the closest palette entry for every texel of the subset,
+	\return the squared error	*/
+static int BC7_assign_indices(
+		const unsigned char *const block,
+		const int *texels, int count,
+		const BC7_mode_info *mode,
+		const BC7_endpoints *ep,
+		unsigned char indices[16] )
+{
+	const int *weights = (mode->index_bits == 3) ? BC7_weights3 : BC7_weights4;
+	const int steps = 1 << mode->index_bits;
+	int palette[16][4];
+	int i, k, c, error = 0;
+	for( k = 0; k < steps; ++k )
+	{
+		for( c = 0; c < 4; ++c )
+		{
+			palette[k][c] = ((64 - weights[k]) * ep->color[0][c] +
+					weights[k] * ep->color[1][c] + 32) >> 6;
+		}
+	}
+	for( i = 0; i < count; ++i )
+	{
+		const unsigned char *texel = block + texels[i] * 4;
+		int best = 0, best_error = 1 << 30;
+		for( k = 0; k < steps; ++k )
+		{
+			int e = 0;
+			for( c = 0; c < mode->channels; ++c )
+			{
+				int d = palette[k][c] - texel[c];
+				e += d * d;
+			}
+			if( e < best_error )
+			{
+				best_error = e;
+				best = k;
+			}
+		}
+		indices[texels[i]] = (unsigned char)best;
+		error += best_error;
+	}
+	return error;
+}
+
+/*	quantizes the endpoints with the best p-bits and assigns the
+	indices, keeping the result if it beats *best_error	*/
+static void BC7_try_endpoints(
+		const unsigned char *const block,
+		const int *texels, int count,
+		const BC7_mode_info *mode,
+		int quality,
+		const float ends[2][4],
+		BC7_endpoints *best, unsigned char indices[16], int *best_error )
+{
+	BC7_endpoints ep;
+	unsigned char trial[16];
+	int pbits[4][2];
+	int tries = 0, t, i, c;
+	if( mode->shared_pbit )
+	{
+		pbits[0][0] = pbits[0][1] = 0;
+		pbits[1][0] = pbits[1][1] = 1;
+		tries = 2;
+	} else if( quality == DXT_QUALITY_FAST )
+	{
+		/*	just pick each p-bit by its own quantization error	*/
+		int e;
+		for( e = 0; e < 2; ++e )
+		{
+			float error[2] = { 0.0f, 0.0f };
+			int p;
+			for( p = 0; p < 2; ++p )
+			{
+				for( c = 0; c < mode->channels; ++c )
+				{
+					float d = BC7_unquantize(
+							BC7_quantize( ends[e][c], p, mode->color_bits ),
+							p, mode->color_bits ) - ends[e][c];
+					error[p] += d * d;
+				}
+			}
+			pbits[0][e] = ( error[1] < error[0] ) ? 1 : 0;
+			if( (mode->channels == 4) && (ends[e][3] > 254.5f) )
+			{
+				/*	only p-bit 1 decodes opaque alpha as 255	*/
+				pbits[0][e] = 1;
+			}
+		}
+		tries = 1;
+	} else
+	{
+		for( t = 0; t < 4; ++t )
+		{
+			pbits[t][0] = t & 1;
+			pbits[t][1] = t >> 1;
+		}
+		tries = 4;
+	}
+	for( t = 0; t < tries; ++t )
+	{
+		int error;
+		if( (mode->channels == 4) &&
+			( ((ends[0][3] > 254.5f) && !pbits[t][0]) ||
+			  ((ends[1][3] > 254.5f) && !pbits[t][1]) ) )
+		{
+			/*	keep opaque texels opaque, rather than trading
+				alpha error for a little color precision	*/
+			continue;
+		}
+		BC7_quantize_endpoints( ends, mode, pbits[t][0], pbits[t][1], &ep );
+		error = BC7_assign_indices( block, texels, count, mode, &ep, trial );
+		if( error < *best_error )
+		{
+			*best_error = error;
+			*best = ep;
+			for( i = 0; i < count; ++i )
+			{
+				indices[texels[i]] = trial[texels[i]];
+			}
+		}
+	}
+}
+
+/*	fits a pair of endpoints to the texels of one subset,
+	\return the squared error	*/
+static int BC7_fit_subset(
+		const unsigned char *const block,
+		const int *texels, int count,
+		const BC7_mode_info *mode,
+		int quality,
+		BC7_endpoints *best, unsigned char indices[16] )
+{
+	const int *weights = (mode->index_bits == 3) ? BC7_weights3 : BC7_weights4;
+	const int channels = mode->channels;
+	float mean[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	float cov[4][4];
+	float axis[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	float ends[2][4];
+	float tmin = 1e9f, tmax = -1e9f;
+	int best_error = 1 << 30;
+	int i, c, d, iter, refinements;
+	/*	mean and covariance	*/
+	for( i = 0; i < count; ++i )
+	{
+		for( c = 0; c < channels; ++c )
+		{
+			mean[c] += block[texels[i]*4+c];
+		}
+	}
+	for( c = 0; c < channels; ++c )
+	{
+		mean[c] /= count;
+	}
+	memset( cov, 0, sizeof( cov ) );
+	for( i = 0; i < count; ++i )
+	{
+		float v[4];
+		for( c = 0; c < channels; ++c )
+		{
+			v[c] = block[texels[i]*4+c] - mean[c];
+		}
+		for( c = 0; c < channels; ++c )
+		{
+			for( d = c; d < channels; ++d )
+			{
+				cov[c][d] += v[c] * v[d];
+			}
+		}
+	}
+	for( c = 0; c < channels; ++c )
+	{
+		for( d = 0; d < c; ++d )
+		{
+			cov[c][d] = cov[d][c];
+		}
+	}
+	/*	power method for the principal axis, seeded with
+		the row of the channel that varies the most	*/
+	d = 0;
+	for( c = 1; c < channels; ++c )
+	{
+		if( cov[c][c] > cov[d][d] )
+		{
+			d = c;
+		}
+	}
+	for( c = 0; c < channels; ++c )
+	{
+		axis[c] = cov[d][c];
+	}
+	for( iter = 0; iter < 8; ++iter )
+	{
+		float next[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		float len = 0.0f;
+		for( c = 0; c < channels; ++c )
+		{
+			for( d = 0; d < channels; ++d )
+			{
+				next[c] += cov[c][d] * axis[d];
+			}
+			len += next[c] * next[c];
+		}
+		if( len < 1e-12f )
+		{
+			break;
+		}
+		len = 1.0f / (float)sqrt( len );
+		for( c = 0; c < channels; ++c )
+		{
+			axis[c] = next[c] * len;
+		}
+	}
+	/*	the extent of the texels along that axis	*/
+	for( i = 0; i < count; ++i )
+	{
+		float t = 0.0f;
+		for( c = 0; c < channels; ++c )
+		{
+			t += (block[texels[i]*4+c] - mean[c]) * axis[c];
+		}
+		if( t < tmin )
+		{
+			tmin = t;
+		}
+		if( t > tmax )
+		{
+			tmax = t;
+		}
+	}
+	for( c = 0; c < 4; ++c )
+	{
+		float lo = (c < channels) ? mean[c] + tmin * axis[c] : 255.0f;
+		float hi = (c < channels) ? mean[c] + tmax * axis[c] : 255.0f;
+		ends[0][c] = lo < 0.0f ? 0.0f : ( lo > 255.0f ? 255.0f : lo );
+		ends[1][c] = hi < 0.0f ? 0.0f : ( hi > 255.0f ? 255.0f : hi );
+	}
+	BC7_try_endpoints( block, texels, count, mode, quality, ends, best, indices, &best_error );
+	/*	least squares refinement, using the indices just chosen	*/
+	refinements = ( quality == DXT_QUALITY_FAST ) ? 0 :
+			( ( quality == DXT_QUALITY_HIGH ) ? 3 : 1 );
+	for( iter = 0; (iter < refinements) && (best_error > 0); ++iter )
+	{
+		float aa = 0.0f, ab = 0.0f, bb = 0.0f, det;
+		float ax[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		float bx[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		int previous_error = best_error;
+		for( i = 0; i < count; ++i )
+		{
+			float w = weights[indices[texels[i]]] * (1.0f / 64.0f);
+			float a = 1.0f - w;
+			aa += a * a;
+			ab += a * w;
+			bb += w * w;
+			for( c = 0; c < channels; ++c )
+			{
+				ax[c] += a * block[texels[i]*4+c];
+				bx[c] += w * block[texels[i]*4+c];
+			}
+		}
+		det = aa * bb - ab * ab;
+		if( fabs( det ) < 1e-6f )
+		{
+			/*	every texel on one index, nothing to solve	*/
+			break;
+		}
+		det = 1.0f / det;
+		for( c = 0; c < channels; ++c )
+		{
+			float lo = (ax[c] * bb - bx[c] * ab) * det;
+			float hi = (bx[c] * aa - ax[c] * ab) * det;
+			ends[0][c] = lo < 0.0f ? 0.0f : ( lo > 255.0f ? 255.0f : lo );
+			ends[1][c] = hi < 0.0f ? 0.0f : ( hi > 255.0f ? 255.0f : hi );
+		}
+		BC7_try_endpoints( block, texels, count, mode, quality, ends, best, indices, &best_error );
+		if( best_error >= previous_error )
+		{
+			break;
+		}
+	}
+	return best_error;
+}
+
+/*	the anchor texel's index must have a 0 top bit,
+	if it doesn't then swap the endpoints around	*/
+static void BC7_fix_anchor(
+		const int *texels, int count,
+		int anchor, int index_bits,
+		BC7_endpoints *ep, unsigned char indices[16] )
+{
+	const int top = 1 << (index_bits - 1);
+	const int max_index = (1 << index_bits) - 1;
+	int i, c, t;
+	if( indices[anchor] < top )
+	{
+		return;
+	}
+	for( c = 0; c < 4; ++c )
+	{
+		t = ep->code[0][c]; ep->code[0][c] = ep->code[1][c]; ep->code[1][c] = t;
+		t = ep->color[0][c]; ep->color[0][c] = ep->color[1][c]; ep->color[1][c] = t;
+	}
+	t = ep->pbit[0]; ep->pbit[0] = ep->pbit[1]; ep->pbit[1] = t;
+	for( i = 0; i < count; ++i )
+	{
+		indices[texels[i]] = (unsigned char)(max_index - indices[texels[i]]);
+	}
+}
+
+/*	appends bits to the block, least significant bit first	*/
+static void BC7_put_bits( unsigned char compressed[16], int *bit, int value, int count )
+{
+	while( count-- > 0 )
+	{
+		compressed[*bit >> 3] |= (unsigned char)((value & 1) << (*bit & 7));
+		value >>= 1;
+		++(*bit);
+	}
+}
+
+/*	squared error of the opaque estimate: what the best line through
+	each subset leaves over, for ranking the mode 1 partitions	*/
+static float BC7_partition_estimate( const unsigned char *const block, int partition )
+{
+	float total = 0.0f;
+	int s;
+	for( s = 0; s < 2; ++s )
+	{
+		float sum[3] = { 0.0f, 0.0f, 0.0f };
+		float sq[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+		float cov[6], axis[3], trace;
+		int i, iter, count = 0;
+		for( i = 0; i < 16; ++i )
+		{
+			if( ((BC7_partition2[partition] >> i) & 1) == s )
+			{
+				float r = block[i*4+0], g = block[i*4+1], b = block[i*4+2];
+				sum[0] += r;
+				sum[1] += g;
+				sum[2] += b;
+				sq[0] += r * r;
+				sq[1] += r * g;
+				sq[2] += r * b;
+				sq[3] += g * g;
+				sq[4] += g * b;
+				sq[5] += b * b;
+				++count;
+			}
+		}
+		/*	rr rg rb gg gb bb	*/
+		cov[0] = sq[0] - sum[0] * sum[0] / count;
+		cov[1] = sq[1] - sum[0] * sum[1] / count;
+		cov[2] = sq[2] - sum[0] * sum[2] / count;
+		cov[3] = sq[3] - sum[1] * sum[1] / count;
+		cov[4] = sq[4] - sum[1] * sum[2] / count;
+		cov[5] = sq[5] - sum[2] * sum[2] / count;
+		trace = cov[0] + cov[3] + cov[5];
+		axis[0] = axis[1] = axis[2] = 1.0f;
+		for( iter = 0; iter < 4; ++iter )
+		{
+			float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+			float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+			float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+			float len = x * x + y * y + z * z;
+			if( len < 1e-12f )
+			{
+				break;
+			}
+			len = 1.0f / (float)sqrt( len );
+			axis[0] = x * len;
+			axis[1] = y * len;
+			axis[2] = z * len;
+		}
+		/*	the variance off the principal axis	*/
+		total += trace -
+			( axis[0] * (cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2]) +
+			  axis[1] * (cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2]) +
+			  axis[2] * (cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2]) );
+	}
+	return total;
+}
+
+/********* Mode Encoders *********/
+static int BC7_encode_mode6(
+		const unsigned char *const block,
+		int quality,
+		unsigned char compressed[16] )
+{
+	static const int texels[16] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+	BC7_endpoints ep;
+	unsigned char indices[16];
+	int error, bit = 0, i, c;
+	error = BC7_fit_subset( block, texels, 16, &BC7_mode6, quality, &ep, indices );
+	BC7_fix_anchor( texels, 16, 0, 4, &ep, indices );
+	memset( compressed, 0, 16 );
+	BC7_put_bits( compressed, &bit, 1 << 6, 7 );
+	for( c = 0; c < 4; ++c )
+	{
+		BC7_put_bits( compressed, &bit, ep.code[0][c], 7 );
+		BC7_put_bits( compressed, &bit, ep.code[1][c], 7 );
+	}
+	BC7_put_bits( compressed, &bit, ep.pbit[0], 1 );
+	BC7_put_bits( compressed, &bit, ep.pbit[1], 1 );
+	for( i = 0; i < 16; ++i )
+	{
+		BC7_put_bits( compressed, &bit, indices[i], i == 0 ? 3 : 4 );
+	}
+	return error;
+}
+
+static int BC7_encode_mode1(
+		const unsigned char *const block,
+		int partition, int quality,
+		unsigned char compressed[16] )
+{
+	BC7_endpoints ep[2];
+	unsigned char indices[16];
+	int texels[2][16], count[2] = { 0, 0 };
+	int error = 0, bit = 0, i, s, c;
+	for( i = 0; i < 16; ++i )
+	{
+		s = (BC7_partition2[partition] >> i) & 1;
+		texels[s][count[s]++] = i;
+	}
+	for( s = 0; s < 2; ++s )
+	{
+		error += BC7_fit_subset( block, texels[s], count[s], &BC7_mode1, quality, &ep[s], indices );
+		BC7_fix_anchor( texels[s], count[s], s ? BC7_anchor2[partition] : 0, 3, &ep[s], indices );
+	}
+	memset( compressed, 0, 16 );
+	BC7_put_bits( compressed, &bit, 1 << 1, 2 );
+	BC7_put_bits( compressed, &bit, partition, 6 );
+	for( c = 0; c < 3; ++c )
+	{
+		for( s = 0; s < 2; ++s )
+		{
+			BC7_put_bits( compressed, &bit, ep[s].code[0][c], 6 );
+			BC7_put_bits( compressed, &bit, ep[s].code[1][c], 6 );
+		}
+	}
+	BC7_put_bits( compressed, &bit, ep[0].pbit[0], 1 );
+	BC7_put_bits( compressed, &bit, ep[1].pbit[0], 1 );
+	for( i = 0; i < 16; ++i )
+	{
+		int anchor = (i == 0) || (i == BC7_anchor2[partition]);
+		BC7_put_bits( compressed, &bit, indices[i], anchor ? 2 : 3 );
+	}
+	return error;
+}
+
+/********* Actual Exposed Functions *********/
+void
+	compress_BC7_block
+	(
+		const unsigned char *const uncompressed,
+		int quality,
+		unsigned char compressed[16]
+	)
+{
+	unsigned char trial[16];
+	int best_partitions[BC7_PARTITIONS_HIGH];
+	float best_estimates[BC7_PARTITIONS_HIGH];
+	int error, partitions, opaque = 1;
+	int i, p;
+	error = BC7_encode_mode6( uncompressed, quality, compressed );
+	if( (quality == DXT_QUALITY_FAST) || (error == 0) )
+	{
+		return;
+	}
+	/*	mode 1 has no alpha at all	*/
+	for( i = 3; i < 16*4; i += 4 )
+	{
+		opaque &= (uncompressed[i] == 255);
+	}
+	if( !opaque )
+	{
+		return;
+	}
+	/*	rank the partitions cheaply, then encode only the best few	*/
+	partitions = ( quality == DXT_QUALITY_HIGH ) ? BC7_PARTITIONS_HIGH : BC7_PARTITIONS_DEFAULT;
+	for( i = 0; i < partitions; ++i )
+	{
+		best_partitions[i] = -1;
+		best_estimates[i] = 1e30f;
+	}
+	for( p = 0; p < 64; ++p )
+	{
+		float estimate = BC7_partition_estimate( uncompressed, p );
+		for( i = partitions - 1; (i >= 0) && (estimate < best_estimates[i]); --i )
+		{
+			if( i + 1 < partitions )
+			{
+				best_partitions[i+1] = best_partitions[i];
+				best_estimates[i+1] = best_estimates[i];
+			}
+			best_partitions[i] = p;
+			best_estimates[i] = estimate;
+		}
+	}
+	for( i = 0; i < partitions; ++i )
+	{
+		int mode1_error = BC7_encode_mode1( uncompressed, best_partitions[i], quality, trial );
+		if( mode1_error < error )
+		{
+			error = mode1_error;
+			memcpy( compressed, trial, 16 );
+		}
+	}
+}
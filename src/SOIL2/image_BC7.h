@@ -0,0 +1,27 @@
+/*
+	BC7 (BPTC) block compression
+
+	public domain
+*/
+
+#ifndef HEADER_IMAGE_BC7
+#define HEADER_IMAGE_BC7
+
+/**
+	Compresses a 4x4 block of RGBA texels (16*4 bytes) into one
+	16 byte BC7 block, using one of the DXT_QUALITY_* levels.
+	DXT_QUALITY_FAST:		mode 6 only (one RGBA subset, 4 bit indices)
+	DXT_QUALITY_DEFAULT:	mode 6, plus mode 1 (two RGB subsets) for
+							opaque blocks on the best fitting partitions
+	DXT_QUALITY_HIGH:		as default, over more partitions and with
+							more endpoint refinement
+**/
+void
+compress_BC7_block
+(
+    const unsigned char *const uncompressed,
+    int quality,
+    unsigned char compressed[16]
+);
+
+#endif /* HEADER_IMAGE_BC7	*/
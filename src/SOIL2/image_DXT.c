@@ -8,17 +8,30 @@
 */
 
 #include "image_DXT.h"
+#include "image_BC7.h"
+#include "thread_helper.h"
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
+/*	SSE2 kernels for the per block color line search (RGBA blocks),
+	define DXT_NO_SIMD to use only the scalar code	*/
+#if !defined( DXT_NO_SIMD ) && ( defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 ) )
+#define DXT_SSE2
+#include <emmintrin.h>
+#endif
+
 /*	set this =1 if you want to use the covarince matrix method...
 	which is better than my method of using standard deviations
 	overall, except on the infintesimal chance that the power
 	method fails for finding the largest eigenvector	*/
 #define USE_COV_MAT	1
 
+/*	below this many 4x4 blocks per thread, spawning more
+	threads costs more than it saves	*/
+#define DXT_MIN_BLOCKS_PER_THREAD	1024
+
 /********* Function Prototypes *********/
 /*
 	Takes a 4x4 block of pixels and compresses it into 8 bytes
@@ -29,6 +42,27 @@ void compress_DDS_color_block(
 				int channels,
 				const unsigned char *const uncompressed,
 				unsigned char compressed[8] );
+/*
+	Stores the master colors enc_c0 and enc_c1 and places every
+	texel of the 4x4 block on the line between them.
+*/
+static void encode_DDS_color_block(
+				int channels,
+				const unsigned char *const uncompressed,
+				int enc_c0, int enc_c1,
+				unsigned char compressed[8] );
+/*
+	The fast (bounding box) and high quality (cluster fit)
+	alternatives to compress_DDS_color_block.
+*/
+static void compress_DDS_color_block_range_fit(
+				int channels,
+				const unsigned char *const uncompressed,
+				unsigned char compressed[8] );
+static void compress_DDS_color_block_cluster_fit(
+				int channels,
+				const unsigned char *const uncompressed,
+				unsigned char compressed[8] );
 /*
 	Takes a 4x4 block of pixels and compresses the alpha
 	component it into 8 bytes for use in DXT5 DDS files.
@@ -37,6 +71,24 @@ void compress_DDS_color_block(
 void compress_DDS_alpha_block(
 				const unsigned char *const uncompressed,
 				unsigned char compressed[8] );
+/*
+	Compresses one channel of a 4x4 RGBA block into 8 bytes,
+	the BC4 block (and half of a BC5 block).
+*/
+void compress_DDS_channel_block(
+				const unsigned char *const uncompressed,
+				int channel,
+				unsigned char compressed[8] );
+
+/*
+	Compresses the whole image, one row of 4x4 blocks per job,
+	to one of the DDS_FORMAT_* block formats.
+*/
+static unsigned char* convert_image_to_DXT(
+				const unsigned char *const uncompressed,
+				int width, int height, int channels,
+				int format, int quality,
+				int *out_size );
 
 /********* Actual Exposed Functions *********/
 int
@@ -46,29 +98,97 @@ int
 		int width, int height, int channels,
 		const unsigned char *const data
 	)
+{
+	return save_image_as_DDS_quality( filename, width, height, channels, data, DXT_QUALITY_DEFAULT );
+}
+
+int
+	save_image_as_DDS_quality
+	(
+		const char *filename,
+		int width, int height, int channels,
+		const unsigned char *const data,
+		int quality
+	)
+{
+	return save_image_as_DDS_format( filename, width, height, channels, data, DDS_FORMAT_AUTO, quality );
+}
+
+int
+	save_image_as_DDS_format
+	(
+		const char *filename,
+		int width, int height, int channels,
+		const unsigned char *const data,
+		int format, int quality
+	)
+{
+	return save_image_array_as_DDS( filename, width, height, channels, &data, 1, format, quality );
+}
+
+/*	the DX10 header's name for each block format	*/
+static unsigned int DDS_DXGI_format( int format, int srgb )
+{
+	switch( format )
+	{
+	case DDS_FORMAT_DXT1:
+		return srgb ? DDS_DXGI_FORMAT_BC1_UNORM_SRGB : DDS_DXGI_FORMAT_BC1_UNORM;
+	case DDS_FORMAT_BC4:
+		return DDS_DXGI_FORMAT_BC4_UNORM;
+	case DDS_FORMAT_BC5:
+		return DDS_DXGI_FORMAT_BC5_UNORM;
+	case DDS_FORMAT_BC7:
+		return srgb ? DDS_DXGI_FORMAT_BC7_UNORM_SRGB : DDS_DXGI_FORMAT_BC7_UNORM;
+	default:
+		return srgb ? DDS_DXGI_FORMAT_BC3_UNORM_SRGB : DDS_DXGI_FORMAT_BC3_UNORM;
+	}
+}
+
+int
+	save_image_array_as_DDS
+	(
+		const char *filename,
+		int width, int height, int channels,
+		const unsigned char *const *layers, int layer_count,
+		int format, int quality
+	)
 {
 	/*	variables	*/
 	FILE *fout;
 	unsigned char *DDS_data;
 	DDS_header header;
+	DDS_header_DX10 header_DX10;
 	int DDS_size;
+	int srgb, use_DX10, i;
 	/*	error check	*/
 	if( (NULL == filename) ||
 		(width < 1) || (height < 1) ||
 		(channels < 1) || (channels > 4) ||
-		(data == NULL ) )
+		(layers == NULL) || (layer_count < 1) )
 	{
 		return 0;
 	}
-	/*	Convert the image	*/
-	if( (channels & 1) == 1 )
+	for( i = 0; i < layer_count; ++i )
 	{
-		/*	no alpha, just use DXT1	*/
-		DDS_data = convert_image_to_DXT1( data, width, height, channels, &DDS_size );
-	} else
+		if( NULL == layers[i] )
+		{
+			return 0;
+		}
+	}
+	srgb = ( format & DDS_FORMAT_SRGB ) != 0;
+	format &= ~DDS_FORMAT_SRGB;
+	if( format == DDS_FORMAT_AUTO )
 	{
-		/*	has alpha, so use DXT5	*/
-		DDS_data = convert_image_to_DXT5( data, width, height, channels, &DDS_size );
+		/*	no alpha, just use DXT1, otherwise use DXT5	*/
+		format = ( (channels & 1) == 1 ) ? DDS_FORMAT_DXT1 : DDS_FORMAT_DXT5;
+	}
+	/*	BC7, sRGB and arrays have no legacy FourCC	*/
+	use_DX10 = ( format == DDS_FORMAT_BC7 ) || srgb || ( layer_count > 1 );
+	/*	Convert the first layer, the rest are converted as they are written	*/
+	DDS_data = convert_image_to_DXT( layers[0], width, height, channels, format, quality, &DDS_size );
+	if( NULL == DDS_data )
+	{
+		return 0;
 	}
 	/*	save it	*/
 	memset( &header, 0, sizeof( DDS_header ) );
@@ -80,21 +200,61 @@ int
 	header.dwPitchOrLinearSize = DDS_size;
 	header.sPixelFormat.dwSize = 32;
 	header.sPixelFormat.dwFlags = DDPF_FOURCC;
-	if( (channels & 1) == 1 )
+	if( use_DX10 )
 	{
-		header.sPixelFormat.dwFourCC = ('D' << 0) | ('X' << 8) | ('T' << 16) | ('1' << 24);
+		header.sPixelFormat.dwFourCC = ('D' << 0) | ('X' << 8) | ('1' << 16) | ('0' << 24);
 	} else
 	{
-		header.sPixelFormat.dwFourCC = ('D' << 0) | ('X' << 8) | ('T' << 16) | ('5' << 24);
+		switch( format )
+		{
+		case DDS_FORMAT_DXT1:
+			header.sPixelFormat.dwFourCC = ('D' << 0) | ('X' << 8) | ('T' << 16) | ('1' << 24);
+			break;
+		case DDS_FORMAT_BC4:
+			header.sPixelFormat.dwFourCC = ('A' << 0) | ('T' << 8) | ('I' << 16) | ('1' << 24);
+			break;
+		case DDS_FORMAT_BC5:
+			header.sPixelFormat.dwFourCC = ('A' << 0) | ('T' << 8) | ('I' << 16) | ('2' << 24);
+			break;
+		default:
+			header.sPixelFormat.dwFourCC = ('D' << 0) | ('X' << 8) | ('T' << 16) | ('5' << 24);
+			break;
+		}
 	}
 	header.sCaps.dwCaps1 = DDSCAPS_TEXTURE;
+	memset( &header_DX10, 0, sizeof( DDS_header_DX10 ) );
+	header_DX10.dxgiFormat = DDS_DXGI_format( format, srgb );
+	header_DX10.resourceDimension = DDS_DIMENSION_TEXTURE2D;
+	header_DX10.arraySize = layer_count;
 	/*	write it out	*/
 	fout = fopen( filename, "wb");
+	if( NULL == fout )
+	{
+		free( DDS_data );
+		return 0;
+	}
 	fwrite( &header, sizeof( DDS_header ), 1, fout );
-	fwrite( DDS_data, 1, DDS_size, fout );
+	if( use_DX10 )
+	{
+		fwrite( &header_DX10, sizeof( DDS_header_DX10 ), 1, fout );
+	}
+	for( i = 0; ; )
+	{
+		fwrite( DDS_data, 1, DDS_size, fout );
+		free( DDS_data );
+		if( ++i == layer_count )
+		{
+			break;
+		}
+		DDS_data = convert_image_to_DXT( layers[i], width, height, channels, format, quality, &DDS_size );
+		if( NULL == DDS_data )
+		{
+			fclose( fout );
+			return 0;
+		}
+	}
 	fclose( fout );
 	/*	done	*/
-	free( DDS_data );
 	return 1;
 }
 
@@ -103,175 +263,234 @@ unsigned char* convert_image_to_DXT1(
 		int width, int height, int channels,
 		int *out_size )
 {
+	return convert_image_to_DXT( uncompressed, width, height, channels, DDS_FORMAT_DXT1, DXT_QUALITY_DEFAULT, out_size );
+}
+
+unsigned char* convert_image_to_DXT1_quality(
+		const unsigned char *const uncompressed,
+		int width, int height, int channels,
+		int quality,
+		int *out_size )
+{
+	return convert_image_to_DXT( uncompressed, width, height, channels, DDS_FORMAT_DXT1, quality, out_size );
+}
+
+unsigned char* convert_image_to_DXT5(
+		const unsigned char *const uncompressed,
+		int width, int height, int channels,
+		int *out_size )
+{
+	return convert_image_to_DXT( uncompressed, width, height, channels, DDS_FORMAT_DXT5, DXT_QUALITY_DEFAULT, out_size );
+}
+
+unsigned char* convert_image_to_DXT5_quality(
+		const unsigned char *const uncompressed,
+		int width, int height, int channels,
+		int quality,
+		int *out_size )
+{
+	return convert_image_to_DXT( uncompressed, width, height, channels, DDS_FORMAT_DXT5, quality, out_size );
+}
+
+unsigned char* convert_image_to_BC4(
+		const unsigned char *const uncompressed,
+		int width, int height, int channels,
+		int *out_size )
+{
+	return convert_image_to_DXT( uncompressed, width, height, channels, DDS_FORMAT_BC4, DXT_QUALITY_DEFAULT, out_size );
+}
+
+unsigned char* convert_image_to_BC5(
+		const unsigned char *const uncompressed,
+		int width, int height, int channels,
+		int *out_size )
+{
+	return convert_image_to_DXT( uncompressed, width, height, channels, DDS_FORMAT_BC5, DXT_QUALITY_DEFAULT, out_size );
+}
+
+unsigned char* convert_image_to_BC7(
+		const unsigned char *const uncompressed,
+		int width, int height, int channels,
+		int quality,
+		int *out_size )
+{
+	return convert_image_to_DXT( uncompressed, width, height, channels, DDS_FORMAT_BC7, quality, out_size );
+}
+
+/********* Block Row Compression *********/
+/*	everything a worker needs to compress one row of 4x4 blocks	*/
+typedef struct
+{
+	const unsigned char *uncompressed;
+	int width, height, channels;
+	int format, quality;
+	void (*compress_color_block)( int channels,
+			const unsigned char *const uncompressed,
+			unsigned char compressed[8] );
+	int block_bytes;
+	int blocks_wide;
 	unsigned char *compressed;
-	int i, j, x, y;
-	unsigned char ublock[16*3];
-	unsigned char cblock[8];
-	int index = 0, chan_step = 1;
-	int block_count = 0;
-	/*	error check	*/
-	*out_size = 0;
-	if( (width < 1) || (height < 1) ||
-		(NULL == uncompressed) ||
-		(channels < 1) || (channels > 4) )
+}
+DXT_compress_job;
+
+/*
+	Copies the 4x4 block at (i,j) into ublock as RGBA (4 bytes per
+	texel, alpha is 255 for images without alpha), replicating the
+	first texel into the parts of the block that fall outside of
+	the image.
+*/
+static void extract_block(
+		const DXT_compress_job *job,
+		int i, int j,
+		unsigned char *ublock )
+{
+	const unsigned char *const uncompressed = job->uncompressed;
+	const int width = job->width;
+	const int channels = job->channels;
+	/*	for channels == 1 or 2, I do not step forward for R,G,B values	*/
+	const int chan_step = channels < 3 ? 0 : 1;
+	/*	# channels = 1 or 3 have no alpha, 2 & 4 do have alpha	*/
+	const int has_alpha = 1 - (channels & 1);
+	int x, y, c;
+	int idx = 0;
+	int mx = 4, my = 4;
+	if( j+4 >= job->height )
 	{
-		return NULL;
+		my = job->height - j;
 	}
-	/*	for channels == 1 or 2, I do not step forward for R,G,B values	*/
-	if( channels < 3 )
+	if( i+4 >= width )
 	{
-		chan_step = 0;
+		mx = width - i;
 	}
-	/*	get the RAM for the compressed image
-		(8 bytes per 4x4 pixel block)	*/
-	*out_size = ((width+3) >> 2) * ((height+3) >> 2) * 8;
-	compressed = (unsigned char*)malloc( *out_size );
-	/*	go through each block	*/
-	for( j = 0; j < height; j += 4 )
+	for( y = 0; y < my; ++y )
 	{
-		for( i = 0; i < width; i += 4 )
+		const unsigned char *row = uncompressed + ((j+y)*width + i)*channels;
+		for( x = 0; x < mx; ++x )
 		{
-			/*	copy this block into a new one	*/
-			int idx = 0;
-			int mx = 4, my = 4;
-			if( j+4 >= height )
-			{
-				my = height - j;
-			}
-			if( i+4 >= width )
-			{
-				mx = width - i;
-			}
-			for( y = 0; y < my; ++y )
-			{
-				for( x = 0; x < mx; ++x )
-				{
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels];
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels+chan_step];
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels+chan_step+chan_step];
-				}
-				for( x = mx; x < 4; ++x )
-				{
-					ublock[idx++] = ublock[0];
-					ublock[idx++] = ublock[1];
-					ublock[idx++] = ublock[2];
-				}
-			}
-			for( y = my; y < 4; ++y )
+			ublock[idx++] = row[x*channels];
+			ublock[idx++] = row[x*channels+chan_step];
+			ublock[idx++] = row[x*channels+chan_step+chan_step];
+			ublock[idx++] = has_alpha ? row[x*channels+channels-1] : 255;
+		}
+		for( x = mx; x < 4; ++x )
+		{
+			for( c = 0; c < 4; ++c )
 			{
-				for( x = 0; x < 4; ++x )
-				{
-					ublock[idx++] = ublock[0];
-					ublock[idx++] = ublock[1];
-					ublock[idx++] = ublock[2];
-				}
+				ublock[idx++] = ublock[c];
 			}
-			/*	compress the block	*/
-			++block_count;
-			compress_DDS_color_block( 3, ublock, cblock );
-			/*	copy the data from the block into the main block	*/
-			for( x = 0; x < 8; ++x )
+		}
+	}
+	for( y = my; y < 4; ++y )
+	{
+		for( x = 0; x < 4; ++x )
+		{
+			for( c = 0; c < 4; ++c )
 			{
-				compressed[index++] = cblock[x];
+				ublock[idx++] = ublock[c];
 			}
 		}
 	}
-	return compressed;
 }
 
-unsigned char* convert_image_to_DXT5(
+/*	compresses block row "block_row" straight into the output buffer	*/
+static void compress_DXT_block_row( void *arg, int block_row )
+{
+	const DXT_compress_job *job = (const DXT_compress_job*)arg;
+	unsigned char ublock[16*4];
+	unsigned char *out = job->compressed +
+			block_row * job->blocks_wide * job->block_bytes;
+	int i;
+	for( i = 0; i < job->width; i += 4 )
+	{
+		/*	DXT1 blocks are extracted as RGBA too, the color
+			encoder ignores alpha and has a SIMD path for 4 channels	*/
+		extract_block( job, i, block_row*4, ublock );
+		switch( job->format )
+		{
+		case DDS_FORMAT_DXT1:
+			job->compress_color_block( 4, ublock, out );
+			break;
+		case DDS_FORMAT_BC4:
+			/*	red (or luminance) through the DXT5 alpha block encoder	*/
+			compress_DDS_channel_block( ublock, 0, out );
+			break;
+		case DDS_FORMAT_BC5:
+			/*	red and green, or luminance and alpha for 2 channel images	*/
+			compress_DDS_channel_block( ublock, 0, out );
+			compress_DDS_channel_block( ublock, job->channels == 2 ? 3 : 1, out + 8 );
+			break;
+		case DDS_FORMAT_BC7:
+			compress_BC7_block( ublock, job->quality, out );
+			break;
+		default:
+			/*	alpha block first, then the color block	*/
+			compress_DDS_alpha_block( ublock, out );
+			job->compress_color_block( 4, ublock, out + 8 );
+			break;
+		}
+		out += job->block_bytes;
+	}
+}
+
+static unsigned char* convert_image_to_DXT(
 		const unsigned char *const uncompressed,
 		int width, int height, int channels,
+		int format, int quality,
 		int *out_size )
 {
-	unsigned char *compressed;
-	int i, j, x, y;
-	unsigned char ublock[16*4];
-	unsigned char cblock[8];
-	int index = 0, chan_step = 1;
-	int block_count = 0, has_alpha;
+	DXT_compress_job job;
+	int blocks_high, max_threads;
 	/*	error check	*/
 	*out_size = 0;
 	if( (width < 1) || (height < 1) ||
 		(NULL == uncompressed) ||
-		(channels < 1) || ( channels > 4) )
+		(channels < 1) || (channels > 4) )
 	{
 		return NULL;
 	}
-	/*	for channels == 1 or 2, I do not step forward for R,G,B vales	*/
-	if( channels < 3 )
+	job.uncompressed = uncompressed;
+	job.width = width;
+	job.height = height;
+	job.channels = channels;
+	job.format = format;
+	job.quality = quality;
+	switch( quality )
 	{
-		chan_step = 0;
+	case DXT_QUALITY_FAST:
+		job.compress_color_block = compress_DDS_color_block_range_fit;
+		break;
+	case DXT_QUALITY_HIGH:
+		job.compress_color_block = compress_DDS_color_block_cluster_fit;
+		break;
+	default:
+		job.compress_color_block = compress_DDS_color_block;
+		break;
 	}
-	/*	# channels = 1 or 3 have no alpha, 2 & 4 do have alpha	*/
-	has_alpha = 1 - (channels & 1);
-	/*	get the RAM for the compressed image
-		(16 bytes per 4x4 pixel block)	*/
-	*out_size = ((width+3) >> 2) * ((height+3) >> 2) * 16;
-	compressed = (unsigned char*)malloc( *out_size );
-	/*	go through each block	*/
-	for( j = 0; j < height; j += 4 )
-	{
-		for( i = 0; i < width; i += 4 )
-		{
-			/*	local variables, and my block counter	*/
-			int idx = 0;
-			int mx = 4, my = 4;
-			if( j+4 >= height )
-			{
-				my = height - j;
-			}
-			if( i+4 >= width )
-			{
-				mx = width - i;
-			}
-			for( y = 0; y < my; ++y )
-			{
-				for( x = 0; x < mx; ++x )
-				{
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels];
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels+chan_step];
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels+chan_step+chan_step];
-					ublock[idx++] =
-						has_alpha * uncompressed[(j+y)*width*channels+(i+x)*channels+channels-1]
-						+ (1-has_alpha)*255;
-				}
-				for( x = mx; x < 4; ++x )
-				{
-					ublock[idx++] = ublock[0];
-					ublock[idx++] = ublock[1];
-					ublock[idx++] = ublock[2];
-					ublock[idx++] = ublock[3];
-				}
-			}
-			for( y = my; y < 4; ++y )
-			{
-				for( x = 0; x < 4; ++x )
-				{
-					ublock[idx++] = ublock[0];
-					ublock[idx++] = ublock[1];
-					ublock[idx++] = ublock[2];
-					ublock[idx++] = ublock[3];
-				}
-			}
-			/*	now compress the alpha block	*/
-			compress_DDS_alpha_block( ublock, cblock );
-			/*	copy the data from the compressed alpha block into the main buffer	*/
-			for( x = 0; x < 8; ++x )
-			{
-				compressed[index++] = cblock[x];
-			}
-			/*	then compress the color block	*/
-			++block_count;
-			compress_DDS_color_block( 4, ublock, cblock );
-			/*	copy the data from the compressed color block into the main buffer	*/
-			for( x = 0; x < 8; ++x )
-			{
-				compressed[index++] = cblock[x];
-			}
-		}
+	/*	8 bytes per 4x4 pixel block for DXT1 and BC4, 16 for DXT5, BC5 and BC7	*/
+	job.block_bytes = ( format == DDS_FORMAT_DXT1 || format == DDS_FORMAT_BC4 ) ? 8 : 16;
+	job.blocks_wide = (width+3) >> 2;
+	blocks_high = (height+3) >> 2;
+	/*	get the RAM for the compressed image	*/
+	job.compressed = (unsigned char*)malloc( job.blocks_wide * blocks_high * job.block_bytes );
+	if( NULL == job.compressed )
+	{
+		return NULL;
+	}
+	*out_size = job.blocks_wide * blocks_high * job.block_bytes;
+	/*	every block row is independent, so hand them out to the
+		available cores (small images aren't worth a thread,
+		but BC7 blocks are far slower than the DXT ones)	*/
+	max_threads = (job.blocks_wide * blocks_high) /
+			( format == DDS_FORMAT_BC7 ? DXT_MIN_BLOCKS_PER_THREAD / 16 : DXT_MIN_BLOCKS_PER_THREAD );
+	if( max_threads < 1 )
+	{
+		max_threads = 1;
+	} else if( max_threads > get_hardware_thread_count() )
+	{
+		max_threads = get_hardware_thread_count();
 	}
-	return compressed;
+	run_parallel_jobs( blocks_high, max_threads, compress_DXT_block_row, &job );
+	return job.compressed;
 }
 
 /********* Helper Functions *********/
@@ -296,6 +515,122 @@ void rgb_888_from_565( unsigned int c, int *r, int *g, int *b )
 	*b = convert_bit_range( (c >> 00) & 31, 5, 8 );
 }
 
+#ifdef DXT_SSE2
+/*
+	Splits a 16 texel RGBA block into 16 bit R, G and B planes,
+	texels 0-7 in [0] and texels 8-15 in [1].
+*/
+static void load_block_planes_SSE2(
+		const unsigned char *const uncompressed,
+		__m128i r[2], __m128i g[2], __m128i b[2] )
+{
+	const __m128i zero = _mm_setzero_si128();
+	int half;
+	for( half = 0; half < 2; ++half )
+	{
+		__m128i v0 = _mm_loadu_si128( (const __m128i*)(uncompressed + half*32) );
+		__m128i v1 = _mm_loadu_si128( (const __m128i*)(uncompressed + half*32 + 16) );
+		/*	3 rounds of byte interleaving turn RGBA x 8 into RRRRRRRRGGGGGGGG, BBBBBBBBAAAAAAAA	*/
+		__m128i t0 = _mm_unpacklo_epi8( v0, v1 );
+		__m128i t1 = _mm_unpackhi_epi8( v0, v1 );
+		__m128i u0 = _mm_unpacklo_epi8( t0, t1 );
+		__m128i u1 = _mm_unpackhi_epi8( t0, t1 );
+		__m128i rg = _mm_unpacklo_epi8( u0, u1 );
+		__m128i ba = _mm_unpackhi_epi8( u0, u1 );
+		r[half] = _mm_unpacklo_epi8( rg, zero );
+		g[half] = _mm_unpackhi_epi8( rg, zero );
+		b[half] = _mm_unpacklo_epi8( ba, zero );
+	}
+}
+
+static int hsum_epi32_SSE2( __m128i v )
+{
+	v = _mm_add_epi32( v, _mm_shuffle_epi32( v, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+	v = _mm_add_epi32( v, _mm_shuffle_epi32( v, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+	return _mm_cvtsi128_si32( v );
+}
+
+/*	sum of a*b over all 16 texels	*/
+static int block_dot_SSE2( const __m128i a[2], const __m128i b[2] )
+{
+	return hsum_epi32_SSE2( _mm_add_epi32(
+			_mm_madd_epi16( a[0], b[0] ),
+			_mm_madd_epi16( a[1], b[1] ) ) );
+}
+
+/*
+	The integer sums needed for the covariance matrix of an RGBA block:
+	r, g, b, rr, gg, bb, rg, rb, gb.  They are exact, so they match the
+	scalar float accumulation bit for bit.
+*/
+static void block_color_sums_SSE2(
+		const unsigned char *const uncompressed,
+		int sums[9] )
+{
+	const __m128i ones = _mm_set1_epi16( 1 );
+	const __m128i one[2] = { ones, ones };
+	__m128i r[2], g[2], b[2];
+	load_block_planes_SSE2( uncompressed, r, g, b );
+	sums[0] = block_dot_SSE2( r, one );
+	sums[1] = block_dot_SSE2( g, one );
+	sums[2] = block_dot_SSE2( b, one );
+	sums[3] = block_dot_SSE2( r, r );
+	sums[4] = block_dot_SSE2( g, g );
+	sums[5] = block_dot_SSE2( b, b );
+	sums[6] = block_dot_SSE2( r, g );
+	sums[7] = block_dot_SSE2( r, b );
+	sums[8] = block_dot_SSE2( g, b );
+}
+
+/*
+	Projects all 16 texels of an RGBA block onto direction and returns
+	the smallest and largest dot products.  The products and sums are
+	done in the same order as the scalar code.
+*/
+static void block_dot_range_SSE2(
+		const unsigned char *const uncompressed,
+		const float direction[3],
+		float *dot_min, float *dot_max )
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 dr = _mm_set1_ps( direction[0] );
+	const __m128 dg = _mm_set1_ps( direction[1] );
+	const __m128 db = _mm_set1_ps( direction[2] );
+	__m128i r[2], g[2], b[2];
+	__m128 dot[4], vmin, vmax;
+	int i;
+	load_block_planes_SSE2( uncompressed, r, g, b );
+	for( i = 0; i < 4; ++i )
+	{
+		__m128i r32, g32, b32;
+		if( i & 1 )
+		{
+			r32 = _mm_unpackhi_epi16( r[i >> 1], zero );
+			g32 = _mm_unpackhi_epi16( g[i >> 1], zero );
+			b32 = _mm_unpackhi_epi16( b[i >> 1], zero );
+		} else
+		{
+			r32 = _mm_unpacklo_epi16( r[i >> 1], zero );
+			g32 = _mm_unpacklo_epi16( g[i >> 1], zero );
+			b32 = _mm_unpacklo_epi16( b[i >> 1], zero );
+		}
+		dot[i] = _mm_add_ps(
+				_mm_add_ps(
+					_mm_mul_ps( dr, _mm_cvtepi32_ps( r32 ) ),
+					_mm_mul_ps( dg, _mm_cvtepi32_ps( g32 ) ) ),
+				_mm_mul_ps( db, _mm_cvtepi32_ps( b32 ) ) );
+	}
+	vmin = _mm_min_ps( _mm_min_ps( dot[0], dot[1] ), _mm_min_ps( dot[2], dot[3] ) );
+	vmax = _mm_max_ps( _mm_max_ps( dot[0], dot[1] ), _mm_max_ps( dot[2], dot[3] ) );
+	vmin = _mm_min_ps( vmin, _mm_shuffle_ps( vmin, vmin, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+	vmin = _mm_min_ps( vmin, _mm_shuffle_ps( vmin, vmin, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+	vmax = _mm_max_ps( vmax, _mm_shuffle_ps( vmax, vmax, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+	vmax = _mm_max_ps( vmax, _mm_shuffle_ps( vmax, vmax, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+	*dot_min = _mm_cvtss_f32( vmin );
+	*dot_max = _mm_cvtss_f32( vmax );
+}
+#endif
+
 void compute_color_line_STDEV(
 		const unsigned char *const uncompressed,
 		int channels,
@@ -308,6 +643,22 @@ void compute_color_line_STDEV(
 	float sum_rg = 0.0f, sum_rb = 0.0f, sum_gb = 0.0f;
 	/*	calculate all data needed for the covariance matrix
 		( to compare with _rygdxt code)	*/
+#ifdef DXT_SSE2
+	if( channels == 4 )
+	{
+		int sums[9];
+		block_color_sums_SSE2( uncompressed, sums );
+		sum_r = (float)sums[0];
+		sum_g = (float)sums[1];
+		sum_b = (float)sums[2];
+		sum_rr = (float)sums[3];
+		sum_gg = (float)sums[4];
+		sum_bb = (float)sums[5];
+		sum_rg = (float)sums[6];
+		sum_rb = (float)sums[7];
+		sum_gb = (float)sums[8];
+	} else
+#endif
 	for( i = 0; i < 16*channels; i += channels )
 	{
 		sum_r += uncompressed[i+0];
@@ -431,27 +782,35 @@ void LSE_master_colors_max_min(
 	vec_len2 = 1.0f / ( 0.00001f +
 			sum_x2[0]*sum_x2[0] + sum_x2[1]*sum_x2[1] + sum_x2[2]*sum_x2[2] );
 	/*	finding the max and min vector values	*/
-	dot_max =
-			(
-				sum_x2[0] * uncompressed[0] +
-				sum_x2[1] * uncompressed[1] +
-				sum_x2[2] * uncompressed[2]
-			);
-	dot_min = dot_max;
-	for( i = 1; i < 16; ++i )
-	{
-		dot =
-			(
-				sum_x2[0] * uncompressed[i*channels+0] +
-				sum_x2[1] * uncompressed[i*channels+1] +
-				sum_x2[2] * uncompressed[i*channels+2]
-			);
-		if( dot < dot_min )
-		{
-			dot_min = dot;
-		} else if( dot > dot_max )
-		{
-			dot_max = dot;
+#ifdef DXT_SSE2
+	if( channels == 4 )
+	{
+		block_dot_range_SSE2( uncompressed, sum_x2, &dot_min, &dot_max );
+	} else
+#endif
+	{
+		dot_max =
+				(
+					sum_x2[0] * uncompressed[0] +
+					sum_x2[1] * uncompressed[1] +
+					sum_x2[2] * uncompressed[2]
+				);
+		dot_min = dot_max;
+		for( i = 1; i < 16; ++i )
+		{
+			dot =
+				(
+					sum_x2[0] * uncompressed[i*channels+0] +
+					sum_x2[1] * uncompressed[i*channels+1] +
+					sum_x2[2] * uncompressed[i*channels+2]
+				);
+			if( dot < dot_min )
+			{
+				dot_min = dot;
+			} else if( dot > dot_max )
+			{
+				dot_max = dot;
+			}
 		}
 	}
 	/*	and the offset (from the average location)	*/
@@ -504,18 +863,30 @@ void
 		const unsigned char *const uncompressed,
 		unsigned char compressed[8]
 	)
+{
+	/*	get the master colors	*/
+	int enc_c0, enc_c1;
+	LSE_master_colors_max_min( &enc_c0, &enc_c1, channels, uncompressed );
+	encode_DDS_color_block( channels, uncompressed, enc_c0, enc_c1, compressed );
+}
+
+static void
+	encode_DDS_color_block
+	(
+		int channels,
+		const unsigned char *const uncompressed,
+		int enc_c0, int enc_c1,
+		unsigned char compressed[8]
+	)
 {
 	/*	variables	*/
 	int i;
 	int next_bit;
-	int enc_c0, enc_c1;
 	int c0[4], c1[4];
 	float color_line[] = { 0.0f, 0.0f, 0.0f, 0.0f };
 	float vec_len2 = 0.0f, dot_offset = 0.0f;
 	/*	stupid order	*/
 	int swizzle4[] = { 0, 2, 3, 1 };
-	/*	get the master colors	*/
-	LSE_master_colors_max_min( &enc_c0, &enc_c1, channels, uncompressed );
 	/*	store the 565 color 0 and color 1	*/
 	compressed[0] = (enc_c0 >> 0) & 255;
 	compressed[1] = (enc_c0 >> 8) & 255;
@@ -574,6 +945,301 @@ void
 	/*	done compressing to DXT1	*/
 }
 
+/*
+	Range fit: the master colors are the corners of the (slightly inset)
+	bounding box of the block.  No line fitting at all, so it is very
+	fast, but the box diagonal can miss the actual color line.
+*/
+static void
+	compress_DDS_color_block_range_fit
+	(
+		int channels,
+		const unsigned char *const uncompressed,
+		unsigned char compressed[8]
+	)
+{
+	int i, c, major = 0;
+	int cmin[3] = { 255, 255, 255 };
+	int cmax[3] = { 0, 0, 0 };
+	int mid[3], covariance[3] = { 0, 0, 0 };
+	int enc_c0, enc_c1;
+	/*	find the bounding box	*/
+	for( i = 0; i < 16*channels; i += channels )
+	{
+		const int r = uncompressed[i+0];
+		const int g = uncompressed[i+1];
+		const int b = uncompressed[i+2];
+		cmin[0] = r < cmin[0] ? r : cmin[0];
+		cmax[0] = r > cmax[0] ? r : cmax[0];
+		cmin[1] = g < cmin[1] ? g : cmin[1];
+		cmax[1] = g > cmax[1] ? g : cmax[1];
+		cmin[2] = b < cmin[2] ? b : cmin[2];
+		cmax[2] = b > cmax[2] ? b : cmax[2];
+	}
+	/*	the diagonal from min to max assumes all channels rise together,
+		so flip any channel that falls while the widest channel rises	*/
+	for( c = 0; c < 3; ++c )
+	{
+		mid[c] = cmin[c] + cmax[c];
+		if( cmax[c] - cmin[c] > cmax[major] - cmin[major] )
+		{
+			major = c;
+		}
+	}
+	for( i = 0; i < 16*channels; i += channels )
+	{
+		const int m = 2*uncompressed[i+major] - mid[major];
+		covariance[0] += m * (2*uncompressed[i+0] - mid[0]);
+		covariance[1] += m * (2*uncompressed[i+1] - mid[1]);
+		covariance[2] += m * (2*uncompressed[i+2] - mid[2]);
+	}
+	for( c = 0; c < 3; ++c )
+	{
+		if( covariance[c] < 0 )
+		{
+			int temp = cmin[c];
+			cmin[c] = cmax[c];
+			cmax[c] = temp;
+		}
+	}
+	/*	inset the box by 1/16th, the ends are rarely hit exactly	*/
+	for( c = 0; c < 3; ++c )
+	{
+		int inset = (cmax[c] - cmin[c]) / 16;
+		cmin[c] += inset;
+		cmax[c] -= inset;
+	}
+	enc_c0 = rgb_to_565( cmax[0], cmax[1], cmax[2] );
+	enc_c1 = rgb_to_565( cmin[0], cmin[1], cmin[2] );
+	/*	c0 > c1 selects the 4 color mode	*/
+	if( enc_c0 < enc_c1 )
+	{
+		int temp = enc_c0;
+		enc_c0 = enc_c1;
+		enc_c1 = temp;
+	}
+	encode_DDS_color_block( channels, uncompressed, enc_c0, enc_c1, compressed );
+}
+
+/*
+	Stores the master colors and, for every texel, the index of the
+	closest of the 4 palette colors.
+	\return the total squared error of the encoded block
+*/
+static int
+	encode_DDS_color_block_best_match
+	(
+		int channels,
+		const unsigned char *const uncompressed,
+		int enc_c0, int enc_c1,
+		unsigned char compressed[8]
+	)
+{
+	int palette[4][3];
+	int i, p, c;
+	int total_error = 0;
+	rgb_888_from_565( enc_c0, &palette[0][0], &palette[0][1], &palette[0][2] );
+	rgb_888_from_565( enc_c1, &palette[1][0], &palette[1][1], &palette[1][2] );
+	for( c = 0; c < 3; ++c )
+	{
+		palette[2][c] = (2*palette[0][c] + palette[1][c] + 1) / 3;
+		palette[3][c] = (palette[0][c] + 2*palette[1][c] + 1) / 3;
+	}
+	compressed[0] = (enc_c0 >> 0) & 255;
+	compressed[1] = (enc_c0 >> 8) & 255;
+	compressed[2] = (enc_c1 >> 0) & 255;
+	compressed[3] = (enc_c1 >> 8) & 255;
+	compressed[4] = 0;
+	compressed[5] = 0;
+	compressed[6] = 0;
+	compressed[7] = 0;
+	for( i = 0; i < 16; ++i )
+	{
+		int best = 0, best_error = 0x7FFFFFFF;
+		/*	with equal master colors only index 0 is well defined	*/
+		int palette_size = ( enc_c0 == enc_c1 ) ? 1 : 4;
+		for( p = 0; p < palette_size; ++p )
+		{
+			int error = 0;
+			for( c = 0; c < 3; ++c )
+			{
+				int d = uncompressed[i*channels+c] - palette[p][c];
+				error += d*d;
+			}
+			if( error < best_error )
+			{
+				best_error = error;
+				best = p;
+			}
+		}
+		total_error += best_error;
+		compressed[4 + (i >> 2)] |= best << ((i & 3) * 2);
+	}
+	return total_error;
+}
+
+/*	rounds an 8 bit [0,255] float channel to its 5 or 6 bit grid value	*/
+static float quantize_to_565_grid( float value, int bits )
+{
+	int q;
+	const float scale = (bits == 6) ? (63.0f / 255.0f) : (31.0f / 255.0f);
+	if( value < 0.0f )
+	{
+		value = 0.0f;
+	} else if( value > 255.0f )
+	{
+		value = 255.0f;
+	}
+	q = (int)(value * scale + 0.5f);
+	return (float)convert_bit_range( q, bits, 8 );
+}
+
+/*
+	Cluster fit (after Simon Brown's squish): sort the texels along the
+	color line, then try every way of splitting that order into the 4
+	palette entries, solving the least squares master colors for each
+	split.  Slow, but the best quality, meant for offline baking.
+*/
+static void
+	compress_DDS_color_block_cluster_fit
+	(
+		int channels,
+		const unsigned char *const uncompressed,
+		unsigned char compressed[8]
+	)
+{
+	const int grid_bits[3] = { 5, 6, 5 };
+	float point[3], axis[3];
+	float prefix[17][3];
+	float best_error = 1e30f;
+	int order[16];
+	int best_c0, best_c1;
+	int i, j, k, c, iteration;
+	unsigned char candidate[8];
+	/*	the default encoder is the baseline to beat	*/
+	LSE_master_colors_max_min( &best_c0, &best_c1, channels, uncompressed );
+	best_error = (float)encode_DDS_color_block_best_match(
+			channels, uncompressed, best_c0, best_c1, compressed );
+	if( best_error <= 0.0f )
+	{
+		return;
+	}
+	compute_color_line_STDEV( uncompressed, channels, point, axis );
+	for( iteration = 0; iteration < 2; ++iteration )
+	{
+		float dots[16];
+		float iteration_best = 1e30f;
+		float best_a[3], best_b[3];
+		/*	sort the texels along the axis (insertion sort, only 16)	*/
+		for( i = 0; i < 16; ++i )
+		{
+			dots[i] =
+				axis[0] * uncompressed[i*channels+0] +
+				axis[1] * uncompressed[i*channels+1] +
+				axis[2] * uncompressed[i*channels+2];
+			for( j = i; (j > 0) && (dots[order[j-1]] > dots[i]); --j )
+			{
+				order[j] = order[j-1];
+			}
+			order[j] = i;
+		}
+		/*	prefix sums of the sorted colors	*/
+		prefix[0][0] = prefix[0][1] = prefix[0][2] = 0.0f;
+		for( i = 0; i < 16; ++i )
+		{
+			for( c = 0; c < 3; ++c )
+			{
+				prefix[i+1][c] = prefix[i][c] + uncompressed[order[i]*channels+c];
+			}
+		}
+		/*	clusters are [0,i) [i,j) [j,k) [k,16)	*/
+		for( i = 0; i <= 16; ++i )
+		{
+			for( j = i; j <= 16; ++j )
+			{
+				for( k = j; k <= 16; ++k )
+				{
+					/*	sums of alpha^2, beta^2 and alpha*beta over the texels	*/
+					const float alpha2 = i + (4.0f/9.0f) * (j - i) + (1.0f/9.0f) * (k - j);
+					const float beta2 = (1.0f/9.0f) * (j - i) + (4.0f/9.0f) * (k - j) + (16 - k);
+					const float alphabeta = (2.0f/9.0f) * (k - i);
+					float alphax[3], betax[3], a[3], b[3];
+					float factor, error;
+					factor = alpha2 * beta2 - alphabeta * alphabeta;
+					if( factor <= 0.0f )
+					{
+						/*	all texels in one cluster, a single color	*/
+						continue;
+					}
+					factor = 1.0f / factor;
+					error = 0.0f;
+					for( c = 0; c < 3; ++c )
+					{
+						const float s0 = prefix[i][c];
+						const float s1 = prefix[j][c] - prefix[i][c];
+						const float s2 = prefix[k][c] - prefix[j][c];
+						const float s3 = prefix[16][c] - prefix[k][c];
+						/*	color 0 has weight 1, 2/3, 1/3, 0 in the 4 clusters	*/
+						alphax[c] = s0 + (2.0f/3.0f) * s1 + (1.0f/3.0f) * s2;
+						betax[c] = (1.0f/3.0f) * s1 + (2.0f/3.0f) * s2 + s3;
+						a[c] = quantize_to_565_grid(
+								(alphax[c] * beta2 - betax[c] * alphabeta) * factor,
+								grid_bits[c] );
+						b[c] = quantize_to_565_grid(
+								(betax[c] * alpha2 - alphax[c] * alphabeta) * factor,
+								grid_bits[c] );
+						/*	squared error, less the constant sum of x^2	*/
+						error +=
+							a[c] * a[c] * alpha2 + b[c] * b[c] * beta2 +
+							2.0f * (a[c] * b[c] * alphabeta -
+							a[c] * alphax[c] - b[c] * betax[c]);
+					}
+					if( error < iteration_best )
+					{
+						iteration_best = error;
+						for( c = 0; c < 3; ++c )
+						{
+							best_a[c] = a[c];
+							best_b[c] = b[c];
+						}
+					}
+				}
+			}
+		}
+		if( iteration_best < 1e30f )
+		{
+			/*	encode the winner for real, and keep it if it beats the rest	*/
+			int enc_c0 = rgb_to_565( (int)best_a[0], (int)best_a[1], (int)best_a[2] );
+			int enc_c1 = rgb_to_565( (int)best_b[0], (int)best_b[1], (int)best_b[2] );
+			float error;
+			if( enc_c0 < enc_c1 )
+			{
+				int temp = enc_c0;
+				enc_c0 = enc_c1;
+				enc_c1 = temp;
+			}
+			error = (float)encode_DDS_color_block_best_match(
+					channels, uncompressed, enc_c0, enc_c1, candidate );
+			if( error < best_error )
+			{
+				best_error = error;
+				memcpy( compressed, candidate, 8 );
+			} else
+			{
+				break;
+			}
+			/*	refine the sort order with the new color line	*/
+			for( c = 0; c < 3; ++c )
+			{
+				axis[c] = best_a[c] - best_b[c];
+			}
+		} else
+		{
+			break;
+		}
+	}
+}
+
 void
 	compress_DDS_alpha_block
 	(
@@ -610,9 +1276,10 @@ void
 	compressed[5] = 0;
 	compressed[6] = 0;
 	compressed[7] = 0;
-	/*	store the all of the alpha values	*/
+	/*	store the all of the alpha values
+		(a flat block stores index 1, which is a1 == a0)	*/
 	next_bit = 8*2;
-	scale_me = 7.9999f / (a0 - a1);
+	scale_me = ( a0 > a1 ) ? 7.9999f / (a0 - a1) : 0.0f;
 	for( i = 3; i < 16*4; i += 4 )
 	{
 		/*	convert this alpha value to a 3 bit number	*/
@@ -630,3 +1297,21 @@ void
 	}
 	/*	done compressing to DXT1	*/
 }
+
+void
+	compress_DDS_channel_block
+	(
+		const unsigned char *const uncompressed,
+		int channel,
+		unsigned char compressed[8]
+	)
+{
+	/*	move the channel into the alpha slot the alpha encoder reads	*/
+	unsigned char ublock[16*4];
+	int i;
+	for( i = 0; i < 16; ++i )
+	{
+		ublock[i*4+3] = uncompressed[i*4+channel];
+	}
+	compress_DDS_alpha_block( ublock, compressed );
+}
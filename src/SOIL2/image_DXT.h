@@ -10,6 +10,39 @@
 #ifndef HEADER_IMAGE_DXT
 #define HEADER_IMAGE_DXT
 
+/**
+	DXT encoder quality levels.
+	DXT_QUALITY_FAST:		bounding box range fit, for runtime streaming
+	DXT_QUALITY_DEFAULT:	color line fit (the original SOIL encoder)
+	DXT_QUALITY_HIGH:		cluster fit, for offline baking (much slower)
+**/
+enum
+{
+	DXT_QUALITY_FAST = 0,
+	DXT_QUALITY_DEFAULT = 1,
+	DXT_QUALITY_HIGH = 2
+};
+
+/**
+	Block compressed formats written by save_image_as_DDS_format.
+	DDS_FORMAT_AUTO:	DXT1 for 1 and 3 channel images, DXT5 for 2 and 4
+	DDS_FORMAT_BC4:		first channel only ( red / luminance ), FourCC ATI1
+	DDS_FORMAT_BC5:		the first two channels as red and green, FourCC ATI2
+	DDS_FORMAT_BC7:		RGBA at 8 bits per pixel, written with a DX10 header
+	DDS_FORMAT_SRGB:	can be OR'd with DXT1, DXT5 or BC7 to tag the data
+						as sRGB, which needs a DX10 header too
+**/
+enum
+{
+	DDS_FORMAT_AUTO = 0,
+	DDS_FORMAT_DXT1 = 1,
+	DDS_FORMAT_DXT5 = 2,
+	DDS_FORMAT_BC4 = 3,
+	DDS_FORMAT_BC5 = 4,
+	DDS_FORMAT_BC7 = 5,
+	DDS_FORMAT_SRGB = 256
+};
+
 /**
 	Converts an image from an array of unsigned chars (RGB or RGBA) to
 	DXT1 or DXT5, then saves the converted image to disk.
@@ -23,6 +56,47 @@ save_image_as_DDS
     const unsigned char *const data
 );
 
+/**
+	Same as save_image_as_DDS, with one of the DXT_QUALITY_* levels.
+	\return 0 if failed, otherwise returns 1
+**/
+int
+save_image_as_DDS_quality
+(
+    const char *filename,
+    int width, int height, int channels,
+    const unsigned char *const data,
+    int quality
+);
+
+/**
+	Same as save_image_as_DDS_quality, but writes one of the
+	DDS_FORMAT_* block formats.
+	\return 0 if failed, otherwise returns 1
+**/
+int
+save_image_as_DDS_format
+(
+    const char *filename,
+    int width, int height, int channels,
+    const unsigned char *const data,
+    int format, int quality
+);
+
+/**
+	Saves layer_count images of the same size and channel count as
+	one DDS texture array ( DX10 header with arraySize = layer_count ).
+	\return 0 if failed, otherwise returns 1
+**/
+int
+save_image_array_as_DDS
+(
+    const char *filename,
+    int width, int height, int channels,
+    const unsigned char *const *layers, int layer_count,
+    int format, int quality
+);
+
 /**
 	take an image and convert it to DXT1 (no alpha)
 **/
@@ -34,6 +108,19 @@ convert_image_to_DXT1
     int *out_size
 );
 
+/**
+	take an image and convert it to DXT1 (no alpha)
+	using one of the DXT_QUALITY_* levels
+**/
+unsigned char*
+convert_image_to_DXT1_quality
+(
+    const unsigned char *const uncompressed,
+    int width, int height, int channels,
+    int quality,
+    int *out_size
+);
+
 /**
 	take an image and convert it to DXT5 (with alpha)
 **/
@@ -45,6 +132,55 @@ convert_image_to_DXT5
     int *out_size
 );
 
+/**
+	take an image and convert it to DXT5 (with alpha)
+	using one of the DXT_QUALITY_* levels
+**/
+unsigned char*
+convert_image_to_DXT5_quality
+(
+    const unsigned char *const uncompressed,
+    int width, int height, int channels,
+    int quality,
+    int *out_size
+);
+
+/**
+	take an image and convert its first channel to BC4 (RGTC1)
+**/
+unsigned char*
+convert_image_to_BC4
+(
+    const unsigned char *const uncompressed,
+    int width, int height, int channels,
+    int *out_size
+);
+
+/**
+	take an image and convert its first two channels to BC5 (RGTC2),
+	stored and sampled as red and green
+**/
+unsigned char*
+convert_image_to_BC5
+(
+    const unsigned char *const uncompressed,
+    int width, int height, int channels,
+    int *out_size
+);
+
+/**
+	take an image and convert it to BC7 (RGBA, 8 bits per pixel)
+	using one of the DXT_QUALITY_* levels
+**/
+unsigned char*
+convert_image_to_BC7
+(
+    const unsigned char *const uncompressed,
+    int width, int height, int channels,
+    int quality,
+    int *out_size
+);
+
 /**	A bunch of DirectDraw Surface structures and flags **/
 typedef struct
 {
@@ -85,6 +221,17 @@ typedef struct
 }
 DDS_header ;
 
+/**	follows DDS_header when the FourCC is "DX10"	**/
+typedef struct
+{
+    unsigned int    dxgiFormat;
+    unsigned int    resourceDimension;
+    unsigned int    miscFlag;
+    unsigned int    arraySize;
+    unsigned int    miscFlags2;
+}
+DDS_header_DX10 ;
+
 /*	the following constants were copied directly off the MSDN website	*/
 
 /*	The dwFlags member of the original DDSURFACEDESC2 structure
@@ -120,4 +267,24 @@ DDS_header ;
 #define DDSCAPS2_CUBEMAP_NEGATIVEZ	0x00008000
 #define DDSCAPS2_VOLUME	0x00200000
 
+/*	The block compressed DXGI_FORMAT values of the DX10 header	*/
+#define DDS_DXGI_FORMAT_BC1_UNORM	71
+#define DDS_DXGI_FORMAT_BC1_UNORM_SRGB	72
+#define DDS_DXGI_FORMAT_BC2_UNORM	74
+#define DDS_DXGI_FORMAT_BC2_UNORM_SRGB	75
+#define DDS_DXGI_FORMAT_BC3_UNORM	77
+#define DDS_DXGI_FORMAT_BC3_UNORM_SRGB	78
+#define DDS_DXGI_FORMAT_BC4_UNORM	80
+#define DDS_DXGI_FORMAT_BC4_SNORM	81
+#define DDS_DXGI_FORMAT_BC5_UNORM	83
+#define DDS_DXGI_FORMAT_BC5_SNORM	84
+#define DDS_DXGI_FORMAT_BC6H_UF16	95
+#define DDS_DXGI_FORMAT_BC6H_SF16	96
+#define DDS_DXGI_FORMAT_BC7_UNORM	98
+#define DDS_DXGI_FORMAT_BC7_UNORM_SRGB	99
+
+/*	The resourceDimension and miscFlag members of the DX10 header	*/
+#define DDS_DIMENSION_TEXTURE2D	3
+#define DDS_RESOURCE_MISC_TEXTURECUBE	0x00000004
+
 #endif /* HEADER_IMAGE_DXT	*/
@@ -3,7 +3,11 @@
  * Quick Notes:
  * 	Based on a javascript jpeg writer
  * 	JPEG baseline (no JPEG progressive)
- * 	Supports 1, 3 or 4 component input. (luminance, RGB or RGBX)
+ * 	Supports 1, 2, 3 or 4 component input. (luminance, luminance + alpha, RGB or RGBX)
+ * 	Writes to a file, a callback or a memory buffer
+ * 	The DCT and the quantization use SSE2 where available, define JO_JPEG_NO_SIMD to avoid it
+ * 	Big images are encoded in bands on all cores with thread_helper.h, define JO_JPEG_NO_PARALLEL to avoid it
+ * 	Optional 4:2:0 chroma subsampling and Huffman tables optimized for the image, see JO_JPEG_SUBSAMPLE and JO_JPEG_OPTIMIZE
  *
  * Latest revisions:
  *	1.53 (2016-07-08) Added support to compile as plain C code.
@@ -16,7 +20,9 @@
  *
  * Basic usage:
  *	char *foo = new char[128*128*4]; // 4 component. RGBX format, where X is unused 
- *	jo_write_jpg("foo.jpg", foo, 128, 128, 4, 90); // comp can be 1, 3, or 4. Lum, RGB, or RGBX respectively.
+ *	jo_write_jpg("foo.jpg", foo, 128, 128, 4, 90); // comp can be 1, 2, 3, or 4. Lum, LumX, RGB, or RGBX respectively.
+ *	jo_write_jpg_ex("foo.jpg", foo, 128, 128, 4, 75, JO_JPEG_SUBSAMPLE | JO_JPEG_OPTIMIZE); // smallest files
+ *	int len; unsigned char *jpg = jo_write_jpg_to_mem(foo, 128, 128, 4, 90, 0, &len); // release with free()
  * 	
  * */
 
@@ -30,6 +36,25 @@
 // Returns false on failure
 extern int jo_write_jpg(const char *filename, const void *data, int width, int height, int comp, int quality);
 
+// Flags for the writers below, or them together. Without any the output is
+// the same as jo_write_jpg's: 4:4:4 with the standard Huffman tables.
+// 4:2:0, Cb and Cr at half the resolution both ways: much smaller files, slightly softer color edges
+#define JO_JPEG_SUBSAMPLE 1
+// a first pass over the image counts the symbols to build Huffman tables for it: a bit smaller, about half as fast
+#define JO_JPEG_OPTIMIZE 2
+
+// Returns false on failure
+extern int jo_write_jpg_ex(const char *filename, const void *data, int width, int height, int comp, int quality, int flags);
+
+// Gets the encoded file in order, a piece at a time
+typedef void jo_write_func(void *context, void *data, int size);
+
+// Returns false on failure
+extern int jo_write_jpg_to_func(jo_write_func *func, void *context, const void *data, int width, int height, int comp, int quality, int flags);
+
+// Returns the whole file in a buffer to release with free(), or NULL on failure
+extern unsigned char *jo_write_jpg_to_mem(const void *data, int width, int height, int comp, int quality, int flags, int *out_len);
+
 #endif // JO_INCLUDE_JPEG_H
 
 #ifndef JO_JPEG_HEADER_FILE_ONLY
@@ -40,24 +65,109 @@ extern int jo_write_jpg(const char *filename, const void *data, int width, int h
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
+// define JO_JPEG_NO_PARALLEL to encode on the calling thread only
+#ifndef JO_JPEG_NO_PARALLEL
+#include "thread_helper.h"
+#endif
+
+#if !defined(JO_JPEG_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define JO_JPEG_SSE2
+#include <emmintrin.h>
+#endif
+
 static const unsigned char s_jo_ZigZag[] = { 0,1,5,6,14,15,27,28,2,4,7,13,16,26,29,42,3,8,12,17,25,30,41,43,9,11,18,24,31,40,44,53,10,19,23,32,39,45,52,54,20,22,33,38,46,51,55,60,21,34,37,47,50,56,59,61,35,36,48,49,57,58,62,63 };
 
-static void jo_writeBits(FILE *fp, int *bitBuf, int *bitCnt, const unsigned short *bs) {
-	*bitCnt += bs[1];
-	*bitBuf |= bs[0] << (24 - *bitCnt);
-	while(*bitCnt >= 8) {
-		unsigned char c = (*bitBuf >> 16) & 255;
-		putc(c, fp);
+// The encoded bytes collect here. With a func they are handed over each time
+// the buffer fills up, without one the buffer grows to hold the whole file.
+typedef struct {
+	jo_write_func *func;
+	void *context;
+	unsigned char *data;
+	int size, capacity, failed;
+	unsigned int bitBuf;
+	int bitCnt;
+} jo_output;
+
+#define JO_OUTPUT_CHUNK (64*1024)
+
+// Makes room for n more bytes, returns false when out of memory
+static int jo_reserve(jo_output *o, int n) {
+	if(o->failed) {
+		return 0;
+	}
+	if(o->size + n <= o->capacity) {
+		return 1;
+	}
+	if(o->func && o->size) {
+		o->func(o->context, o->data, o->size);
+		o->size = 0;
+		if(n <= o->capacity) {
+			return 1;
+		}
+	}
+	int capacity = o->capacity ? o->capacity : JO_OUTPUT_CHUNK;
+	while(capacity < o->size + n) {
+		capacity *= 2;
+	}
+	unsigned char *data = (unsigned char *)realloc(o->data, capacity);
+	if(!data) {
+		o->failed = 1;
+		return 0;
+	}
+	o->data = data;
+	o->capacity = capacity;
+	return 1;
+}
+
+static void jo_putBytes(jo_output *o, const void *p, int n) {
+	if(jo_reserve(o, n)) {
+		memcpy(o->data + o->size, p, n);
+		o->size += n;
+	}
+}
+
+static void jo_putc(jo_output *o, unsigned char c) {
+	jo_putBytes(o, &c, 1);
+}
+
+// Works on local copies of the output state, so the compiler can keep it in
+// registers while a block is written; the room must have been reserved
+typedef struct {
+	unsigned char *out;
+	unsigned int bitBuf;
+	int bitCnt;
+} jo_bitWriter;
+
+static void jo_writeBits(jo_bitWriter *w, const unsigned short *bs) {
+	w->bitCnt += bs[1];
+	w->bitBuf |= (unsigned int)bs[0] << (24 - w->bitCnt);
+	while(w->bitCnt >= 8) {
+		unsigned char c = (w->bitBuf >> 16) & 255;
+		*w->out++ = c;
 		if(c == 255) {
-			putc(0, fp);
+			*w->out++ = 0;
 		}
-		*bitBuf <<= 8;
-		*bitCnt -= 8;
+		w->bitBuf <<= 8;
+		w->bitCnt -= 8;
 	}
 }
 
+static void jo_beginBits(jo_output *o, jo_bitWriter *w) {
+	w->out = o->data + o->size;
+	w->bitBuf = o->bitBuf;
+	w->bitCnt = o->bitCnt;
+}
+
+static void jo_endBits(jo_output *o, const jo_bitWriter *w) {
+	o->size = (int)(w->out - o->data);
+	o->bitBuf = w->bitBuf;
+	o->bitCnt = w->bitCnt;
+}
+
+#ifndef JO_JPEG_SSE2
 static void jo_DCT(float *d0, float *d1, float *d2, float *d3, float *d4, float *d5, float *d6, float *d7) {
 	float tmp0 = *d0 + *d7;
 	float tmp7 = *d0 - *d7;
@@ -100,6 +210,7 @@ static void jo_DCT(float *d0, float *d1, float *d2, float *d3, float *d4, float
 	*d1 = z11 + z4;
 	*d7 = z11 - z4;
 } 
+#endif
 
 static void jo_calcBits(int val, unsigned short bits[2]) {
 	int tmp1 = val < 0 ? -val : val;
@@ -111,11 +222,106 @@ static void jo_calcBits(int val, unsigned short bits[2]) {
 	bits[0] = val & ((1<<bits[1])-1);
 }
 
-static int jo_processDU(FILE *fp, int *bitBuf, int *bitCnt, float *CDU, float *fdtbl, int DC, const unsigned short HTDC[256][2], const unsigned short HTAC[256][2]) {
-	const unsigned short EOB[2] = { HTAC[0x00][0], HTAC[0x00][1] };
-	const unsigned short M16zeroes[2] = { HTAC[0xF0][0], HTAC[0xF0][1] };
-	int dataOff, i, nrmarker;
-	
+
+#ifdef JO_JPEG_SSE2
+// jo_DCT on four columns at once, with the very same operations so the
+// result does not depend on the path taken
+static void jo_DCT_SSE2(__m128 *d) {
+	__m128 tmp0 = _mm_add_ps(d[0], d[7]);
+	__m128 tmp7 = _mm_sub_ps(d[0], d[7]);
+	__m128 tmp1 = _mm_add_ps(d[1], d[6]);
+	__m128 tmp6 = _mm_sub_ps(d[1], d[6]);
+	__m128 tmp2 = _mm_add_ps(d[2], d[5]);
+	__m128 tmp5 = _mm_sub_ps(d[2], d[5]);
+	__m128 tmp3 = _mm_add_ps(d[3], d[4]);
+	__m128 tmp4 = _mm_sub_ps(d[3], d[4]);
+
+	// Even part
+	__m128 tmp10 = _mm_add_ps(tmp0, tmp3);
+	__m128 tmp13 = _mm_sub_ps(tmp0, tmp3);
+	__m128 tmp11 = _mm_add_ps(tmp1, tmp2);
+	__m128 tmp12 = _mm_sub_ps(tmp1, tmp2);
+
+	d[0] = _mm_add_ps(tmp10, tmp11);
+	d[4] = _mm_sub_ps(tmp10, tmp11);
+
+	__m128 z1 = _mm_mul_ps(_mm_add_ps(tmp12, tmp13), _mm_set1_ps(0.707106781f));
+	d[2] = _mm_add_ps(tmp13, z1);
+	d[6] = _mm_sub_ps(tmp13, z1);
+
+	// Odd part
+	tmp10 = _mm_add_ps(tmp4, tmp5);
+	tmp11 = _mm_add_ps(tmp5, tmp6);
+	tmp12 = _mm_add_ps(tmp6, tmp7);
+
+	__m128 z5 = _mm_mul_ps(_mm_sub_ps(tmp10, tmp12), _mm_set1_ps(0.382683433f));
+	__m128 z2 = _mm_add_ps(_mm_mul_ps(tmp10, _mm_set1_ps(0.541196100f)), z5);
+	__m128 z4 = _mm_add_ps(_mm_mul_ps(tmp12, _mm_set1_ps(1.306562965f)), z5);
+	__m128 z3 = _mm_mul_ps(tmp11, _mm_set1_ps(0.707106781f));
+
+	__m128 z11 = _mm_add_ps(tmp7, z3);
+	__m128 z13 = _mm_sub_ps(tmp7, z3);
+
+	d[5] = _mm_add_ps(z13, z2);
+	d[3] = _mm_sub_ps(z13, z2);
+	d[1] = _mm_add_ps(z11, z4);
+	d[7] = _mm_sub_ps(z11, z4);
+}
+
+// L holds the left four columns of the block, R the right four
+static void jo_transpose8(__m128 *L, __m128 *R) {
+	int i;
+	_MM_TRANSPOSE4_PS(L[0], L[1], L[2], L[3]);
+	_MM_TRANSPOSE4_PS(L[4], L[5], L[6], L[7]);
+	_MM_TRANSPOSE4_PS(R[0], R[1], R[2], R[3]);
+	_MM_TRANSPOSE4_PS(R[4], R[5], R[6], R[7]);
+	// the top right and bottom left quarters trade places
+	for(i = 0; i < 4; ++i) {
+		__m128 t = R[i];
+		R[i] = L[i+4];
+		L[i+4] = t;
+	}
+}
+#endif
+
+// DCT of the 8x8 block at src, whose rows are stride floats apart, then
+// quantize/descale it into DU in zigzag order
+static void jo_fdctQuantize(const float *src, int stride, const float *fdtbl, int *DU) {
+	int i;
+#ifdef JO_JPEG_SSE2
+	const __m128 half = _mm_set1_ps(0.5f), sign = _mm_set1_ps(-0.0f);
+	__m128 L[8], R[8];
+	int q[64];
+	for(i = 0; i < 8; ++i) {
+		L[i] = _mm_loadu_ps(src + i*stride);
+		R[i] = _mm_loadu_ps(src + i*stride + 4);
+	}
+	// DCT rows: as columns of the transposed block
+	jo_transpose8(L, R);
+	jo_DCT_SSE2(L);
+	jo_DCT_SSE2(R);
+	jo_transpose8(L, R);
+	// DCT columns
+	jo_DCT_SSE2(L);
+	jo_DCT_SSE2(R);
+	// round half away from zero: truncate after adding 0.5 with the sign of v
+	for(i = 0; i < 8; ++i) {
+		__m128 l = _mm_mul_ps(L[i], _mm_loadu_ps(fdtbl + i*8));
+		__m128 r = _mm_mul_ps(R[i], _mm_loadu_ps(fdtbl + i*8 + 4));
+		l = _mm_add_ps(l, _mm_or_ps(_mm_and_ps(l, sign), half));
+		r = _mm_add_ps(r, _mm_or_ps(_mm_and_ps(r, sign), half));
+		_mm_storeu_si128((__m128i *)(q + i*8), _mm_cvttps_epi32(l));
+		_mm_storeu_si128((__m128i *)(q + i*8 + 4), _mm_cvttps_epi32(r));
+	}
+	for(i = 0; i < 64; ++i) {
+		DU[s_jo_ZigZag[i]] = q[i];
+	}
+#else
+	float CDU[64];
+	int dataOff;
+	for(i = 0; i < 8; ++i) {
+		memcpy(CDU + i*8, src + i*stride, 8*sizeof(float));
+	}
 	// DCT rows
 	for(dataOff=0; dataOff<64; dataOff+=8) {
 		jo_DCT(&CDU[dataOff], &CDU[dataOff+1], &CDU[dataOff+2], &CDU[dataOff+3], &CDU[dataOff+4], &CDU[dataOff+5], &CDU[dataOff+6], &CDU[dataOff+7]);
@@ -125,21 +331,34 @@ static int jo_processDU(FILE *fp, int *bitBuf, int *bitCnt, float *CDU, float *f
 		jo_DCT(&CDU[dataOff], &CDU[dataOff+8], &CDU[dataOff+16], &CDU[dataOff+24], &CDU[dataOff+32], &CDU[dataOff+40], &CDU[dataOff+48], &CDU[dataOff+56]);
 	}
 	// Quantize/descale/zigzag the coefficients
-	int DU[64];
 	for(i=0; i<64; ++i) {
 		float v = CDU[i]*fdtbl[i];
 		DU[s_jo_ZigZag[i]] = (int)(v < 0 ? ceilf(v - 0.5f) : floorf(v + 0.5f));
 	}
+#endif
+}
+
+static int jo_encodeDU(jo_output *o, const int *DU, int DC, const unsigned short HTDC[256][2], const unsigned short HTAC[256][2]) {
+	const unsigned short EOB[2] = { HTAC[0x00][0], HTAC[0x00][1] };
+	const unsigned short M16zeroes[2] = { HTAC[0xF0][0], HTAC[0xF0][1] };
+	int i, nrmarker;
+	jo_bitWriter w;
+
+	// a block is at most 64 codes of up to 27 bits, twice that with 0xFF stuffing
+	if(!jo_reserve(o, 512)) {
+		return DU[0];
+	}
+	jo_beginBits(o, &w);
 
 	// Encode DC
 	int diff = DU[0] - DC; 
 	if (diff == 0) {
-		jo_writeBits(fp, bitBuf, bitCnt, HTDC[0]);
+		jo_writeBits(&w, HTDC[0]);
 	} else {
 		unsigned short bits[2];
 		jo_calcBits(diff, bits);
-		jo_writeBits(fp, bitBuf, bitCnt, HTDC[bits[1]]);
-		jo_writeBits(fp, bitBuf, bitCnt, bits);
+		jo_writeBits(&w, HTDC[bits[1]]);
+		jo_writeBits(&w, bits);
 	}
 	// Encode ACs
 	int end0pos = 63;
@@ -147,7 +366,8 @@ static int jo_processDU(FILE *fp, int *bitBuf, int *bitCnt, float *CDU, float *f
 	}
 	// end0pos = first element in reverse order !=0
 	if(end0pos == 0) {
-		jo_writeBits(fp, bitBuf, bitCnt, EOB);
+		jo_writeBits(&w, EOB);
+		jo_endBits(o, &w);
 		return DU[0];
 	}
 	for(i = 1; i <= end0pos; ++i) {
@@ -158,21 +378,329 @@ static int jo_processDU(FILE *fp, int *bitBuf, int *bitCnt, float *CDU, float *f
 		if ( nrzeroes >= 16 ) {
 			int lng = nrzeroes>>4;
 			for (nrmarker=1; nrmarker <= lng; ++nrmarker)
-				jo_writeBits(fp, bitBuf, bitCnt, M16zeroes);
+				jo_writeBits(&w, M16zeroes);
 			nrzeroes &= 15;
 		}
 		unsigned short bits[2];
 		jo_calcBits(DU[i], bits);
-		jo_writeBits(fp, bitBuf, bitCnt, HTAC[(nrzeroes<<4)+bits[1]]);
-		jo_writeBits(fp, bitBuf, bitCnt, bits);
+		jo_writeBits(&w, HTAC[(nrzeroes<<4)+bits[1]]);
+		jo_writeBits(&w, bits);
 	}
 	if(end0pos != 63) {
-		jo_writeBits(fp, bitBuf, bitCnt, EOB);
+		jo_writeBits(&w, EOB);
 	}
+	jo_endBits(o, &w);
 	return DU[0];
 }
 
-int jo_write_jpg(const char *filename, const void *data, int width, int height, int comp, int quality) {
+// How often each symbol of the luminance [0] and chrominance [1] tables is
+// written, with room for the reserved symbol 256 of jo_buildHuffman
+typedef struct {
+	unsigned long long dc[2][257], ac[2][257];
+} jo_huffCounts;
+
+// Counts the symbols jo_encodeDU would write for the block
+static int jo_countDU(const int *DU, int DC, unsigned long long *dcFreq, unsigned long long *acFreq) {
+	unsigned short bits[2];
+	int i, diff = DU[0] - DC;
+	if(diff == 0) {
+		dcFreq[0]++;
+	} else {
+		jo_calcBits(diff, bits);
+		dcFreq[bits[1]]++;
+	}
+	int end0pos = 63;
+	for(; (end0pos>0)&&(DU[end0pos]==0); --end0pos) {
+	}
+	for(i = 1; i <= end0pos; ++i) {
+		int startpos = i;
+		for (; DU[i]==0; ++i) {
+		}
+		int nrzeroes = i-startpos;
+		acFreq[0xF0] += nrzeroes>>4;
+		jo_calcBits(DU[i], bits);
+		acFreq[((nrzeroes&15)<<4)+bits[1]]++;
+	}
+	if(end0pos != 63) {
+		acFreq[0]++;
+	}
+	return DU[0];
+}
+
+// Builds an optimal Huffman table for the counts with codes of at most 16
+// bits (JPEG spec annex K.2). Fills the code counts by length and the
+// symbols for the DHT segment, and the codes in HT, returns the symbol count.
+static int jo_buildHuffman(const unsigned long long *counts, unsigned char nrcodes[17], unsigned char values[256], unsigned short HT[256][2]) {
+	unsigned long long freq[257];
+	int codesize[257], others[257], bits[258];
+	int i, j, n, code;
+	for(i = 0; i < 256; ++i) {
+		freq[i] = counts[i];
+		codesize[i] = 0;
+		others[i] = -1;
+	}
+	// a reserved symbol takes the longest code, so that no code is all 1 bits
+	freq[256] = 1;
+	codesize[256] = 0;
+	others[256] = -1;
+	for(;;) {
+		// merge the two least frequent trees, c1 is the larger symbol of ties
+		int c1 = -1, c2 = -1;
+		unsigned long long v = ~0ull;
+		for(i = 0; i < 257; ++i) {
+			if(freq[i] && freq[i] <= v) {
+				v = freq[i];
+				c1 = i;
+			}
+		}
+		v = ~0ull;
+		for(i = 0; i < 257; ++i) {
+			if(freq[i] && freq[i] <= v && i != c1) {
+				v = freq[i];
+				c2 = i;
+			}
+		}
+		if(c2 < 0) {
+			break;
+		}
+		freq[c1] += freq[c2];
+		freq[c2] = 0;
+		++codesize[c1];
+		while(others[c1] >= 0) {
+			c1 = others[c1];
+			++codesize[c1];
+		}
+		others[c1] = c2;
+		++codesize[c2];
+		while(others[c2] >= 0) {
+			c2 = others[c2];
+			++codesize[c2];
+		}
+	}
+	memset(bits, 0, sizeof(bits));
+	for(i = 0; i < 257; ++i) {
+		if(codesize[i]) {
+			bits[codesize[i]]++;
+		}
+	}
+	// move pairs of codes that are too long up, one of them replacing a
+	// shorter code that moves down with the other
+	for(i = 257; i > 16; --i) {
+		while(bits[i] > 0) {
+			for(j = i - 2; bits[j] == 0; --j) {
+			}
+			bits[i] -= 2;
+			bits[i-1]++;
+			bits[j+1] += 2;
+			bits[j]--;
+		}
+	}
+	for(i = 16; bits[i] == 0; --i) {
+	}
+	bits[i]--; // the reserved symbol
+	nrcodes[0] = 0;
+	for(i = 1; i <= 16; ++i) {
+		nrcodes[i] = (unsigned char)bits[i];
+	}
+	// the symbols by code length, before the limit, then by value
+	for(n = 0, i = 1; i <= 257; ++i) {
+		for(j = 0; j < 256; ++j) {
+			if(codesize[j] == i) {
+				values[n++] = (unsigned char)j;
+			}
+		}
+	}
+	memset(HT, 0, 256*sizeof(HT[0]));
+	for(code = 0, n = 0, i = 1; i <= 16; ++i, code <<= 1) {
+		for(j = 0; j < bits[i]; ++j, ++n, ++code) {
+			HT[values[n]][0] = (unsigned short)code;
+			HT[values[n]][1] = (unsigned short)i;
+		}
+	}
+	return n;
+}
+
+// Converts rows y0 to y0+rows-1 to Y, Cb and Cr planes pw floats wide,
+// repeating the last column and the last row to fill whole blocks
+static void jo_convertRows(const unsigned char *imageData, int width, int height, int comp, int y0, int rows, int pw, float *Y, float *U, float *V) {
+	int ofsG = comp > 2 ? 1 : 0, ofsB = comp > 2 ? 2 : 0;
+	int row, col;
+	for(row = 0; row < rows; ++row) {
+		const unsigned char *p = imageData + (size_t)(y0+row < height ? y0+row : height-1)*width*comp;
+		float *y = Y + row*pw, *u = U + row*pw, *v = V + row*pw;
+		for(col = 0; col < width; ++col, p += comp) {
+			float r = p[0], g = p[ofsG], b = p[ofsB];
+			y[col]=+0.29900f*r+0.58700f*g+0.11400f*b-128;
+			u[col]=-0.16874f*r-0.33126f*g+0.50000f*b;
+			v[col]=+0.50000f*r-0.41869f*g-0.08131f*b;
+		}
+		for(; col < pw; ++col) {
+			y[col] = y[width-1];
+			u[col] = u[width-1];
+			v[col] = v[width-1];
+		}
+	}
+}
+
+// What the blocks of one image are encoded with
+typedef struct {
+	const unsigned char *imageData;
+	int width, height, comp, subsample;
+	const float *fdtbl_Y, *fdtbl_UV;
+	const unsigned short (*YDC_HT)[2], (*YAC_HT)[2], (*UVDC_HT)[2], (*UVAC_HT)[2];
+} jo_encoder;
+
+// Encodes the block at src, or only counts its symbols when counts is set,
+// returns its DC to predict the next one from
+static int jo_processDU(jo_output *o, jo_huffCounts *counts, const jo_encoder *e, const float *src, int stride, int chroma, int DC) {
+	int DU[64];
+	jo_fdctQuantize(src, stride, chroma ? e->fdtbl_UV : e->fdtbl_Y, DU);
+	if(counts) {
+		return jo_countDU(DU, DC, counts->dc[chroma], counts->ac[chroma]);
+	}
+	return jo_encodeDU(o, DU, DC, chroma ? e->UVDC_HT : e->YDC_HT, chroma ? e->UVAC_HT : e->YAC_HT);
+}
+
+// Averages each 2x2 pixels of 16 rows pw floats wide into 8 rows pw/2 wide
+static void jo_downsample(const float *src, int pw, float *dst) {
+	int row, col;
+	for(row = 0; row < 8; ++row, src += 2*pw, dst += pw/2) {
+		for(col = 0; col < pw/2; ++col) {
+			dst[col] = (src[2*col] + src[2*col+1] + src[pw+2*col] + src[pw+2*col+1]) * 0.25f;
+		}
+	}
+}
+
+// Encodes the rows of MCUs that start at pixel rows y_begin to y_end-1,
+// with the DC predictions starting from 0, or with counts set only counts
+// their symbols. Returns false when out of memory.
+static int jo_encodeRows(jo_output *o, jo_huffCounts *counts, const jo_encoder *e, int y_begin, int y_end) {
+	int DCY=0, DCU=0, DCV=0;
+	int mcuSize = e->subsample ? 16 : 8;
+	int x, y, pw = (e->width + mcuSize-1) & ~(mcuSize-1);
+	// with 4:2:0 there are two more planes for the halved Cb and Cr
+	float *planes = (float *)malloc((3*mcuSize*pw + (e->subsample ? 8*pw : 0)) * sizeof(float));
+	if(!planes) {
+		o->failed = 1;
+		return 0;
+	}
+	float *YP = planes, *UP = planes + mcuSize*pw, *VP = planes + 2*mcuSize*pw;
+	for(y = y_begin; y < y_end; y += mcuSize) {
+		jo_convertRows(e->imageData, e->width, e->height, e->comp, y, mcuSize, pw, YP, UP, VP);
+		if(e->subsample) {
+			float *UH = planes + 3*mcuSize*pw, *VH = UH + 4*pw;
+			jo_downsample(UP, pw, UH);
+			jo_downsample(VP, pw, VH);
+			for(x = 0; x < e->width; x += 16) {
+				DCY = jo_processDU(o, counts, e, YP + x, pw, 0, DCY);
+				DCY = jo_processDU(o, counts, e, YP + x + 8, pw, 0, DCY);
+				DCY = jo_processDU(o, counts, e, YP + 8*pw + x, pw, 0, DCY);
+				DCY = jo_processDU(o, counts, e, YP + 8*pw + x + 8, pw, 0, DCY);
+				DCU = jo_processDU(o, counts, e, UH + x/2, pw/2, 1, DCU);
+				DCV = jo_processDU(o, counts, e, VH + x/2, pw/2, 1, DCV);
+			}
+		} else {
+			for(x = 0; x < e->width; x += 8) {
+				DCY = jo_processDU(o, counts, e, YP + x, pw, 0, DCY);
+				DCU = jo_processDU(o, counts, e, UP + x, pw, 1, DCU);
+				DCV = jo_processDU(o, counts, e, VP + x, pw, 1, DCV);
+			}
+		}
+	}
+	free(planes);
+	return !o->failed;
+}
+
+// Pads the last byte with 1 bits, as needed before a marker
+static void jo_flushBits(jo_output *o) {
+	static const unsigned short fillBits[] = {0x7F, 7};
+	if(jo_reserve(o, 4)) {
+		jo_bitWriter w;
+		jo_beginBits(o, &w);
+		jo_writeBits(&w, fillBits);
+		jo_endBits(o, &w);
+	}
+	o->bitBuf = 0;
+	o->bitCnt = 0;
+}
+
+#ifndef JO_JPEG_NO_PARALLEL
+// Bands of MCU rows are encoded by separate threads, each into its own
+// buffer. They are independent since the decoder resets the DC predictions at
+// the restart marker between two bands.
+typedef struct {
+	const jo_encoder *e;
+	int bandHeight, firstBand, bandCount;
+	jo_output *bands;
+	jo_huffCounts *counts; // one per band when only counting
+} jo_bandJobs;
+
+static void jo_bandJob(void *arg, int job) {
+	jo_bandJobs *j = (jo_bandJobs *)arg;
+	jo_output *o = &j->bands[job];
+	int y_begin = (j->firstBand + job) * j->bandHeight;
+	int y_end = y_begin + j->bandHeight < j->e->height ? y_begin + j->bandHeight : j->e->height;
+	memset(o, 0, sizeof(*o));
+	if(j->counts) {
+		memset(&j->counts[job], 0, sizeof(jo_huffCounts));
+		jo_encodeRows(o, &j->counts[job], j->e, y_begin, y_end);
+	} else if(jo_encodeRows(o, NULL, j->e, y_begin, y_end)) {
+		jo_flushBits(o);
+	}
+}
+
+// Encodes the bands a few per thread at a time, so the buffers stay small,
+// and writes them with a restart marker between each two. With total set
+// only adds up their symbol counts there.
+static void jo_encodeBands(jo_output *o, const jo_encoder *e, int threads, int bandHeight, int bandCount, jo_huffCounts *total) {
+	int groupSize = threads * 4, first, band, k, i;
+	jo_output *bands = (jo_output *)calloc(groupSize, sizeof(jo_output));
+	jo_huffCounts *counts = total ? (jo_huffCounts *)malloc(groupSize * sizeof(jo_huffCounts)) : NULL;
+	if(!bands || (total && !counts)) {
+		free(bands);
+		free(counts);
+		o->failed = 1;
+		return;
+	}
+	jo_bandJobs j;
+	j.e = e;
+	j.bandHeight = bandHeight;
+	j.bands = bands;
+	j.counts = counts;
+	for(first = 0; first < bandCount && !o->failed; first += groupSize) {
+		j.firstBand = first;
+		j.bandCount = bandCount - first < groupSize ? bandCount - first : groupSize;
+		run_parallel_jobs(j.bandCount, threads, jo_bandJob, &j);
+		for(band = 0; band < j.bandCount; ++band) {
+			if(bands[band].failed) {
+				o->failed = 1;
+			} else if(total) {
+				for(k = 0; k < 2; ++k) {
+					for(i = 0; i < 257; ++i) {
+						total->dc[k][i] += counts[band].dc[k][i];
+						total->ac[k][i] += counts[band].ac[k][i];
+					}
+				}
+			} else {
+				if(first + band) {
+					jo_putc(o, 0xFF);
+					jo_putc(o, (unsigned char)(0xD0 + (first + band - 1) % 8)); // RSTn
+				}
+				jo_putBytes(o, bands[band].data, bands[band].size);
+			}
+			free(bands[band].data);
+		}
+	}
+	free(counts);
+	free(bands);
+}
+#endif
+
+static int jo_validArgs(const void *data, int width, int height, int comp) {
+	return data && width > 0 && height > 0 && width <= 0xFFFF && height <= 0xFFFF && comp >= 1 && comp <= 4;
+}
+
+static int jo_write_jpg_core(jo_output *o, const void *data, int width, int height, int comp, int quality, int flags) {
 	// Constants that don't pollute global namespace
 	static const unsigned char std_dc_luminance_nrcodes[] = {0,0,1,5,1,1,1,1,1,1,0,0,0,0,0,0,0};
 	static const unsigned char std_dc_luminance_values[] = {0,1,2,3,4,5,6,7,8,9,10,11};
@@ -240,14 +768,9 @@ int jo_write_jpg(const char *filename, const void *data, int width, int height,
 	static const int YQT[] = {16,11,10,16,24,40,51,61,12,12,14,19,26,58,60,55,14,13,16,24,40,57,69,56,14,17,22,29,51,87,80,62,18,22,37,56,68,109,103,77,24,35,55,64,81,104,113,92,49,64,78,87,103,121,120,101,72,92,95,98,112,100,103,99};
 	static const int UVQT[] = {17,18,24,47,99,99,99,99,18,21,26,66,99,99,99,99,24,26,56,99,99,99,99,99,47,66,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99};
 	static const float aasf[] = { 1.0f * 2.828427125f, 1.387039845f * 2.828427125f, 1.306562965f * 2.828427125f, 1.175875602f * 2.828427125f, 1.0f * 2.828427125f, 0.785694958f * 2.828427125f, 0.541196100f * 2.828427125f, 0.275899379f * 2.828427125f };
-	int i, row, col, x, y, k, pos;
+	int i, row, col, k;
 	
-	if(!data || !filename || !width || !height || comp > 4 || comp < 1 || comp == 2) {
-		return 0;
-	}
-
-	FILE *fp = fopen(filename, "wb");
-	if(!fp) {
+	if(!jo_validArgs(data, width, height, comp)) {
 		return 0;
 	}
 
@@ -271,70 +794,157 @@ int jo_write_jpg(const char *filename, const void *data, int width, int height,
 		}
 	}
 
+	jo_encoder e;
+	e.imageData = (const unsigned char *)data;
+	e.width = width;
+	e.height = height;
+	e.comp = comp;
+	e.subsample = (flags & JO_JPEG_SUBSAMPLE) != 0;
+	e.fdtbl_Y = fdtbl_Y;
+	e.fdtbl_UV = fdtbl_UV;
+	e.YDC_HT = YDC_HT;
+	e.YAC_HT = YAC_HT;
+	e.UVDC_HT = UVDC_HT;
+	e.UVAC_HT = UVAC_HT;
+#ifndef JO_JPEG_NO_PARALLEL
+	// Big images on more than one core are cut into bands of 8 MCU rows
+	// with a restart marker after each, and the bands encoded in parallel
+	int threads = 1;
+	int mcuSize = e.subsample ? 16 : 8;
+	int mcusPerRow = (width + mcuSize - 1) / mcuSize;
+	int bandRows = 65535 / mcusPerRow < 8 ? 65535 / mcusPerRow : 8;
+	int bandCount = (height + bandRows*mcuSize - 1) / (bandRows*mcuSize);
+	if((size_t)width * height >= 512*512 && bandCount > 1) {
+		threads = get_hardware_thread_count();
+	}
+#endif
+
+	// The Huffman tables, the standard ones or built from what a first pass
+	// over the image counts
+	const unsigned char *nrcodes[4] = { std_dc_luminance_nrcodes, std_ac_luminance_nrcodes, std_dc_chrominance_nrcodes, std_ac_chrominance_nrcodes };
+	const unsigned char *values[4] = { std_dc_luminance_values, std_ac_luminance_values, std_dc_chrominance_values, std_ac_chrominance_values };
+	int valueCounts[4] = { (int)sizeof(std_dc_luminance_values), (int)sizeof(std_ac_luminance_values), (int)sizeof(std_dc_chrominance_values), (int)sizeof(std_ac_chrominance_values) };
+	unsigned char optNrcodes[4][17], optValues[4][256];
+	unsigned short optHT[4][256][2];
+	if(flags & JO_JPEG_OPTIMIZE) {
+		jo_huffCounts counts;
+		memset(&counts, 0, sizeof(counts));
+#ifndef JO_JPEG_NO_PARALLEL
+		if(threads > 1) {
+			jo_encodeBands(o, &e, threads, bandRows*mcuSize, bandCount, &counts);
+		} else
+#endif
+		{
+			jo_encodeRows(o, &counts, &e, 0, height);
+		}
+		if(o->failed) {
+			return 0;
+		}
+		for(i = 0; i < 4; ++i) {
+			valueCounts[i] = jo_buildHuffman(i & 1 ? counts.ac[i>>1] : counts.dc[i>>1], optNrcodes[i], optValues[i], optHT[i]);
+			nrcodes[i] = optNrcodes[i];
+			values[i] = optValues[i];
+		}
+		e.YDC_HT = (const unsigned short (*)[2])optHT[0];
+		e.YAC_HT = (const unsigned short (*)[2])optHT[1];
+		e.UVDC_HT = (const unsigned short (*)[2])optHT[2];
+		e.UVAC_HT = (const unsigned short (*)[2])optHT[3];
+	}
+
 	// Write Headers
 	static const unsigned char head0[] = { 0xFF,0xD8,0xFF,0xE0,0,0x10,'J','F','I','F',0,1,1,0,0,1,0,1,0,0,0xFF,0xDB,0,0x84,0 };
-	fwrite(head0, sizeof(head0), 1, fp);
-	fwrite(YTable, sizeof(YTable), 1, fp);
-	putc(1, fp);
-	fwrite(UVTable, sizeof(UVTable), 1, fp);
-	const unsigned char head1[] = { 0xFF,0xC0,0,0x11,8,(unsigned char)(height>>8),(unsigned char)(height&0xFF),(unsigned char)(width>>8),(unsigned char)(width&0xFF),3,1,0x11,0,2,0x11,1,3,0x11,1,0xFF,0xC4,0x01,0xA2,0 };
-	fwrite(head1, sizeof(head1), 1, fp);
-	fwrite(std_dc_luminance_nrcodes+1, sizeof(std_dc_luminance_nrcodes)-1, 1, fp);
-	fwrite(std_dc_luminance_values, sizeof(std_dc_luminance_values), 1, fp);
-	putc(0x10, fp); // HTYACinfo
-	fwrite(std_ac_luminance_nrcodes+1, sizeof(std_ac_luminance_nrcodes)-1, 1, fp);
-	fwrite(std_ac_luminance_values, sizeof(std_ac_luminance_values), 1, fp);
-	putc(1, fp); // HTUDCinfo
-	fwrite(std_dc_chrominance_nrcodes+1, sizeof(std_dc_chrominance_nrcodes)-1, 1, fp);
-	fwrite(std_dc_chrominance_values, sizeof(std_dc_chrominance_values), 1, fp);
-	putc(0x11, fp); // HTUACinfo
-	fwrite(std_ac_chrominance_nrcodes+1, sizeof(std_ac_chrominance_nrcodes)-1, 1, fp);
-	fwrite(std_ac_chrominance_values, sizeof(std_ac_chrominance_values), 1, fp);
+	jo_putBytes(o, head0, sizeof(head0));
+	jo_putBytes(o, YTable, sizeof(YTable));
+	jo_putc(o, 1);
+	jo_putBytes(o, UVTable, sizeof(UVTable));
+	// with 4:2:0 the Y component has twice the sampling factors of Cb and Cr
+	const unsigned char head1[] = { 0xFF,0xC0,0,0x11,8,(unsigned char)(height>>8),(unsigned char)(height&0xFF),(unsigned char)(width>>8),(unsigned char)(width&0xFF),3,1,(unsigned char)(e.subsample ? 0x22 : 0x11),0,2,0x11,1,3,0x11,1 };
+	jo_putBytes(o, head1, sizeof(head1));
+	int dhtLength = 2 + 4*17 + valueCounts[0] + valueCounts[1] + valueCounts[2] + valueCounts[3];
+	const unsigned char dht[] = { 0xFF,0xC4,(unsigned char)(dhtLength>>8),(unsigned char)(dhtLength&0xFF) };
+	jo_putBytes(o, dht, sizeof(dht));
+	static const unsigned char tableInfo[] = { 0, 0x10, 1, 0x11 }; // HTYDCinfo, HTYACinfo, HTUDCinfo, HTUACinfo
+	for(i = 0; i < 4; ++i) {
+		jo_putc(o, tableInfo[i]);
+		jo_putBytes(o, nrcodes[i]+1, 16);
+		jo_putBytes(o, values[i], valueCounts[i]);
+	}
 	static const unsigned char head2[] = { 0xFF,0xDA,0,0xC,3,1,0,2,0x11,3,0x11,0,0x3F,0 };
-	fwrite(head2, sizeof(head2), 1, fp);
 
-	// Encode 8x8 macroblocks
-	const unsigned char *imageData = (const unsigned char *)data;
-	int DCY=0, DCU=0, DCV=0;
-	int bitBuf=0, bitCnt=0;
-	int ofsG = comp > 1 ? 1 : 0, ofsB = comp > 1 ? 2 : 0;
-	for(y = 0; y < height; y += 8) {
-		for(x = 0; x < width; x += 8) {
-			float YDU[64], UDU[64], VDU[64];
-			for(row = y, pos = 0; row < y+8; ++row) {
-				for(col = x; col < x+8; ++col, ++pos) {
-					int p = row*width*comp + col*comp;
-					if(row >= height) {
-						p -= width*comp*(row+1 - height);
-					}
-					if(col >= width) {
-						p -= comp*(col+1 - width);
-					}
+	// Encode the MCUs: 8x8 blocks of Y, Cb and Cr, or with 4:2:0 four of Y
+	// for a 16x16 area and one each of the halved Cb and Cr
+#ifndef JO_JPEG_NO_PARALLEL
+	if(threads > 1) {
+		int restartInterval = mcusPerRow * bandRows;
+		const unsigned char dri[] = { 0xFF,0xDD,0,4,(unsigned char)(restartInterval>>8),(unsigned char)(restartInterval&0xFF) };
+		jo_putBytes(o, dri, sizeof(dri));
+		jo_putBytes(o, head2, sizeof(head2));
+		jo_encodeBands(o, &e, threads, bandRows*mcuSize, bandCount, NULL);
+	} else
+#endif
+	{
+		jo_putBytes(o, head2, sizeof(head2));
+		jo_encodeRows(o, NULL, &e, 0, height);
+		// Do the bit alignment of the EOI marker
+		jo_flushBits(o);
+	}
 
-					float r = imageData[p+0], g = imageData[p+ofsG], b = imageData[p+ofsB];
-					YDU[pos]=+0.29900f*r+0.58700f*g+0.11400f*b-128;
-					UDU[pos]=-0.16874f*r-0.33126f*g+0.50000f*b;
-					VDU[pos]=+0.50000f*r-0.41869f*g-0.08131f*b;
-				}
-			}
+	// EOI
+	jo_putc(o, 0xFF);
+	jo_putc(o, 0xD9);
 
-			DCY = jo_processDU(fp, &bitBuf, &bitCnt, YDU, fdtbl_Y, DCY, YDC_HT, YAC_HT);
-			DCU = jo_processDU(fp, &bitBuf, &bitCnt, UDU, fdtbl_UV, DCU, UVDC_HT, UVAC_HT);
-			DCV = jo_processDU(fp, &bitBuf, &bitCnt, VDU, fdtbl_UV, DCV, UVDC_HT, UVAC_HT);
-		}
+	return !o->failed;
+}
+
+static void jo_stdioWrite(void *context, void *data, int size) {
+	fwrite(data, 1, size, (FILE *)context);
+}
+
+int jo_write_jpg_to_func(jo_write_func *func, void *context, const void *data, int width, int height, int comp, int quality, int flags) {
+	jo_output o;
+	if(!func) {
+		return 0;
 	}
-	
-	// Do the bit alignment of the EOI marker
-	static const unsigned short fillBits[] = {0x7F, 7};
-	jo_writeBits(fp, &bitBuf, &bitCnt, fillBits);
+	memset(&o, 0, sizeof(o));
+	o.func = func;
+	o.context = context;
+	int ok = jo_write_jpg_core(&o, data, width, height, comp, quality, flags);
+	if(ok && o.size) {
+		func(context, o.data, o.size);
+	}
+	free(o.data);
+	return ok;
+}
 
-	// EOI
-	putc(0xFF, fp);
-	putc(0xD9, fp);
+int jo_write_jpg_ex(const char *filename, const void *data, int width, int height, int comp, int quality, int flags) {
+	if(!filename || !jo_validArgs(data, width, height, comp)) {
+		return 0;
+	}
 
+	FILE *fp = fopen(filename, "wb");
+	if(!fp) {
+		return 0;
+	}
+	int ok = jo_write_jpg_to_func(jo_stdioWrite, fp, data, width, height, comp, quality, flags);
 	fclose(fp);
-	return 1;
+	return ok;
 }
 
-#endif
+int jo_write_jpg(const char *filename, const void *data, int width, int height, int comp, int quality) {
+	return jo_write_jpg_ex(filename, data, width, height, comp, quality, 0);
+}
+
+unsigned char *jo_write_jpg_to_mem(const void *data, int width, int height, int comp, int quality, int flags, int *out_len) {
+	jo_output o;
+	memset(&o, 0, sizeof(o));
+	if(!jo_write_jpg_core(&o, data, width, height, comp, quality, flags)) {
+		free(o.data);
+		return NULL;
+	}
+	if(out_len) {
+		*out_len = o.size;
+	}
+	return o.data;
+}
 
+#endif
@@ -305,6 +305,7 @@ RECENT REVISION HISTORY:
 #ifndef STBI_NO_STDIO
 #include <stdio.h>
 #endif // STBI_NO_STDIO
+#include <stddef.h> // size_t
 
 #define STBI_VERSION 1
 
@@ -361,6 +362,52 @@ STBIDEF stbi_uc *stbi_load_from_file   (FILE *f, int *x, int *y, int *channels_i
 // for stbi_load_from_file, file pointer is left pointing immediately after image
 #endif
 
+// decode into caller supplied memory instead of a freshly malloc'ed buffer.
+// rows are 'stride' bytes apart (0 for tightly packed), and stored bottom row
+// first if 'flip' is set (stbi_set_flip_vertically_on_load is ignored here).
+// 'out_size' must be at least stride*(y-1) + x*channels, which is checked once
+// the header is read. JPEGs are decoded straight into 'out', other formats
+// go through one temporary image. returns 1 on success, 0 on failure
+STBIDEF int      stbi_load_into               (char              const *filename,           stbi_uc *out, int out_size, int stride, int flip, int *x, int *y, int *channels_in_file, int desired_channels);
+STBIDEF int      stbi_load_into_from_memory   (stbi_uc           const *buffer, int len   , stbi_uc *out, int out_size, int stride, int flip, int *x, int *y, int *channels_in_file, int desired_channels);
+STBIDEF int      stbi_load_into_from_callbacks(stbi_io_callbacks const *clbk  , void *user, stbi_uc *out, int out_size, int stride, int flip, int *x, int *y, int *channels_in_file, int desired_channels);
+
+// decode a JPEG at 1/2, 1/4 or 1/8 of its size ('scale' 2, 4 or 8, 1 is a
+// normal load). only the low frequencies of each block are transformed, so
+// this is much cheaper than a full decode and a downsample. x and y return
+// the reduced size, rounded up. other formats ignore 'scale' and load in full
+STBIDEF stbi_uc *stbi_load_scaled               (char              const *filename,           int scale, int *x, int *y, int *channels_in_file, int desired_channels);
+STBIDEF stbi_uc *stbi_load_scaled_from_memory   (stbi_uc           const *buffer, int len   , int scale, int *x, int *y, int *channels_in_file, int desired_channels);
+STBIDEF stbi_uc *stbi_load_scaled_from_callbacks(stbi_io_callbacks const *clbk  , void *user, int scale, int *x, int *y, int *channels_in_file, int desired_channels);
+
+// decode only the rw x rh rectangle at (rx,ry), clipped to the image; x and y
+// return the clipped size. JPEGs only transform and color convert the MCUs
+// around the region, and stop reading after it if the file has a single
+// scan. non-interlaced PNGs stop inflating after its last row and only keep
+// its rows. other formats are decoded in full and cropped. (rx,ry) is in the
+// image as stored, row 0 at the top, even with stbi_set_flip_vertically_on_load;
+// the returned rectangle is then flipped on its own
+STBIDEF stbi_uc *stbi_load_region               (char              const *filename,           int rx, int ry, int rw, int rh, int *x, int *y, int *channels_in_file, int desired_channels);
+STBIDEF stbi_uc *stbi_load_region_from_memory   (stbi_uc           const *buffer, int len   , int rx, int ry, int rw, int rh, int *x, int *y, int *channels_in_file, int desired_channels);
+STBIDEF stbi_uc *stbi_load_region_from_callbacks(stbi_io_callbacks const *clbk  , void *user, int rx, int ry, int rw, int rh, int *x, int *y, int *channels_in_file, int desired_channels);
+
+// decode without ever holding the whole image: rows are handed to the
+// callback as soon as they are decoded, as 8-bit pixels of desired_channels
+// (or channels_in_file) channels, tightly packed. y is where the first of
+// the 'rows' rows goes in the w x h image; rows come in file order, which
+// is bottom up for most BMPs and some TGAs, and the vertical flip setting
+// does not apply. return 0 from the callback to stop decoding. sequential
+// JPEGs are handed out an MCU row at a time, keeping 3 MCU rows of planes;
+// non-interlaced PNGs, BMPs, TGAs and HDRs a row at a time (a PNG still
+// reads its compressed data in full, and a 32-bit BMP with an all zero
+// alpha channel is not made opaque). other images are decoded in full and
+// handed out in one call. returns 1 on success, 0 on failure or if stopped
+typedef int (*stbi_row_callback)(void *user, stbi_uc const *pixels, int w, int h, int channels, int y, int rows);
+
+STBIDEF int      stbi_load_rows               (char              const *filename,           stbi_row_callback cb, void *cb_user, int *x, int *y, int *channels_in_file, int desired_channels);
+STBIDEF int      stbi_load_rows_from_memory   (stbi_uc           const *buffer, int len   , stbi_row_callback cb, void *cb_user, int *x, int *y, int *channels_in_file, int desired_channels);
+STBIDEF int      stbi_load_rows_from_callbacks(stbi_io_callbacks const *clbk  , void *user, stbi_row_callback cb, void *cb_user, int *x, int *y, int *channels_in_file, int desired_channels);
+
 ////////////////////////////////////
 //
 // 16-bits-per-channel interface
@@ -406,7 +453,7 @@ STBIDEF int      stbi_is_hdr_from_file(FILE *f);
 
 
 // get a VERY brief reason for failure
-// NOT THREADSAFE
+// on most compilers (and ALL modern mainstream compilers) this is threadsafe
 STBIDEF const char *stbi_failure_reason  (void);
 
 // free the loaded image -- this is just free()
@@ -436,6 +483,40 @@ STBIDEF void stbi_convert_iphone_png_to_rgb(int flag_true_if_should_convert);
 // flip the image vertically, so the first pixel in the output array is the bottom left
 STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip);
 
+// as above, but only applies to images loaded on the thread that calls the function
+// this function is only available if your compiler supports thread-local variables;
+// calling it will fail to link if your compiler doesn't
+STBIDEF void stbi_set_unpremultiply_on_load_thread(int flag_true_if_should_unpremultiply);
+STBIDEF void stbi_convert_iphone_png_to_rgb_thread(int flag_true_if_should_convert);
+STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_flip);
+
+// scratch memory hooks for stbi_load_into*: every buffer the decoders need
+// while loading (jpeg components, zlib output, png filter rows, ...) comes
+// from alloc_fn and goes back through free_fn before the call returns, so
+// an arena or pool can be reset after each image. realloc_fn may be NULL
+// (alloc + copy + free is used), so may free_fn (for arenas). old_size is
+// 0 if it is not known. only stbi_load_into* use the hooks, everything
+// else stbi_load* returns must outlive the decode and stays on STBI_MALLOC
+typedef struct
+{
+   void *(*alloc_fn)  (void *user, size_t size);
+   void *(*realloc_fn)(void *user, void *p, size_t old_size, size_t new_size);
+   void  (*free_fn)   (void *user, void *p);
+   void *user;
+} stbi_allocator;
+
+// memory use of the last load on this thread
+typedef struct
+{
+   int    allocations;     // malloc and realloc calls
+   size_t bytes_allocated; // sum of all requested sizes
+   size_t peak_bytes;      // most bytes in use at the same time
+} stbi_alloc_stats;
+
+// set (or with NULL, remove) the scratch allocator for the calling thread
+STBIDEF void stbi_set_scratch_allocator_thread(stbi_allocator const *allocator);
+STBIDEF void stbi_get_alloc_stats_thread(stbi_alloc_stats *stats);
+
 // ZLIB client - used by PNG, available for other purposes
 
 STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int initial_size, int *outlen);
@@ -458,6 +539,10 @@ STBIDEF int   stbi_zlib_decode_noheader_buffer(char *obuffer, int olen, const ch
 #include "stbi_pkm.h"
 #endif
 
+#ifndef STBI_NO_QOI
+#include "stbi_qoi.h"
+#endif
+
 #ifndef STBI_NO_EXT
 #include "stbi_ext.h"
 #endif
@@ -525,6 +610,14 @@ STBIDEF int   stbi_zlib_decode_noheader_buffer(char *obuffer, int olen, const ch
 #include <stdio.h>
 #endif
 
+// define STBI_NO_PARALLEL_JPEG to keep JPEG decoding on the calling thread
+#if defined(STBI_NO_JPEG) && !defined(STBI_NO_PARALLEL_JPEG)
+#define STBI_NO_PARALLEL_JPEG
+#endif
+#ifndef STBI_NO_PARALLEL_JPEG
+#include "thread_helper.h"
+#endif
+
 #ifndef STBI_ASSERT
 #include <assert.h>
 #define STBI_ASSERT(x) assert(x)
@@ -547,12 +640,14 @@ typedef unsigned short stbi__uint16;
 typedef   signed short stbi__int16;
 typedef unsigned int   stbi__uint32;
 typedef   signed int   stbi__int32;
+typedef unsigned __int64 stbi__uint64;
 #else
 #include <stdint.h>
 typedef uint16_t stbi__uint16;
 typedef int16_t  stbi__int16;
 typedef uint32_t stbi__uint32;
 typedef int32_t  stbi__int32;
+typedef uint64_t stbi__uint64;
 #endif
 
 // should produce compiler error if size is wrong
@@ -662,6 +757,36 @@ static int stbi__sse2_available()
 #endif
 #endif
 
+// AVX2, compiled through target attributes and used only if cpuid says
+// so, no compiler flag needed. define STBI_NO_AVX2 to leave it out
+#if defined(STBI_SSE2) && !defined(STBI_NO_AVX2)
+#if defined(_MSC_VER) && _MSC_VER >= 1900
+#define STBI_AVX2
+#define STBI__AVX2_TARGET
+#include <immintrin.h>
+static int stbi__avx2_available(void)
+{
+   int info[4];
+   __cpuid(info, 0);
+   if (info[0] < 7) return 0;
+   __cpuid(info, 1);
+   // the OS has to save the ymm registers too (OSXSAVE, AVX, XCR0)
+   if ((info[2] & 0x18000000) != 0x18000000 || (_xgetbv(0) & 6) != 6) return 0;
+   __cpuidex(info, 7, 0);
+   return (info[1] >> 5) & 1;
+}
+#elif (defined(__clang__) && __clang_major__ >= 4) || (!defined(__clang__) && defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#define STBI_AVX2
+#define STBI__AVX2_TARGET __attribute__((target("avx2")))
+#include <immintrin.h>
+static int stbi__avx2_available(void)
+{
+   __builtin_cpu_init();
+   return __builtin_cpu_supports("avx2");
+}
+#endif
+#endif
+
 // ARM NEON
 #if defined(STBI_NO_SIMD) && defined(STBI_NEON)
 #undef STBI_NEON
@@ -697,6 +822,24 @@ typedef struct
 
    stbi_uc *img_buffer, *img_buffer_end;
    stbi_uc *img_buffer_original, *img_buffer_original_end;
+
+   // caller supplied destination for stbi_load_into, NULL otherwise
+   stbi_uc *out_buffer;
+   int out_size, out_stride, out_flip;
+   int out_written; // set by decoders that wrote straight into out_buffer
+
+   int jpeg_scale; // 1, or 2, 4, 8 for stbi_load_scaled
+
+   // stbi_load_region rectangle, region_w == 0 for the whole image
+   int region_x, region_y, region_w, region_h;
+   int region_done; // set by decoders that produced just the region
+
+   // stbi_load_rows callback, NULL otherwise
+   stbi_row_callback row_cb;
+   void *row_user;
+   stbi_uc *row_buf; // conversion space for stbi__emit_rows
+   int row_buf_size;
+   int rows_done; // set by decoders that handed out the rows themselves
 } stbi__context;
 
 
@@ -709,6 +852,11 @@ static void stbi__start_mem(stbi__context *s, stbi_uc const *buffer, int len)
    s->read_from_callbacks = 0;
    s->img_buffer = s->img_buffer_original = (stbi_uc *) buffer;
    s->img_buffer_end = s->img_buffer_original_end = (stbi_uc *) buffer+len;
+   s->out_buffer = NULL;
+   s->jpeg_scale = 1;
+   s->region_w = 0;
+   s->row_cb = NULL;
+   s->rows_done = 0;
 }
 
 // initialize a callback-based context
@@ -719,6 +867,11 @@ static void stbi__start_callbacks(stbi__context *s, stbi_io_callbacks *c, void *
    s->buflen = sizeof(s->buffer_start);
    s->read_from_callbacks = 1;
    s->img_buffer_original = s->buffer_start;
+   s->out_buffer = NULL;
+   s->jpeg_scale = 1;
+   s->region_w = 0;
+   s->row_cb = NULL;
+   s->rows_done = 0;
    stbi__refill_buffer(s);
    s->img_buffer_original_end = s->img_buffer_end;
 }
@@ -850,8 +1003,36 @@ static void    *stbi__pkm_load(stbi__context *s, int *x, int *y, int *comp, int
 static int      stbi__pkm_info(stbi__context *s, int *x, int *y, int *comp);
 #endif
 
-// this is not threadsafe
+#ifndef STBI_NO_QOI
+static int      stbi__qoi_test(stbi__context *s);
+static void    *stbi__qoi_load(stbi__context *s, int *x, int *y, int *comp, int req_comp);
+static int      stbi__qoi_info(stbi__context *s, int *x, int *y, int *comp);
+#endif
+
+#ifndef STBI_NO_THREAD_LOCALS
+   #if defined(__cplusplus) &&  __cplusplus >= 201103L
+      #define STBI_THREAD_LOCAL       thread_local
+   #elif defined(__GNUC__) && __GNUC__ < 5
+      #define STBI_THREAD_LOCAL       __thread
+   #elif defined(_MSC_VER)
+      #define STBI_THREAD_LOCAL       __declspec(thread)
+   #elif defined (__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+      #define STBI_THREAD_LOCAL       _Thread_local
+   #endif
+
+   #ifndef STBI_THREAD_LOCAL
+      #if defined(__GNUC__)
+        #define STBI_THREAD_LOCAL       __thread
+      #endif
+   #endif
+#endif
+
+// each thread sees its own failure reason (when thread locals are available)
+#ifdef STBI_THREAD_LOCAL
+static STBI_THREAD_LOCAL const char *stbi__g_failure_reason;
+#else
 static const char *stbi__g_failure_reason;
+#endif
 
 STBIDEF const char *stbi_failure_reason(void)
 {
@@ -864,6 +1045,146 @@ static int stbi__err(const char *str)
    return 0;
 }
 
+// all stb_image allocations go through these, to count them and to hand
+// them to the scratch allocator while stbi_load_into* is decoding
+#ifdef STBI_THREAD_LOCAL
+#define STBI__ALLOC_TLS STBI_THREAD_LOCAL
+#else
+#define STBI__ALLOC_TLS
+#endif
+
+// live blocks remembered for the peak count (and realloc_fn's old_size),
+// a decode rarely holds more than a dozen at once
+#define STBI__MAX_TRACKED_ALLOCS 64
+
+typedef struct
+{
+   void *p;
+   size_t size;
+} stbi__tracked_alloc;
+
+static STBI__ALLOC_TLS stbi_allocator stbi__scratch_allocator;
+static STBI__ALLOC_TLS int stbi__scratch_active;
+static STBI__ALLOC_TLS stbi_alloc_stats stbi__alloc_stats;
+static STBI__ALLOC_TLS size_t stbi__live_bytes;
+static STBI__ALLOC_TLS stbi__tracked_alloc stbi__live_allocs[STBI__MAX_TRACKED_ALLOCS];
+static STBI__ALLOC_TLS int stbi__live_count;
+
+STBIDEF void stbi_set_scratch_allocator_thread(stbi_allocator const *allocator)
+{
+   if (allocator && allocator->alloc_fn)
+      stbi__scratch_allocator = *allocator;
+   else
+      memset(&stbi__scratch_allocator, 0, sizeof(stbi__scratch_allocator));
+}
+
+STBIDEF void stbi_get_alloc_stats_thread(stbi_alloc_stats *stats)
+{
+   if (stats) *stats = stbi__alloc_stats;
+}
+
+static void stbi__reset_alloc_stats(void)
+{
+   memset(&stbi__alloc_stats, 0, sizeof(stbi__alloc_stats));
+   stbi__live_bytes = 0;
+   stbi__live_count = 0;
+}
+
+static void stbi__track_alloc(void *p, size_t size)
+{
+   ++stbi__alloc_stats.allocations;
+   stbi__alloc_stats.bytes_allocated += size;
+   // a block we can't remember is left out of the peak, rather than never leaving it
+   if (stbi__live_count == STBI__MAX_TRACKED_ALLOCS) return;
+   stbi__live_allocs[stbi__live_count].p = p;
+   stbi__live_allocs[stbi__live_count].size = size;
+   ++stbi__live_count;
+   stbi__live_bytes += size;
+   if (stbi__live_bytes > stbi__alloc_stats.peak_bytes)
+      stbi__alloc_stats.peak_bytes = stbi__live_bytes;
+}
+
+// forgets p, returns its size (0 if it was not tracked)
+static size_t stbi__untrack_alloc(void *p)
+{
+   int i;
+   for (i = stbi__live_count - 1; i >= 0; --i) {
+      if (stbi__live_allocs[i].p == p) {
+         size_t size = stbi__live_allocs[i].size;
+         stbi__live_allocs[i] = stbi__live_allocs[--stbi__live_count];
+         stbi__live_bytes -= size;
+         return size;
+      }
+   }
+   return 0;
+}
+
+static void *stbi__hooked_malloc(size_t size)
+{
+   void *p;
+   if (stbi__scratch_active)
+      p = stbi__scratch_allocator.alloc_fn(stbi__scratch_allocator.user, size);
+   else
+      p = STBI_MALLOC(size);
+   if (p) stbi__track_alloc(p, size);
+   return p;
+}
+
+static void stbi__hooked_free(void *p)
+{
+   if (!p) return;
+   stbi__untrack_alloc(p);
+   if (stbi__scratch_active) {
+      if (stbi__scratch_allocator.free_fn)
+         stbi__scratch_allocator.free_fn(stbi__scratch_allocator.user, p);
+   } else {
+      STBI_FREE(p);
+   }
+}
+
+static void *stbi__hooked_realloc(void *p, size_t old_size, size_t new_size)
+{
+   void *q;
+   size_t tracked = 0;
+   if (!p) return stbi__hooked_malloc(new_size);
+   // look the size up before the block moves, but untrack only on success
+   {
+      int i;
+      for (i = 0; i < stbi__live_count; ++i)
+         if (stbi__live_allocs[i].p == p) { tracked = stbi__live_allocs[i].size; break; }
+   }
+   if (!old_size) old_size = tracked;
+   if (stbi__scratch_active) {
+      if (stbi__scratch_allocator.realloc_fn) {
+         q = stbi__scratch_allocator.realloc_fn(stbi__scratch_allocator.user, p, old_size, new_size);
+      } else {
+         q = stbi__scratch_allocator.alloc_fn(stbi__scratch_allocator.user, new_size);
+         if (q) {
+            memcpy(q, p, old_size < new_size ? old_size : new_size);
+            if (stbi__scratch_allocator.free_fn)
+               stbi__scratch_allocator.free_fn(stbi__scratch_allocator.user, p);
+         }
+      }
+   } else {
+      q = STBI_REALLOC_SIZED(p, old_size, new_size);
+   }
+   if (q) {
+      stbi__untrack_alloc(p);
+      stbi__track_alloc(q, new_size);
+   }
+   return q;
+}
+
+// from here on every allocation goes through the hooks above
+#undef STBI_MALLOC
+#undef STBI_REALLOC
+#undef STBI_REALLOC_SIZED
+#undef STBI_FREE
+#define STBI_MALLOC(sz)                   stbi__hooked_malloc(sz)
+#define STBI_REALLOC(p,newsz)             stbi__hooked_realloc(p,0,newsz)
+#define STBI_REALLOC_SIZED(p,oldsz,newsz) stbi__hooked_realloc(p,oldsz,newsz)
+#define STBI_FREE(p)                      stbi__hooked_free(p)
+
 static void *stbi__malloc(size_t size)
 {
     return STBI_MALLOC(size);
@@ -968,15 +1289,34 @@ static float   *stbi__ldr_to_hdr(stbi_uc *data, int x, int y, int comp);
 static stbi_uc *stbi__hdr_to_ldr(float   *data, int x, int y, int comp);
 #endif
 
-static int stbi__vertically_flip_on_load = 0;
+static int stbi__emit_rows(stbi__context *s, void *rows, int w, int h, int img_n, int req_comp, int bits, int y, int count);
+
+static int stbi__vertically_flip_on_load_global = 0;
 
 STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip)
 {
-    stbi__vertically_flip_on_load = flag_true_if_should_flip;
+    stbi__vertically_flip_on_load_global = flag_true_if_should_flip;
+}
+
+#ifndef STBI_THREAD_LOCAL
+#define stbi__vertically_flip_on_load  stbi__vertically_flip_on_load_global
+#else
+static STBI_THREAD_LOCAL int stbi__vertically_flip_on_load_local, stbi__vertically_flip_on_load_set;
+
+STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_flip)
+{
+   stbi__vertically_flip_on_load_local = flag_true_if_should_flip;
+   stbi__vertically_flip_on_load_set = 1;
 }
 
+#define stbi__vertically_flip_on_load  (stbi__vertically_flip_on_load_set       \
+                                         ? stbi__vertically_flip_on_load_local  \
+                                         : stbi__vertically_flip_on_load_global)
+#endif // STBI_THREAD_LOCAL
+
 static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri, int bpc)
 {
+   stbi__reset_alloc_stats();
    memset(ri, 0, sizeof(*ri)); // make sure it's initialized if we add new fields
    ri->bits_per_channel = 8; // default is 8 so most paths don't have to be changed
    ri->channel_order = STBI_ORDER_RGB; // all current input & output are this, but this is here so we can add BGR order
@@ -1012,10 +1352,14 @@ static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int re
    #ifndef STBI_NO_PKM
    if (stbi__pkm_test(s))  return stbi__pkm_load(s,x,y,comp,req_comp);
    #endif
+   #ifndef STBI_NO_QOI
+   if (stbi__qoi_test(s))  return stbi__qoi_load(s,x,y,comp,req_comp);
+   #endif
 
    #ifndef STBI_NO_HDR
    if (stbi__hdr_test(s)) {
       float *hdr = stbi__hdr_load(s, x,y,comp,req_comp, ri);
+      if (s->rows_done) return hdr; // just the last row, already handed out
       return stbi__hdr_to_ldr(hdr, *x, *y, req_comp ? req_comp : *comp);
    }
    #endif
@@ -1061,10 +1405,51 @@ static stbi__uint16 *stbi__convert_8_to_16(stbi_uc *orig, int w, int h, int chan
    return enlarged;
 }
 
+// clips the stbi_load_region rectangle to a w x h image, 0 if nothing is left
+static int stbi__clip_region(stbi__context *s, int w, int h, int *x0, int *y0, int *rw, int *rh)
+{
+   int x = s->region_x, y = s->region_y, cw = s->region_w, ch = s->region_h;
+   // a negative origin is clipped off like the right and bottom edges
+   if (x < 0) { cw += x; x = 0; }
+   if (y < 0) { ch += y; y = 0; }
+   if (cw <= 0 || ch <= 0 || x >= w || y >= h)
+      return stbi__err("bad region", "Region is outside the image");
+   *x0 = x;
+   *y0 = y;
+   *rw = cw < w - x ? cw : w - x;
+   *rh = ch < h - y ? ch : h - y;
+   return 1;
+}
+
+// stbi_load_region for the decoders that can only do the whole image
+static stbi_uc *stbi__crop_region(stbi__context *s, stbi_uc *image, int *x, int *y, int n)
+{
+   int x0, y0, w, h, row;
+   stbi_uc *out;
+   if (!stbi__clip_region(s, *x, *y, &x0, &y0, &w, &h)) {
+      STBI_FREE(image);
+      return NULL;
+   }
+   out = (stbi_uc *) stbi__malloc_mad3(w, h, n, 0);
+   if (out == NULL) {
+      STBI_FREE(image);
+      return stbi__errpuc("outofmem", "Out of memory");
+   }
+   for (row = 0; row < h; ++row)
+      memcpy(out + row * w * n, image + ((y0 + row) * *x + x0) * n, w * n);
+   STBI_FREE(image);
+   *x = w;
+   *y = h;
+   return out;
+}
+
 static unsigned char *stbi__load_and_postprocess_8bit(stbi__context *s, int *x, int *y, int *comp, int req_comp)
 {
    stbi__result_info ri;
-   void *result = stbi__load_main(s, x, y, comp, req_comp, &ri, 8);
+   void *result;
+
+   s->region_done = 0;
+   result = stbi__load_main(s, x, y, comp, req_comp, &ri, 8);
 
    if (result == NULL)
       return NULL;
@@ -1073,6 +1458,12 @@ static unsigned char *stbi__load_and_postprocess_8bit(stbi__context *s, int *x,
       STBI_ASSERT(ri.bits_per_channel == 16);
       result = stbi__convert_16_to_8((stbi__uint16 *) result, *x, *y, req_comp == 0 ? *comp : req_comp);
       ri.bits_per_channel = 8;
+      if (result == NULL) return NULL;
+   }
+
+   if (s->region_w && !s->region_done) {
+      result = stbi__crop_region(s, (stbi_uc *) result, x, y, req_comp ? req_comp : *comp);
+      if (result == NULL) return NULL;
    }
 
    // @TODO: move stbi__convert_format to here
@@ -1098,6 +1489,69 @@ static unsigned char *stbi__load_and_postprocess_8bit(stbi__context *s, int *x,
    return (unsigned char *) result;
 }
 
+// returns the row stride to use for s->out_buffer, or 0 if the image does not fit
+static int stbi__out_buffer_stride(stbi__context *s, int w, int h, int n)
+{
+   int stride = s->out_stride ? s->out_stride : w * n;
+   if (!stbi__mul2sizes_valid(w, n) || stride < w * n) return 0;
+   if (!stbi__mad2sizes_valid(stride, h - 1, w * n)) return 0;
+   if (stride * (h - 1) + w * n > s->out_size) return 0;
+   return stride;
+}
+
+static int stbi__load_into_8bit(stbi__context *s, stbi_uc *out, int out_size, int stride, int flip, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__result_info ri;
+   stbi_uc *image;
+   int n, row, row_bytes;
+   void *result;
+
+   if (out == NULL || out_size <= 0 || stride < 0)
+      return stbi__err("bad out buffer", "Invalid output buffer");
+
+   s->out_buffer = out;
+   s->out_size = out_size;
+   s->out_stride = stride;
+   s->out_flip = flip;
+   s->out_written = 0;
+   // nothing allocated from here on outlives this call, so the scratch allocator can serve it
+   stbi__scratch_active = stbi__scratch_allocator.alloc_fn != NULL;
+   result = stbi__load_main(s, x, y, comp, req_comp, &ri, 8);
+   s->out_buffer = NULL;
+
+   if (result == NULL) {
+      stbi__scratch_active = 0;
+      return 0;
+   }
+   if (s->out_written) {
+      stbi__scratch_active = 0;
+      return 1;
+   }
+
+   // the decoder used its own buffer, copy it over
+   n = req_comp ? req_comp : *comp;
+   if (ri.bits_per_channel != 8) {
+      STBI_ASSERT(ri.bits_per_channel == 16);
+      result = stbi__convert_16_to_8((stbi__uint16 *) result, *x, *y, n);
+      if (result == NULL) { stbi__scratch_active = 0; return 0; }
+   }
+   s->out_buffer = out;
+   stride = stbi__out_buffer_stride(s, *x, *y, n);
+   s->out_buffer = NULL;
+   if (!stride) {
+      STBI_FREE(result);
+      stbi__scratch_active = 0;
+      return stbi__err("buffer too small", "Output buffer too small for image");
+   }
+   image = (stbi_uc *) result;
+   row_bytes = *x * n;
+   for (row = 0; row < *y; ++row)
+      memcpy(out + (flip ? *y - 1 - row : row) * stride, image + row * row_bytes, row_bytes);
+   STBI_FREE(result);
+   stbi__scratch_active = 0;
+   return 1;
+}
+
 static stbi__uint16 *stbi__load_and_postprocess_16bit(stbi__context *s, int *x, int *y, int *comp, int req_comp)
 {
    stbi__result_info ri;
@@ -1159,6 +1613,50 @@ static void stbi__float_postprocess(float *result, int *x, int *y, int *comp, in
 }
 #endif
 
+static stbi_uc *stbi__load_scaled(stbi__context *s, int scale, int *x, int *y, int *comp, int req_comp)
+{
+   if (scale != 1 && scale != 2 && scale != 4 && scale != 8)
+      return stbi__errpuc("bad scale", "Scale must be 1, 2, 4 or 8");
+   s->jpeg_scale = scale;
+   return stbi__load_and_postprocess_8bit(s,x,y,comp,req_comp);
+}
+
+static stbi_uc *stbi__load_region(stbi__context *s, int rx, int ry, int rw, int rh, int *x, int *y, int *comp, int req_comp)
+{
+   if (rw <= 0 || rh <= 0)
+      return stbi__errpuc("bad region", "Region is empty");
+   s->region_x = rx;
+   s->region_y = ry;
+   s->region_w = rw;
+   s->region_h = rh;
+   return stbi__load_and_postprocess_8bit(s,x,y,comp,req_comp);
+}
+
+static int stbi__load_rows(stbi__context *s, stbi_row_callback cb, void *cb_user, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__result_info ri;
+   void *result;
+   int ok;
+
+   if (cb == NULL) return stbi__err("no callback", "No row callback given");
+   s->row_cb = cb;
+   s->row_user = cb_user;
+   s->row_buf = NULL;
+   s->row_buf_size = 0;
+   s->rows_done = 0;
+   result = stbi__load_main(s, x, y, comp, req_comp, &ri, 8);
+   ok = result != NULL;
+   if (ok && !s->rows_done) {
+      // the decoder could only do the whole image, hand it out in one go
+      int n = req_comp ? req_comp : *comp;
+      ok = stbi__emit_rows(s, result, *x, *y, n, n, ri.bits_per_channel, 0, *y);
+   }
+   STBI_FREE(result);
+   STBI_FREE(s->row_buf);
+   s->row_cb = NULL;
+   return ok;
+}
+
 #ifndef STBI_NO_STDIO
 
 static FILE *stbi__fopen(char const *filename, char const *mode)
@@ -1197,6 +1695,54 @@ STBIDEF stbi_uc *stbi_load_from_file(FILE *f, int *x, int *y, int *comp, int req
    return result;
 }
 
+STBIDEF int stbi_load_into(char const *filename, stbi_uc *out, int out_size, int stride, int flip, int *x, int *y, int *comp, int req_comp)
+{
+   FILE *f = stbi__fopen(filename, "rb");
+   stbi__context s;
+   int result;
+   if (!f) return stbi__err("can't fopen", "Unable to open file");
+   stbi__start_file(&s,f);
+   result = stbi__load_into_8bit(&s,out,out_size,stride,flip,x,y,comp,req_comp);
+   fclose(f);
+   return result;
+}
+
+STBIDEF stbi_uc *stbi_load_scaled(char const *filename, int scale, int *x, int *y, int *comp, int req_comp)
+{
+   FILE *f = stbi__fopen(filename, "rb");
+   stbi__context s;
+   stbi_uc *result;
+   if (!f) return stbi__errpuc("can't fopen", "Unable to open file");
+   stbi__start_file(&s,f);
+   result = stbi__load_scaled(&s,scale,x,y,comp,req_comp);
+   fclose(f);
+   return result;
+}
+
+STBIDEF stbi_uc *stbi_load_region(char const *filename, int rx, int ry, int rw, int rh, int *x, int *y, int *comp, int req_comp)
+{
+   FILE *f = stbi__fopen(filename, "rb");
+   stbi__context s;
+   stbi_uc *result;
+   if (!f) return stbi__errpuc("can't fopen", "Unable to open file");
+   stbi__start_file(&s,f);
+   result = stbi__load_region(&s,rx,ry,rw,rh,x,y,comp,req_comp);
+   fclose(f);
+   return result;
+}
+
+STBIDEF int stbi_load_rows(char const *filename, stbi_row_callback cb, void *cb_user, int *x, int *y, int *comp, int req_comp)
+{
+   FILE *f = stbi__fopen(filename, "rb");
+   stbi__context s;
+   int result;
+   if (!f) return stbi__err("can't fopen", "Unable to open file");
+   stbi__start_file(&s,f);
+   result = stbi__load_rows(&s,cb,cb_user,x,y,comp,req_comp);
+   fclose(f);
+   return result;
+}
+
 STBIDEF stbi__uint16 *stbi_load_from_file_16(FILE *f, int *x, int *y, int *comp, int req_comp)
 {
    stbi__uint16 *result;
@@ -1237,6 +1783,62 @@ STBIDEF stbi_uc *stbi_load_from_callbacks(stbi_io_callbacks const *clbk, void *u
    return stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
 }
 
+STBIDEF int stbi_load_into_from_memory(stbi_uc const *buffer, int len, stbi_uc *out, int out_size, int stride, int flip, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   return stbi__load_into_8bit(&s,out,out_size,stride,flip,x,y,comp,req_comp);
+}
+
+STBIDEF int stbi_load_into_from_callbacks(stbi_io_callbacks const *clbk, void *user, stbi_uc *out, int out_size, int stride, int flip, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_callbacks(&s, (stbi_io_callbacks *) clbk, user);
+   return stbi__load_into_8bit(&s,out,out_size,stride,flip,x,y,comp,req_comp);
+}
+
+STBIDEF stbi_uc *stbi_load_scaled_from_memory(stbi_uc const *buffer, int len, int scale, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   return stbi__load_scaled(&s,scale,x,y,comp,req_comp);
+}
+
+STBIDEF stbi_uc *stbi_load_scaled_from_callbacks(stbi_io_callbacks const *clbk, void *user, int scale, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_callbacks(&s, (stbi_io_callbacks *) clbk, user);
+   return stbi__load_scaled(&s,scale,x,y,comp,req_comp);
+}
+
+STBIDEF stbi_uc *stbi_load_region_from_memory(stbi_uc const *buffer, int len, int rx, int ry, int rw, int rh, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   return stbi__load_region(&s,rx,ry,rw,rh,x,y,comp,req_comp);
+}
+
+STBIDEF stbi_uc *stbi_load_region_from_callbacks(stbi_io_callbacks const *clbk, void *user, int rx, int ry, int rw, int rh, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_callbacks(&s, (stbi_io_callbacks *) clbk, user);
+   return stbi__load_region(&s,rx,ry,rw,rh,x,y,comp,req_comp);
+}
+
+STBIDEF int stbi_load_rows_from_memory(stbi_uc const *buffer, int len, stbi_row_callback cb, void *cb_user, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   return stbi__load_rows(&s,cb,cb_user,x,y,comp,req_comp);
+}
+
+STBIDEF int stbi_load_rows_from_callbacks(stbi_io_callbacks const *clbk, void *user, stbi_row_callback cb, void *cb_user, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_callbacks(&s, (stbi_io_callbacks *) clbk, user);
+   return stbi__load_rows(&s,cb,cb_user,x,y,comp,req_comp);
+}
+
 #ifndef STBI_NO_LINEAR
 static float *stbi__loadf_main(stbi__context *s, int *x, int *y, int *comp, int req_comp)
 {
@@ -1500,22 +2102,11 @@ static stbi_uc stbi__compute_y(int r, int g, int b)
    return (stbi_uc) (((r*77) + (g*150) +  (29*b)) >> 8);
 }
 
-static unsigned char *stbi__convert_format(unsigned char *data, int img_n, int req_comp, unsigned int x, unsigned int y)
+static void stbi__convert_format_into(unsigned char *good, unsigned char const *data, int img_n, int req_comp, unsigned int x, unsigned int y)
 {
    int i,j;
-   unsigned char *good;
-
-   if (req_comp == img_n) return data;
-   STBI_ASSERT(req_comp >= 1 && req_comp <= 4);
-
-   good = (unsigned char *) stbi__malloc_mad3(req_comp, x, y, 0);
-   if (good == NULL) {
-      STBI_FREE(data);
-      return stbi__errpuc("outofmem", "Out of memory");
-   }
-
    for (j=0; j < (int) y; ++j) {
-      unsigned char *src  = data + j * x * img_n   ;
+      unsigned char const *src = data + j * x * img_n;
       unsigned char *dest = good + j * x * req_comp;
 
       #define STBI__COMBO(a,b)  ((a)*8+(b))
@@ -1539,7 +2130,22 @@ static unsigned char *stbi__convert_format(unsigned char *data, int img_n, int r
       }
       #undef STBI__CASE
    }
+}
+
+static unsigned char *stbi__convert_format(unsigned char *data, int img_n, int req_comp, unsigned int x, unsigned int y)
+{
+   unsigned char *good;
+
+   if (req_comp == img_n) return data;
+   STBI_ASSERT(req_comp >= 1 && req_comp <= 4);
 
+   good = (unsigned char *) stbi__malloc_mad3(req_comp, x, y, 0);
+   if (good == NULL) {
+      STBI_FREE(data);
+      return stbi__errpuc("outofmem", "Out of memory");
+   }
+
+   stbi__convert_format_into(good, data, img_n, req_comp, x, y);
    STBI_FREE(data);
    return good;
 }
@@ -1549,22 +2155,11 @@ static stbi__uint16 stbi__compute_y_16(int r, int g, int b)
    return (stbi__uint16) (((r*77) + (g*150) +  (29*b)) >> 8);
 }
 
-static stbi__uint16 *stbi__convert_format16(stbi__uint16 *data, int img_n, int req_comp, unsigned int x, unsigned int y)
+static void stbi__convert_format16_into(stbi__uint16 *good, stbi__uint16 const *data, int img_n, int req_comp, unsigned int x, unsigned int y)
 {
    int i,j;
-   stbi__uint16 *good;
-
-   if (req_comp == img_n) return data;
-   STBI_ASSERT(req_comp >= 1 && req_comp <= 4);
-
-   good = (stbi__uint16 *) stbi__malloc(req_comp * x * y * 2);
-   if (good == NULL) {
-      STBI_FREE(data);
-      return (stbi__uint16 *) stbi__errpuc("outofmem", "Out of memory");
-   }
-
    for (j=0; j < (int) y; ++j) {
-      stbi__uint16 *src  = data + j * x * img_n   ;
+      stbi__uint16 const *src = data + j * x * img_n;
       stbi__uint16 *dest = good + j * x * req_comp;
 
       #define STBI__COMBO(a,b)  ((a)*8+(b))
@@ -1588,7 +2183,22 @@ static stbi__uint16 *stbi__convert_format16(stbi__uint16 *data, int img_n, int r
       }
       #undef STBI__CASE
    }
+}
 
+static stbi__uint16 *stbi__convert_format16(stbi__uint16 *data, int img_n, int req_comp, unsigned int x, unsigned int y)
+{
+   stbi__uint16 *good;
+
+   if (req_comp == img_n) return data;
+   STBI_ASSERT(req_comp >= 1 && req_comp <= 4);
+
+   good = (stbi__uint16 *) stbi__malloc(req_comp * x * y * 2);
+   if (good == NULL) {
+      STBI_FREE(data);
+      return (stbi__uint16 *) stbi__errpuc("outofmem", "Out of memory");
+   }
+
+   stbi__convert_format16_into(good, data, img_n, req_comp, x, y);
    STBI_FREE(data);
    return good;
 }
@@ -1616,13 +2226,9 @@ static float   *stbi__ldr_to_hdr(stbi_uc *data, int x, int y, int comp)
 
 #ifndef STBI_NO_HDR
 #define stbi__float2int(x)   ((int) (x))
-static stbi_uc *stbi__hdr_to_ldr(float   *data, int x, int y, int comp)
+static void stbi__hdr_to_ldr_into(stbi_uc *output, float const *data, int x, int y, int comp)
 {
    int i,k,n;
-   stbi_uc *output;
-   if (!data) return NULL;
-   output = (stbi_uc *) stbi__malloc_mad3(x, y, comp, 0);
-   if (output == NULL) { STBI_FREE(data); return stbi__errpuc("outofmem", "Out of memory"); }
    // compute number of non-alpha components
    if (comp & 1) n = comp; else n = comp-1;
    for (i=0; i < x*y; ++i) {
@@ -1639,11 +2245,66 @@ static stbi_uc *stbi__hdr_to_ldr(float   *data, int x, int y, int comp)
          output[i*comp + k] = (stbi_uc) stbi__float2int(z);
       }
    }
+}
+
+static stbi_uc *stbi__hdr_to_ldr(float   *data, int x, int y, int comp)
+{
+   stbi_uc *output;
+   if (!data) return NULL;
+   output = (stbi_uc *) stbi__malloc_mad3(x, y, comp, 0);
+   if (output == NULL) { STBI_FREE(data); return stbi__errpuc("outofmem", "Out of memory"); }
+   stbi__hdr_to_ldr_into(output, data, x, y, comp);
    STBI_FREE(data);
    return output;
 }
 #endif
 
+// hands count rows of w pixels, the first being row y of h, to the
+// stbi_load_rows callback as 8-bit pixels of req_comp channels. bits is
+// the channel size of rows: 8, 16, or 32 for floats
+static int stbi__emit_rows(stbi__context *s, void *rows, int w, int h, int img_n, int req_comp, int bits, int y, int count)
+{
+   stbi_uc *pixels = (stbi_uc *) rows;
+   int n = req_comp ? req_comp : img_n;
+   if (bits != 8 || n != img_n) {
+      int i, len = w * count * img_n;
+      int size = img_n + n > 2 * n ? img_n + n : 2 * n; // bytes per pixel
+      if (!stbi__mad3sizes_valid(w, count, size, 0)) return stbi__err("too large", "Image too large to decode");
+      if (s->row_buf_size < w * count * size) {
+         stbi_uc *p = (stbi_uc *) STBI_REALLOC_SIZED(s->row_buf, s->row_buf_size, w * count * size);
+         if (p == NULL) return stbi__err("outofmem", "Out of memory");
+         s->row_buf = p;
+         s->row_buf_size = w * count * size;
+      }
+      if (bits == 16) {
+         // convert in 16 bits and then narrow, in the order a full decode does
+         stbi__uint16 const *wide = (stbi__uint16 const *) rows;
+         if (n != img_n) {
+            stbi__convert_format16_into((stbi__uint16 *) s->row_buf, wide, img_n, n, w, count);
+            wide = (stbi__uint16 const *) s->row_buf;
+            img_n = n;
+         }
+         // in place is fine, each byte goes no further than the word it came from
+         for (i=0; i < w * count * n; ++i)
+            s->row_buf[i] = (stbi_uc) (wide[i] >> 8);
+         pixels = s->row_buf;
+      }
+#ifndef STBI_NO_HDR
+      else if (bits == 32) {
+         stbi__hdr_to_ldr_into(s->row_buf, (float *) rows, w, count, img_n);
+         pixels = s->row_buf;
+      }
+#endif
+      if (n != img_n) {
+         stbi__convert_format_into(s->row_buf + len, pixels, img_n, n, w, count);
+         pixels = s->row_buf + len;
+      }
+   }
+   if (!s->row_cb(s->row_user, pixels, w, h, n, y, count))
+      return stbi__err("stopped", "Stopped by the row callback");
+   return 1;
+}
+
 //////////////////////////////////////////////////////////////////////////////
 //
 //  "baseline" JPEG/JFIF decoder
@@ -1681,6 +2342,19 @@ typedef struct
    int    delta[17];   // old 'firstsymbol' - old 'firstcode'
 } stbi__huffman;
 
+typedef stbi_uc *(*resample_row_func)(stbi_uc *out, stbi_uc *in0, stbi_uc *in1,
+                                    int w, int hs);
+
+typedef struct
+{
+   resample_row_func resample;
+   stbi_uc *line0,*line1;
+   int hs,vs;   // expansion factor in each axis
+   int w_lores; // horizontal pixels pre-expansion
+   int ystep;   // how far through vertical expansion we are
+   int ypos;    // which pre-expansion row we're on
+} stbi__resample;
+
 typedef struct
 {
    stbi__context *s;
@@ -1731,6 +2405,22 @@ typedef struct
 
 // kernels
    void (*idct_block_kernel)(stbi_uc *out, int out_stride, short data[64]);
+   int idct_out; // pixels per side of a transformed block, 8 unless stbi_load_scaled
+
+// stbi_load_region: only the MCUs of the window are transformed and stored,
+// crop_* is the region inside the window (crop_w == 0 for a full decode)
+   int win_mcu_x, win_mcu_y, win_mcu_w, win_mcu_h;
+   int crop_x, crop_y, crop_w, crop_h;
+   int rest_skipped; // stopped reading the scan below the window
+
+// color conversion: output components, planes actually used, their resamplers
+   int out_n, decode_n, is_rgb;
+   stbi__resample res_comp[4];
+
+// stbi_load_rows: the planes are a ring of 3 MCU rows, and the rows above the
+// MCU row being decoded are converted and handed out as soon as it is done
+   int stream_rows, stream_req_comp, stream_y;
+   stbi_uc *stream_out;
    void (*YCbCr_to_RGB_kernel)(stbi_uc *out, const stbi_uc *y, const stbi_uc *pcb, const stbi_uc *pcr, int count, int step);
    stbi_uc *(*resample_row_hv_2_kernel)(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs);
 } stbi__jpeg;
@@ -2243,6 +2933,84 @@ static void stbi__idct_block(stbi_uc *out, int out_stride, short data[64])
    }
 }
 
+// reduced IDCTs for stbi_load_scaled. every output is the exact mean of the
+// 2x2 or 4x4 pixels the full 8x8 IDCT would give, as in libjpeg's jidctred:
+// averaging a pair of cos((2x+1)*u*pi/16) samples multiplies the pair's
+// midpoint value by cos(u*pi/16), and at the coarser positions frequency
+// 8-u aliases onto -u (and 4 drops out), so each is folded onto the low
+// ones with those factors before the shorter transform. constants are
+// scaled by 4096.
+// the 4-point one is the usual even/odd butterfly with
+// 0.5 * C(u) * cos((2x+1)*u*pi/8), the folding merged into its constants
+#define STBI__IDCT_4(s0,s1,s2,s3,s5,s6,s7) \
+   int t0 = (s0) * 1448 + (s2) * 1338 - (s6) * 554;  \
+   int t2 = (s0) * 1448 - (s2) * 1338 + (s6) * 554;  \
+   int t1 = (s1) * 1856 - (s7) * 369 + (s3) * 652 - (s5) * 436;   \
+   int t3 = (s1) * 769 - (s7) * 153 - (s3) * 1573 + (s5) * 1051;
+
+static void stbi__idct_4x4(stbi_uc *out, int out_stride, short data[64])
+{
+   int i,val[32],*v=val;
+   short *d=data;
+   // rows, keeping 2 bits of fraction. row 4 adds nothing to the means
+   for (i=0; i < 8; ++i, d += 8, v += 4) {
+      if (i == 4) continue;
+      if (d[1]==0 && d[2]==0 && d[3]==0 && d[5]==0 && d[6]==0 && d[7]==0) {
+         v[0] = v[1] = v[2] = v[3] = (d[0] * 1448 + 512) >> 10;
+      } else {
+         STBI__IDCT_4(d[0],d[1],d[2],d[3],d[5],d[6],d[7])
+         v[0] = (t0 + t1 + 512) >> 10;
+         v[1] = (t2 + t3 + 512) >> 10;
+         v[2] = (t2 - t3 + 512) >> 10;
+         v[3] = (t0 - t1 + 512) >> 10;
+      }
+   }
+   // columns, then descale by 12+2 bits, round and level shift
+   for (i=0, v=val; i < 4; ++i, ++v) {
+      STBI__IDCT_4(v[0],v[4],v[8],v[12],v[20],v[24],v[28])
+      t0 += (128 << 14) + (1 << 13);
+      t2 += (128 << 14) + (1 << 13);
+      out[i             ] = stbi__clamp((t0 + t1) >> 14);
+      out[i+out_stride  ] = stbi__clamp((t2 + t3) >> 14);
+      out[i+out_stride*2] = stbi__clamp((t2 - t3) >> 14);
+      out[i+out_stride*3] = stbi__clamp((t0 - t1) >> 14);
+   }
+}
+
+// the 2-point one: the mean over 4 samples of 0.5 * C(u) * cos((2x+1)*u*pi/16)
+// is 0 for even u > 0, the odd ones flip sign between the two halves
+#define STBI__IDCT_2(s0,s1,s3,s5,s7) \
+   int e = (s0) * 1448; \
+   int o = (s1) * 1312 - (s3) * 461 + (s5) * 308 - (s7) * 261;
+
+static void stbi__idct_2x2(stbi_uc *out, int out_stride, short data[64])
+{
+   int i,val[16],*v=val;
+   short *d=data;
+   // rows 0, 1, 3, 5 and 7, keeping 2 bits of fraction
+   for (i=0; i < 8; ++i, d += 8, v += 2) {
+      if (i != 0 && !(i & 1)) continue;
+      {
+         STBI__IDCT_2(d[0],d[1],d[3],d[5],d[7])
+         v[0] = (e + o + 512) >> 10;
+         v[1] = (e - o + 512) >> 10;
+      }
+   }
+   // columns, then descale by 12+2 bits, round and level shift
+   for (i=0, v=val; i < 2; ++i, ++v) {
+      STBI__IDCT_2(v[0],v[2],v[6],v[10],v[14])
+      e += (128 << 14) + (1 << 13);
+      out[i           ] = stbi__clamp((e + o) >> 14);
+      out[i+out_stride] = stbi__clamp((e - o) >> 14);
+   }
+}
+
+static void stbi__idct_1x1(stbi_uc *out, int out_stride, short data[64])
+{
+   STBI_NOTUSED(out_stride);
+   out[0] = stbi__clamp(((data[0] + 4) >> 3) + 128);
+}
+
 #ifdef STBI_SSE2
 // sse2 integer IDCT. not the fastest possible implementation but it
 // produces bit-identical results to the generic C version so it's
@@ -2666,10 +3434,162 @@ static void stbi__jpeg_reset(stbi__jpeg *j)
    // since we don't even allow 1<<30 pixels
 }
 
+// where block (bx,by) of component n is transformed to, NULL if it is
+// outside the window of a region decode
+stbi_inline static stbi_uc *stbi__jpeg_block_dest(stbi__jpeg *z, int n, int bx, int by)
+{
+   bx -= z->win_mcu_x * z->img_comp[n].h;
+   by -= z->win_mcu_y * z->img_comp[n].v;
+   if (bx < 0 || by < 0 || bx >= z->win_mcu_w * z->img_comp[n].h || by >= z->win_mcu_h * z->img_comp[n].v)
+      return NULL;
+   if (z->stream_rows)
+      by %= 3 * z->img_comp[n].v;
+   return z->img_comp[n].data + (z->img_comp[n].w2 * by + bx) * z->idct_out;
+}
+
+#ifndef STBI_NO_PARALLEL_JPEG
+// baseline scans with a restart interval are split at the RSTn markers and
+// the independent segments are decoded on several threads. every segment
+// writes its own MCUs of img_comp[].data, so no locking is needed
+
+// below this many MCUs (or blocks) the threads cost more than they save
+#define STBI__PARALLEL_JPEG_MIN_UNITS 1024
+
+typedef struct
+{
+   stbi__jpeg *z;
+   stbi_uc **segment;   // segment_count+1 pointers, the last is the end of the scan
+   int segment_count;
+   int job_count;
+   int units;           // MCUs, or blocks for a non-interleaved scan
+   volatile int failed;
+} stbi__jpeg_parallel;
+
+// decodes units [first, first+count) of the current scan
+static int stbi__jpeg_decode_units(stbi__jpeg *z, int first, int count)
+{
+   STBI_SIMD_ALIGN(short, data[64]);
+   int m, k, x, y;
+   for (m = first; m < first + count; ++m) {
+      if (z->scan_n == 1) {
+         int n = z->order[0];
+         int w = (z->img_comp[n].x+7) >> 3;
+         int i = m % w, j = m / w;
+         int ha = z->img_comp[n].ha;
+         stbi_uc *out;
+         if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+         out = stbi__jpeg_block_dest(z, n, i, j);
+         if (out) z->idct_block_kernel(out, z->img_comp[n].w2, data);
+      } else {
+         int i = m % z->img_mcu_x, j = m / z->img_mcu_x;
+         for (k=0; k < z->scan_n; ++k) {
+            int n = z->order[k];
+            for (y=0; y < z->img_comp[n].v; ++y) {
+               for (x=0; x < z->img_comp[n].h; ++x) {
+                  int ha = z->img_comp[n].ha;
+                  stbi_uc *out;
+                  if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+                  out = stbi__jpeg_block_dest(z, n, i*z->img_comp[n].h + x, j*z->img_comp[n].v + y);
+                  if (out) z->idct_block_kernel(out, z->img_comp[n].w2, data);
+               }
+            }
+         }
+      }
+   }
+   return 1;
+}
+
+static void stbi__jpeg_parallel_job(void *arg, int job)
+{
+   stbi__jpeg_parallel *p = (stbi__jpeg_parallel *) arg;
+   int share = p->segment_count / p->job_count, extra = p->segment_count % p->job_count;
+   int first = job * share + (job < extra ? job : extra);
+   int last  = first + share + (job < extra ? 1 : 0);
+   int interval = p->z->restart_interval, k;
+   stbi__context s;
+   stbi__jpeg z = *p->z; // own bit reader and DC predictors, shared tables and output
+   z.s = &s;
+   for (k = first; k < last && !p->failed; ++k) {
+      int unit = k * interval;
+      int count = unit + interval > p->units ? p->units - unit : interval;
+      stbi__start_mem(&s, p->segment[k], (int) (p->segment[k+1] - p->segment[k]));
+      stbi__jpeg_reset(&z);
+      if (!stbi__jpeg_decode_units(&z, unit, count))
+         p->failed = 1;
+   }
+}
+
+// returns 1 or 0 like stbi__parse_entropy_coded_data, or -1 if the scan has
+// to be decoded sequentially (no restart markers, streamed input, small image...)
+static int stbi__jpeg_parse_parallel(stbi__jpeg *z)
+{
+   stbi__jpeg_parallel p;
+   stbi_uc *pos, *end;
+   int expected, threads;
+
+   if (z->progressive || z->restart_interval <= 0 || z->s->read_from_callbacks || z->stream_rows)
+      return -1;
+   if (z->scan_n == 1) {
+      int n = z->order[0];
+      p.units = ((z->img_comp[n].x+7) >> 3) * ((z->img_comp[n].y+7) >> 3);
+   } else {
+      p.units = z->img_mcu_x * z->img_mcu_y;
+   }
+   expected = (p.units + z->restart_interval - 1) / z->restart_interval;
+   threads = get_hardware_thread_count();
+   if (p.units < STBI__PARALLEL_JPEG_MIN_UNITS || expected < 2 || threads < 2)
+      return -1;
+
+   p.segment = (stbi_uc **) stbi__malloc_mad2(expected + 1, sizeof(stbi_uc *), 0);
+   if (!p.segment) return -1;
+
+   // find the segments: in entropy coded data 0xff is always followed by a
+   // stuffed 0, fill 0xffs or a marker, and only RSTn are inside the scan
+   pos = z->s->img_buffer;
+   end = z->s->img_buffer_end;
+   p.segment[0] = pos;
+   p.segment_count = 1;
+   while (pos + 1 < end) {
+      if (pos[0] != 0xff || pos[1] == 0xff) { ++pos; continue; }
+      if (pos[1] == 0x00) { pos += 2; continue; }
+      if (!STBI__RESTART(pos[1])) break;
+      pos += 2;
+      if (p.segment_count == expected) break; // more markers than MCUs, let the sequential decoder cope
+      p.segment[p.segment_count++] = pos;
+   }
+   if (pos + 1 >= end || p.segment_count != expected || STBI__RESTART(pos[1])) {
+      STBI_FREE(p.segment);
+      return -1;
+   }
+   p.segment[p.segment_count] = pos;
+
+   p.z = z;
+   p.failed = 0;
+   p.job_count = p.segment_count < threads * 4 ? p.segment_count : threads * 4;
+   run_parallel_jobs(p.job_count, threads, stbi__jpeg_parallel_job, &p);
+   STBI_FREE(p.segment);
+   if (p.failed)
+      return stbi__err("bad huffman code","Corrupt JPEG");
+
+   // continue after the scan, at the marker that ended it
+   z->s->img_buffer = pos;
+   stbi__jpeg_reset(z);
+   return 1;
+}
+#endif // STBI_NO_PARALLEL_JPEG
+
+// stbi_load_rows, below the color conversion
+static int stbi__jpeg_stream_begin(stbi__jpeg *z);
+static int stbi__jpeg_stream_rows(stbi__jpeg *z, int mcu_rows);
+
 static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
 {
    stbi__jpeg_reset(z);
    if (!z->progressive) {
+#ifndef STBI_NO_PARALLEL_JPEG
+      int parallel = stbi__jpeg_parse_parallel(z);
+      if (parallel >= 0) return parallel;
+#endif
       if (z->scan_n == 1) {
          int i,j;
          STBI_SIMD_ALIGN(short, data[64]);
@@ -2683,8 +3603,10 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
          for (j=0; j < h; ++j) {
             for (i=0; i < w; ++i) {
                int ha = z->img_comp[n].ha;
+               stbi_uc *out;
                if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
+               out = stbi__jpeg_block_dest(z, n, i, j);
+               if (out) z->idct_block_kernel(out, z->img_comp[n].w2, data);
                // every data block is an MCU, so countdown the restart interval
                if (--z->todo <= 0) {
                   if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
@@ -2694,6 +3616,12 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
                   stbi__jpeg_reset(z);
                }
             }
+            if (z->stream_rows && !stbi__jpeg_stream_rows(z, (j+1) / z->img_comp[n].v)) return 0;
+            // a region decode of a one component image is done below the window
+            if (z->crop_w && z->s->img_n == 1 && j+1 >= (z->win_mcu_y + z->win_mcu_h) * z->img_comp[n].v) {
+               z->rest_skipped = 1;
+               return 1;
+            }
          }
          return 1;
       } else { // interleaved
@@ -2708,11 +3636,11 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
                   // by the basic H and V specified for the component
                   for (y=0; y < z->img_comp[n].v; ++y) {
                      for (x=0; x < z->img_comp[n].h; ++x) {
-                        int x2 = (i*z->img_comp[n].h + x)*8;
-                        int y2 = (j*z->img_comp[n].v + y)*8;
                         int ha = z->img_comp[n].ha;
+                        stbi_uc *out;
                         if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-                        z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data);
+                        out = stbi__jpeg_block_dest(z, n, i*z->img_comp[n].h + x, j*z->img_comp[n].v + y);
+                        if (out) z->idct_block_kernel(out, z->img_comp[n].w2, data);
                      }
                   }
                }
@@ -2724,6 +3652,12 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
                   stbi__jpeg_reset(z);
                }
             }
+            if (z->stream_rows && !stbi__jpeg_stream_rows(z, j+1)) return 0;
+            // a region decode is done below the window if this is the only scan
+            if (z->crop_w && z->scan_n == z->s->img_n && j+1 >= z->win_mcu_y + z->win_mcu_h) {
+               z->rest_skipped = 1;
+               return 1;
+            }
          }
          return 1;
       }
@@ -2808,8 +3742,10 @@ static void stbi__jpeg_finish(stbi__jpeg *z)
          for (j=0; j < h; ++j) {
             for (i=0; i < w; ++i) {
                short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
+               stbi_uc *out = stbi__jpeg_block_dest(z, n, i, j);
+               if (!out) continue;
                stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
+               z->idct_block_kernel(out, z->img_comp[n].w2, data);
             }
          }
       }
@@ -2983,7 +3919,7 @@ static int stbi__free_jpeg_components(stbi__jpeg *z, int ncomp, int why)
 static int stbi__process_frame_header(stbi__jpeg *z, int scan)
 {
    stbi__context *s = z->s;
-   int Lf,p,i,q, h_max=1,v_max=1,c;
+   int Lf,p,i,q, h_max=1,v_max=1,c,plane_mcu_h;
    Lf = stbi__get16be(s);         if (Lf < 11) return stbi__err("bad SOF len","Corrupt JPEG"); // JPEG
    p  = stbi__get8(s);            if (p != 8) return stbi__err("only 8-bit","JPEG format not supported: 8-bit only"); // JPEG baseline
    s->img_y = stbi__get16be(s);   if (s->img_y == 0) return stbi__err("no header height", "JPEG format not supported: delayed height"); // Legal, but we don't handle it--but neither does IJG
@@ -3028,6 +3964,31 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
    z->img_mcu_x = (s->img_x + z->img_mcu_w-1) / z->img_mcu_w;
    z->img_mcu_y = (s->img_y + z->img_mcu_h-1) / z->img_mcu_h;
 
+   z->win_mcu_x = z->win_mcu_y = 0;
+   z->win_mcu_w = z->img_mcu_x;
+   z->win_mcu_h = z->img_mcu_y;
+   z->crop_w = 0;
+   if (s->region_w) {
+      int x0, y0, w, h, mx1, my1;
+      if (!stbi__clip_region(s, s->img_x, s->img_y, &x0, &y0, &w, &h)) return 0;
+      // one MCU of margin all round, so chroma upsampling at the edges of the
+      // region sees the same neighbours as in a full decode
+      z->win_mcu_x = x0 / z->img_mcu_w > 0 ? x0 / z->img_mcu_w - 1 : 0;
+      z->win_mcu_y = y0 / z->img_mcu_h > 0 ? y0 / z->img_mcu_h - 1 : 0;
+      mx1 = (x0 + w + z->img_mcu_w-1) / z->img_mcu_w + 1;
+      my1 = (y0 + h + z->img_mcu_h-1) / z->img_mcu_h + 1;
+      z->win_mcu_w = (mx1 < z->img_mcu_x ? mx1 : z->img_mcu_x) - z->win_mcu_x;
+      z->win_mcu_h = (my1 < z->img_mcu_y ? my1 : z->img_mcu_y) - z->win_mcu_y;
+      z->crop_x = x0 - z->win_mcu_x * z->img_mcu_w;
+      z->crop_y = y0 - z->win_mcu_y * z->img_mcu_h;
+      z->crop_w = w;
+      z->crop_h = h;
+   }
+
+   // stbi_load_rows only keeps the last 3 MCU rows of a sequential image
+   if (z->progressive) z->stream_rows = 0;
+   plane_mcu_h = z->stream_rows && z->win_mcu_h > 3 ? 3 : z->win_mcu_h;
+
    for (i=0; i < s->img_n; ++i) {
       // number of effective pixels (e.g. for non-interleaved MCU)
       z->img_comp[i].x = (s->img_x * z->img_comp[i].h + h_max-1) / h_max;
@@ -3039,8 +4000,8 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
       //
       // img_mcu_x, img_mcu_y: <=17 bits; comp[i].h and .v are <=4 (checked earlier)
       // so these muls can't overflow with 32-bit ints (which we require)
-      z->img_comp[i].w2 = z->img_mcu_x * z->img_comp[i].h * 8;
-      z->img_comp[i].h2 = z->img_mcu_y * z->img_comp[i].v * 8;
+      z->img_comp[i].w2 = z->win_mcu_w * z->img_comp[i].h * z->idct_out;
+      z->img_comp[i].h2 = plane_mcu_h * z->img_comp[i].v * z->idct_out;
       z->img_comp[i].coeff = 0;
       z->img_comp[i].raw_coeff = 0;
       z->img_comp[i].linebuf = NULL;
@@ -3050,10 +4011,10 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
       // align blocks for idct using mmx/sse
       z->img_comp[i].data = (stbi_uc*) (((size_t) z->img_comp[i].raw_data + 15) & ~15);
       if (z->progressive) {
-         // w2, h2 are multiples of 8 (see above)
-         z->img_comp[i].coeff_w = z->img_comp[i].w2 / 8;
-         z->img_comp[i].coeff_h = z->img_comp[i].h2 / 8;
-         z->img_comp[i].raw_coeff = stbi__malloc_mad3(z->img_comp[i].w2, z->img_comp[i].h2, sizeof(short), 15);
+         // one block per 8x8 pixels of the full size image
+         z->img_comp[i].coeff_w = z->img_mcu_x * z->img_comp[i].h;
+         z->img_comp[i].coeff_h = z->img_mcu_y * z->img_comp[i].v;
+         z->img_comp[i].raw_coeff = stbi__malloc_mad3(z->img_comp[i].coeff_w * 8, z->img_comp[i].coeff_h * 8, sizeof(short), 15);
          if (z->img_comp[i].raw_coeff == NULL)
             return stbi__free_jpeg_components(z, i+1, stbi__err("outofmem", "Out of memory"));
          z->img_comp[i].coeff = (short*) (((size_t) z->img_comp[i].raw_coeff + 15) & ~15);
@@ -3105,12 +4066,15 @@ static int stbi__decode_jpeg_image(stbi__jpeg *j)
       j->img_comp[m].raw_coeff = NULL;
    }
    j->restart_interval = 0;
+   j->rest_skipped = 0;
    if (!stbi__decode_jpeg_header(j, STBI__SCAN_load)) return 0;
    m = stbi__get_marker(j);
    while (!stbi__EOI(m)) {
       if (stbi__SOS(m)) {
          if (!stbi__process_scan_header(j)) return 0;
+         if (j->stream_rows && !j->stream_out && !stbi__jpeg_stream_begin(j)) return 0;
          if (!stbi__parse_entropy_coded_data(j)) return 0;
+         if (j->rest_skipped) return 1;
          if (j->marker == STBI__MARKER_none ) {
             // handle 0s at the end of image data from IP Kamera 9060
             while (!stbi__at_eof(j->s)) {
@@ -3139,9 +4103,6 @@ static int stbi__decode_jpeg_image(stbi__jpeg *j)
 
 // static jfif-centered resampling (across block boundaries)
 
-typedef stbi_uc *(*resample_row_func)(stbi_uc *out, stbi_uc *in0, stbi_uc *in1,
-                                    int w, int hs);
-
 #define stbi__div4(x) ((stbi_uc) ((x) >> 2))
 
 static stbi_uc *resample_row_1(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
@@ -3368,7 +4329,7 @@ static void stbi__YCbCr_to_RGB_row(stbi_uc *out, const stbi_uc *y, const stbi_uc
       out[0] = (stbi_uc)r;
       out[1] = (stbi_uc)g;
       out[2] = (stbi_uc)b;
-      out[3] = 255;
+      if (step == 4) out[3] = 255; // step 3 must not write past the last pixel of the row
       out += step;
    }
 }
@@ -3502,12 +4463,129 @@ static void stbi__YCbCr_to_RGB_simd(stbi_uc *out, stbi_uc const *y, stbi_uc cons
       out[0] = (stbi_uc)r;
       out[1] = (stbi_uc)g;
       out[2] = (stbi_uc)b;
-      out[3] = 255;
+      if (step == 4) out[3] = 255;
       out += step;
    }
 }
 #endif
 
+#ifdef STBI_AVX2
+// AVX2 versions of the upsampler and color converter, 16 pixels at a time.
+// they give the same results as the SSE2 code and are picked at run time
+static STBI__AVX2_TARGET stbi_uc *stbi__resample_row_hv_2_avx2(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
+{
+   int i=0,t0,t1;
+
+   if (w == 1) {
+      out[0] = out[1] = stbi__div4(3*in_near[0] + in_far[0] + 2);
+      return out;
+   }
+
+   t1 = 3*in_near[0] + in_far[0];
+   for (; i < ((w-1) & ~15); i += 16) {
+      // vertical pass, 3*near + far = 4*near + (far - near)
+      __m256i farw  = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_far + i)));
+      __m256i nearw = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_near + i)));
+      __m256i curr  = _mm256_add_epi16(_mm256_slli_epi16(nearw, 2), _mm256_sub_epi16(farw, nearw));
+
+      // current row shifted by one pixel each way, across the two lanes
+      __m256i lo    = _mm256_permute2x128_si256(curr, curr, 0x08); // [0, curr.lo]
+      __m256i hi    = _mm256_permute2x128_si256(curr, curr, 0x81); // [curr.hi, 0]
+      __m256i prev  = _mm256_insert_epi16(_mm256_alignr_epi8(curr, lo, 14), t1, 0);
+      __m256i next  = _mm256_insert_epi16(_mm256_alignr_epi8(hi, curr, 2), 3*in_near[i+16] + in_far[i+16], 15);
+
+      // horizontal pass, same polyphase filter as the SSE2 version
+      __m256i bias  = _mm256_set1_epi16(8);
+      __m256i curb  = _mm256_add_epi16(_mm256_slli_epi16(curr, 2), bias);
+      __m256i even  = _mm256_add_epi16(_mm256_sub_epi16(prev, curr), curb);
+      __m256i odd   = _mm256_add_epi16(_mm256_sub_epi16(next, curr), curb);
+
+      // interleave even and odd pixels ( within each lane, which keeps
+      // the 32 output bytes in order after the pack ), descale and store
+      __m256i de0   = _mm256_srli_epi16(_mm256_unpacklo_epi16(even, odd), 4);
+      __m256i de1   = _mm256_srli_epi16(_mm256_unpackhi_epi16(even, odd), 4);
+      _mm256_storeu_si256((__m256i *) (out + i*2), _mm256_packus_epi16(de0, de1));
+
+      t1 = 3*in_near[i+15] + in_far[i+15];
+   }
+
+   t0 = t1;
+   t1 = 3*in_near[i] + in_far[i];
+   out[i*2] = stbi__div16(3*t1 + t0 + 8);
+
+   for (++i; i < w; ++i) {
+      t0 = t1;
+      t1 = 3*in_near[i]+in_far[i];
+      out[i*2-1] = stbi__div16(3*t0 + t1 + 8);
+      out[i*2  ] = stbi__div16(3*t1 + t0 + 8);
+   }
+   out[w*2-1] = stbi__div4(t1+2);
+
+   STBI_NOTUSED(hs);
+
+   return out;
+}
+
+static STBI__AVX2_TARGET void stbi__YCbCr_to_RGB_avx2(stbi_uc *out, stbi_uc const *y, stbi_uc const *pcb, stbi_uc const *pcr, int count, int step)
+{
+   int i = 0;
+   if (step == 4 || step == 3) {
+      __m256i cr_const0 = _mm256_set1_epi16(   (short) ( 1.40200f*4096.0f+0.5f));
+      __m256i cr_const1 = _mm256_set1_epi16( - (short) ( 0.71414f*4096.0f+0.5f));
+      __m256i cb_const0 = _mm256_set1_epi16( - (short) ( 0.34414f*4096.0f+0.5f));
+      __m256i cb_const1 = _mm256_set1_epi16(   (short) ( 1.77200f*4096.0f+0.5f));
+      __m256i bias128 = _mm256_set1_epi16(128);
+      __m256i y_round = _mm256_set1_epi16(8);
+      __m256i xw = _mm256_set1_epi16(255); // alpha channel
+      // drops every 4th byte of each lane, for step == 3
+      __m256i rgb_only = _mm256_setr_epi8(0,1,2,4,5,6,8,9,10,12,13,14,-1,-1,-1,-1,
+                                          0,1,2,4,5,6,8,9,10,12,13,14,-1,-1,-1,-1);
+
+      // step == 3 stores 4 bytes past the 16 pixels, so keep 2 pixels spare
+      for (; i + 16 + (step == 3 ? 2 : 0) <= count; i += 16) {
+         // widen to shorts: y*16+8 and (c-128)*256, as the SSE2 unpacks do
+         __m256i yws = _mm256_add_epi16(_mm256_slli_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (y+i))), 4), y_round);
+         __m256i crw = _mm256_slli_epi16(_mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (pcr+i))), bias128), 8);
+         __m256i cbw = _mm256_slli_epi16(_mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (pcb+i))), bias128), 8);
+
+         // color transform
+         __m256i rws = _mm256_add_epi16(_mm256_mulhi_epi16(cr_const0, crw), yws);
+         __m256i gws = _mm256_add_epi16(_mm256_add_epi16(_mm256_mulhi_epi16(cb_const0, cbw), yws), _mm256_mulhi_epi16(crw, cr_const1));
+         __m256i bws = _mm256_add_epi16(yws, _mm256_mulhi_epi16(cbw, cb_const1));
+
+         // descale, back to bytes and interleave, per lane:
+         // o0 holds pixels 0-3 / 8-11, o1 pixels 4-7 / 12-15
+         __m256i brb = _mm256_packus_epi16(_mm256_srai_epi16(rws, 4), _mm256_srai_epi16(bws, 4));
+         __m256i gxb = _mm256_packus_epi16(_mm256_srai_epi16(gws, 4), xw);
+         __m256i t0 = _mm256_unpacklo_epi8(brb, gxb);
+         __m256i t1 = _mm256_unpackhi_epi8(brb, gxb);
+         __m256i o0 = _mm256_unpacklo_epi16(t0, t1);
+         __m256i o1 = _mm256_unpackhi_epi16(t0, t1);
+         __m256i p0 = _mm256_permute2x128_si256(o0, o1, 0x20); // pixels 0-7
+         __m256i p1 = _mm256_permute2x128_si256(o0, o1, 0x31); // pixels 8-15
+
+         if (step == 4) {
+            _mm256_storeu_si256((__m256i *) (out + 0), p0);
+            _mm256_storeu_si256((__m256i *) (out + 32), p1);
+            out += 64;
+         } else {
+            __m256i q0 = _mm256_shuffle_epi8(p0, rgb_only);
+            __m256i q1 = _mm256_shuffle_epi8(p1, rgb_only);
+            // 12 good bytes per 16 byte store, each store covers the last one's tail
+            _mm_storeu_si128((__m128i *) (out + 0), _mm256_castsi256_si128(q0));
+            _mm_storeu_si128((__m128i *) (out + 12), _mm256_extracti128_si256(q0, 1));
+            _mm_storeu_si128((__m128i *) (out + 24), _mm256_castsi256_si128(q1));
+            _mm_storeu_si128((__m128i *) (out + 36), _mm256_extracti128_si256(q1, 1));
+            out += 48;
+         }
+      }
+   }
+   // the rest, SSE2 and scalar
+   if (i < count)
+      stbi__YCbCr_to_RGB_simd(out, y + i, pcb + i, pcr + i, count - i, step);
+}
+#endif // STBI_AVX2
+
 // set up the kernels
 static void stbi__setup_jpeg(stbi__jpeg *j)
 {
@@ -3523,29 +4601,37 @@ static void stbi__setup_jpeg(stbi__jpeg *j)
    }
 #endif
 
+#ifdef STBI_AVX2
+   // the IDCT works on one 8x8 block, already a full SSE2 register per row
+   if (stbi__avx2_available()) {
+      j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_avx2;
+      j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_avx2;
+   }
+#endif
+
 #ifdef STBI_NEON
    j->idct_block_kernel = stbi__idct_simd;
    j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
    j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_simd;
 #endif
+
+   // last, so the reduced kernels replace every full size one picked above
+   j->idct_out = 8;
+   switch (j->s->jpeg_scale) {
+      case 2: j->idct_block_kernel = stbi__idct_4x4; j->idct_out = 4; break;
+      case 4: j->idct_block_kernel = stbi__idct_2x2; j->idct_out = 2; break;
+      case 8: j->idct_block_kernel = stbi__idct_1x1; j->idct_out = 1; break;
+   }
 }
 
 // clean up the temporary component buffers
 static void stbi__cleanup_jpeg(stbi__jpeg *j)
 {
    stbi__free_jpeg_components(j, j->s->img_n, 0);
+   STBI_FREE(j->stream_out);
+   j->stream_out = NULL;
 }
 
-typedef struct
-{
-   resample_row_func resample;
-   stbi_uc *line0,*line1;
-   int hs,vs;   // expansion factor in each axis
-   int w_lores; // horizontal pixels pre-expansion
-   int ystep;   // how far through vertical expansion we are
-   int ypos;    // which pre-expansion row we're on
-} stbi__resample;
-
 // fast 0..255 * 0..255 => 0..255 rounded multiplication
 static stbi_uc stbi__blinn_8x8(stbi_uc x, stbi_uc y)
 {
@@ -3553,10 +4639,207 @@ static stbi_uc stbi__blinn_8x8(stbi_uc x, stbi_uc y)
    return (stbi_uc) ((t + (t >>8)) >> 8);
 }
 
+// picks the components to output and sets up the resamplers of the planes
+static int stbi__jpeg_begin_output(stbi__jpeg *z, int req_comp)
+{
+   int k;
+
+   // determine actual number of components to generate
+   z->out_n = req_comp ? req_comp : z->s->img_n >= 3 ? 3 : 1;
+
+   z->is_rgb = z->s->img_n == 3 && (z->rgb == 3 || (z->app14_color_transform == 0 && !z->jfif));
+
+   if (z->s->img_n == 3 && z->out_n < 3 && !z->is_rgb)
+      z->decode_n = 1;
+   else
+      z->decode_n = z->s->img_n;
+
+   for (k=0; k < z->decode_n; ++k) {
+      stbi__resample *r = &z->res_comp[k];
+
+      // allocate line buffer big enough for upsampling off the edges
+      // with upsample factor of 4
+      z->img_comp[k].linebuf = (stbi_uc *) stbi__malloc(z->s->img_x + 3);
+      if (!z->img_comp[k].linebuf) return stbi__err("outofmem", "Out of memory");
+
+      r->hs      = z->img_h_max / z->img_comp[k].h;
+      r->vs      = z->img_v_max / z->img_comp[k].v;
+      r->ystep   = r->vs >> 1;
+      r->w_lores = (z->s->img_x + r->hs-1) / r->hs;
+      r->ypos    = 0;
+      r->line0   = r->line1 = z->img_comp[k].data;
+
+      if      (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
+      else if (r->hs == 1 && r->vs == 2) r->resample = stbi__resample_row_v_2;
+      else if (r->hs == 2 && r->vs == 1) r->resample = stbi__resample_row_h_2;
+      else if (r->hs == 2 && r->vs == 2) r->resample = z->resample_row_hv_2_kernel;
+      else                               r->resample = stbi__resample_row_generic;
+   }
+   return 1;
+}
+
+// upsamples the next row of every component into coutput, starting crop_x
+// pixels in; coutput NULL only moves the resamplers past the row
+static void stbi__jpeg_resample_row(stbi__jpeg *z, stbi_uc **coutput, int crop_x)
+{
+   int k;
+   for (k=0; k < z->decode_n; ++k) {
+      stbi__resample *r = &z->res_comp[k];
+      int y_bot = r->ystep >= (r->vs >> 1);
+      if (coutput)
+         coutput[k] = r->resample(z->img_comp[k].linebuf,
+                                  y_bot ? r->line1 : r->line0,
+                                  y_bot ? r->line0 : r->line1,
+                                  r->w_lores, r->hs) + crop_x;
+      if (++r->ystep >= r->vs) {
+         r->ystep = 0;
+         r->line0 = r->line1;
+         if (++r->ypos < z->img_comp[k].y) {
+            r->line1 += z->img_comp[k].w2;
+            // the planes of stbi_load_rows wrap around
+            if (r->line1 == z->img_comp[k].data + z->img_comp[k].w2 * z->img_comp[k].h2)
+               r->line1 = z->img_comp[k].data;
+         }
+      }
+   }
+}
+
+// color converts w pixels of upsampled components to out_n channels
+static void stbi__jpeg_convert_row(stbi__jpeg *z, stbi_uc *out, stbi_uc **coutput, int w)
+{
+   int i, n = z->out_n;
+   if (n >= 3) {
+      stbi_uc *y = coutput[0];
+      if (z->s->img_n == 3) {
+         if (z->is_rgb) {
+            for (i=0; i < w; ++i) {
+               out[0] = y[i];
+               out[1] = coutput[1][i];
+               out[2] = coutput[2][i];
+               if (n == 4) out[3] = 255;
+               out += n;
+            }
+         } else {
+            z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], w, n);
+         }
+      } else if (z->s->img_n == 4) {
+         if (z->app14_color_transform == 0) { // CMYK
+            for (i=0; i < w; ++i) {
+               stbi_uc k = coutput[3][i];
+               out[0] = stbi__blinn_8x8(coutput[0][i], k);
+               out[1] = stbi__blinn_8x8(coutput[1][i], k);
+               out[2] = stbi__blinn_8x8(coutput[2][i], k);
+               if (n == 4) out[3] = 255;
+               out += n;
+            }
+         } else if (z->app14_color_transform == 2) { // YCCK
+            z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], w, n);
+            for (i=0; i < w; ++i) {
+               stbi_uc k = coutput[3][i];
+               out[0] = stbi__blinn_8x8(255 - out[0], k);
+               out[1] = stbi__blinn_8x8(255 - out[1], k);
+               out[2] = stbi__blinn_8x8(255 - out[2], k);
+               out += n;
+            }
+         } else { // YCbCr + alpha?  Ignore the fourth channel for now
+            z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], w, n);
+         }
+      } else
+         for (i=0; i < w; ++i) {
+            out[0] = out[1] = out[2] = y[i];
+            if (n == 4) out[3] = 255; // n==3 may be writing the caller's buffer
+            out += n;
+         }
+   } else {
+      if (z->is_rgb) {
+         if (n == 1)
+            for (i=0; i < w; ++i)
+               *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+         else {
+            for (i=0; i < w; ++i, out += 2) {
+               out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+               out[1] = 255;
+            }
+         }
+      } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
+         for (i=0; i < w; ++i) {
+            stbi_uc k = coutput[3][i];
+            stbi_uc r = stbi__blinn_8x8(coutput[0][i], k);
+            stbi_uc g = stbi__blinn_8x8(coutput[1][i], k);
+            stbi_uc b = stbi__blinn_8x8(coutput[2][i], k);
+            out[0] = stbi__compute_y(r, g, b);
+            if (n == 2) out[1] = 255; // n==1 may be writing the caller's buffer
+            out += n;
+         }
+      } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
+         for (i=0; i < w; ++i) {
+            out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
+            if (n == 2) out[1] = 255; // n==1 may be writing the caller's buffer
+            out += n;
+         }
+      } else {
+         stbi_uc *y = coutput[0];
+         if (n == 1)
+            for (i=0; i < w; ++i) out[i] = y[i];
+         else
+            for (i=0; i < w; ++i) *out++ = y[i], *out++ = 255;
+      }
+   }
+}
+
+// called at the first scan: streams it if it has every component, otherwise
+// the planes are grown back to the whole image
+static int stbi__jpeg_stream_begin(stbi__jpeg *z)
+{
+   int i;
+   if (z->scan_n != z->s->img_n) {
+      z->stream_rows = 0;
+      for (i=0; i < z->s->img_n; ++i) {
+         STBI_FREE(z->img_comp[i].raw_data);
+         z->img_comp[i].h2 = z->img_mcu_y * z->img_comp[i].v * z->idct_out;
+         z->img_comp[i].raw_data = stbi__malloc_mad2(z->img_comp[i].w2, z->img_comp[i].h2, 15);
+         if (z->img_comp[i].raw_data == NULL)
+            return stbi__free_jpeg_components(z, z->s->img_n, stbi__err("outofmem", "Out of memory"));
+         z->img_comp[i].data = (stbi_uc*) (((size_t) z->img_comp[i].raw_data + 15) & ~15);
+      }
+      return 1;
+   }
+   if (!stbi__jpeg_begin_output(z, z->stream_req_comp)) return 0;
+   // room for the two MCU rows that may be handed out at the end
+   z->stream_out = (stbi_uc *) stbi__malloc_mad3(z->s->img_x, z->out_n, z->img_mcu_h * 2, 0);
+   if (!z->stream_out) return stbi__err("outofmem", "Out of memory");
+   z->stream_y = 0;
+   return 1;
+}
+
+// hands out the rows that have all their upsampling neighbours once the
+// first mcu_rows MCU rows are decoded, or all that are left
+static int stbi__jpeg_stream_rows(stbi__jpeg *z, int mcu_rows)
+{
+   int last = mcu_rows >= z->img_mcu_y ? (int) z->s->img_y : (mcu_rows - 1) * z->img_mcu_h;
+   int row_bytes = z->s->img_x * z->out_n;
+   stbi_uc *coutput[4];
+   while (z->stream_y < last) {
+      int y0 = z->stream_y, count = last - y0, j;
+      if (count > z->img_mcu_h * 2) count = z->img_mcu_h * 2;
+      for (j=0; j < count; ++j) {
+         stbi__jpeg_resample_row(z, coutput, 0);
+         stbi__jpeg_convert_row(z, z->stream_out + j * row_bytes, coutput, z->s->img_x);
+      }
+      z->stream_y += count;
+      if (!stbi__emit_rows(z->s, z->stream_out, z->s->img_x, z->s->img_y, z->out_n, z->out_n, 8, y0, count))
+         return 0;
+   }
+   return 1;
+}
+
 static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
 {
-   int n, decode_n, is_rgb;
+   int out_w, out_h, crop_x = 0, crop_y = 0;
    z->s->img_n = 0; // make stbi__cleanup_jpeg safe
+   z->stream_rows = z->s->row_cb != NULL;
+   z->stream_req_comp = req_comp;
+   z->stream_out = NULL;
 
    // validate req_comp
    if (req_comp < 0 || req_comp > 4) return stbi__errpuc("bad req_comp", "Internal error");
@@ -3564,149 +4847,82 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
    // load a jpeg image from whichever source, but leave in YCbCr format
    if (!stbi__decode_jpeg_image(z)) { stbi__cleanup_jpeg(z); return NULL; }
 
-   // determine actual number of components to generate
-   n = req_comp ? req_comp : z->s->img_n >= 3 ? 3 : 1;
+   if (z->stream_rows) {
+      stbi_uc *rows = z->stream_out;
+      // hand out whatever a short scan left
+      if (!rows) { stbi__cleanup_jpeg(z); return stbi__errpuc("no SOS", "Corrupt JPEG"); }
+      if (!stbi__jpeg_stream_rows(z, z->img_mcu_y)) { stbi__cleanup_jpeg(z); return NULL; }
+      z->stream_out = NULL;
+      stbi__cleanup_jpeg(z);
+      *out_x = z->s->img_x;
+      *out_y = z->s->img_y;
+      if (comp) *comp = z->s->img_n >= 3 ? 3 : 1;
+      z->s->rows_done = 1;
+      return rows;
+   }
+
+   // a scaled decode left smaller planes, from here on it is a smaller image
+   if (z->idct_out != 8) {
+      int k, scale = 8 / z->idct_out;
+      z->s->img_x = (z->s->img_x + scale-1) / scale;
+      z->s->img_y = (z->s->img_y + scale-1) / scale;
+      for (k=0; k < z->s->img_n; ++k) {
+         z->img_comp[k].x = (z->img_comp[k].x + scale-1) / scale;
+         z->img_comp[k].y = (z->img_comp[k].y + scale-1) / scale;
+      }
+   }
 
-   is_rgb = z->s->img_n == 3 && (z->rgb == 3 || (z->app14_color_transform == 0 && !z->jfif));
+   // a region decode only has the window of MCUs around the region: that
+   // is the image as far as upsampling goes, the region is cut out below
+   out_w = z->s->img_x;
+   out_h = z->s->img_y;
+   if (z->crop_w) {
+      int k, wx = z->win_mcu_x * z->img_mcu_w, wy = z->win_mcu_y * z->img_mcu_h;
+      int wx1 = wx + z->win_mcu_w * z->img_mcu_w, wy1 = wy + z->win_mcu_h * z->img_mcu_h;
+      z->s->img_x = (wx1 < (int) z->s->img_x ? wx1 : (int) z->s->img_x) - wx;
+      z->s->img_y = (wy1 < (int) z->s->img_y ? wy1 : (int) z->s->img_y) - wy;
+      for (k=0; k < z->s->img_n; ++k) {
+         z->img_comp[k].x = (z->s->img_x * z->img_comp[k].h + z->img_h_max-1) / z->img_h_max;
+         z->img_comp[k].y = (z->s->img_y * z->img_comp[k].v + z->img_v_max-1) / z->img_v_max;
+      }
+      crop_x = z->crop_x;
+      crop_y = z->crop_y;
+      out_w = z->crop_w;
+      out_h = z->crop_h;
+      z->s->region_done = 1;
+   }
 
-   if (z->s->img_n == 3 && n < 3 && !is_rgb)
-      decode_n = 1;
-   else
-      decode_n = z->s->img_n;
+   if (!stbi__jpeg_begin_output(z, req_comp)) { stbi__cleanup_jpeg(z); return NULL; }
 
    // resample and color-convert
    {
-      int k;
-      unsigned int i,j;
-      stbi_uc *output;
-      stbi_uc *coutput[4];
-
-      stbi__resample res_comp[4];
-
-      for (k=0; k < decode_n; ++k) {
-         stbi__resample *r = &res_comp[k];
-
-         // allocate line buffer big enough for upsampling off the edges
-         // with upsample factor of 4
-         z->img_comp[k].linebuf = (stbi_uc *) stbi__malloc(z->s->img_x + 3);
-         if (!z->img_comp[k].linebuf) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
-
-         r->hs      = z->img_h_max / z->img_comp[k].h;
-         r->vs      = z->img_v_max / z->img_comp[k].v;
-         r->ystep   = r->vs >> 1;
-         r->w_lores = (z->s->img_x + r->hs-1) / r->hs;
-         r->ypos    = 0;
-         r->line0   = r->line1 = z->img_comp[k].data;
+      int j, n = z->out_n;
+      stbi_uc *output;
+      stbi_uc *coutput[4];
+      int stride = n * out_w, flip = 0;
 
-         if      (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
-         else if (r->hs == 1 && r->vs == 2) r->resample = stbi__resample_row_v_2;
-         else if (r->hs == 2 && r->vs == 1) r->resample = stbi__resample_row_h_2;
-         else if (r->hs == 2 && r->vs == 2) r->resample = z->resample_row_hv_2_kernel;
-         else                               r->resample = stbi__resample_row_generic;
+      // can't error after this so, this is safe
+      if (z->s->out_buffer) {
+         // write the rows straight into the caller's memory
+         stride = stbi__out_buffer_stride(z->s, out_w, out_h, n);
+         if (!stride) { stbi__cleanup_jpeg(z); return stbi__errpuc("buffer too small", "Output buffer too small for image"); }
+         output = z->s->out_buffer;
+         flip = z->s->out_flip;
+         z->s->out_written = 1;
+      } else {
+         output = (stbi_uc *) stbi__malloc_mad3(n, out_w, out_h, 1);
+         if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
       }
 
-      // can't error after this so, this is safe
-      output = (stbi_uc *) stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
-      if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
-
-      // now go ahead and resample
-      for (j=0; j < z->s->img_y; ++j) {
-         stbi_uc *out = output + n * z->s->img_x * j;
-         for (k=0; k < decode_n; ++k) {
-            stbi__resample *r = &res_comp[k];
-            int y_bot = r->ystep >= (r->vs >> 1);
-            coutput[k] = r->resample(z->img_comp[k].linebuf,
-                                     y_bot ? r->line1 : r->line0,
-                                     y_bot ? r->line0 : r->line1,
-                                     r->w_lores, r->hs);
-            if (++r->ystep >= r->vs) {
-               r->ystep = 0;
-               r->line0 = r->line1;
-               if (++r->ypos < z->img_comp[k].y)
-                  r->line1 += z->img_comp[k].w2;
-            }
-         }
-         if (n >= 3) {
-            stbi_uc *y = coutput[0];
-            if (z->s->img_n == 3) {
-               if (is_rgb) {
-                  for (i=0; i < z->s->img_x; ++i) {
-                     out[0] = y[i];
-                     out[1] = coutput[1][i];
-                     out[2] = coutput[2][i];
-                     out[3] = 255;
-                     out += n;
-                  }
-               } else {
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-               }
-            } else if (z->s->img_n == 4) {
-               if (z->app14_color_transform == 0) { // CMYK
-                  for (i=0; i < z->s->img_x; ++i) {
-                     stbi_uc k = coutput[3][i];
-                     out[0] = stbi__blinn_8x8(coutput[0][i], k);
-                     out[1] = stbi__blinn_8x8(coutput[1][i], k);
-                     out[2] = stbi__blinn_8x8(coutput[2][i], k);
-                     out[3] = 255;
-                     out += n;
-                  }
-               } else if (z->app14_color_transform == 2) { // YCCK
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-                  for (i=0; i < z->s->img_x; ++i) {
-                     stbi_uc k = coutput[3][i];
-                     out[0] = stbi__blinn_8x8(255 - out[0], k);
-                     out[1] = stbi__blinn_8x8(255 - out[1], k);
-                     out[2] = stbi__blinn_8x8(255 - out[2], k);
-                     out += n;
-                  }
-               } else { // YCbCr + alpha?  Ignore the fourth channel for now
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-               }
-            } else
-               for (i=0; i < z->s->img_x; ++i) {
-                  out[0] = out[1] = out[2] = y[i];
-                  out[3] = 255; // not used if n==3
-                  out += n;
-               }
-         } else {
-            if (is_rgb) {
-               if (n == 1)
-                  for (i=0; i < z->s->img_x; ++i)
-                     *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-               else {
-                  for (i=0; i < z->s->img_x; ++i, out += 2) {
-                     out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-                     out[1] = 255;
-                  }
-               }
-            } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
-               for (i=0; i < z->s->img_x; ++i) {
-                  stbi_uc k = coutput[3][i];
-                  stbi_uc r = stbi__blinn_8x8(coutput[0][i], k);
-                  stbi_uc g = stbi__blinn_8x8(coutput[1][i], k);
-                  stbi_uc b = stbi__blinn_8x8(coutput[2][i], k);
-                  out[0] = stbi__compute_y(r, g, b);
-                  out[1] = 255;
-                  out += n;
-               }
-            } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
-               for (i=0; i < z->s->img_x; ++i) {
-                  out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
-                  out[1] = 255;
-                  out += n;
-               }
-            } else {
-               stbi_uc *y = coutput[0];
-               if (n == 1)
-                  for (i=0; i < z->s->img_x; ++i) out[i] = y[i];
-               else
-                  for (i=0; i < z->s->img_x; ++i) *out++ = y[i], *out++ = 255;
-            }
-         }
+      // now go ahead and resample; rows above a region only move the resamplers along
+      for (j=0; j < crop_y + out_h; ++j) {
+         stbi__jpeg_resample_row(z, j >= crop_y ? coutput : NULL, crop_x);
+         if (j < crop_y) continue;
+         stbi__jpeg_convert_row(z, output + stride * (flip ? crop_y + out_h - 1 - j : j - crop_y), coutput, out_w);
       }
       stbi__cleanup_jpeg(z);
-      *out_x = z->s->img_x;
-      *out_y = z->s->img_y;
+      *out_x = out_w;
+      *out_y = out_h;
       if (comp) *comp = z->s->img_n >= 3 ? 3 : 1; // report original components, not output
       return output;
    }
@@ -3764,14 +4980,20 @@ static int stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp)
 //      - all input must be provided in an upfront buffer
 //      - all output is written to a single output buffer (can malloc/realloc)
 //    performance
-//      - fast huffman
+//      - fast huffman, two literals per lookup where both codes fit
+//      - 64-bit bit buffer refilled a word at a time
+//      - matches copied a word at a time
 
 #ifndef STBI_NO_ZLIB
 
 // fast-way is faster to check than jpeg huffman, but slow way is slower
-#define STBI__ZFAST_BITS  9 // accelerate all cases in default tables
+#define STBI__ZFAST_BITS  11 // accelerate all cases in default tables, nearly all in dynamic ones
 #define STBI__ZFAST_MASK  ((1 << STBI__ZFAST_BITS) - 1)
 
+// output room the fast inflate loop needs for one step: the longest match,
+// plus the word the match copy may run over
+#define STBI__ZFAST_OUT   (258 + 8)
+
 // zlib-style huffman encoding
 // (jpegs packs from left, zlib from right, so can't share code)
 typedef struct
@@ -3858,16 +5080,44 @@ typedef struct
 {
    stbi_uc *zbuffer, *zbuffer_end;
    int num_bits;
-   stbi__uint32 code_buffer;
+   stbi__uint64 code_buffer;
 
    char *zout;
    char *zout_start;
    char *zout_end;
    int   z_expandable;
+   stbi__uint32 stop_after; // stop after the block that reaches this many bytes, 0 for never
+
+   // streamed output: when the buffer is full, flush is handed the bytes from
+   // zout_flushed on and returns how many it used (-1 on error); the used
+   // ones then slide out, except for the 32K window
+   int (*flush)(void *user, stbi_uc *data, int len);
+   void *flush_user;
+   char *zout_flushed;
 
    stbi__zhuffman z_length, z_distance;
+
+   // z_length.fast, with a second literal folded in wherever both codes fit:
+   // bits 0-4 the bits used (0 if the code is longer than the table), 5-13 the
+   // first symbol, 14-21 the second literal, bit 22 set if there is one
+   stbi__uint32 zlit[1 << STBI__ZFAST_BITS];
 } stbi__zbuf;
 
+#if defined(STBI__X86_TARGET) || defined(STBI__X64_TARGET) || (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+stbi_inline static stbi__uint64 stbi__zload64(stbi_uc const *p)
+{
+   stbi__uint64 v;
+   memcpy(&v, p, 8);
+   return v;
+}
+#else
+stbi_inline static stbi__uint64 stbi__zload64(stbi_uc const *p)
+{
+   return (stbi__uint64) (p[0] | (p[1] << 8) | (p[2] << 16) | ((stbi__uint32) p[3] << 24))
+        | ((stbi__uint64) (p[4] | (p[5] << 8) | (p[6] << 16) | ((stbi__uint32) p[7] << 24)) << 32);
+}
+#endif
+
 stbi_inline static stbi_uc stbi__zget8(stbi__zbuf *z)
 {
    if (z->zbuffer >= z->zbuffer_end) return 0;
@@ -3877,8 +5127,8 @@ stbi_inline static stbi_uc stbi__zget8(stbi__zbuf *z)
 static void stbi__fill_bits(stbi__zbuf *z)
 {
    do {
-      STBI_ASSERT(z->code_buffer < (1U << z->num_bits));
-      z->code_buffer |= (unsigned int) stbi__zget8(z) << z->num_bits;
+      STBI_ASSERT(z->code_buffer < ((stbi__uint64) 1 << z->num_bits));
+      z->code_buffer |= (stbi__uint64) stbi__zget8(z) << z->num_bits;
       z->num_bits += 8;
    } while (z->num_bits <= 24);
 }
@@ -3887,18 +5137,19 @@ stbi_inline static unsigned int stbi__zreceive(stbi__zbuf *z, int n)
 {
    unsigned int k;
    if (z->num_bits < n) stbi__fill_bits(z);
-   k = z->code_buffer & ((1 << n) - 1);
+   k = (unsigned int) (z->code_buffer & ((1 << n) - 1));
    z->code_buffer >>= n;
    z->num_bits -= n;
    return k;
 }
 
-static int stbi__zhuffman_decode_slowpath(stbi__zbuf *a, stbi__zhuffman *z)
+// the code at the bottom of 'bits' is not resolved by the fast table, so
+// compute it the slow way; sets *size to its length
+static int stbi__zhuffman_slow(stbi__zhuffman *z, unsigned int bits, int *size)
 {
    int b,s,k;
-   // not resolved by fast table, so compute it the slow way
    // use jpeg approach, which requires MSbits at top
-   k = stbi__bit_reverse(a->code_buffer, 16);
+   k = stbi__bit_reverse(bits & 0xffff, 16);
    for (s=STBI__ZFAST_BITS+1; ; ++s)
       if (k < z->maxcode[s])
          break;
@@ -3906,9 +5157,17 @@ static int stbi__zhuffman_decode_slowpath(stbi__zbuf *a, stbi__zhuffman *z)
    // code size is s, so:
    b = (k >> (16-s)) - z->firstcode[s] + z->firstsymbol[s];
    STBI_ASSERT(z->size[b] == s);
+   *size = s;
+   return z->value[b];
+}
+
+static int stbi__zhuffman_decode_slowpath(stbi__zbuf *a, stbi__zhuffman *z)
+{
+   int s, v = stbi__zhuffman_slow(z, (unsigned int) a->code_buffer, &s);
+   if (v < 0) return -1;
    a->code_buffer >>= s;
    a->num_bits -= s;
-   return z->value[b];
+   return v;
 }
 
 stbi_inline static int stbi__zhuffman_decode(stbi__zbuf *a, stbi__zhuffman *z)
@@ -3928,9 +5187,24 @@ stbi_inline static int stbi__zhuffman_decode(stbi__zbuf *a, stbi__zhuffman *z)
 static int stbi__zexpand(stbi__zbuf *z, char *zout, int n)  // need to make room for n bytes
 {
    char *q;
-   int cur, limit, old_limit;
+   int cur, limit, old_limit, flushed = 0;
    z->zout = zout;
    if (!z->z_expandable) return stbi__err("output buffer limit","Corrupt PNG");
+   if (z->flush) {
+      char *keep;
+      int used = z->flush(z->flush_user, (stbi_uc *) z->zout_flushed, (int) (zout - z->zout_flushed));
+      if (used < 0) return 0;
+      z->zout_flushed += used;
+      keep = zout - z->zout_start > 32768 ? zout - 32768 : z->zout_start;
+      if (keep > z->zout_flushed) keep = z->zout_flushed;
+      if (keep > z->zout_start) {
+         memmove(z->zout_start, keep, zout - keep);
+         z->zout_flushed -= keep - z->zout_start;
+         z->zout -= keep - z->zout_start;
+      }
+      if (z->zout + n <= z->zout_end) return 1;
+      flushed = (int) (z->zout_flushed - z->zout_start);
+   }
    cur   = (int) (z->zout     - z->zout_start);
    limit = old_limit = (int) (z->zout_end - z->zout_start);
    while (cur + n > limit)
@@ -3941,6 +5215,7 @@ static int stbi__zexpand(stbi__zbuf *z, char *zout, int n)  // need to make room
    z->zout_start = q;
    z->zout       = q + cur;
    z->zout_end   = q + limit;
+   z->zout_flushed = q + flushed;
    return 1;
 }
 
@@ -3958,11 +5233,131 @@ static int stbi__zdist_base[32] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,
 static int stbi__zdist_extra[32] =
 { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
 
+static void stbi__zbuild_litpairs(stbi__zbuf *a)
+{
+   stbi__uint16 *fast = a->z_length.fast;
+   int i;
+   for (i=0; i < (1 << STBI__ZFAST_BITS); ++i) {
+      int b = fast[i], s = b >> 9, v = b & 511;
+      stbi__uint32 e = b ? (stbi__uint32) (s | (v << 5)) : 0;
+      if (b && v < 256 && s < STBI__ZFAST_BITS) {
+         // the next code starts at bit s; it is known if it ends inside the index
+         int b2 = fast[i >> s], s2 = b2 >> 9, v2 = b2 & 511;
+         if (b2 && s + s2 <= STBI__ZFAST_BITS && v2 < 256)
+            e = (stbi__uint32) ((s + s2) | (v << 5) | (v2 << 14) | (1 << 22));
+      }
+      a->zlit[i] = e;
+   }
+}
+
+// decodes with the whole state in locals while at least 8 bytes of input and
+// STBI__ZFAST_OUT bytes of output room are left, so every refill is one
+// unaligned load and no step needs a bounds check. after a refill at least 56
+// bits are buffered, which covers a literal pair or a length/distance pair with
+// its extra bits. returns 1 at the end of the block, 0 when the slow path has to
+// take over, -1 on error
+static int stbi__parse_huffman_fast(stbi__zbuf *a, char **pzout)
+{
+   stbi__uint64 bits = a->code_buffer;
+   int nbits = a->num_bits, result = 0;
+   stbi_uc const *in = a->zbuffer;
+   stbi_uc const *in_end = a->zbuffer_end - 8;
+   char *zout = *pzout;
+   char *zout_end = a->zout_end - STBI__ZFAST_OUT;
+   while (in <= in_end && zout <= zout_end) {
+      stbi__uint32 e;
+      int z, s, len, dist;
+      char *p;
+      bits |= stbi__zload64(in) << nbits;
+      in += (63 - nbits) >> 3;
+      nbits |= 56;
+      e = a->zlit[bits & STBI__ZFAST_MASK];
+      if (e & (1 << 22)) {
+         zout[0] = (char) (e >> 5);
+         zout[1] = (char) (e >> 14);
+         zout += 2;
+         bits >>= e & 31;
+         nbits -= e & 31;
+         continue;
+      }
+      if (e) {
+         z = (e >> 5) & 511;
+         s = e & 31;
+      } else {
+         z = stbi__zhuffman_slow(&a->z_length, (unsigned int) bits, &s);
+         if (z < 0) { result = stbi__err("bad huffman code","Corrupt PNG") - 1; break; }
+      }
+      bits >>= s;
+      nbits -= s;
+      if (z < 256) {
+         *zout++ = (char) z;
+         continue;
+      }
+      if (z == 256) {
+         result = 1;
+         break;
+      }
+      if (z >= 286) { result = stbi__err("bad huffman code","Corrupt PNG") - 1; break; }
+      z -= 257;
+      s = stbi__zlength_extra[z];
+      len = stbi__zlength_base[z] + (int) (bits & ((1 << s) - 1));
+      bits >>= s;
+      nbits -= s;
+      z = a->z_distance.fast[bits & STBI__ZFAST_MASK];
+      if (z) {
+         s = z >> 9;
+         z &= 511;
+      } else
+         z = stbi__zhuffman_slow(&a->z_distance, (unsigned int) bits, &s);
+      if (z < 0 || z >= 30) { result = stbi__err("bad huffman code","Corrupt PNG") - 1; break; }
+      bits >>= s;
+      nbits -= s;
+      s = stbi__zdist_extra[z];
+      dist = stbi__zdist_base[z] + (int) (bits & ((1 << s) - 1));
+      bits >>= s;
+      nbits -= s;
+      if (zout - a->zout_start < dist) { result = stbi__err("bad dist","Corrupt PNG") - 1; break; }
+      p = zout - dist;
+      if (dist >= 8) {
+         // whole words, each one read after the match has written it; the last
+         // may run up to 7 bytes past the match, into the room checked above
+         char *end = zout + len;
+         do {
+            memcpy(zout, p, 8);
+            zout += 8;
+            p += 8;
+         } while (zout < end);
+         zout = end;
+      } else if (dist == 1) { // run of one byte; common in images.
+         memset(zout, *p, len);
+         zout += len;
+      } else {
+         do *zout++ = *p++; while (--len);
+      }
+   }
+   // drop the bits past nbits the last load brought in, the slow path reads bytewise
+   a->code_buffer = bits & (((stbi__uint64) 1 << nbits) - 1);
+   a->num_bits = nbits;
+   a->zbuffer = (stbi_uc *) in;
+   *pzout = zout;
+   return result;
+}
+
 static int stbi__parse_huffman_block(stbi__zbuf *a)
 {
    char *zout = a->zout;
+   stbi__zbuild_litpairs(a);
    for(;;) {
-      int z = stbi__zhuffman_decode(a, &a->z_length);
+      int z;
+      if (a->zbuffer_end - a->zbuffer >= 8 && a->zout_end - zout >= STBI__ZFAST_OUT) {
+         z = stbi__parse_huffman_fast(a, &zout);
+         if (z < 0) return 0;
+         if (z) {
+            a->zout = zout;
+            return 1;
+         }
+      }
+      z = stbi__zhuffman_decode(a, &a->z_length);
       if (z < 256) {
          if (z < 0) return stbi__err("bad huffman code","Corrupt PNG"); // error in huffman codes
          if (zout >= a->zout_end) {
@@ -3977,11 +5372,12 @@ static int stbi__parse_huffman_block(stbi__zbuf *a)
             a->zout = zout;
             return 1;
          }
+         if (z >= 286) return stbi__err("bad huffman code","Corrupt PNG");
          z -= 257;
          len = stbi__zlength_base[z];
          if (stbi__zlength_extra[z]) len += stbi__zreceive(a, stbi__zlength_extra[z]);
          z = stbi__zhuffman_decode(a, &a->z_distance);
-         if (z < 0) return stbi__err("bad huffman code","Corrupt PNG");
+         if (z < 0 || z >= 30) return stbi__err("bad huffman code","Corrupt PNG");
          dist = stbi__zdist_base[z];
          if (stbi__zdist_extra[z]) dist += stbi__zreceive(a, stbi__zdist_extra[z]);
          if (zout - a->zout_start < dist) return stbi__err("bad dist","Corrupt PNG");
@@ -4057,12 +5453,18 @@ static int stbi__parse_uncompressed_block(stbi__zbuf *a)
       stbi__zreceive(a, a->num_bits & 7); // discard
    // drain the bit-packed data into header
    k = 0;
-   while (a->num_bits > 0) {
+   while (a->num_bits > 0 && k < 4) {
       header[k++] = (stbi_uc) (a->code_buffer & 255); // suppress MSVC run-time check
       a->code_buffer >>= 8;
       a->num_bits -= 8;
    }
-   STBI_ASSERT(a->num_bits == 0);
+   // a word refill reads ahead of the header; those bytes go back to the input
+   // (more than 4 buffered bytes only come from one, never from zero padding)
+   if (a->num_bits > 0) {
+      a->zbuffer -= a->num_bits >> 3;
+      a->code_buffer = 0;
+      a->num_bits = 0;
+   }
    // now fill header the normal way
    while (k < 4)
       header[k++] = stbi__zget8(a);
@@ -4144,7 +5546,7 @@ static int stbi__parse_zlib(stbi__zbuf *a, int parse_header)
          }
          if (!stbi__parse_huffman_block(a)) return 0;
       }
-   } while (!final);
+   } while (!final && !(a->stop_after && (stbi__uint32) (a->zout - a->zout_start) >= a->stop_after));
    return 1;
 }
 
@@ -4154,10 +5556,59 @@ static int stbi__do_zlib(stbi__zbuf *a, char *obuf, int olen, int exp, int parse
    a->zout       = obuf;
    a->zout_end   = obuf + olen;
    a->z_expandable = exp;
+   a->stop_after = 0;
+   a->flush = NULL;
 
    return stbi__parse_zlib(a, parse_header);
 }
 
+// inflates no further than the deflate block that completes the first
+// 'needed' bytes, for stbi_load_region
+static char *stbi__zlib_decode_malloc_upto(const char *buffer, int len, int initial_size, stbi__uint32 needed, int *outlen, int parse_header)
+{
+   stbi__zbuf a;
+   char *p = (char *) stbi__malloc(initial_size);
+   if (p == NULL) return NULL;
+   a.zbuffer = (stbi_uc *) buffer;
+   a.zbuffer_end = (stbi_uc *) buffer + len;
+   a.zout_start = a.zout = p;
+   a.zout_end = p + initial_size;
+   a.z_expandable = 1;
+   a.stop_after = needed;
+   a.flush = NULL;
+   if (stbi__parse_zlib(&a, parse_header)) {
+      if (outlen) *outlen = (int) (a.zout - a.zout_start);
+      return a.zout_start;
+   } else {
+      STBI_FREE(a.zout_start);
+      return NULL;
+   }
+}
+
+// inflates through flush, for stbi_load_rows: the output never takes more
+// than initial_size bytes unless flush holds on to more than that
+static int stbi__zlib_decode_stream(const char *buffer, int len, int initial_size, int (*flush)(void *user, stbi_uc *data, int len), void *user, int parse_header)
+{
+   stbi__zbuf a;
+   int ok;
+   char *p = (char *) stbi__malloc(initial_size);
+   if (p == NULL) return stbi__err("outofmem", "Out of memory");
+   a.zbuffer = (stbi_uc *) buffer;
+   a.zbuffer_end = (stbi_uc *) buffer + len;
+   a.zout_start = a.zout = a.zout_flushed = p;
+   a.zout_end = p + initial_size;
+   a.z_expandable = 1;
+   a.stop_after = 0;
+   a.flush = flush;
+   a.flush_user = user;
+   ok = stbi__parse_zlib(&a, parse_header);
+   // whatever is left after the last block
+   if (ok && flush(user, (stbi_uc *) a.zout_flushed, (int) (a.zout - a.zout_flushed)) < 0)
+      ok = 0;
+   STBI_FREE(a.zout_start);
+   return ok;
+}
+
 STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int initial_size, int *outlen)
 {
    stbi__zbuf a;
@@ -4309,199 +5760,304 @@ static int stbi__paeth(int a, int b, int c)
 
 static stbi_uc stbi__depth_scale_table[9] = { 0, 0xff, 0x55, 0, 0x11, 0,0,0, 0x01 };
 
-// create the png data from post-deflated data
-static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color)
+static int stbi__png_simd_available(void)
+{
+#ifdef STBI_SSE2
+   return stbi__sse2_available();
+#else
+   return 0;
+#endif
+}
+
+#ifdef STBI_SSE2
+// a pixel of up to 4 bytes moves as 4, a wider one as 8; either may take in
+// bytes of the next pixel, so the last one of a row is left to the scalar code
+stbi_inline static __m128i stbi__png_load_px(stbi_uc const *p, int wide)
+{
+   int v;
+   if (wide) return _mm_loadl_epi64((__m128i const *) p);
+   memcpy(&v, p, 4);
+   return _mm_cvtsi32_si128(v);
+}
+
+stbi_inline static void stbi__png_store_px(stbi_uc *p, __m128i x, int wide)
+{
+   int v;
+   if (wide) {
+      _mm_storel_epi64((__m128i *) p, x);
+      return;
+   }
+   v = _mm_cvtsi128_si32(x);
+   memcpy(p, &v, 4);
+}
+
+// unfilters n pixels of 3, 4, 6 or 8 bytes, a whole pixel per step as libpng's
+// SSE2 filters do: every pixel depends on the one to its left, so the work is
+// spread over its bytes instead. the pixel before cur is already done. with
+// out_bytes > filter_bytes the pixels gain an opaque alpha on the way out
+static void stbi__png_unfilter_sse2(stbi_uc *cur, stbi_uc const *prior, stbi_uc const *raw, int filter, int filter_bytes, int out_bytes, stbi__uint32 n)
+{
+   int wide = filter_bytes > 4;
+   stbi__uint64 alpha_bits = out_bytes > filter_bytes ? ~(stbi__uint64) 0 << (filter_bytes * 8) : 0;
+   __m128i zero = _mm_setzero_si128();
+   __m128i one = _mm_set1_epi8(1);
+   __m128i alpha = _mm_loadl_epi64((__m128i const *) &alpha_bits);
+   __m128i a = stbi__png_load_px(cur - out_bytes, wide);
+   __m128i c = stbi__png_load_px(prior - out_bytes, wide);
+   __m128i b, x;
+   stbi__uint32 i;
+
+   #define STBI__CASE(f) \
+       case f:     \
+          for (i=0; i < n; ++i, stbi__png_store_px(cur, a, wide), cur += out_bytes, prior += out_bytes, raw += filter_bytes)
+   switch (filter) {
+      STBI__CASE(STBI__F_none)         { a = _mm_or_si128(stbi__png_load_px(raw, wide), alpha); } break;
+      STBI__CASE(STBI__F_sub)          { a = _mm_or_si128(_mm_add_epi8(stbi__png_load_px(raw, wide), a), alpha); } break;
+      STBI__CASE(STBI__F_up)           { a = _mm_or_si128(_mm_add_epi8(stbi__png_load_px(raw, wide), stbi__png_load_px(prior, wide)), alpha); } break;
+      STBI__CASE(STBI__F_avg)          {
+         // _mm_avg_epu8 rounds up, take the carry back off
+         b = stbi__png_load_px(prior, wide);
+         x = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+         a = _mm_or_si128(_mm_add_epi8(stbi__png_load_px(raw, wide), x), alpha);
+      } break;
+      STBI__CASE(STBI__F_paeth)        {
+         __m128i a16, b16, c16, pa, pb, pc, m;
+         b = stbi__png_load_px(prior, wide);
+         a16 = _mm_unpacklo_epi8(a, zero);
+         b16 = _mm_unpacklo_epi8(b, zero);
+         c16 = _mm_unpacklo_epi8(c, zero);
+         // p = a+b-c, so p-a = b-c, p-b = a-c and p-c = (b-c)+(a-c)
+         pa = _mm_sub_epi16(b16, c16);
+         pb = _mm_sub_epi16(a16, c16);
+         pc = _mm_add_epi16(pa, pb);
+         pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+         pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+         pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+         m = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+         // ties go to a, then b, then c
+         pb = _mm_cmpeq_epi16(m, pb);
+         x = _mm_or_si128(_mm_and_si128(pb, b16), _mm_andnot_si128(pb, c16));
+         pa = _mm_cmpeq_epi16(m, pa);
+         x = _mm_or_si128(_mm_and_si128(pa, a16), _mm_andnot_si128(pa, x));
+         a = _mm_or_si128(_mm_add_epi8(stbi__png_load_px(raw, wide), _mm_packus_epi16(x, x)), alpha);
+         c = b;
+      } break;
+      STBI__CASE(STBI__F_avg_first)    {
+         x = _mm_sub_epi8(_mm_avg_epu8(a, zero), _mm_and_si128(a, one));
+         a = _mm_or_si128(_mm_add_epi8(stbi__png_load_px(raw, wide), x), alpha);
+      } break;
+      STBI__CASE(STBI__F_paeth_first)  { a = _mm_or_si128(_mm_add_epi8(stbi__png_load_px(raw, wide), a), alpha); } break;
+   }
+   #undef STBI__CASE
+}
+#endif
+
+// unfilters the row of x pixels at raw (its filter byte first) into row,
+// with prior_row the unfiltered row above, NULL for the first row. depth < 8
+// rows are left packed in the rightmost bytes of row, for stbi__png_expand_row.
+// simd is stbi__png_simd_available()
+static int stbi__png_unfilter_row(stbi_uc *row, stbi_uc *prior_row, stbi_uc *raw, int img_n, int out_n, stbi__uint32 x, int depth, int simd)
 {
    int bytes = (depth == 16? 2 : 1);
-   stbi__context *s = a->s;
-   stbi__uint32 i,j,stride = x*out_n*bytes;
-   stbi__uint32 img_len, img_width_bytes;
+   stbi__uint32 i, img_width_bytes = (((img_n * x * depth) + 7) >> 3);
+   stbi_uc *cur = row;
+   stbi_uc *prior;
    int k;
-   int img_n = s->img_n; // copy it into a local for later
+   int filter = *raw++;
 
    int output_bytes = out_n*bytes;
    int filter_bytes = img_n*bytes;
    int width = x;
+   stbi__uint32 done = 0; // by the SIMD loop: bytes if img_n == out_n, else pixels
 
-   STBI_ASSERT(out_n == s->img_n || out_n == s->img_n+1);
-   a->out = (stbi_uc *) stbi__malloc_mad3(x, y, output_bytes, 0); // extra bytes to write off the end into
-   if (!a->out) return stbi__err("outofmem", "Out of memory");
+   if (filter > 4)
+      return stbi__err("invalid filter","Corrupt PNG");
 
-   img_width_bytes = (((img_n * x * depth) + 7) >> 3);
-   img_len = (img_width_bytes + 1) * y;
-   if (s->img_x == x && s->img_y == y) {
-      if (raw_len != img_len) return stbi__err("not enough pixels","Corrupt PNG");
-   } else { // interlaced:
-      if (raw_len < img_len) return stbi__err("not enough pixels","Corrupt PNG");
+   if (depth < 8) {
+      STBI_ASSERT(img_width_bytes <= x);
+      cur += x*out_n - img_width_bytes; // store output to the rightmost img_len bytes, so we can decode in place
+      filter_bytes = 1;
+      width = img_width_bytes;
+   }
+   // bugfix: need to compute this after 'cur +=' computation above
+   prior = prior_row ? prior_row + (cur - row) : cur;
+
+   // if first row, use special filter that doesn't sample previous row
+   if (!prior_row) filter = first_row_filter[filter];
+
+   // handle first byte explicitly
+   for (k=0; k < filter_bytes; ++k) {
+      switch (filter) {
+         case STBI__F_none       : cur[k] = raw[k]; break;
+         case STBI__F_sub        : cur[k] = raw[k]; break;
+         case STBI__F_up         : cur[k] = STBI__BYTECAST(raw[k] + prior[k]); break;
+         case STBI__F_avg        : cur[k] = STBI__BYTECAST(raw[k] + (prior[k]>>1)); break;
+         case STBI__F_paeth      : cur[k] = STBI__BYTECAST(raw[k] + stbi__paeth(0,prior[k],0)); break;
+         case STBI__F_avg_first  : cur[k] = raw[k]; break;
+         case STBI__F_paeth_first: cur[k] = raw[k]; break;
+      }
    }
 
-   for (j=0; j < y; ++j) {
-      stbi_uc *cur = a->out + stride*j;
-      stbi_uc *prior;
-      int filter = *raw++;
-
-      if (filter > 4)
-         return stbi__err("invalid filter","Corrupt PNG");
-
-      if (depth < 8) {
-         STBI_ASSERT(img_width_bytes <= x);
-         cur += x*out_n - img_width_bytes; // store output to the rightmost img_len bytes, so we can decode in place
-         filter_bytes = 1;
-         width = img_width_bytes;
+   if (depth == 8) {
+      if (img_n != out_n)
+         cur[img_n] = 255; // first pixel
+      raw += img_n;
+      cur += out_n;
+      prior += out_n;
+   } else if (depth == 16) {
+      if (img_n != out_n) {
+         cur[filter_bytes]   = 255; // first pixel top byte
+         cur[filter_bytes+1] = 255; // first pixel bottom byte
       }
-      prior = cur - stride; // bugfix: need to compute this after 'cur +=' computation above
-
-      // if first row, use special filter that doesn't sample previous row
-      if (j == 0) filter = first_row_filter[filter];
-
-      // handle first byte explicitly
-      for (k=0; k < filter_bytes; ++k) {
-         switch (filter) {
-            case STBI__F_none       : cur[k] = raw[k]; break;
-            case STBI__F_sub        : cur[k] = raw[k]; break;
-            case STBI__F_up         : cur[k] = STBI__BYTECAST(raw[k] + prior[k]); break;
-            case STBI__F_avg        : cur[k] = STBI__BYTECAST(raw[k] + (prior[k]>>1)); break;
-            case STBI__F_paeth      : cur[k] = STBI__BYTECAST(raw[k] + stbi__paeth(0,prior[k],0)); break;
-            case STBI__F_avg_first  : cur[k] = raw[k]; break;
-            case STBI__F_paeth_first: cur[k] = raw[k]; break;
-         }
+      raw += filter_bytes;
+      cur += output_bytes;
+      prior += output_bytes;
+   } else {
+      raw += 1;
+      cur += 1;
+      prior += 1;
+   }
+
+#ifdef STBI_SSE2
+   // all but the last pixel, which the scalar loops below finish
+   if (simd && depth >= 8 && x > 2) {
+      if (img_n == out_n && filter == STBI__F_up) {
+         // nothing chains along the row, add 16 bytes at a time
+         done = (x-2)*filter_bytes & ~15;
+         for (k=0; k < (int) done; k += 16)
+            _mm_storeu_si128((__m128i *) (cur + k), _mm_add_epi8(_mm_loadu_si128((__m128i const *) (raw + k)), _mm_loadu_si128((__m128i const *) (prior + k))));
+         raw += done;
+         cur += done;
+         prior += done;
+      } else if ((filter_bytes == 3 || filter_bytes == 4 || filter_bytes == 6 || filter_bytes == 8) &&
+                 (filter != STBI__F_none || img_n != out_n)) {
+         stbi__png_unfilter_sse2(cur, prior, raw, filter, filter_bytes, output_bytes, x-2);
+         raw += (x-2)*filter_bytes;
+         cur += (x-2)*output_bytes;
+         prior += (x-2)*output_bytes;
+         done = img_n == out_n ? (x-2)*filter_bytes : x-2;
       }
+   }
+#else
+   STBI_NOTUSED(simd);
+#endif
 
-      if (depth == 8) {
-         if (img_n != out_n)
-            cur[img_n] = 255; // first pixel
-         raw += img_n;
-         cur += out_n;
-         prior += out_n;
-      } else if (depth == 16) {
-         if (img_n != out_n) {
-            cur[filter_bytes]   = 255; // first pixel top byte
-            cur[filter_bytes+1] = 255; // first pixel bottom byte
-         }
-         raw += filter_bytes;
-         cur += output_bytes;
-         prior += output_bytes;
-      } else {
-         raw += 1;
-         cur += 1;
-         prior += 1;
+   // this is a little gross, so that we don't switch per-pixel or per-component
+   if (depth < 8 || img_n == out_n) {
+      int nk = (width - 1)*filter_bytes - done;
+      #define STBI__CASE(f) \
+          case f:     \
+             for (k=0; k < nk; ++k)
+      switch (filter) {
+         // "none" filter turns into a memcpy here; make that explicit.
+         case STBI__F_none:         memcpy(cur, raw, nk); break;
+         STBI__CASE(STBI__F_sub)          { cur[k] = STBI__BYTECAST(raw[k] + cur[k-filter_bytes]); } break;
+         STBI__CASE(STBI__F_up)           { cur[k] = STBI__BYTECAST(raw[k] + prior[k]); } break;
+         STBI__CASE(STBI__F_avg)          { cur[k] = STBI__BYTECAST(raw[k] + ((prior[k] + cur[k-filter_bytes])>>1)); } break;
+         STBI__CASE(STBI__F_paeth)        { cur[k] = STBI__BYTECAST(raw[k] + stbi__paeth(cur[k-filter_bytes],prior[k],prior[k-filter_bytes])); } break;
+         STBI__CASE(STBI__F_avg_first)    { cur[k] = STBI__BYTECAST(raw[k] + (cur[k-filter_bytes] >> 1)); } break;
+         STBI__CASE(STBI__F_paeth_first)  { cur[k] = STBI__BYTECAST(raw[k] + stbi__paeth(cur[k-filter_bytes],0,0)); } break;
+      }
+      #undef STBI__CASE
+   } else {
+      STBI_ASSERT(img_n+1 == out_n);
+      #define STBI__CASE(f) \
+          case f:     \
+             for (i=x-1-done; i >= 1; --i, cur[filter_bytes]=255,raw+=filter_bytes,cur+=output_bytes,prior+=output_bytes) \
+                for (k=0; k < filter_bytes; ++k)
+      switch (filter) {
+         STBI__CASE(STBI__F_none)         { cur[k] = raw[k]; } break;
+         STBI__CASE(STBI__F_sub)          { cur[k] = STBI__BYTECAST(raw[k] + cur[k- output_bytes]); } break;
+         STBI__CASE(STBI__F_up)           { cur[k] = STBI__BYTECAST(raw[k] + prior[k]); } break;
+         STBI__CASE(STBI__F_avg)          { cur[k] = STBI__BYTECAST(raw[k] + ((prior[k] + cur[k- output_bytes])>>1)); } break;
+         STBI__CASE(STBI__F_paeth)        { cur[k] = STBI__BYTECAST(raw[k] + stbi__paeth(cur[k- output_bytes],prior[k],prior[k- output_bytes])); } break;
+         STBI__CASE(STBI__F_avg_first)    { cur[k] = STBI__BYTECAST(raw[k] + (cur[k- output_bytes] >> 1)); } break;
+         STBI__CASE(STBI__F_paeth_first)  { cur[k] = STBI__BYTECAST(raw[k] + stbi__paeth(cur[k- output_bytes],0,0)); } break;
       }
+      #undef STBI__CASE
 
-      // this is a little gross, so that we don't switch per-pixel or per-component
-      if (depth < 8 || img_n == out_n) {
-         int nk = (width - 1)*filter_bytes;
-         #define STBI__CASE(f) \
-             case f:     \
-                for (k=0; k < nk; ++k)
-         switch (filter) {
-            // "none" filter turns into a memcpy here; make that explicit.
-            case STBI__F_none:         memcpy(cur, raw, nk); break;
-            STBI__CASE(STBI__F_sub)          { cur[k] = STBI__BYTECAST(raw[k] + cur[k-filter_bytes]); } break;
-            STBI__CASE(STBI__F_up)           { cur[k] = STBI__BYTECAST(raw[k] + prior[k]); } break;
-            STBI__CASE(STBI__F_avg)          { cur[k] = STBI__BYTECAST(raw[k] + ((prior[k] + cur[k-filter_bytes])>>1)); } break;
-            STBI__CASE(STBI__F_paeth)        { cur[k] = STBI__BYTECAST(raw[k] + stbi__paeth(cur[k-filter_bytes],prior[k],prior[k-filter_bytes])); } break;
-            STBI__CASE(STBI__F_avg_first)    { cur[k] = STBI__BYTECAST(raw[k] + (cur[k-filter_bytes] >> 1)); } break;
-            STBI__CASE(STBI__F_paeth_first)  { cur[k] = STBI__BYTECAST(raw[k] + stbi__paeth(cur[k-filter_bytes],0,0)); } break;
-         }
-         #undef STBI__CASE
-         raw += nk;
-      } else {
-         STBI_ASSERT(img_n+1 == out_n);
-         #define STBI__CASE(f) \
-             case f:     \
-                for (i=x-1; i >= 1; --i, cur[filter_bytes]=255,raw+=filter_bytes,cur+=output_bytes,prior+=output_bytes) \
-                   for (k=0; k < filter_bytes; ++k)
-         switch (filter) {
-            STBI__CASE(STBI__F_none)         { cur[k] = raw[k]; } break;
-            STBI__CASE(STBI__F_sub)          { cur[k] = STBI__BYTECAST(raw[k] + cur[k- output_bytes]); } break;
-            STBI__CASE(STBI__F_up)           { cur[k] = STBI__BYTECAST(raw[k] + prior[k]); } break;
-            STBI__CASE(STBI__F_avg)          { cur[k] = STBI__BYTECAST(raw[k] + ((prior[k] + cur[k- output_bytes])>>1)); } break;
-            STBI__CASE(STBI__F_paeth)        { cur[k] = STBI__BYTECAST(raw[k] + stbi__paeth(cur[k- output_bytes],prior[k],prior[k- output_bytes])); } break;
-            STBI__CASE(STBI__F_avg_first)    { cur[k] = STBI__BYTECAST(raw[k] + (cur[k- output_bytes] >> 1)); } break;
-            STBI__CASE(STBI__F_paeth_first)  { cur[k] = STBI__BYTECAST(raw[k] + stbi__paeth(cur[k- output_bytes],0,0)); } break;
-         }
-         #undef STBI__CASE
-
-         // the loop above sets the high byte of the pixels' alpha, but for
-         // 16 bit png files we also need the low byte set. we'll do that here.
-         if (depth == 16) {
-            cur = a->out + stride*j; // start at the beginning of the row again
-            for (i=0; i < x; ++i,cur+=output_bytes) {
-               cur[filter_bytes+1] = 255;
-            }
+      // the loop above sets the high byte of the pixels' alpha, but for
+      // 16 bit png files we also need the low byte set. we'll do that here.
+      if (depth == 16) {
+         cur = row; // start at the beginning of the row again
+         for (i=0; i < x; ++i,cur+=output_bytes) {
+            cur[filter_bytes+1] = 255;
          }
       }
    }
+   return 1;
+}
 
-   // we make a separate pass to expand bits to pixels; for performance,
-   // this could run two scanlines behind the above code, so it won't
-   // intefere with filtering but will still be in the cache.
+// expands an unfiltered row in place to 8-bit pixels (depth < 8), or to
+// platform-native 16-bit ones
+static void stbi__png_expand_row(stbi_uc *row, int img_n, int out_n, stbi__uint32 x, int depth, int color)
+{
+   stbi__uint32 i;
+   int k;
    if (depth < 8) {
-      for (j=0; j < y; ++j) {
-         stbi_uc *cur = a->out + stride*j;
-         stbi_uc *in  = a->out + stride*j + x*out_n - img_width_bytes;
-         // unpack 1/2/4-bit into a 8-bit buffer. allows us to keep the common 8-bit path optimal at minimal cost for 1/2/4-bit
-         // png guarante byte alignment, if width is not multiple of 8/4/2 we'll decode dummy trailing data that will be skipped in the later loop
-         stbi_uc scale = (color == 0) ? stbi__depth_scale_table[depth] : 1; // scale grayscale values to 0..255 range
-
-         // note that the final byte might overshoot and write more data than desired.
-         // we can allocate enough data that this never writes out of memory, but it
-         // could also overwrite the next scanline. can it overwrite non-empty data
-         // on the next scanline? yes, consider 1-pixel-wide scanlines with 1-bit-per-pixel.
-         // so we need to explicitly clamp the final ones
-
-         if (depth == 4) {
-            for (k=x*img_n; k >= 2; k-=2, ++in) {
-               *cur++ = scale * ((*in >> 4)       );
-               *cur++ = scale * ((*in     ) & 0x0f);
-            }
-            if (k > 0) *cur++ = scale * ((*in >> 4)       );
-         } else if (depth == 2) {
-            for (k=x*img_n; k >= 4; k-=4, ++in) {
-               *cur++ = scale * ((*in >> 6)       );
-               *cur++ = scale * ((*in >> 4) & 0x03);
-               *cur++ = scale * ((*in >> 2) & 0x03);
-               *cur++ = scale * ((*in     ) & 0x03);
-            }
-            if (k > 0) *cur++ = scale * ((*in >> 6)       );
-            if (k > 1) *cur++ = scale * ((*in >> 4) & 0x03);
-            if (k > 2) *cur++ = scale * ((*in >> 2) & 0x03);
-         } else if (depth == 1) {
-            for (k=x*img_n; k >= 8; k-=8, ++in) {
-               *cur++ = scale * ((*in >> 7)       );
-               *cur++ = scale * ((*in >> 6) & 0x01);
-               *cur++ = scale * ((*in >> 5) & 0x01);
-               *cur++ = scale * ((*in >> 4) & 0x01);
-               *cur++ = scale * ((*in >> 3) & 0x01);
-               *cur++ = scale * ((*in >> 2) & 0x01);
-               *cur++ = scale * ((*in >> 1) & 0x01);
-               *cur++ = scale * ((*in     ) & 0x01);
-            }
-            if (k > 0) *cur++ = scale * ((*in >> 7)       );
-            if (k > 1) *cur++ = scale * ((*in >> 6) & 0x01);
-            if (k > 2) *cur++ = scale * ((*in >> 5) & 0x01);
-            if (k > 3) *cur++ = scale * ((*in >> 4) & 0x01);
-            if (k > 4) *cur++ = scale * ((*in >> 3) & 0x01);
-            if (k > 5) *cur++ = scale * ((*in >> 2) & 0x01);
-            if (k > 6) *cur++ = scale * ((*in >> 1) & 0x01);
+      stbi_uc *cur = row;
+      stbi_uc *in  = row + x*out_n - (((img_n * x * depth) + 7) >> 3);
+      // unpack 1/2/4-bit into a 8-bit buffer. allows us to keep the common 8-bit path optimal at minimal cost for 1/2/4-bit
+      // png guarante byte alignment, if width is not multiple of 8/4/2 we'll decode dummy trailing data that will be skipped in the later loop
+      stbi_uc scale = (color == 0) ? stbi__depth_scale_table[depth] : 1; // scale grayscale values to 0..255 range
+
+      // note that the final byte might overshoot and write more data than desired.
+      // we can allocate enough data that this never writes out of memory, but it
+      // could also overwrite the next scanline. can it overwrite non-empty data
+      // on the next scanline? yes, consider 1-pixel-wide scanlines with 1-bit-per-pixel.
+      // so we need to explicitly clamp the final ones
+
+      if (depth == 4) {
+         for (k=x*img_n; k >= 2; k-=2, ++in) {
+            *cur++ = scale * ((*in >> 4)       );
+            *cur++ = scale * ((*in     ) & 0x0f);
          }
-         if (img_n != out_n) {
-            int q;
-            // insert alpha = 255
-            cur = a->out + stride*j;
-            if (img_n == 1) {
-               for (q=x-1; q >= 0; --q) {
-                  cur[q*2+1] = 255;
-                  cur[q*2+0] = cur[q];
-               }
-            } else {
-               STBI_ASSERT(img_n == 3);
-               for (q=x-1; q >= 0; --q) {
-                  cur[q*4+3] = 255;
-                  cur[q*4+2] = cur[q*3+2];
-                  cur[q*4+1] = cur[q*3+1];
-                  cur[q*4+0] = cur[q*3+0];
-               }
+         if (k > 0) *cur++ = scale * ((*in >> 4)       );
+      } else if (depth == 2) {
+         for (k=x*img_n; k >= 4; k-=4, ++in) {
+            *cur++ = scale * ((*in >> 6)       );
+            *cur++ = scale * ((*in >> 4) & 0x03);
+            *cur++ = scale * ((*in >> 2) & 0x03);
+            *cur++ = scale * ((*in     ) & 0x03);
+         }
+         if (k > 0) *cur++ = scale * ((*in >> 6)       );
+         if (k > 1) *cur++ = scale * ((*in >> 4) & 0x03);
+         if (k > 2) *cur++ = scale * ((*in >> 2) & 0x03);
+      } else if (depth == 1) {
+         for (k=x*img_n; k >= 8; k-=8, ++in) {
+            *cur++ = scale * ((*in >> 7)       );
+            *cur++ = scale * ((*in >> 6) & 0x01);
+            *cur++ = scale * ((*in >> 5) & 0x01);
+            *cur++ = scale * ((*in >> 4) & 0x01);
+            *cur++ = scale * ((*in >> 3) & 0x01);
+            *cur++ = scale * ((*in >> 2) & 0x01);
+            *cur++ = scale * ((*in >> 1) & 0x01);
+            *cur++ = scale * ((*in     ) & 0x01);
+         }
+         if (k > 0) *cur++ = scale * ((*in >> 7)       );
+         if (k > 1) *cur++ = scale * ((*in >> 6) & 0x01);
+         if (k > 2) *cur++ = scale * ((*in >> 5) & 0x01);
+         if (k > 3) *cur++ = scale * ((*in >> 4) & 0x01);
+         if (k > 4) *cur++ = scale * ((*in >> 3) & 0x01);
+         if (k > 5) *cur++ = scale * ((*in >> 2) & 0x01);
+         if (k > 6) *cur++ = scale * ((*in >> 1) & 0x01);
+      }
+      if (img_n != out_n) {
+         int q;
+         // insert alpha = 255
+         cur = row;
+         if (img_n == 1) {
+            for (q=x-1; q >= 0; --q) {
+               cur[q*2+1] = 255;
+               cur[q*2+0] = cur[q];
+            }
+         } else {
+            STBI_ASSERT(img_n == 3);
+            for (q=x-1; q >= 0; --q) {
+               cur[q*4+3] = 255;
+               cur[q*4+2] = cur[q*3+2];
+               cur[q*4+1] = cur[q*3+1];
+               cur[q*4+0] = cur[q*3+0];
             }
          }
       }
@@ -4510,25 +6066,107 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
       // this is done in a separate pass due to the decoding relying
       // on the data being untouched, but could probably be done
       // per-line during decode if care is taken.
-      stbi_uc *cur = a->out;
+      stbi_uc *cur = row;
       stbi__uint16 *cur16 = (stbi__uint16*)cur;
 
-      for(i=0; i < x*y*out_n; ++i,cur16++,cur+=2) {
+      for(i=0; i < x*out_n; ++i,cur16++,cur+=2) {
          *cur16 = (cur[0] << 8) | cur[1];
       }
    }
+}
+
+// create the png data from post-deflated data
+// only rows y_first to y-1 are kept in a->out, the ones above go through
+// two scratch rows after them (y_first is 0 except for stbi_load_region)
+static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, stbi__uint32 y_first, int depth, int color)
+{
+   int bytes = (depth == 16? 2 : 1);
+   stbi__context *s = a->s;
+   stbi__uint32 j,stride = x*out_n*bytes;
+   stbi__uint32 img_len, img_width_bytes;
+   stbi__uint32 kept = y - y_first;
+   stbi_uc *scratch;
+   int img_n = s->img_n; // copy it into a local for later
+   int simd = stbi__png_simd_available();
+
+   int output_bytes = out_n*bytes;
+
+   STBI_ASSERT(out_n == s->img_n || out_n == s->img_n+1);
+   a->out = (stbi_uc *) stbi__malloc_mad3(x, kept + (y_first ? 2 : 0), output_bytes, 0); // extra bytes to write off the end into
+   if (!a->out) return stbi__err("outofmem", "Out of memory");
+   scratch = a->out + stride*kept;
+
+   img_width_bytes = (((img_n * x * depth) + 7) >> 3);
+   img_len = (img_width_bytes + 1) * y;
+   if (s->img_x == x && s->img_y == y) {
+      if (raw_len != img_len) return stbi__err("not enough pixels","Corrupt PNG");
+   } else { // interlaced:
+      if (raw_len < img_len) return stbi__err("not enough pixels","Corrupt PNG");
+   }
+
+   for (j=0; j < y; ++j) {
+      stbi_uc *row = j < y_first ? scratch + stride*(j & 1) : a->out + stride*(j - y_first);
+      stbi_uc *prior_row = NULL;
+      if (j > y_first)
+         prior_row = row - stride;
+      else if (j > 0)
+         prior_row = scratch + stride*((j-1) & 1);
+      if (!stbi__png_unfilter_row(row, prior_row, raw, img_n, out_n, x, depth, simd)) return 0;
+      raw += img_width_bytes + 1;
+      // expanding bits to pixels or swapping the 16-bit ones has to wait
+      // until the row below is unfiltered, as that needs this one untouched
+      if (depth != 8 && j > y_first)
+         stbi__png_expand_row(prior_row, img_n, out_n, x, depth, color);
+   }
+   if (depth != 8 && kept)
+      stbi__png_expand_row(a->out + stride*(kept-1), img_n, out_n, x, depth, color);
 
    return 1;
 }
 
+// exact size of the filtered image data, so inflate can allocate its output once
+static stbi__uint32 stbi__png_raw_size(stbi__png *a, int depth, int interlaced)
+{
+   int xorig[] = { 0,4,0,2,0,1,0 };
+   int yorig[] = { 0,0,4,0,2,0,1 };
+   int xspc[]  = { 8,8,4,4,2,2,1 };
+   int yspc[]  = { 8,8,8,4,4,2,2 };
+   stbi__uint32 len = 0;
+   int p;
+   if (!interlaced)
+      return ((((a->s->img_n * a->s->img_x * depth) + 7) >> 3) + 1) * a->s->img_y;
+   for (p=0; p < 7; ++p) {
+      stbi__uint32 x = (a->s->img_x - xorig[p] + xspc[p]-1) / xspc[p];
+      stbi__uint32 y = (a->s->img_y - yorig[p] + yspc[p]-1) / yspc[p];
+      if (x && y)
+         len += ((((a->s->img_n * x * depth) + 7) >> 3) + 1) * y;
+   }
+   return len;
+}
+
 static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint32 image_data_len, int out_n, int depth, int color, int interlaced)
 {
    int bytes = (depth == 16 ? 2 : 1);
    int out_bytes = out_n * bytes;
    stbi_uc *final;
    int p;
-   if (!interlaced)
-      return stbi__create_png_image_raw(a, image_data, image_data_len, out_n, a->s->img_x, a->s->img_y, depth, color);
+   if (!interlaced) {
+      int x0, y0, w, h;
+      stbi__uint32 row;
+      if (!a->s->region_w)
+         return stbi__create_png_image_raw(a, image_data, image_data_len, out_n, a->s->img_x, a->s->img_y, 0, depth, color);
+
+      // stbi_load_region: unfilter down to the last row of the region,
+      // keeping its rows only, then close up the columns
+      if (!stbi__clip_region(a->s, a->s->img_x, a->s->img_y, &x0, &y0, &w, &h)) return 0;
+      if (!stbi__create_png_image_raw(a, image_data, image_data_len, out_n, a->s->img_x, y0 + h, y0, depth, color)) return 0;
+      for (row = 0; row < (stbi__uint32) h; ++row)
+         memmove(a->out + row * w * out_bytes, a->out + (row * a->s->img_x + x0) * out_bytes, w * out_bytes);
+      a->s->img_x = w;
+      a->s->img_y = h;
+      a->s->region_done = 1;
+      return 1;
+   }
 
    // de-interlacing
    final = (stbi_uc *) stbi__malloc_mad3(a->s->img_x, a->s->img_y, out_bytes, 0);
@@ -4543,7 +6181,7 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint3
       y = (a->s->img_y - yorig[p] + yspc[p]-1) / yspc[p];
       if (x && y) {
          stbi__uint32 img_len = ((((a->s->img_n * x * depth) + 7) >> 3) + 1) * y;
-         if (!stbi__create_png_image_raw(a, image_data, image_data_len, out_n, x, y, depth, color)) {
+         if (!stbi__create_png_image_raw(a, image_data, image_data_len, out_n, x, y, 0, depth, color)) {
             STBI_FREE(final);
             return 0;
          }
@@ -4565,11 +6203,9 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint3
    return 1;
 }
 
-static int stbi__compute_transparency(stbi__png *z, stbi_uc tc[3], int out_n)
+static int stbi__compute_transparency(stbi_uc *p, stbi__uint32 pixel_count, stbi_uc tc[3], int out_n)
 {
-   stbi__context *s = z->s;
-   stbi__uint32 i, pixel_count = s->img_x * s->img_y;
-   stbi_uc *p = z->out;
+   stbi__uint32 i;
 
    // compute color-based transparency, assuming we've
    // already got 255 as the alpha value in the output
@@ -4590,11 +6226,9 @@ static int stbi__compute_transparency(stbi__png *z, stbi_uc tc[3], int out_n)
    return 1;
 }
 
-static int stbi__compute_transparency16(stbi__png *z, stbi__uint16 tc[3], int out_n)
+static int stbi__compute_transparency16(stbi__uint16 *p, stbi__uint32 pixel_count, stbi__uint16 tc[3], int out_n)
 {
-   stbi__context *s = z->s;
-   stbi__uint32 i, pixel_count = s->img_x * s->img_y;
-   stbi__uint16 *p = (stbi__uint16*) z->out;
+   stbi__uint32 i;
 
    // compute color-based transparency, assuming we've
    // already got 65535 as the alpha value in the output
@@ -4615,17 +6249,9 @@ static int stbi__compute_transparency16(stbi__png *z, stbi__uint16 tc[3], int ou
    return 1;
 }
 
-static int stbi__expand_png_palette(stbi__png *a, stbi_uc *palette, int len, int pal_img_n)
+static void stbi__apply_png_palette(stbi_uc *p, stbi_uc const *orig, stbi__uint32 pixel_count, stbi_uc *palette, int pal_img_n)
 {
-   stbi__uint32 i, pixel_count = a->s->img_x * a->s->img_y;
-   stbi_uc *p, *temp_out, *orig = a->out;
-
-   p = (stbi_uc *) stbi__malloc_mad2(pixel_count, pal_img_n, 0);
-   if (p == NULL) return stbi__err("outofmem", "Out of memory");
-
-   // between here and free(out) below, exitting would leak
-   temp_out = p;
-
+   stbi__uint32 i;
    if (pal_img_n == 3) {
       for (i=0; i < pixel_count; ++i) {
          int n = orig[i]*4;
@@ -4644,6 +6270,17 @@ static int stbi__expand_png_palette(stbi__png *a, stbi_uc *palette, int len, int
          p += 4;
       }
    }
+}
+
+static int stbi__expand_png_palette(stbi__png *a, stbi_uc *palette, int len, int pal_img_n)
+{
+   stbi__uint32 pixel_count = a->s->img_x * a->s->img_y;
+   stbi_uc *temp_out;
+
+   temp_out = (stbi_uc *) stbi__malloc_mad2(pixel_count, pal_img_n, 0);
+   if (temp_out == NULL) return stbi__err("outofmem", "Out of memory");
+
+   stbi__apply_png_palette(temp_out, a->out, pixel_count, palette, pal_img_n);
    STBI_FREE(a->out);
    a->out = temp_out;
 
@@ -4652,26 +6289,51 @@ static int stbi__expand_png_palette(stbi__png *a, stbi_uc *palette, int len, int
    return 1;
 }
 
-static int stbi__unpremultiply_on_load = 0;
-static int stbi__de_iphone_flag = 0;
+static int stbi__unpremultiply_on_load_global = 0;
+static int stbi__de_iphone_flag_global = 0;
 
 STBIDEF void stbi_set_unpremultiply_on_load(int flag_true_if_should_unpremultiply)
 {
-   stbi__unpremultiply_on_load = flag_true_if_should_unpremultiply;
+   stbi__unpremultiply_on_load_global = flag_true_if_should_unpremultiply;
 }
 
 STBIDEF void stbi_convert_iphone_png_to_rgb(int flag_true_if_should_convert)
 {
-   stbi__de_iphone_flag = flag_true_if_should_convert;
+   stbi__de_iphone_flag_global = flag_true_if_should_convert;
+}
+
+#ifndef STBI_THREAD_LOCAL
+#define stbi__unpremultiply_on_load  stbi__unpremultiply_on_load_global
+#define stbi__de_iphone_flag  stbi__de_iphone_flag_global
+#else
+static STBI_THREAD_LOCAL int stbi__unpremultiply_on_load_local, stbi__unpremultiply_on_load_set;
+static STBI_THREAD_LOCAL int stbi__de_iphone_flag_local, stbi__de_iphone_flag_set;
+
+STBIDEF void stbi_set_unpremultiply_on_load_thread(int flag_true_if_should_unpremultiply)
+{
+   stbi__unpremultiply_on_load_local = flag_true_if_should_unpremultiply;
+   stbi__unpremultiply_on_load_set = 1;
 }
 
-static void stbi__de_iphone(stbi__png *z)
+STBIDEF void stbi_convert_iphone_png_to_rgb_thread(int flag_true_if_should_convert)
 {
-   stbi__context *s = z->s;
-   stbi__uint32 i, pixel_count = s->img_x * s->img_y;
-   stbi_uc *p = z->out;
+   stbi__de_iphone_flag_local = flag_true_if_should_convert;
+   stbi__de_iphone_flag_set = 1;
+}
+
+#define stbi__unpremultiply_on_load  (stbi__unpremultiply_on_load_set           \
+                                       ? stbi__unpremultiply_on_load_local      \
+                                       : stbi__unpremultiply_on_load_global)
+#define stbi__de_iphone_flag  (stbi__de_iphone_flag_set                         \
+                                ? stbi__de_iphone_flag_local                    \
+                                : stbi__de_iphone_flag_global)
+#endif // STBI_THREAD_LOCAL
+
+static void stbi__de_iphone(stbi_uc *p, stbi__uint32 pixel_count, int out_n)
+{
+   stbi__uint32 i;
 
-   if (s->img_out_n == 3) {  // convert bgr to rgb
+   if (out_n == 3) {  // convert bgr to rgb
       for (i=0; i < pixel_count; ++i) {
          stbi_uc t = p[0];
          p[0] = p[2];
@@ -4679,7 +6341,7 @@ static void stbi__de_iphone(stbi__png *z)
          p += 3;
       }
    } else {
-      STBI_ASSERT(s->img_out_n == 4);
+      STBI_ASSERT(out_n == 4);
       if (stbi__unpremultiply_on_load) {
          // convert bgr to rgb and unpremultiply
          for (i=0; i < pixel_count; ++i) {
@@ -4707,6 +6369,95 @@ static void stbi__de_iphone(stbi__png *z)
    }
 }
 
+// stbi_load_rows of a non-interlaced PNG: every row the inflater completes
+// is unfiltered, expanded and handed out, keeping just the row above it
+typedef struct
+{
+   stbi__png *a;
+   int out_n, color, req_comp, de_iphone, simd;
+   stbi_uc *tc;       // tRNS color, NULL if none
+   stbi__uint16 *tc16;
+   stbi_uc *palette;
+   int pal_img_n;     // 0 if not paletted
+   stbi__uint32 y, stride;
+   stbi_uc *rows;     // the unfiltered row and the one above it
+   stbi_uc *pixels;   // the row being expanded
+   stbi_uc *paletted; // and looked up in the palette
+} stbi__png_stream;
+
+static int stbi__png_stream_flush(void *user, stbi_uc *data, int len)
+{
+   stbi__png_stream *p = (stbi__png_stream *) user;
+   stbi__context *s = p->a->s;
+   int depth = p->a->depth;
+   stbi__uint32 row_bytes = (((s->img_n * s->img_x * depth) + 7) >> 3) + 1;
+   int used = 0;
+   while (p->y < s->img_y && (stbi__uint32) (len - used) >= row_bytes) {
+      stbi_uc *row = p->rows + p->stride * (p->y & 1);
+      stbi_uc *prior_row = p->y ? p->rows + p->stride * ((p->y - 1) & 1) : NULL;
+      stbi_uc *pixels = p->pixels;
+      int n = p->out_n;
+      if (!stbi__png_unfilter_row(row, prior_row, data + used, s->img_n, p->out_n, s->img_x, depth, p->simd)) return -1;
+      used += row_bytes;
+      memcpy(pixels, row, p->stride);
+      stbi__png_expand_row(pixels, s->img_n, p->out_n, s->img_x, depth, p->color);
+      if (p->tc16)
+         stbi__compute_transparency16((stbi__uint16 *) pixels, s->img_x, p->tc16, n);
+      else if (p->tc)
+         stbi__compute_transparency(pixels, s->img_x, p->tc, n);
+      if (p->de_iphone)
+         stbi__de_iphone(pixels, s->img_x, n);
+      if (p->pal_img_n) {
+         stbi__apply_png_palette(p->paletted, pixels, s->img_x, p->palette, p->pal_img_n);
+         pixels = p->paletted;
+         n = p->pal_img_n;
+      }
+      if (!stbi__emit_rows(s, pixels, s->img_x, s->img_y, n, p->req_comp, depth == 16 ? 16 : 8, p->y, 1)) return -1;
+      ++p->y;
+   }
+   if (p->y == s->img_y && used < len) {
+      stbi__err("not enough pixels","Corrupt PNG"); // too many, same as a full decode
+      return -1;
+   }
+   return used;
+}
+
+static int stbi__png_stream_rows(stbi__png *z, stbi__uint32 ioff, int req_comp, int color, int is_iphone, stbi_uc *palette, int pal_img_n, stbi_uc *tc, stbi__uint16 *tc16)
+{
+   stbi__context *s = z->s;
+   stbi__png_stream p;
+   int bytes = (z->depth == 16 ? 2 : 1), ok;
+   stbi__uint32 row_bytes = (((s->img_n * s->img_x * z->depth) + 7) >> 3) + 1;
+
+   p.a = z;
+   p.simd = stbi__png_simd_available();
+   p.out_n = s->img_out_n;
+   p.color = color;
+   p.req_comp = req_comp;
+   p.de_iphone = is_iphone && stbi__de_iphone_flag && s->img_out_n > 2;
+   p.tc = z->depth == 16 ? NULL : tc;
+   p.tc16 = z->depth == 16 ? tc16 : NULL;
+   p.palette = palette;
+   p.pal_img_n = pal_img_n && req_comp >= 3 ? req_comp : pal_img_n;
+   p.y = 0;
+   p.stride = s->img_x * p.out_n * bytes;
+   // two rows to unfilter, one to expand, and 4 bytes a pixel for the palette
+   z->out = (stbi_uc *) stbi__malloc_mad2(s->img_x, p.out_n * bytes * 3 + 4, 0);
+   if (!z->out) return stbi__err("outofmem", "Out of memory");
+   p.rows = z->out;
+   p.pixels = p.rows + p.stride * 2;
+   p.paletted = p.pixels + p.stride;
+
+   // the inflater holds the 32K window and a few rows at most
+   ok = stbi__zlib_decode_stream((char *) z->idata, ioff, 32768 + 4 * row_bytes, stbi__png_stream_flush, &p, !is_iphone);
+   STBI_FREE(z->idata); z->idata = NULL;
+   if (!ok) return 0;
+   if (p.y != s->img_y) return stbi__err("not enough pixels","Corrupt PNG");
+   if (pal_img_n) s->img_n = pal_img_n; // record the actual colors we had
+   s->rows_done = 1;
+   return 1;
+}
+
 #define STBI__PNG_TYPE(a,b,c,d)  (((a) << 24) + ((b) << 16) + ((c) << 8) + (d))
 
 static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
@@ -4820,30 +6571,39 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
          }
 
          case STBI__PNG_TYPE('I','E','N','D'): {
-            stbi__uint32 raw_len, bpl;
+            stbi__uint32 raw_len;
             if (first) return stbi__err("first not IHDR", "Corrupt PNG");
             if (scan != STBI__SCAN_load) return 1;
             if (z->idata == NULL) return stbi__err("no IDAT","Corrupt PNG");
-            // initial guess for decoded data size to avoid unnecessary reallocs
-            bpl = (s->img_x * z->depth + 7) / 8; // bytes per line, per component
-            raw_len = bpl * s->img_y * s->img_n /* pixels */ + s->img_y /* filter mode per row */;
-            z->expanded = (stbi_uc *) stbi_zlib_decode_malloc_guesssize_headerflag((char *) z->idata, ioff, raw_len, (int *) &raw_len, !is_iphone);
-            if (z->expanded == NULL) return 0; // zlib should set error
-            STBI_FREE(z->idata); z->idata = NULL;
             if ((req_comp == s->img_n+1 && req_comp != 3 && !pal_img_n) || has_trans)
                s->img_out_n = s->img_n+1;
             else
                s->img_out_n = s->img_n;
+            if (s->row_cb && !interlace)
+               return stbi__png_stream_rows(z, ioff, req_comp, color, is_iphone, pal_img_n ? palette : NULL, pal_img_n,
+                                            has_trans ? tc : NULL, has_trans ? tc16 : NULL);
+            // the decoded data size is known from IHDR, so the output is allocated once
+            raw_len = stbi__png_raw_size(z, z->depth, interlace);
+            if (s->region_w && !interlace) {
+               // stbi_load_region needs nothing after the last row of the region
+               int x0, y0, w, h;
+               if (!stbi__clip_region(s, s->img_x, s->img_y, &x0, &y0, &w, &h)) return 0;
+               raw_len = ((((s->img_n * s->img_x * z->depth) + 7) >> 3) + 1) * (y0 + h);
+               z->expanded = (stbi_uc *) stbi__zlib_decode_malloc_upto((char *) z->idata, ioff, raw_len, raw_len, (int *) &raw_len, !is_iphone);
+            } else
+               z->expanded = (stbi_uc *) stbi_zlib_decode_malloc_guesssize_headerflag((char *) z->idata, ioff, raw_len, (int *) &raw_len, !is_iphone);
+            if (z->expanded == NULL) return 0; // zlib should set error
+            STBI_FREE(z->idata); z->idata = NULL;
             if (!stbi__create_png_image(z, z->expanded, raw_len, s->img_out_n, z->depth, color, interlace)) return 0;
             if (has_trans) {
                if (z->depth == 16) {
-                  if (!stbi__compute_transparency16(z, tc16, s->img_out_n)) return 0;
+                  if (!stbi__compute_transparency16((stbi__uint16 *) z->out, s->img_x * s->img_y, tc16, s->img_out_n)) return 0;
                } else {
-                  if (!stbi__compute_transparency(z, tc, s->img_out_n)) return 0;
+                  if (!stbi__compute_transparency(z->out, s->img_x * s->img_y, tc, s->img_out_n)) return 0;
                }
             }
             if (is_iphone && stbi__de_iphone_flag && s->img_out_n > 2)
-               stbi__de_iphone(z);
+               stbi__de_iphone(z->out, s->img_x * s->img_y, s->img_out_n);
             if (pal_img_n) {
                // pal_img_n == 3 or 4
                s->img_n = pal_img_n; // record the actual colors we had
@@ -4889,7 +6649,7 @@ static void *stbi__do_png(stbi__png *p, int *x, int *y, int *n, int req_comp, st
          ri->bits_per_channel = p->depth;
       result = p->out;
       p->out = NULL;
-      if (req_comp && req_comp != p->s->img_out_n) {
+      if (req_comp && req_comp != p->s->img_out_n && !p->s->rows_done) {
          if (ri->bits_per_channel == 8)
             result = stbi__convert_format((unsigned char *) result, p->s->img_out_n, req_comp, p->s->img_x, p->s->img_y);
          else
@@ -5141,7 +6901,8 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
    if (!stbi__mad3sizes_valid(target, s->img_x, s->img_y, 0))
       return stbi__errpuc("too large", "Corrupt BMP");
 
-   out = (stbi_uc *) stbi__malloc_mad3(target, s->img_x, s->img_y, 0);
+   // stbi_load_rows only needs one row
+   out = (stbi_uc *) stbi__malloc_mad3(target, s->img_x, s->row_cb ? 1 : s->img_y, 0);
    if (!out) return stbi__errpuc("outofmem", "Out of memory");
    if (info.bpp < 16) {
       int z=0;
@@ -5177,6 +6938,10 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
             if (target == 4) out[z++] = 255;
          }
          stbi__skip(s, pad);
+         if (s->row_cb) {
+            if (!stbi__emit_rows(s, out, s->img_x, s->img_y, target, req_comp, 8, flip_vertically ? (int) s->img_y-1-j : j, 1)) { STBI_FREE(out); return NULL; }
+            z = 0;
+         }
       }
    } else {
       int rshift=0,gshift=0,bshift=0,ashift=0,rcount=0,gcount=0,bcount=0,acount=0;
@@ -5227,9 +6992,22 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
             }
          }
          stbi__skip(s, pad);
+         if (s->row_cb) {
+            if (!stbi__emit_rows(s, out, s->img_x, s->img_y, target, req_comp, 8, flip_vertically ? (int) s->img_y-1-j : j, 1)) { STBI_FREE(out); return NULL; }
+            z = 0;
+         }
       }
    }
 
+   if (s->row_cb) {
+      // the rows are handed out already, an all zero alpha channel stays as it is
+      *x = s->img_x;
+      *y = s->img_y;
+      if (comp) *comp = s->img_n;
+      s->rows_done = 1;
+      return out;
+   }
+
    // if alpha channel is all 0s, replace with all 255s
    if (target == 4 && all_a == 0)
       for (i=4*s->img_x*s->img_y-1; i >= 0; i -= 4)
@@ -5394,6 +7172,20 @@ static void stbi__tga_read_rgb16(stbi__context *s, stbi_uc* out)
    // so let's treat all 15 and 16bit TGAs as RGB with no alpha.
 }
 
+// stbi_load_rows: swaps a TGA row to RGB if needed and hands it out
+static int stbi__tga_emit_row(stbi__context *s, stbi_uc *row, int w, int h, int comp, int req_comp, int swap, int y)
+{
+   int i;
+   if (swap) {
+      for (i=0; i < w; ++i) {
+         stbi_uc temp = row[i*comp];
+         row[i*comp] = row[i*comp+2];
+         row[i*comp+2] = temp;
+      }
+   }
+   return stbi__emit_rows(s, row, w, h, comp, req_comp, 8, y, 1);
+}
+
 static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri)
 {
    //   read in the TGA header stuff
@@ -5445,7 +7237,8 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
    if (!stbi__mad3sizes_valid(tga_width, tga_height, tga_comp, 0))
       return stbi__errpuc("too large", "Corrupt TGA");
 
-   tga_data = (unsigned char*)stbi__malloc_mad3(tga_width, tga_height, tga_comp, 0);
+   // stbi_load_rows only needs one row
+   tga_data = (unsigned char*)stbi__malloc_mad3(tga_width, s->row_cb ? 1 : tga_height, tga_comp, 0);
    if (!tga_data) return stbi__errpuc("outofmem", "Out of memory");
 
    // skip to the data's starting position (offset usually = 0)
@@ -5454,8 +7247,12 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
    if ( !tga_indexed && !tga_is_RLE && !tga_rgb16 ) {
       for (i=0; i < tga_height; ++i) {
          int row = tga_inverted ? tga_height -i - 1 : i;
-         stbi_uc *tga_row = tga_data + row*tga_width*tga_comp;
+         stbi_uc *tga_row = s->row_cb ? tga_data : tga_data + row*tga_width*tga_comp;
          stbi__getn(s, tga_row, tga_width * tga_comp);
+         if (s->row_cb && !stbi__tga_emit_row(s, tga_row, tga_width, tga_height, tga_comp, req_comp, tga_comp >= 3, row)) {
+            STBI_FREE(tga_data);
+            return NULL;
+         }
       }
    } else  {
       //   do I need to load a palette?
@@ -5533,14 +7330,27 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
          } // end of reading a pixel
 
          // copy data
-         for (j = 0; j < tga_comp; ++j)
-           tga_data[i*tga_comp+j] = raw_data[j];
+         if (s->row_cb) {
+            for (j = 0; j < tga_comp; ++j)
+              tga_data[(i % tga_width)*tga_comp+j] = raw_data[j];
+            if ((i+1) % tga_width == 0) {
+               int row = tga_inverted ? tga_height - 1 - i / tga_width : i / tga_width;
+               if (!stbi__tga_emit_row(s, tga_data, tga_width, tga_height, tga_comp, req_comp, tga_comp >= 3 && !tga_rgb16, row)) {
+                  STBI_FREE(tga_data);
+                  STBI_FREE(tga_palette);
+                  return NULL;
+               }
+            }
+         } else {
+            for (j = 0; j < tga_comp; ++j)
+              tga_data[i*tga_comp+j] = raw_data[j];
+         }
 
          //   in case we're in RLE mode, keep counting down
          --RLE_count;
       }
       //   do I need to invert the image?
-      if ( tga_inverted )
+      if ( tga_inverted && !s->row_cb )
       {
          for (j = 0; j*2 < tga_height; ++j)
          {
@@ -5563,6 +7373,11 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
       }
    }
 
+   if (s->row_cb) {
+      s->rows_done = 1;
+      return tga_data;
+   }
+
    // swap RGB - if the source data was RGB16, it already is in the right order
    if (tga_comp >= 3 && !tga_rgb16)
    {
@@ -6512,7 +8327,7 @@ static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int re
    float *hdr_data;
    int len;
    unsigned char count, value;
-   int i, j, k, c1,c2, z;
+   int i, j, k, c1,c2, z, stream;
    const char *headerToken;
    STBI_NOTUSED(ri);
 
@@ -6550,8 +8365,9 @@ static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int re
    if (!stbi__mad4sizes_valid(width, height, req_comp, sizeof(float), 0))
       return stbi__errpf("too large", "HDR image is too large");
 
-   // Read data
-   hdr_data = (float *) stbi__malloc_mad4(width, height, req_comp, sizeof(float), 0);
+   // Read data; stbi_load_rows only needs one row
+   stream = s->row_cb != NULL;
+   hdr_data = (float *) stbi__malloc_mad4(width, stream ? 1 : height, req_comp, sizeof(float), 0);
    if (!hdr_data)
       return stbi__errpf("outofmem", "Out of memory");
 
@@ -6564,7 +8380,11 @@ static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int re
             stbi_uc rgbe[4];
            main_decode_loop:
             stbi__getn(s, rgbe, 4);
-            stbi__hdr_convert(hdr_data + j * width * req_comp + i * req_comp, rgbe, req_comp);
+            stbi__hdr_convert(hdr_data + (stream ? 0 : j * width * req_comp) + i * req_comp, rgbe, req_comp);
+         }
+         if (stream && !stbi__emit_rows(s, hdr_data, width, height, req_comp, req_comp, 32, j, 1)) {
+            STBI_FREE(hdr_data);
+            return NULL;
          }
       }
    } else {
@@ -6621,12 +8441,18 @@ static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int re
             }
          }
          for (i=0; i < width; ++i)
-            stbi__hdr_convert(hdr_data+(j*width + i)*req_comp, scanline + i*4, req_comp);
+            stbi__hdr_convert(hdr_data+((stream ? 0 : j*width) + i)*req_comp, scanline + i*4, req_comp);
+         if (stream && !stbi__emit_rows(s, hdr_data, width, height, req_comp, req_comp, 32, j, 1)) {
+            STBI_FREE(hdr_data);
+            STBI_FREE(scanline);
+            return NULL;
+         }
       }
       if (scanline)
          STBI_FREE(scanline);
    }
 
+   s->rows_done = stream;
    return hdr_data;
 }
 
@@ -6956,6 +8782,10 @@ static int stbi__info_main(stbi__context *s, int *x, int *y, int *comp)
    #ifndef STBI_NO_PKM
    if (stbi__pkm_info(s, x, y, comp))  return 1;
    #endif
+
+   #ifndef STBI_NO_QOI
+   if (stbi__qoi_info(s, x, y, comp))  return 1;
+   #endif
    
    #ifndef STBI_NO_HDR
    if (stbi__hdr_info(s, x, y, comp))  return 1;
@@ -7021,6 +8851,11 @@ STBIDEF int stbi_info_from_callbacks(stbi_io_callbacks const *c, void *user, int
 #include "stbi_pkm_c.h"
 #endif
 
+// add in QOI loading support
+#ifndef STBI_NO_QOI
+#include "stbi_qoi_c.h"
+#endif
+
 #ifndef STBI_NO_EXT
 #include "stbi_ext_c.h"
 #endif
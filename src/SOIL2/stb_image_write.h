@@ -26,23 +26,27 @@ BUILDING:
    You can #define STBIW_MALLOC(), STBIW_REALLOC(), and STBIW_FREE() to replace
    malloc,realloc,free.
    You can define STBIW_MEMMOVE() to replace memmove()
+   Large PNGs are filtered and deflated on all cores with thread_helper.h;
+   #define STBIW_NO_PARALLEL to encode them on the calling thread only.
 
 USAGE:
 
-   There are four functions, one for each image file format:
+   There are five functions, one for each image file format:
 
      int stbi_write_png(char const *filename, int w, int h, int comp, const void *data, int stride_in_bytes);
      int stbi_write_bmp(char const *filename, int w, int h, int comp, const void *data);
      int stbi_write_tga(char const *filename, int w, int h, int comp, const void *data);
      int stbi_write_hdr(char const *filename, int w, int h, int comp, const float *data);
+     int stbi_write_qoi(char const *filename, int w, int h, int comp, const void *data);
 
-   There are also four equivalent functions that use an arbitrary write function. You are
+   There are also five equivalent functions that use an arbitrary write function. You are
    expected to open/close your file-equivalent before and after calling these:
 
      int stbi_write_png_to_func(stbi_write_func *func, void *context, int w, int h, int comp, const void  *data, int stride_in_bytes);
      int stbi_write_bmp_to_func(stbi_write_func *func, void *context, int w, int h, int comp, const void  *data);
      int stbi_write_tga_to_func(stbi_write_func *func, void *context, int w, int h, int comp, const void  *data);
      int stbi_write_hdr_to_func(stbi_write_func *func, void *context, int w, int h, int comp, const float *data);
+     int stbi_write_qoi_to_func(stbi_write_func *func, void *context, int w, int h, int comp, const void *data);
 
    where the callback is:
       void stbi_write_func(void *context, void *data, int size);
@@ -80,6 +84,17 @@ USAGE:
    TGA supports RLE or non-RLE compressed data. To use non-RLE-compressed
    data, set the global variable 'stbi_write_tga_with_rle' to 0.
 
+   PNG is deflated at the level in the global variable
+   'stbi_write_png_compression_level', 8 unless changed, or at the level
+   passed to stbi_write_png_level. 0 stores the rows as they are, 1 only
+   encodes runs (fast, fine for screenshots), 2 to 9 search more and more
+   matches for smaller files.
+
+   QOI is lossless like PNG but much faster to write and read, at the cost of
+   larger files; it suits caches and screenshot dumps. Y and YA are expanded to
+   RGB and RGBA, the only layouts the format has. It is streamed to the write
+   function in 64 KB blocks.
+
 CREDITS:
 
    PNG/BMP/TGA
@@ -124,6 +139,7 @@ extern "C" {
 #else
 #define STBIWDEF extern
 extern int stbi_write_tga_with_rle;
+extern int stbi_write_png_compression_level;
 #endif
 
 #ifndef STBI_WRITE_NO_STDIO
@@ -131,6 +147,8 @@ STBIWDEF int stbi_write_png(char const *filename, int w, int h, int comp, const
 STBIWDEF int stbi_write_bmp(char const *filename, int w, int h, int comp, const void  *data);
 STBIWDEF int stbi_write_tga(char const *filename, int w, int h, int comp, const void  *data);
 STBIWDEF int stbi_write_hdr(char const *filename, int w, int h, int comp, const float *data);
+STBIWDEF int stbi_write_png_level(char const *filename, int w, int h, int comp, const void  *data, int stride_in_bytes, int level);
+STBIWDEF int stbi_write_qoi(char const *filename, int w, int h, int comp, const void  *data);
 #endif
 
 typedef void stbi_write_func(void *context, void *data, int size);
@@ -138,6 +156,7 @@ typedef void stbi_write_func(void *context, void *data, int size);
 STBIWDEF int stbi_write_png_to_func(stbi_write_func *func, void *context, int w, int h, int comp, const void  *data, int stride_in_bytes);
 STBIWDEF int stbi_write_bmp_to_func(stbi_write_func *func, void *context, int w, int h, int comp, const void  *data);
 STBIWDEF int stbi_write_tga_to_func(stbi_write_func *func, void *context, int w, int h, int comp, const void  *data);
+STBIWDEF int stbi_write_qoi_to_func(stbi_write_func *func, void *context, int w, int h, int comp, const void  *data);
 STBIWDEF int stbi_write_hdr_to_func(stbi_write_func *func, void *context, int w, int h, int comp, const float *data);
 
 #ifdef __cplusplus
@@ -166,6 +185,11 @@ STBIWDEF int stbi_write_hdr_to_func(stbi_write_func *func, void *context, int w,
 #include <string.h>
 #include <math.h>
 
+// define STBIW_NO_PARALLEL to keep PNG encoding on the calling thread
+#ifndef STBIW_NO_PARALLEL
+#include "thread_helper.h"
+#endif
+
 #if defined(STBIW_MALLOC) && defined(STBIW_FREE) && (defined(STBIW_REALLOC) || defined(STBIW_REALLOC_SIZED))
 // ok
 #elif !defined(STBIW_MALLOC) && !defined(STBIW_FREE) && !defined(STBIW_REALLOC) && !defined(STBIW_REALLOC_SIZED)
@@ -236,8 +260,10 @@ typedef int stb_image_write_test[sizeof(stbiw_uint32)==4 ? 1 : -1];
 
 #ifdef STB_IMAGE_WRITE_STATIC
 static int stbi_write_tga_with_rle = 1;
+static int stbi_write_png_compression_level = 8;
 #else
 int stbi_write_tga_with_rle = 1;
+int stbi_write_png_compression_level = 8;
 #endif
 
 static void stbiw__writefv(stbi__write_context *s, const char *fmt, va_list v)
@@ -640,6 +666,137 @@ int stbi_write_hdr(char const *filename, int x, int y, int comp, const float *da
 }
 #endif // STBI_WRITE_NO_STDIO
 
+// *************************************************************************************************
+// QOI writer, "Quite OK Image" format (https://qoiformat.org)
+//
+// Lossless with no entropy coding, one pass over the pixels, so it runs at
+// close to memory speed. The output goes to the write function in blocks of
+// STBIW__QOI_BLOCK bytes instead of building the whole file first.
+
+#define STBIW__QOI_OP_INDEX  0x00
+#define STBIW__QOI_OP_DIFF   0x40
+#define STBIW__QOI_OP_LUMA   0x80
+#define STBIW__QOI_OP_RUN    0xc0
+#define STBIW__QOI_OP_RGB    0xfe
+#define STBIW__QOI_OP_RGBA   0xff
+#define STBIW__QOI_HASH(r,g,b,a)  (((r) * 3 + (g) * 5 + (b) * 7 + (a) * 11) & 63)
+#define STBIW__QOI_BLOCK     65536
+
+static int stbi_write_qoi_core(stbi__write_context *s, int x, int y, int comp, const void *data)
+{
+   static const unsigned char end_marker[8] = { 0,0,0,0,0,0,0,1 };
+   stbiw_uint32 index[64];
+   const unsigned char *src = (const unsigned char *) data;
+   unsigned char *block, *o, *limit;
+   unsigned char r, g, b, a, pr = 0, pg = 0, pb = 0, pa = 255;
+   size_t i, count;
+   int run = 0;
+
+   if (x <= 0 || y <= 0 || comp < 1 || comp > 4 || data == NULL)
+      return 0;
+
+   block = (unsigned char *) STBIW_MALLOC(STBIW__QOI_BLOCK);
+   if (!block)
+      return 0;
+   memset(index, 0, sizeof(index));
+
+   // Y and YA are stored as RGB and RGBA, the format has nothing smaller
+   o = block;
+   *o++ = 'q'; *o++ = 'o'; *o++ = 'i'; *o++ = 'f';
+   *o++ = STBIW_UCHAR(x >> 24); *o++ = STBIW_UCHAR(x >> 16); *o++ = STBIW_UCHAR(x >> 8); *o++ = STBIW_UCHAR(x);
+   *o++ = STBIW_UCHAR(y >> 24); *o++ = STBIW_UCHAR(y >> 16); *o++ = STBIW_UCHAR(y >> 8); *o++ = STBIW_UCHAR(y);
+   *o++ = (comp == 2 || comp == 4) ? 4 : 3;
+   *o++ = 0; // sRGB with linear alpha
+
+   // the longest op is 5 bytes
+   limit = block + STBIW__QOI_BLOCK - 5;
+   count = (size_t) x * (size_t) y;
+   for (i = 0; i < count; ++i, src += comp) {
+      if (comp >= 3) {
+         r = src[0]; g = src[1]; b = src[2];
+         a = comp == 4 ? src[3] : 255;
+      } else {
+         r = g = b = src[0];
+         a = comp == 2 ? src[1] : 255;
+      }
+
+      if (r == pr && g == pg && b == pb && a == pa) {
+         if (++run == 62) {
+            *o++ = STBIW__QOI_OP_RUN | 61;
+            run = 0;
+         }
+      } else {
+         stbiw_uint32 px = r | (g << 8) | (b << 16) | ((stbiw_uint32) a << 24);
+         int h = STBIW__QOI_HASH(r, g, b, a);
+
+         if (run) {
+            *o++ = STBIW_UCHAR(STBIW__QOI_OP_RUN | (run - 1));
+            run = 0;
+         }
+
+         if (index[h] == px) {
+            *o++ = STBIW_UCHAR(STBIW__QOI_OP_INDEX | h);
+         } else {
+            index[h] = px;
+            if (a == pa) {
+               int vr = (signed char) (r - pr);
+               int vg = (signed char) (g - pg);
+               int vb = (signed char) (b - pb);
+               int vg_r = vr - vg;
+               int vg_b = vb - vg;
+               if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+                  *o++ = STBIW_UCHAR(STBIW__QOI_OP_DIFF | ((vr + 2) << 4) | ((vg + 2) << 2) | (vb + 2));
+               } else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 && vg_b > -9 && vg_b < 8) {
+                  *o++ = STBIW_UCHAR(STBIW__QOI_OP_LUMA | (vg + 32));
+                  *o++ = STBIW_UCHAR(((vg_r + 8) << 4) | (vg_b + 8));
+               } else {
+                  *o++ = STBIW__QOI_OP_RGB;
+                  *o++ = r; *o++ = g; *o++ = b;
+               }
+            } else {
+               *o++ = STBIW__QOI_OP_RGBA;
+               *o++ = r; *o++ = g; *o++ = b; *o++ = a;
+            }
+         }
+         pr = r; pg = g; pb = b; pa = a;
+      }
+
+      if (o >= limit) {
+         s->func(s->context, block, (int) (o - block));
+         o = block;
+      }
+   }
+
+   if (run)
+      *o++ = STBIW_UCHAR(STBIW__QOI_OP_RUN | (run - 1));
+   s->func(s->context, block, (int) (o - block));
+   s->func(s->context, (void *) end_marker, 8);
+   STBIW_FREE(block);
+   return 1;
+}
+
+STBIWDEF int stbi_write_qoi_to_func(stbi_write_func *func, void *context, int x, int y, int comp, const void *data)
+{
+   stbi__write_context s;
+   stbi__start_write_callbacks(&s, func, context);
+   return stbi_write_qoi_core(&s, x, y, comp, data);
+}
+
+#ifndef STBI_WRITE_NO_STDIO
+STBIWDEF int stbi_write_qoi(char const *filename, int x, int y, int comp, const void *data)
+{
+   stbi__write_context s;
+   if (stbi__start_write_file(&s,filename)) {
+      int r = stbi_write_qoi_core(&s, x, y, comp, data);
+      // a full disk only shows up when the buffered data is flushed
+      r = r && !ferror((FILE *) s.context);
+      stbi__end_write_file(&s);
+      return r;
+   } else
+      return 0;
+}
+#endif // STBI_WRITE_NO_STDIO
+
 
 //////////////////////////////////////////////////////////////////////////////
 //
@@ -694,8 +851,16 @@ static int stbiw__zlib_bitrev(int code, int codebits)
 
 static unsigned int stbiw__zlib_countm(unsigned char *a, unsigned char *b, int limit)
 {
-   int i;
-   for (i=0; i < limit && i < 258; ++i)
+   int i=0;
+   if (limit > 258) limit = 258;
+   // four bytes at a time while they all agree
+   for (; i+4 <= limit; i += 4) {
+      stbiw_uint32 u, v;
+      memcpy(&u, a+i, 4);
+      memcpy(&v, b+i, 4);
+      if (u != v) break;
+   }
+   for (; i < limit; ++i)
       if (a[i] != b[i]) break;
    return i;
 }
@@ -725,110 +890,308 @@ static unsigned int stbiw__zhash(unsigned char *data)
 #define stbiw__zlib_huffb(n) ((n) <= 143 ? stbiw__zlib_huff1(n) : stbiw__zlib_huff2(n))
 
 #define stbiw__ZHASH   16384
+#define stbiw__ZWINDOW 32768
 
-unsigned char * stbi_zlib_compress(unsigned char *data, int data_len, int *out_len, int quality)
+// chunks deflated on separate threads; the output only depends on this size,
+// never on the number of cores
+#define stbiw__ZCHUNK  (256*1024)
+
+static unsigned int stbiw__zlib_adler32(unsigned char *data, int data_len)
+{
+   unsigned int s1=1, s2=0;
+   int i, j=0, blocklen = (int) (data_len % 5552);
+   while (j < data_len) {
+      for (i=0; i < blocklen; ++i) s1 += data[j+i], s2 += s1;
+      s1 %= 65521, s2 %= 65521;
+      j += blocklen;
+      blocklen = 5552;
+   }
+   return (s2 << 16) | s1;
+}
+
+// adler32 of a followed by b, given the adler32 of each and the length of b
+static unsigned int stbiw__zlib_adler32_combine(unsigned int a, unsigned int b, int b_len)
+{
+   unsigned int rem = (unsigned int) (b_len % 65521);
+   unsigned int s1 = a & 0xffff;
+   unsigned int s2 = (rem * s1) % 65521;
+   s1 += (b & 0xffff) + 65521 - 1;
+   s2 += (a >> 16) + (b >> 16) + 65521 - rem;
+   if (s1 >= 65521) s1 -= 65521;
+   if (s1 >= 65521) s1 -= 65521;
+   if (s2 >= 2*65521) s2 -= 2*65521;
+   if (s2 >= 65521) s2 -= 65521;
+   return (s2 << 16) | s1;
+}
+
+static unsigned short stbiw__zlib_lengthc[] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258, 259 };
+static unsigned char  stbiw__zlib_lengtheb[]= { 0,0,0,0,0,0,0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4,  4,  5,  5,  5,  5,  0 };
+static unsigned short stbiw__zlib_distc[]   = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577, 32768 };
+static unsigned char  stbiw__zlib_disteb[]  = { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
+
+// what each compression level does: how many earlier positions with the same
+// hash to try, a match length that is good enough to stop looking, and whether
+// a match is held back one byte in case the next byte starts a longer one
+// ("lazy matching"). Behind a held match at least 'good' long only a quarter
+// of the chain is searched. Level 0 only stores, level 1 only encodes runs.
+static struct { unsigned short chain, nice, good; unsigned char lazy; } stbiw__zlib_levels[10] =
+{
+   {    0,   0,   0, 0 },
+   {    0,   0,   0, 0 },
+   {    4,  16,   0, 0 },
+   {    8,  32,   0, 0 },
+   {    4,  16,   4, 1 },
+   {    8,  32,   8, 1 },
+   {   12,  64,   8, 1 },
+   {   16, 128,  16, 1 },
+   {   24, 258,  16, 1 },
+   {  512, 258, 258, 1 },
+};
+
+static unsigned char *stbiw__zlib_match(unsigned char *out, unsigned int *bitbuffer, int *bitcounter, int best, int d)
+{
+   unsigned int bitbuf = *bitbuffer;
+   int j, bitcount = *bitcounter;
+   STBIW_ASSERT(d <= 32767 && best <= 258);
+   for (j=0; best > stbiw__zlib_lengthc[j+1]-1; ++j);
+   stbiw__zlib_huff(j+257);
+   if (stbiw__zlib_lengtheb[j]) stbiw__zlib_add(best - stbiw__zlib_lengthc[j], stbiw__zlib_lengtheb[j]);
+   for (j=0; d > stbiw__zlib_distc[j+1]-1; ++j);
+   stbiw__zlib_add(stbiw__zlib_bitrev(j,5),5);
+   if (stbiw__zlib_disteb[j]) stbiw__zlib_add(d - stbiw__zlib_distc[j], stbiw__zlib_disteb[j]);
+   *bitbuffer = bitbuf;
+   *bitcounter = bitcount;
+   return out;
+}
+
+// the match finder keeps, for every hash, the newest position that had it in
+// head[], and for every position in the window the one before it in prev[]
+static void stbiw__zlib_insert(unsigned char *data, int i, int *head, int *prev)
+{
+   int h = stbiw__zhash(data+i)&(stbiw__ZHASH-1);
+   prev[i & (stbiw__ZWINDOW-1)] = head[h];
+   head[h] = i;
+}
+
+// returns the length of the longest match for data+i, or 0 if there is none
+// of at least 3 bytes; limit is how many bytes are left
+static int stbiw__zlib_longest(unsigned char *data, int i, int limit, int *head, int *prev, int chain, int nice, int *dist)
+{
+   int best = 2, cur = head[stbiw__zhash(data+i)&(stbiw__ZHASH-1)];
+   if (limit > 258) limit = 258;
+   if (nice > limit) nice = limit;
+   while (cur >= 0 && cur > i - stbiw__ZWINDOW && chain-- > 0) {
+      // a longer match has to agree on the byte after the current best
+      if (data[cur+best] == data[i+best] && data[cur] == data[i]) {
+         int d = (int) stbiw__zlib_countm(data+cur, data+i, limit);
+         if (d > best) {
+            best = d;
+            *dist = i - cur;
+            if (best >= nice) break;
+         }
+      }
+      cur = prev[cur & (stbiw__ZWINDOW-1)];
+   }
+   return best >= 3 ? best : 0;
+}
+
+// deflates data[start..end) as one fixed huffman block (or stored blocks at
+// level 0). Matches may reach back before start, since the decoder has seen
+// those bytes already. Unless this is the last chunk, the block is followed by
+// an empty stored block (a sync flush) so the output ends on a byte boundary
+// and the chunks can be concatenated.
+static unsigned char *stbiw__zlib_compress_chunk(unsigned char *data, int start, int end, int level, int last)
 {
-   static unsigned short lengthc[] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258, 259 };
-   static unsigned char  lengtheb[]= { 0,0,0,0,0,0,0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4,  4,  5,  5,  5,  5,  0 };
-   static unsigned short distc[]   = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577, 32768 };
-   static unsigned char  disteb[]  = { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
    unsigned int bitbuf=0;
-   int i,j, bitcount=0;
+   int i, bitcount=0;
    unsigned char *out = NULL;
-   unsigned char ***hash_table = (unsigned char***) STBIW_MALLOC(stbiw__ZHASH * sizeof(char**));
-   if (quality < 5) quality = 5;
+   int *head = NULL, *prev = NULL;
+
+   if (level <= 0) {
+      // every chunk starts on a byte boundary, so stored blocks need no padding
+      i = start;
+      do {
+         int len = end-i < 65535 ? end-i : 65535;
+         stbiw__sbpush(out, (unsigned char) (last && i+len == end)); // BFINAL, BTYPE = 0 -- stored
+         stbiw__sbpush(out, STBIW_UCHAR(len));
+         stbiw__sbpush(out, STBIW_UCHAR(len >> 8));
+         stbiw__sbpush(out, STBIW_UCHAR(~len));
+         stbiw__sbpush(out, STBIW_UCHAR(~len >> 8));
+         stbiw__sbmaybegrow(out, len);
+         STBIW_MEMMOVE(out + stbiw__sbn(out), data+i, len);
+         stbiw__sbn(out) += len;
+         i += len;
+      } while (i < end);
+      return out;
+   }
 
-   stbiw__sbpush(out, 0x78);   // DEFLATE 32K window
-   stbiw__sbpush(out, 0x5e);   // FLEVEL = 1
-   stbiw__zlib_add(1,1);  // BFINAL = 1
+   stbiw__zlib_add(last ? 1 : 0,1);  // BFINAL
    stbiw__zlib_add(1,2);  // BTYPE = 1 -- fixed huffman
 
-   for (i=0; i < stbiw__ZHASH; ++i)
-      hash_table[i] = NULL;
-
-   i=0;
-   while (i < data_len-3) {
-      // hash next 3 bytes of data to be compressed
-      int h = stbiw__zhash(data+i)&(stbiw__ZHASH-1), best=3;
-      unsigned char *bestloc = 0;
-      unsigned char **hlist = hash_table[h];
-      int n = stbiw__sbcount(hlist);
-      for (j=0; j < n; ++j) {
-         if (hlist[j]-data > i-32768) { // if entry lies within window
-            int d = stbiw__zlib_countm(hlist[j], data+i, data_len-i);
-            if (d >= best) best=d,bestloc=hlist[j];
+   i = start;
+   if (level == 1) {
+      // runs only: matches at distance 1
+      while (i <= end-3) {
+         int best = (i > 0 && data[i-1] == data[i]) ? (int) stbiw__zlib_countm(data+i-1, data+i, end-i) : 0;
+         if (best >= 3) {
+            out = stbiw__zlib_match(out, &bitbuf, &bitcount, best, 1);
+            i += best;
+         } else {
+            stbiw__zlib_huffb(data[i]);
+            ++i;
          }
       }
-      // when hash table entry is too long, delete half the entries
-      if (hash_table[h] && stbiw__sbn(hash_table[h]) == 2*quality) {
-         STBIW_MEMMOVE(hash_table[h], hash_table[h]+quality, sizeof(hash_table[h][0])*quality);
-         stbiw__sbn(hash_table[h]) = quality;
-      }
-      stbiw__sbpush(hash_table[h],data+i);
-
-      if (bestloc) {
-         // "lazy matching" - check match at *next* byte, and if it's better, do cur byte as literal
-         h = stbiw__zhash(data+i+1)&(stbiw__ZHASH-1);
-         hlist = hash_table[h];
-         n = stbiw__sbcount(hlist);
-         for (j=0; j < n; ++j) {
-            if (hlist[j]-data > i-32767) {
-               int e = stbiw__zlib_countm(hlist[j], data+i+1, data_len-i-1);
-               if (e > best) { // if next match is better, bail on current match
-                  bestloc = NULL;
-                  break;
-               }
+   } else {
+      int chain = stbiw__zlib_levels[level].chain, nice = stbiw__zlib_levels[level].nice;
+      int good = stbiw__zlib_levels[level].good, lazy = stbiw__zlib_levels[level].lazy;
+      int held = 0, held_dist = 0, p;
+      head = (int *) STBIW_MALLOC((stbiw__ZHASH + stbiw__ZWINDOW) * sizeof(int));
+      if (!head) { (void) stbiw__sbfree(out); return NULL; }
+      prev = head + stbiw__ZHASH;
+      for (p=0; p < stbiw__ZHASH; ++p)
+         head[p] = -1;
+
+      // fill the window with the tail of the previous chunk
+      for (p = start > stbiw__ZWINDOW ? start-stbiw__ZWINDOW : 0; p < start; ++p)
+         stbiw__zlib_insert(data, p, head, prev);
+
+      while (i <= end-3) {
+         int dist = 0, best = stbiw__zlib_longest(data, i, end-i, head, prev, held >= good ? chain >> 2 : chain, nice, &dist);
+         stbiw__zlib_insert(data, i, head, prev);
+         if (held) {
+            if (best > held) {
+               // the match here is longer, so the byte before goes out as a literal
+               stbiw__zlib_huffb(data[i-1]);
+               held = best, held_dist = dist;
+               ++i;
+               continue;
+            }
+            out = stbiw__zlib_match(out, &bitbuf, &bitcount, held, held_dist);
+            for (p=i+1; p < i-1+held && p <= end-3; ++p)
+               stbiw__zlib_insert(data, p, head, prev);
+            i += held-1;
+            held = 0;
+         } else if (best) {
+            if (lazy && best < nice) {
+               held = best, held_dist = dist;
+               ++i;
+               continue;
             }
+            out = stbiw__zlib_match(out, &bitbuf, &bitcount, best, dist);
+            if (lazy)
+               for (p=i+1; p < i+best && p <= end-3; ++p)
+                  stbiw__zlib_insert(data, p, head, prev);
+            i += best;
+         } else {
+            stbiw__zlib_huffb(data[i]);
+            ++i;
          }
       }
-
-      if (bestloc) {
-         int d = (int) (data+i - bestloc); // distance back
-         STBIW_ASSERT(d <= 32767 && best <= 258);
-         for (j=0; best > lengthc[j+1]-1; ++j);
-         stbiw__zlib_huff(j+257);
-         if (lengtheb[j]) stbiw__zlib_add(best - lengthc[j], lengtheb[j]);
-         for (j=0; d > distc[j+1]-1; ++j);
-         stbiw__zlib_add(stbiw__zlib_bitrev(j,5),5);
-         if (disteb[j]) stbiw__zlib_add(d - distc[j], disteb[j]);
-         i += best;
-      } else {
-         stbiw__zlib_huffb(data[i]);
-         ++i;
+      if (held) {
+         out = stbiw__zlib_match(out, &bitbuf, &bitcount, held, held_dist);
+         i += held-1;
       }
+      STBIW_FREE(head);
    }
    // write out final bytes
-   for (;i < data_len; ++i)
+   for (;i < end; ++i)
       stbiw__zlib_huffb(data[i]);
    stbiw__zlib_huff(256); // end of block
+   if (!last) {
+      // sync flush: an empty stored block, then its LEN and NLEN
+      stbiw__zlib_add(0,1);
+      stbiw__zlib_add(0,2);
+      while (bitcount)
+         stbiw__zlib_add(0,1);
+      stbiw__zlib_add(0,16);
+      stbiw__zlib_add(0xffff,16);
+   }
    // pad with 0 bits to byte boundary
    while (bitcount)
       stbiw__zlib_add(0,1);
+   return out;
+}
 
-   for (i=0; i < stbiw__ZHASH; ++i)
-      (void) stbiw__sbfree(hash_table[i]);
-   STBIW_FREE(hash_table);
+typedef struct
+{
+   unsigned char *data;
+   int data_len, level, chunk_count;
+   unsigned char **chunks;
+   unsigned int *adler;
+} stbiw__zlib_jobs;
 
-   {
-      // compute adler32 on input
-      unsigned int s1=1, s2=0;
-      int blocklen = (int) (data_len % 5552);
-      j=0;
-      while (j < data_len) {
-         for (i=0; i < blocklen; ++i) s1 += data[j+i], s2 += s1;
-         s1 %= 65521, s2 %= 65521;
-         j += blocklen;
-         blocklen = 5552;
+static void stbiw__zlib_chunk_job(void *arg, int k)
+{
+   stbiw__zlib_jobs *z = (stbiw__zlib_jobs *) arg;
+   int start = k * stbiw__ZCHUNK;
+   int end = k+1 == z->chunk_count ? z->data_len : start + stbiw__ZCHUNK;
+   z->chunks[k] = stbiw__zlib_compress_chunk(z->data, start, end, z->level, k+1 == z->chunk_count);
+   z->adler[k] = stbiw__zlib_adler32(z->data + start, end - start);
+}
+
+// quality is the compression level: 0 only stores, 1 only encodes runs, 2 to 9
+// search harder and harder for matches; higher values are the same as 9
+unsigned char * stbi_zlib_compress(unsigned char *data, int data_len, int *out_len, int quality)
+{
+   static unsigned char flevel[10] = { 0x01,0x01,0x5e,0x5e,0x5e,0x5e,0x9c,0xda,0xda,0xda };
+   stbiw__zlib_jobs z;
+   unsigned char *out = NULL, *o;
+   unsigned int adler;
+   int k, len, failed = 0;
+#ifndef STBIW_NO_PARALLEL
+   int threads = 1;
+#endif
+
+   z.data = data;
+   z.data_len = data_len;
+   z.level = quality < 0 ? 0 : quality > 9 ? 9 : quality;
+   z.chunk_count = 1;
+#ifndef STBIW_NO_PARALLEL
+   // split big inputs into chunks that are deflated at the same time; each
+   // chunk still sees the 32K before it, so very little ratio is lost
+   if (data_len >= 2*stbiw__ZCHUNK && (threads = get_hardware_thread_count()) > 1)
+      z.chunk_count = data_len / stbiw__ZCHUNK;
+#endif
+   z.chunks = (unsigned char **) STBIW_MALLOC(z.chunk_count * (sizeof(unsigned char *) + sizeof(unsigned int)));
+   if (!z.chunks) return NULL;
+   z.adler = (unsigned int *) (z.chunks + z.chunk_count);
+
+#ifndef STBIW_NO_PARALLEL
+   if (z.chunk_count > 1)
+      run_parallel_jobs(z.chunk_count, threads, stbiw__zlib_chunk_job, &z);
+   else
+#endif
+      stbiw__zlib_chunk_job(&z, 0);
+
+   len = 2 + 4;
+   for (k=0; k < z.chunk_count; ++k) {
+      if (!z.chunks[k]) failed = 1;
+      else len += stbiw__sbn(z.chunks[k]);
+   }
+   if (!failed)
+      out = (unsigned char *) STBIW_MALLOC(len);
+   if (out) {
+      o = out;
+      *o++ = 0x78;   // DEFLATE 32K window
+      *o++ = flevel[z.level];   // FLEVEL, a hint for how hard we tried
+      adler = 1;
+      for (k=0; k < z.chunk_count; ++k) {
+         int start = k * stbiw__ZCHUNK;
+         int end = k+1 == z.chunk_count ? data_len : start + stbiw__ZCHUNK;
+         STBIW_MEMMOVE(o, z.chunks[k], stbiw__sbn(z.chunks[k]));
+         o += stbiw__sbn(z.chunks[k]);
+         adler = k ? stbiw__zlib_adler32_combine(adler, z.adler[k], end - start) : z.adler[k];
       }
-      stbiw__sbpush(out, STBIW_UCHAR(s2 >> 8));
-      stbiw__sbpush(out, STBIW_UCHAR(s2));
-      stbiw__sbpush(out, STBIW_UCHAR(s1 >> 8));
-      stbiw__sbpush(out, STBIW_UCHAR(s1));
+      *o++ = STBIW_UCHAR(adler >> 24);
+      *o++ = STBIW_UCHAR(adler >> 16);
+      *o++ = STBIW_UCHAR(adler >> 8);
+      *o++ = STBIW_UCHAR(adler);
+      *out_len = len;
    }
-   *out_len = stbiw__sbn(out);
-   // make returned pointer freeable
-   STBIW_MEMMOVE(stbiw__sbraw(out), out, *out_len);
-   return (unsigned char *) stbiw__sbraw(out);
+   for (k=0; k < z.chunk_count; ++k)
+      (void) stbiw__sbfree(z.chunks[k]);
+   STBIW_FREE(z.chunks);
+   return out;
 }
 
 static unsigned int stbiw__crc32(unsigned char *buffer, int len)
@@ -894,62 +1257,117 @@ static unsigned char stbiw__paeth(int a, int b, int c)
    return STBIW_UCHAR(c);
 }
 
+// rows are filtered in bands of this many, one band per job
+#define stbiw__PNG_BAND  32
+
+typedef struct
+{
+   unsigned char *pixels, *filt;
+   int stride_bytes, x, y, n, level, failed;
+} stbiw__png_filter_jobs;
+
+// filters one row with the given predictor into line_buffer and returns the sum
+// of the absolute filtered values, the estimate the filter is picked by. Types
+// 5 and 6 are average and paeth for the first row, where there is no row above.
+static int stbiw__png_filter_row(unsigned char *z, int stride_bytes, int x, int n, int type, signed char *line_buffer)
+{
+   unsigned char *up = z - stride_bytes;
+   int i, est = 0, w = x*n;
+   switch (type) {
+      case 0:
+         STBIW_MEMMOVE(line_buffer, z, w);
+         break;
+      case 1: case 6:
+         for (i=0; i < n; ++i) line_buffer[i] = z[i];
+         for (i=n; i < w; ++i) line_buffer[i] = z[i] - z[i-n];
+         break;
+      case 2:
+         for (i=0; i < w; ++i) line_buffer[i] = z[i] - up[i];
+         break;
+      case 3:
+         for (i=0; i < n; ++i) line_buffer[i] = z[i] - (up[i]>>1);
+         for (i=n; i < w; ++i) line_buffer[i] = z[i] - ((z[i-n] + up[i])>>1);
+         break;
+      case 4:
+         for (i=0; i < n; ++i) line_buffer[i] = z[i] - up[i];
+         for (i=n; i < w; ++i) line_buffer[i] = z[i] - stbiw__paeth(z[i-n], up[i], up[i-n]);
+         break;
+      case 5:
+         for (i=0; i < n; ++i) line_buffer[i] = z[i];
+         for (i=n; i < w; ++i) line_buffer[i] = z[i] - (z[i-n]>>1);
+         break;
+   }
+   for (i=0; i < w; ++i)
+      est += abs(line_buffer[i]);
+   return est;
+}
+
 // @OPTIMIZE: provide an option that always forces left-predict or paeth predict
-unsigned char *stbi_write_png_to_mem(unsigned char *pixels, int stride_bytes, int x, int y, int n, int *out_len)
+static void stbiw__png_filter_band(void *arg, int band)
+{
+   stbiw__png_filter_jobs *f = (stbiw__png_filter_jobs *) arg;
+   unsigned char *pixels = f->pixels, *filt = f->filt;
+   int stride_bytes = f->stride_bytes, x = f->x, n = f->n;
+   int j,k, j_end = stbiw__PNG_BAND*(band+1) < f->y ? stbiw__PNG_BAND*(band+1) : f->y;
+   // one row for each of the five filters, so the best one need not be redone
+   signed char *line_buffer = (signed char *) STBIW_MALLOC(5 * x * n);
+   if (!line_buffer) { f->failed = 1; return; }
+   for (j=stbiw__PNG_BAND*band; j < j_end; ++j) {
+      static int mapping[] = { 0,1,2,3,4 };
+      static int firstmap[] = { 0,1,0,5,6 };
+      int *mymap = (j != 0) ? mapping : firstmap;
+      int best = 0, bestval = 0x7fffffff;
+      if (f->level == 0) {
+         // stored data does not get smaller with filtering
+         filt[j*(x*n+1)] = 0;
+         STBIW_MEMMOVE(filt+j*(x*n+1)+1, pixels + stride_bytes*j, x*n);
+         continue;
+      }
+      for (k=0; k < 5; ++k) {
+         int est = stbiw__png_filter_row(pixels + stride_bytes*j, stride_bytes, x, n, mymap[k], line_buffer + k*x*n);
+         if (est < bestval) { bestval = est; best = k; }
+      }
+      filt[j*(x*n+1)] = (unsigned char) best;
+      STBIW_MEMMOVE(filt+j*(x*n+1)+1, line_buffer + best*x*n, x*n);
+   }
+   STBIW_FREE(line_buffer);
+}
+
+static unsigned char *stbiw__write_png_to_mem(unsigned char *pixels, int stride_bytes, int x, int y, int n, int level, int *out_len)
 {
    int ctype[5] = { -1, 0, 4, 2, 6 };
    unsigned char sig[8] = { 137,80,78,71,13,10,26,10 };
    unsigned char *out,*o, *filt, *zlib;
-   signed char *line_buffer;
-   int i,j,k,p,zlen;
+   stbiw__png_filter_jobs f;
+   int band_count,zlen;
 
    if (stride_bytes == 0)
       stride_bytes = x * n;
 
    filt = (unsigned char *) STBIW_MALLOC((x*n+1) * y); if (!filt) return 0;
-   line_buffer = (signed char *) STBIW_MALLOC(x * n); if (!line_buffer) { STBIW_FREE(filt); return 0; }
-   for (j=0; j < y; ++j) {
-      static int mapping[] = { 0,1,2,3,4 };
-      static int firstmap[] = { 0,1,0,5,6 };
-      int *mymap = (j != 0) ? mapping : firstmap;
-      int best = 0, bestval = 0x7fffffff;
-      for (p=0; p < 2; ++p) {
-         for (k= p?best:0; k < 5; ++k) { // @TODO: clarity: rewrite this to go 0..5, and 'continue' the unwanted ones during 2nd pass
-            int type = mymap[k],est=0;
-            unsigned char *z = pixels + stride_bytes*j;
-            for (i=0; i < n; ++i)
-               switch (type) {
-                  case 0: line_buffer[i] = z[i]; break;
-                  case 1: line_buffer[i] = z[i]; break;
-                  case 2: line_buffer[i] = z[i] - z[i-stride_bytes]; break;
-                  case 3: line_buffer[i] = z[i] - (z[i-stride_bytes]>>1); break;
-                  case 4: line_buffer[i] = (signed char) (z[i] - stbiw__paeth(0,z[i-stride_bytes],0)); break;
-                  case 5: line_buffer[i] = z[i]; break;
-                  case 6: line_buffer[i] = z[i]; break;
-               }
-            for (i=n; i < x*n; ++i) {
-               switch (type) {
-                  case 0: line_buffer[i] = z[i]; break;
-                  case 1: line_buffer[i] = z[i] - z[i-n]; break;
-                  case 2: line_buffer[i] = z[i] - z[i-stride_bytes]; break;
-                  case 3: line_buffer[i] = z[i] - ((z[i-n] + z[i-stride_bytes])>>1); break;
-                  case 4: line_buffer[i] = z[i] - stbiw__paeth(z[i-n], z[i-stride_bytes], z[i-stride_bytes-n]); break;
-                  case 5: line_buffer[i] = z[i] - (z[i-n]>>1); break;
-                  case 6: line_buffer[i] = z[i] - stbiw__paeth(z[i-n], 0,0); break;
-               }
-            }
-            if (p) break;
-            for (i=0; i < x*n; ++i)
-               est += abs((signed char) line_buffer[i]);
-            if (est < bestval) { bestval = est; best = k; }
-         }
-      }
-      // when we get here, best contains the filter type, and line_buffer contains the data
-      filt[j*(x*n+1)] = (unsigned char) best;
-      STBIW_MEMMOVE(filt+j*(x*n+1)+1, line_buffer, x*n);
+   f.pixels = pixels;
+   f.filt = filt;
+   f.stride_bytes = stride_bytes;
+   f.x = x;
+   f.y = y;
+   f.n = n;
+   f.level = level;
+   f.failed = 0;
+   band_count = (y + stbiw__PNG_BAND-1) / stbiw__PNG_BAND;
+#ifndef STBIW_NO_PARALLEL
+   // each row only reads its own pixels and the row above, so the bands are
+   // independent; small images are not worth starting threads for
+   if (band_count > 1 && (x*n+1) * y >= stbiw__ZCHUNK)
+      run_parallel_jobs(band_count, 0, stbiw__png_filter_band, &f);
+   else
+#endif
+   {
+      int band;
+      for (band=0; band < band_count; ++band)
+         stbiw__png_filter_band(&f, band);
    }
-   STBIW_FREE(line_buffer);
-   zlib = stbi_zlib_compress(filt, y*( x*n+1), &zlen, 8); // increase 8 to get smaller but use more memory
+   if (f.failed) { STBIW_FREE(filt); return 0; }
+   zlib = stbi_zlib_compress(filt, y*( x*n+1), &zlen, level);
    STBIW_FREE(filt);
    if (!zlib) return 0;
 
@@ -987,12 +1405,22 @@ unsigned char *stbi_write_png_to_mem(unsigned char *pixels, int stride_bytes, in
    return out;
 }
 
+unsigned char *stbi_write_png_to_mem(unsigned char *pixels, int stride_bytes, int x, int y, int n, int *out_len)
+{
+   return stbiw__write_png_to_mem(pixels, stride_bytes, x, y, n, stbi_write_png_compression_level, out_len);
+}
+
 #ifndef STBI_WRITE_NO_STDIO
 STBIWDEF int stbi_write_png(char const *filename, int x, int y, int comp, const void *data, int stride_bytes)
+{
+   return stbi_write_png_level(filename, x, y, comp, data, stride_bytes, stbi_write_png_compression_level);
+}
+
+STBIWDEF int stbi_write_png_level(char const *filename, int x, int y, int comp, const void *data, int stride_bytes, int level)
 {
    FILE *f;
    int len;
-   unsigned char *png = stbi_write_png_to_mem((unsigned char *) data, stride_bytes, x, y, comp, &len);
+   unsigned char *png = stbiw__write_png_to_mem((unsigned char *) data, stride_bytes, x, y, comp, level, &len);
    if (png == NULL) return 0;
    f = fopen(filename, "wb");
    if (!f) { STBIW_FREE(png); return 0; }
@@ -240,6 +240,247 @@ void stbi_decode_DXT_color_block(
 	//	done
 }
 
+//	BC4 (ATI1) and BC5 (ATI2) are the DXT5 alpha block, once or twice
+static int stbi__dds_RGTC_channels( unsigned int fourcc )
+{
+	if( (fourcc == (('A'<<0)|('T'<<8)|('I'<<16)|('1'<<24))) ||
+		(fourcc == (('B'<<0)|('C'<<8)|('4'<<16)|('U'<<24))) )
+	{
+		return 1;
+	}
+	if( (fourcc == (('A'<<0)|('T'<<8)|('I'<<16)|('2'<<24))) ||
+		(fourcc == (('B'<<0)|('C'<<8)|('5'<<16)|('U'<<24))) )
+	{
+		return 2;
+	}
+	return 0;
+}
+void stbi_decode_RGTC_block(
+			unsigned char uncompressed[16*4],
+			unsigned char compressed[16],
+			int channels )
+{
+	unsigned char channel_block[16*4];
+	int i;
+	stbi_decode_DXT45_alpha_block( channel_block, compressed );
+	for( i = 0; i < 16; ++i )
+	{
+		//	BC4 is grey, BC5 is red and green
+		uncompressed[i*4+0] = channel_block[i*4+3];
+		uncompressed[i*4+1] = channel_block[i*4+3];
+		uncompressed[i*4+2] = channel_block[i*4+3];
+		uncompressed[i*4+3] = 255;
+	}
+	if( channels == 2 )
+	{
+		stbi_decode_DXT45_alpha_block( channel_block, compressed + 8 );
+		for( i = 0; i < 16; ++i )
+		{
+			uncompressed[i*4+1] = channel_block[i*4+3];
+			uncompressed[i*4+2] = 0;
+		}
+	}
+}
+
+//	BC7, all 8 modes
+//	the 2 subset partitions, bit i set when texel i is in subset 1
+static const unsigned short stbi__bc7_partition2[64] =
+{
+	0xCCCC, 0x8888, 0xEEEE, 0xECC8, 0xC880, 0xFEEC, 0xFEC8, 0xEC80,
+	0xC800, 0xFFEC, 0xFE80, 0xE800, 0xFFE8, 0xFF00, 0xFFF0, 0xF000,
+	0xF710, 0x008E, 0x7100, 0x08CE, 0x008C, 0x7310, 0x3100, 0x8CCE,
+	0x088C, 0x3110, 0x6666, 0x366C, 0x17E8, 0x0FF0, 0x718E, 0x399C,
+	0xAAAA, 0xF0F0, 0x5A5A, 0x33CC, 0x3C3C, 0x55AA, 0x9696, 0xA55A,
+	0x73CE, 0x13C8, 0x324C, 0x3BDC, 0x6996, 0xC33C, 0x9966, 0x0660,
+	0x0272, 0x04E4, 0x4E40, 0x2720, 0xC936, 0x936C, 0x39C6, 0x639C,
+	0x9336, 0x9CC6, 0x817E, 0xE718, 0xCCF0, 0x0FCC, 0x7744, 0xEE22
+};
+//	the 3 subset partitions, 2 bits per texel
+static const unsigned int stbi__bc7_partition3[64] =
+{
+	0xAA685050, 0x6A5A5040, 0x5A5A4200, 0x5450A0A8, 0xA5A50000, 0xA0A05050, 0x5555A0A0, 0x5A5A5050,
+	0xAA550000, 0xAA555500, 0xAAAA5500, 0x90909090, 0x94949494, 0xA4A4A4A4, 0xA9A59450, 0x2A0A4250,
+	0xA5945040, 0x0A425054, 0xA5A5A500, 0x55A0A0A0, 0xA8A85454, 0x6A6A4040, 0xA4A45000, 0x1A1A0500,
+	0x0050A4A4, 0xAAA59090, 0x14696914, 0x69691400, 0xA08585A0, 0xAA821414, 0x50A4A450, 0x6A5A0200,
+	0xA9A58000, 0x5090A0A8, 0xA8A09050, 0x24242424, 0x00AA5500, 0x24924924, 0x24499224, 0x50A50A50,
+	0x500AA550, 0xAAAA4444, 0x66660000, 0xA5A0A5A0, 0x50A050A0, 0x69286928, 0x44AAAA44, 0x66666600,
+	0xAA444444, 0x54A854A8, 0x95809580, 0x96969600, 0xA85454A8, 0x80959580, 0xAA141414, 0x96960000,
+	0xAAAA1414, 0xA05050A0, 0xA0A5A5A0, 0x96000000, 0x40804080, 0xA9A8A9A8, 0xAAAAAA44, 0x2A4A5254
+};
+//	anchor texels, the indices there drop their top bit
+static const unsigned char stbi__bc7_anchor2[64] =
+{
+	15,15,15,15,15,15,15,15, 15,15,15,15,15,15,15,15, 15, 2, 8, 2, 2, 8, 8,15,  2, 8, 2, 2, 8, 8, 2, 2,
+	15,15, 6, 8, 2, 8,15,15,  2, 8, 2, 2, 2,15,15, 6,  6, 2, 6, 8,15,15, 2, 2, 15,15,15,15,15, 2, 2,15
+};
+static const unsigned char stbi__bc7_anchor3a[64] =
+{
+	 3, 3,15,15, 8, 3,15,15,  8, 8, 6, 6, 6, 5, 3, 3,  3, 3, 8,15, 3, 3, 6,10,  5, 8, 8, 6, 8, 5,15,15,
+	 8,15, 3, 5, 6,10, 8,15, 15, 3,15, 5,15,15,15,15,  3,15, 5, 5, 5, 8, 5,10,  5,10, 8,13,15,12, 3, 3
+};
+static const unsigned char stbi__bc7_anchor3b[64] =
+{
+	15, 8, 8, 3,15,15, 3, 8, 15,15,15,15,15,15,15, 8, 15, 8,15, 3,15, 8,15, 8,  3,15, 6,10,15,15,10, 8,
+	15, 3,15,10,10, 8, 9,10,  6,15, 8,15, 3, 6, 6, 8, 15, 3,15,15,15,15,15,15, 15,15,15,15, 3,15,15, 8
+};
+static const unsigned char stbi__bc7_weights2[4] = { 0, 21, 43, 64 };
+static const unsigned char stbi__bc7_weights3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+static const unsigned char stbi__bc7_weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+//	subsets, partition bits, rotation bits, index selection bits, color bits,
+//	alpha bits, p-bit per endpoint, p-bit per subset, index bits, 2nd index bits
+static const unsigned char stbi__bc7_modes[8][10] =
+{
+	{ 3, 4, 0, 0, 4, 0, 1, 0, 3, 0 },
+	{ 2, 6, 0, 0, 6, 0, 0, 1, 3, 0 },
+	{ 3, 6, 0, 0, 5, 0, 0, 0, 2, 0 },
+	{ 2, 6, 0, 0, 7, 0, 1, 0, 2, 0 },
+	{ 1, 0, 2, 1, 5, 6, 0, 0, 2, 3 },
+	{ 1, 0, 2, 0, 7, 8, 0, 0, 2, 2 },
+	{ 1, 0, 0, 0, 7, 7, 1, 0, 4, 0 },
+	{ 2, 6, 0, 0, 5, 5, 1, 0, 2, 0 }
+};
+static int stbi__bc7_bits( const unsigned char *compressed, int *bit, int count )
+{
+	int i, value = 0;
+	for( i = 0; i < count; ++i, ++*bit )
+	{
+		value |= ((compressed[*bit >> 3] >> (*bit & 7)) & 1) << i;
+	}
+	return value;
+}
+static const unsigned char *stbi__bc7_weights( int index_bits )
+{
+	return (index_bits == 2) ? stbi__bc7_weights2 :
+		( (index_bits == 3) ? stbi__bc7_weights3 : stbi__bc7_weights4 );
+}
+void stbi_decode_BC7_block(
+			unsigned char uncompressed[16*4],
+			unsigned char compressed[16] )
+{
+	int mode, bit, i, c, s;
+	int subsets, partition, rotation, index_sel;
+	int color_bits, alpha_bits, endpoints[6][4];
+	int index1[16], index2[16];
+	const unsigned char *m;
+	//	the mode is the position of the 1st set bit
+	for( mode = 0; (mode < 8) && !((compressed[0] >> mode) & 1); ++mode ) {}
+	if( mode == 8 )
+	{
+		//	reserved, decodes as transparent black
+		memset( uncompressed, 0, 16*4 );
+		return;
+	}
+	m = stbi__bc7_modes[mode];
+	bit = mode + 1;
+	subsets = m[0];
+	partition = stbi__bc7_bits( compressed, &bit, m[1] );
+	rotation = stbi__bc7_bits( compressed, &bit, m[2] );
+	index_sel = stbi__bc7_bits( compressed, &bit, m[3] );
+	color_bits = m[4];
+	alpha_bits = m[5];
+	//	R for every endpoint, then G, B and A
+	for( c = 0; c < 3; ++c )
+	{
+		for( i = 0; i < subsets*2; ++i )
+		{
+			endpoints[i][c] = stbi__bc7_bits( compressed, &bit, color_bits );
+		}
+	}
+	for( i = 0; i < subsets*2; ++i )
+	{
+		endpoints[i][3] = alpha_bits ? stbi__bc7_bits( compressed, &bit, alpha_bits ) : 255;
+	}
+	if( m[6] || m[7] )
+	{
+		int pbits[6];
+		for( i = 0; i < (m[6] ? subsets*2 : subsets); ++i )
+		{
+			pbits[i] = stbi__bc7_bits( compressed, &bit, 1 );
+		}
+		for( i = 0; i < subsets*2; ++i )
+		{
+			int p = m[6] ? pbits[i] : pbits[i >> 1];
+			for( c = 0; c < (alpha_bits ? 4 : 3); ++c )
+			{
+				endpoints[i][c] = (endpoints[i][c] << 1) | p;
+			}
+		}
+		++color_bits;
+		if( alpha_bits )
+		{
+			++alpha_bits;
+		}
+	}
+	//	expand to 8 bits by replicating the top bits
+	for( i = 0; i < subsets*2; ++i )
+	{
+		for( c = 0; c < 3; ++c )
+		{
+			endpoints[i][c] <<= 8 - color_bits;
+			endpoints[i][c] |= endpoints[i][c] >> color_bits;
+		}
+		if( alpha_bits )
+		{
+			endpoints[i][3] <<= 8 - alpha_bits;
+			endpoints[i][3] |= endpoints[i][3] >> alpha_bits;
+		}
+	}
+	//	the indices, anchors have one bit less
+	for( i = 0; i < 16; ++i )
+	{
+		int anchor = (i == 0);
+		if( subsets == 2 )
+		{
+			anchor |= (i == stbi__bc7_anchor2[partition]);
+		} else if( subsets == 3 )
+		{
+			anchor |= (i == stbi__bc7_anchor3a[partition]) || (i == stbi__bc7_anchor3b[partition]);
+		}
+		index1[i] = stbi__bc7_bits( compressed, &bit, m[8] - anchor );
+	}
+	for( i = 0; i < 16; ++i )
+	{
+		index2[i] = m[9] ? stbi__bc7_bits( compressed, &bit, m[9] - (i == 0) ) : index1[i];
+	}
+	//	and interpolate
+	for( i = 0; i < 16; ++i )
+	{
+		const unsigned char *color_weights, *alpha_weights;
+		int color_index = index1[i], alpha_index = index2[i];
+		s = 0;
+		if( subsets == 2 )
+		{
+			s = (stbi__bc7_partition2[partition] >> i) & 1;
+		} else if( subsets == 3 )
+		{
+			s = (stbi__bc7_partition3[partition] >> (i*2)) & 3;
+		}
+		color_weights = stbi__bc7_weights( m[8] );
+		alpha_weights = stbi__bc7_weights( m[9] ? m[9] : m[8] );
+		if( index_sel )
+		{
+			//	mode 4 can swap which index set is for color
+			const unsigned char *w = color_weights;
+			color_weights = alpha_weights;
+			alpha_weights = w;
+			color_index = index2[i];
+			alpha_index = index1[i];
+		}
+		for( c = 0; c < 4; ++c )
+		{
+			int w = (c < 3) ? color_weights[color_index] : alpha_weights[alpha_index];
+			uncompressed[i*4+c] = (unsigned char)(((64 - w) * endpoints[s*2][c] +
+					w * endpoints[s*2+1][c] + 32) >> 6);
+		}
+		if( rotation )
+		{
+			unsigned char t = uncompressed[i*4+3];
+			uncompressed[i*4+3] = uncompressed[i*4+rotation-1];
+			uncompressed[i*4+rotation-1] = t;
+		}
+	}
+}
+
 static int stbi__dds_info( stbi__context *s, int *x, int *y, int *comp, int *iscompressed ) {
 	int flags,is_compressed,has_alpha;
 	DDS_header header={0};
@@ -341,8 +582,8 @@ static void * stbi__dds_load(stbi__context *s, int *x, int *y, int *comp, int re
 	//	all variables go up front
 	stbi_uc *dds_data = NULL;
 	stbi_uc block[16*4];
-	stbi_uc compressed[8];
-	int flags, DXT_family;
+	stbi_uc compressed[16];
+	int flags, DXT_family, RGTC_channels = 0, is_BC7 = 0;
 	int has_alpha, has_mipmap;
 	int is_compressed, cubemap_faces;
 	int block_pitch, num_blocks;
@@ -367,6 +608,46 @@ static void * stbi__dds_load(stbi__context *s, int *x, int *y, int *comp, int re
 	flags = DDPF_FOURCC | DDPF_RGB;
 	if( (header.sPixelFormat.dwFlags & flags) == 0 ) return NULL;
 	if( (header.sCaps.dwCaps1 & DDSCAPS_TEXTURE) == 0 ) return NULL;
+	//	DX10 files keep the format in an extra header, map it back to a FourCC
+	if( (header.sPixelFormat.dwFlags & DDPF_FOURCC) &&
+		(header.sPixelFormat.dwFourCC == (('D'<<0)|('X'<<8)|('1'<<16)|('0'<<24))) )
+	{
+		DDS_header_DX10 header_DX10;
+		stbi__getn( s, (stbi_uc*)(&header_DX10), sizeof( DDS_header_DX10 ) );
+		switch( header_DX10.dxgiFormat )
+		{
+		case DDS_DXGI_FORMAT_BC1_UNORM:
+		case DDS_DXGI_FORMAT_BC1_UNORM_SRGB:
+			header.sPixelFormat.dwFourCC = ('D'<<0)|('X'<<8)|('T'<<16)|('1'<<24);
+			break;
+		case DDS_DXGI_FORMAT_BC2_UNORM:
+		case DDS_DXGI_FORMAT_BC2_UNORM_SRGB:
+			header.sPixelFormat.dwFourCC = ('D'<<0)|('X'<<8)|('T'<<16)|('3'<<24);
+			break;
+		case DDS_DXGI_FORMAT_BC3_UNORM:
+		case DDS_DXGI_FORMAT_BC3_UNORM_SRGB:
+			header.sPixelFormat.dwFourCC = ('D'<<0)|('X'<<8)|('T'<<16)|('5'<<24);
+			break;
+		case DDS_DXGI_FORMAT_BC4_UNORM:
+			header.sPixelFormat.dwFourCC = ('A'<<0)|('T'<<8)|('I'<<16)|('1'<<24);
+			break;
+		case DDS_DXGI_FORMAT_BC5_UNORM:
+			header.sPixelFormat.dwFourCC = ('A'<<0)|('T'<<8)|('I'<<16)|('2'<<24);
+			break;
+		case DDS_DXGI_FORMAT_BC7_UNORM:
+		case DDS_DXGI_FORMAT_BC7_UNORM_SRGB:
+			is_BC7 = 1;
+			break;
+		default:
+			//	BC6H is HDR, and the rest are not block compressed
+			return stbi__errpuc( "unsupported DDS", "DDS DX10 format not supported" );
+		}
+		if( header_DX10.miscFlag & DDS_RESOURCE_MISC_TEXTURECUBE )
+		{
+			header.sCaps.dwCaps2 |= DDSCAPS2_CUBEMAP;
+		}
+		//	for texture arrays only the 1st element gets decoded
+	}
 	//	get the image data
 	s->img_x = header.dwWidth;
 	s->img_y = header.dwHeight;
@@ -390,14 +671,19 @@ static void * stbi__dds_load(stbi__context *s, int *x, int *y, int *comp, int re
 	{
 		/*	compressed	*/
 		//	note: header.sPixelFormat.dwFourCC is something like (('D'<<0)|('X'<<8)|('T'<<16)|('1'<<24))
+		RGTC_channels = stbi__dds_RGTC_channels( header.sPixelFormat.dwFourCC );
 		DXT_family = 1 + (header.sPixelFormat.dwFourCC >> 24) - '1';
-		if( (DXT_family < 1) || (DXT_family > 5) ) return NULL;
+		if( RGTC_channels || is_BC7 )
+		{
+			//	not a DXT family at all, and not to be confused with DXT1/2
+			DXT_family = 0;
+		} else if( (DXT_family < 1) || (DXT_family > 5) ) return NULL;
 		/*	check the expected size...oops, nevermind...
 			those non-compliant writers leave
 			dwPitchOrLinearSize == 0	*/
 		//	passed all the tests, get the RAM for decoding
 		sz = (s->img_x)*(s->img_y)*4*cubemap_faces;
-		dds_data = (unsigned char*)malloc( sz );
+		dds_data = (unsigned char*)STBI_MALLOC( sz );
 		/*	do this once for each face	*/
 		for( cf = 0; cf < cubemap_faces; ++ cf )
 		{
@@ -409,7 +695,17 @@ static void * stbi__dds_load(stbi__context *s, int *x, int *y, int *comp, int re
 				int ref_x = 4 * (i % block_pitch);
 				int ref_y = 4 * (i / block_pitch);
 				//	get the next block's worth of compressed data, and decompress it
-				if( DXT_family == 1 )
+				if( is_BC7 )
+				{
+					//	BC7
+					stbi__getn( s, compressed, 16 );
+					stbi_decode_BC7_block( block, compressed );
+				} else if( RGTC_channels )
+				{
+					//	BC4 / BC5
+					stbi__getn( s, compressed, 8*RGTC_channels );
+					stbi_decode_RGTC_block( block, compressed, RGTC_channels );
+				} else if( DXT_family == 1 )
 				{
 					//	DXT1
 					stbi__getn( s, compressed, 8 );
@@ -454,7 +750,7 @@ static void * stbi__dds_load(stbi__context *s, int *x, int *y, int *comp, int re
 			if( has_mipmap )
 			{
 				int block_size = 16;
-				if( DXT_family == 1 )
+				if( (DXT_family == 1) || (RGTC_channels == 1) )
 				{
 					block_size = 8;
 				}
@@ -485,7 +781,7 @@ static void * stbi__dds_load(stbi__context *s, int *x, int *y, int *comp, int re
 		}
 		*comp = s->img_n;
 		sz = s->img_x*s->img_y*s->img_n*cubemap_faces;
-		dds_data = (unsigned char*)malloc( sz );
+		dds_data = (unsigned char*)STBI_MALLOC( sz );
 		/*	do this once for each face	*/
 		for( cf = 0; cf < cubemap_faces; ++ cf )
 		{
@@ -534,6 +830,21 @@ static void * stbi__dds_load(stbi__context *s, int *x, int *y, int *comp, int re
 			has_alpha |= (dds_data[i] < 255);
 		}
 	}
+	if( ((req_comp == 1) || (req_comp == 2)) && (RGTC_channels == 2) )
+	{
+		//	BC5 holds 2 channels as red and green, hand back the first
+		//	req_comp of those as they were saved ( luminance, then alpha
+		//	for a 2 channel image ), not a weighted mix of red and green
+		for( i = 0; i < sz / 4; ++i )
+		{
+			dds_data[i*req_comp+0] = dds_data[i*4+0];
+			if( req_comp == 2 )
+			{
+				dds_data[i*2+1] = dds_data[i*4+1];
+			}
+		}
+		*comp = req_comp;
+	} else
 	if( (req_comp <= 4) && (req_comp >= 1) )
 	{
 		//	user has some requirements, meet them
@@ -0,0 +1,260 @@
+/*
+	QOI ( https://qoiformat.org ) is a 14 byte header, then one op per
+	pixel or run of pixels, and 7 zeros and a 1 to end the stream.
+	There is no entropy coding, so it decodes as fast as it can be read.
+*/
+
+#define STBI__QOI_OP_INDEX	0x00
+#define STBI__QOI_OP_DIFF	0x40
+#define STBI__QOI_OP_LUMA	0x80
+#define STBI__QOI_OP_RUN	0xc0
+#define STBI__QOI_OP_RGB	0xfe
+#define STBI__QOI_OP_RGBA	0xff
+#define STBI__QOI_HASH(r,g,b,a)	(((r) * 3 + (g) * 5 + (b) * 7 + (a) * 11) & 63)
+
+/*	reads the header into s, 0 if it is not a QOI file stb_image can hold	*/
+static int stbi__qoi_header(stbi__context *s)
+{
+	stbi__uint32 width, height;
+	int channels;
+
+	if ( stbi__get8(s) != 'q' || stbi__get8(s) != 'o' || stbi__get8(s) != 'i' || stbi__get8(s) != 'f' ) {
+		return 0;
+	}
+
+	width = stbi__get32be(s);
+	height = stbi__get32be(s);
+	channels = stbi__get8(s);
+	/*	the color space byte only says how the values should be read	*/
+	stbi__get8(s);
+
+	if ( width == 0 || height == 0 || width > (1 << 24) || height > (1 << 24) ||
+		( channels != 3 && channels != 4 ) ||
+		!stbi__mad3sizes_valid( (int)width, (int)height, 4, 0 ) ) {
+		return 0;
+	}
+
+	s->img_x = width;
+	s->img_y = height;
+	s->img_n = channels;
+	return 1;
+}
+
+static int stbi__qoi_test(stbi__context *s)
+{
+	int r = stbi__get8(s) == 'q' && stbi__get8(s) == 'o' && stbi__get8(s) == 'i' && stbi__get8(s) == 'f';
+	stbi__rewind(s);
+	return r;
+}
+
+#ifndef STBI_NO_STDIO
+
+int      stbi__qoi_test_filename        		(char const *filename)
+{
+   int r;
+   FILE *f = fopen(filename, "rb");
+   if (!f) return 0;
+   r = stbi__qoi_test_file(f);
+   fclose(f);
+   return r;
+}
+
+int      stbi__qoi_test_file        (FILE *f)
+{
+   stbi__context s;
+   int r,n = ftell(f);
+   stbi__start_file(&s,f);
+   r = stbi__qoi_test(&s);
+   fseek(f,n,SEEK_SET);
+   return r;
+}
+#endif
+
+int      stbi__qoi_test_memory      (stbi_uc const *buffer, int len)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer, len);
+   return stbi__qoi_test(&s);
+}
+
+int      stbi__qoi_test_callbacks      (stbi_io_callbacks const *clbk, void *user)
+{
+   stbi__context s;
+   stbi__start_callbacks(&s, (stbi_io_callbacks *) clbk, user);
+   return stbi__qoi_test(&s);
+}
+
+static int stbi__qoi_info(stbi__context *s, int *x, int *y, int *comp )
+{
+	if ( !stbi__qoi_header(s) ) {
+		stbi__rewind(s);
+		return 0;
+	}
+
+	if (x) *x = s->img_x;
+	if (y) *y = s->img_y;
+	if (comp) *comp = s->img_n;
+
+	stbi__rewind(s);
+
+	return 1;
+}
+
+int stbi__qoi_info_from_memory (stbi_uc const *buffer, int len, int *x, int *y, int *comp )
+{
+	stbi__context s;
+	stbi__start_mem(&s,buffer, len);
+	return stbi__qoi_info( &s, x, y, comp );
+}
+
+int stbi__qoi_info_from_callbacks (stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *comp)
+{
+	stbi__context s;
+	stbi__start_callbacks(&s, (stbi_io_callbacks *) clbk, user);
+	return stbi__qoi_info( &s, x, y, comp );
+}
+
+#ifndef STBI_NO_STDIO
+int stbi__qoi_info_from_path(char const *filename,     int *x, int *y, int *comp)
+{
+   int res;
+   FILE *f = fopen(filename, "rb");
+   if (!f) return 0;
+   res = stbi__qoi_info_from_file( f, x, y, comp );
+   fclose(f);
+   return res;
+}
+
+int stbi__qoi_info_from_file(FILE *f,                  int *x, int *y, int *comp)
+{
+   stbi__context s;
+   int res;
+   long n = ftell(f);
+   stbi__start_file(&s, f);
+   res = stbi__qoi_info(&s, x, y, comp);
+   fseek(f, n, SEEK_SET);
+   return res;
+}
+#endif
+
+static void * stbi__qoi_load(stbi__context *s, int *x, int *y, int *comp, int req_comp)
+{
+	stbi_uc index[64 * 4];
+	stbi_uc *out, *p, *end, *c;
+	stbi_uc r = 0, g = 0, b = 0, a = 255;
+	int n, op, run = 0;
+
+	if ( !stbi__qoi_header(s) ) {
+		return stbi__errpuc("bad QOI", "Not a QOI file, or too large");
+	}
+
+	/*	RGB and RGBA are written straight out, gray goes through convert_format	*/
+	n = ( req_comp == 3 || req_comp == 4 ) ? req_comp : s->img_n;
+
+	out = (stbi_uc *) stbi__malloc_mad3( s->img_x, s->img_y, n, 0 );
+	if ( NULL == out ) {
+		return stbi__errpuc("outofmem", "Out of memory");
+	}
+
+	memset( index, 0, sizeof( index ) );
+	end = out + (size_t)s->img_x * s->img_y * n;
+
+	/*	a stream that ends early reads as zeros, which are index ops, so it
+		can not overrun the image, the rest of it is just garbage	*/
+	for ( p = out; p < end; p += n ) {
+		if ( run > 0 ) {
+			--run;
+		} else {
+			op = stbi__get8(s);
+			if ( op == STBI__QOI_OP_RGB ) {
+				r = stbi__get8(s);
+				g = stbi__get8(s);
+				b = stbi__get8(s);
+			} else if ( op == STBI__QOI_OP_RGBA ) {
+				r = stbi__get8(s);
+				g = stbi__get8(s);
+				b = stbi__get8(s);
+				a = stbi__get8(s);
+			} else {
+				switch ( op & 0xc0 ) {
+				case STBI__QOI_OP_INDEX:
+					c = index + op * 4;
+					r = c[0];
+					g = c[1];
+					b = c[2];
+					a = c[3];
+					break;
+				case STBI__QOI_OP_DIFF:
+					r = (stbi_uc)( r + ( ( op >> 4 ) & 3 ) - 2 );
+					g = (stbi_uc)( g + ( ( op >> 2 ) & 3 ) - 2 );
+					b = (stbi_uc)( b + ( op & 3 ) - 2 );
+					break;
+				case STBI__QOI_OP_LUMA: {
+					int rb = stbi__get8(s);
+					int vg = ( op & 0x3f ) - 32;
+					r = (stbi_uc)( r + vg - 8 + ( rb >> 4 ) );
+					g = (stbi_uc)( g + vg );
+					b = (stbi_uc)( b + vg - 8 + ( rb & 15 ) );
+					break;
+				}
+				default:
+					/*	the run includes this pixel	*/
+					run = op & 0x3f;
+					break;
+				}
+			}
+			c = index + STBI__QOI_HASH( r, g, b, a ) * 4;
+			c[0] = r;
+			c[1] = g;
+			c[2] = b;
+			c[3] = a;
+		}
+		p[0] = r;
+		p[1] = g;
+		p[2] = b;
+		if ( n == 4 ) p[3] = a;
+	}
+
+	*x = s->img_x;
+	*y = s->img_y;
+	if (comp) *comp = s->img_n;
+
+	if ( req_comp >= 1 && req_comp <= 4 && req_comp != n ) {
+		out = stbi__convert_format( out, n, req_comp, s->img_x, s->img_y );
+	}
+
+	return out;
+}
+
+#ifndef STBI_NO_STDIO
+void *stbi__qoi_load_from_file   (FILE *f,                  int *x, int *y, int *comp, int req_comp)
+{
+	stbi__context s;
+	stbi__start_file(&s,f);
+	return stbi__qoi_load(&s,x,y,comp,req_comp);
+}
+
+void *stbi__qoi_load_from_path             (char const*filename,           int *x, int *y, int *comp, int req_comp)
+{
+   void *data;
+   FILE *f = fopen(filename, "rb");
+   if (!f) return NULL;
+   data = stbi__qoi_load_from_file(f,x,y,comp,req_comp);
+   fclose(f);
+   return data;
+}
+#endif
+
+void *stbi__qoi_load_from_memory (stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer, len);
+   return stbi__qoi_load(&s,x,y,comp,req_comp);
+}
+
+void *stbi__qoi_load_from_callbacks (stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *comp, int req_comp)
+{
+	stbi__context s;
+   stbi__start_callbacks(&s, (stbi_io_callbacks *) clbk, user);
+   return stbi__qoi_load(&s,x,y,comp,req_comp);
+}
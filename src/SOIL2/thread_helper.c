@@ -0,0 +1,481 @@
+/*
+    Thread helper functions
+
+    MIT license
+*/
+
+#include "thread_helper.h"
+#include <stdlib.h>
+
+#if !defined( SOIL_NO_THREADS )
+	#if defined( __WIN32__ ) || defined( _WIN32 ) || defined( WIN32 )
+		#define THREAD_HELPER_WIN32
+		#define WIN32_LEAN_AND_MEAN
+		#include <windows.h>
+	#else
+		#define THREAD_HELPER_PTHREADS
+		#include <pthread.h>
+		#include <sched.h>
+		#include <unistd.h>
+	#endif
+#endif
+
+/*	the states of a thread_once_flag	*/
+#define THREAD_ONCE_NEW		0
+#define THREAD_ONCE_RUNNING	1
+#define THREAD_ONCE_DONE	2
+
+/*	never spawn more than this many threads for one call	*/
+#define THREAD_HELPER_MAX_THREADS	64
+
+typedef struct
+{
+	parallel_job_func job;
+	void *arg;
+	int job_count;
+	int first_job;
+	int job_step;
+}
+parallel_job_range;
+
+/*	each thread takes every job_step-th job, so neighbouring
+	jobs (usually neighbouring rows) are spread evenly	*/
+static void run_job_range( parallel_job_range *range )
+{
+	int i;
+	for( i = range->first_job; i < range->job_count; i += range->job_step )
+	{
+		range->job( range->arg, i );
+	}
+}
+
+#if defined( THREAD_HELPER_WIN32 )
+static DWORD WINAPI job_range_thread( LPVOID param )
+{
+	run_job_range( (parallel_job_range*)param );
+	return 0;
+}
+#elif defined( THREAD_HELPER_PTHREADS )
+static void *job_range_thread( void *param )
+{
+	run_job_range( (parallel_job_range*)param );
+	return NULL;
+}
+#endif
+
+int
+	get_hardware_thread_count
+	(
+		void
+	)
+{
+	int count = 1;
+#if defined( THREAD_HELPER_WIN32 )
+	SYSTEM_INFO info;
+	GetSystemInfo( &info );
+	count = (int)info.dwNumberOfProcessors;
+#elif defined( THREAD_HELPER_PTHREADS ) && defined( _SC_NPROCESSORS_ONLN )
+	count = (int)sysconf( _SC_NPROCESSORS_ONLN );
+#endif
+	return count < 1 ? 1 : count;
+}
+
+void
+	run_parallel_jobs
+	(
+		int job_count,
+		int max_threads,
+		parallel_job_func job,
+		void *arg
+	)
+{
+	parallel_job_range ranges[THREAD_HELPER_MAX_THREADS];
+	int thread_count, i;
+#if defined( THREAD_HELPER_WIN32 )
+	HANDLE threads[THREAD_HELPER_MAX_THREADS];
+#elif defined( THREAD_HELPER_PTHREADS )
+	pthread_t threads[THREAD_HELPER_MAX_THREADS];
+#endif
+	int started[THREAD_HELPER_MAX_THREADS];
+
+	if( (job_count < 1) || (NULL == job) )
+	{
+		return;
+	}
+	thread_count = max_threads > 0 ? max_threads : get_hardware_thread_count();
+	if( thread_count > job_count )
+	{
+		thread_count = job_count;
+	}
+	if( thread_count > THREAD_HELPER_MAX_THREADS )
+	{
+		thread_count = THREAD_HELPER_MAX_THREADS;
+	}
+#if !defined( THREAD_HELPER_WIN32 ) && !defined( THREAD_HELPER_PTHREADS )
+	thread_count = 1;
+#endif
+	for( i = 0; i < thread_count; ++i )
+	{
+		ranges[i].job = job;
+		ranges[i].arg = arg;
+		ranges[i].job_count = job_count;
+		ranges[i].first_job = i;
+		ranges[i].job_step = thread_count;
+		started[i] = 0;
+	}
+	/*	thread 0 is the caller, spawn the rest	*/
+	for( i = 1; i < thread_count; ++i )
+	{
+#if defined( THREAD_HELPER_WIN32 )
+		threads[i] = CreateThread( NULL, 0, job_range_thread, &ranges[i], 0, NULL );
+		started[i] = ( NULL != threads[i] );
+#elif defined( THREAD_HELPER_PTHREADS )
+		started[i] = ( 0 == pthread_create( &threads[i], NULL, job_range_thread, &ranges[i] ) );
+#endif
+	}
+	run_job_range( &ranges[0] );
+	for( i = 1; i < thread_count; ++i )
+	{
+		if( !started[i] )
+		{
+			/*	could not get a thread, do the work here	*/
+			run_job_range( &ranges[i] );
+			continue;
+		}
+#if defined( THREAD_HELPER_WIN32 )
+		WaitForSingleObject( threads[i], INFINITE );
+		CloseHandle( threads[i] );
+#elif defined( THREAD_HELPER_PTHREADS )
+		pthread_join( threads[i], NULL );
+#endif
+	}
+}
+
+void
+	run_once
+	(
+		thread_once_flag *flag,
+		void (*func)( void )
+	)
+{
+#if defined( THREAD_HELPER_WIN32 )
+	if( InterlockedCompareExchange( &flag->state, THREAD_ONCE_DONE, THREAD_ONCE_DONE ) == THREAD_ONCE_DONE )
+	{
+		return;
+	}
+	if( InterlockedCompareExchange( &flag->state, THREAD_ONCE_RUNNING, THREAD_ONCE_NEW ) == THREAD_ONCE_NEW )
+	{
+		func();
+		InterlockedExchange( &flag->state, THREAD_ONCE_DONE );
+		return;
+	}
+	/*	somebody else got there first, wait for them	*/
+	while( InterlockedCompareExchange( &flag->state, THREAD_ONCE_DONE, THREAD_ONCE_DONE ) != THREAD_ONCE_DONE )
+	{
+		Sleep( 0 );
+	}
+#elif defined( THREAD_HELPER_PTHREADS )
+	if( __sync_val_compare_and_swap( &flag->state, THREAD_ONCE_DONE, THREAD_ONCE_DONE ) == THREAD_ONCE_DONE )
+	{
+		return;
+	}
+	if( __sync_bool_compare_and_swap( &flag->state, THREAD_ONCE_NEW, THREAD_ONCE_RUNNING ) )
+	{
+		func();
+		__sync_synchronize();
+		flag->state = THREAD_ONCE_DONE;
+		return;
+	}
+	/*	somebody else got there first, wait for them	*/
+	while( __sync_val_compare_and_swap( &flag->state, THREAD_ONCE_DONE, THREAD_ONCE_DONE ) != THREAD_ONCE_DONE )
+	{
+		sched_yield();
+	}
+#else
+	if( flag->state != THREAD_ONCE_DONE )
+	{
+		flag->state = THREAD_ONCE_DONE;
+		func();
+	}
+#endif
+}
+
+void
+	atomic_increment
+	(
+		volatile long *value
+	)
+{
+#if defined( THREAD_HELPER_WIN32 )
+	InterlockedIncrement( value );
+#elif defined( THREAD_HELPER_PTHREADS )
+	__sync_add_and_fetch( value, 1 );
+#else
+	++*value;
+#endif
+}
+
+long
+	atomic_read
+	(
+		volatile long *value
+	)
+{
+#if defined( THREAD_HELPER_WIN32 )
+	return InterlockedCompareExchange( value, 0, 0 );
+#elif defined( THREAD_HELPER_PTHREADS )
+	return __sync_val_compare_and_swap( value, 0, 0 );
+#else
+	return *value;
+#endif
+}
+
+typedef struct
+{
+	background_job_func job;
+	void *arg;
+}
+background_job;
+
+struct background_worker
+{
+	/*	a ring of the waiting jobs	*/
+	background_job *jobs;
+	int max_pending;
+	int first_job;
+	int job_count;
+	int busy;
+	int stopping;
+	int threaded;
+#if defined( THREAD_HELPER_WIN32 )
+	HANDLE thread;
+	CRITICAL_SECTION lock;
+	CONDITION_VARIABLE changed;
+#elif defined( THREAD_HELPER_PTHREADS )
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+#endif
+};
+
+/*	one condition for every change of the queue, anybody waiting
+	on it checks again for what they need	*/
+static void worker_lock( background_worker *worker )
+{
+#if defined( THREAD_HELPER_WIN32 )
+	EnterCriticalSection( &worker->lock );
+#elif defined( THREAD_HELPER_PTHREADS )
+	pthread_mutex_lock( &worker->lock );
+#else
+	(void)worker;
+#endif
+}
+
+static void worker_unlock( background_worker *worker )
+{
+#if defined( THREAD_HELPER_WIN32 )
+	LeaveCriticalSection( &worker->lock );
+#elif defined( THREAD_HELPER_PTHREADS )
+	pthread_mutex_unlock( &worker->lock );
+#else
+	(void)worker;
+#endif
+}
+
+static void worker_wait_change( background_worker *worker )
+{
+#if defined( THREAD_HELPER_WIN32 )
+	SleepConditionVariableCS( &worker->changed, &worker->lock, INFINITE );
+#elif defined( THREAD_HELPER_PTHREADS )
+	pthread_cond_wait( &worker->changed, &worker->lock );
+#else
+	(void)worker;
+#endif
+}
+
+static void worker_signal_change( background_worker *worker )
+{
+#if defined( THREAD_HELPER_WIN32 )
+	WakeAllConditionVariable( &worker->changed );
+#elif defined( THREAD_HELPER_PTHREADS )
+	pthread_cond_broadcast( &worker->changed );
+#else
+	(void)worker;
+#endif
+}
+
+#if defined( THREAD_HELPER_WIN32 ) || defined( THREAD_HELPER_PTHREADS )
+static void run_background_jobs( background_worker *worker )
+{
+	background_job next;
+	worker_lock( worker );
+	for( ;; )
+	{
+		while( (0 == worker->job_count) && !worker->stopping )
+		{
+			worker_wait_change( worker );
+		}
+		if( 0 == worker->job_count )
+		{
+			break;
+		}
+		next = worker->jobs[worker->first_job];
+		worker->first_job = (worker->first_job + 1) % worker->max_pending;
+		--worker->job_count;
+		worker->busy = 1;
+		worker_signal_change( worker );
+		worker_unlock( worker );
+		next.job( next.arg );
+		worker_lock( worker );
+		worker->busy = 0;
+		worker_signal_change( worker );
+	}
+	worker_unlock( worker );
+}
+
+#if defined( THREAD_HELPER_WIN32 )
+static DWORD WINAPI background_worker_thread( LPVOID param )
+{
+	run_background_jobs( (background_worker*)param );
+	return 0;
+}
+#else
+static void *background_worker_thread( void *param )
+{
+	run_background_jobs( (background_worker*)param );
+	return NULL;
+}
+#endif
+#endif
+
+background_worker *
+	create_background_worker
+	(
+		int max_pending
+	)
+{
+	background_worker *worker = (background_worker*)calloc( 1, sizeof( background_worker ) );
+	if( NULL == worker )
+	{
+		return NULL;
+	}
+	worker->max_pending = max_pending > 1 ? max_pending : 1;
+	worker->jobs = (background_job*)malloc( worker->max_pending * sizeof( background_job ) );
+	if( NULL == worker->jobs )
+	{
+		free( worker );
+		return NULL;
+	}
+#if defined( THREAD_HELPER_WIN32 )
+	InitializeCriticalSection( &worker->lock );
+	InitializeConditionVariable( &worker->changed );
+	worker->thread = CreateThread( NULL, 0, background_worker_thread, worker, 0, NULL );
+	worker->threaded = ( NULL != worker->thread );
+	if( !worker->threaded )
+	{
+		DeleteCriticalSection( &worker->lock );
+	}
+#elif defined( THREAD_HELPER_PTHREADS )
+	if( 0 == pthread_mutex_init( &worker->lock, NULL ) )
+	{
+		if( 0 == pthread_cond_init( &worker->changed, NULL ) )
+		{
+			worker->threaded = ( 0 == pthread_create( &worker->thread, NULL, background_worker_thread, worker ) );
+			if( !worker->threaded )
+			{
+				pthread_cond_destroy( &worker->changed );
+			}
+		}
+		if( !worker->threaded )
+		{
+			pthread_mutex_destroy( &worker->lock );
+		}
+	}
+#endif
+	return worker;
+}
+
+int
+	submit_background_job
+	(
+		background_worker *worker,
+		background_job_func job,
+		void *arg,
+		int wait
+	)
+{
+	if( (NULL == worker) || (NULL == job) )
+	{
+		return 0;
+	}
+	if( !worker->threaded )
+	{
+		/*	no thread to hand it to, do the work here	*/
+		job( arg );
+		return 1;
+	}
+	worker_lock( worker );
+	while( worker->job_count == worker->max_pending )
+	{
+		if( !wait )
+		{
+			worker_unlock( worker );
+			return 0;
+		}
+		worker_wait_change( worker );
+	}
+	worker->jobs[(worker->first_job + worker->job_count) % worker->max_pending].job = job;
+	worker->jobs[(worker->first_job + worker->job_count) % worker->max_pending].arg = arg;
+	++worker->job_count;
+	worker_signal_change( worker );
+	worker_unlock( worker );
+	return 1;
+}
+
+void
+	wait_background_worker
+	(
+		background_worker *worker
+	)
+{
+	if( (NULL == worker) || !worker->threaded )
+	{
+		return;
+	}
+	worker_lock( worker );
+	while( worker->job_count || worker->busy )
+	{
+		worker_wait_change( worker );
+	}
+	worker_unlock( worker );
+}
+
+void
+	destroy_background_worker
+	(
+		background_worker *worker
+	)
+{
+	if( NULL == worker )
+	{
+		return;
+	}
+	if( worker->threaded )
+	{
+		worker_lock( worker );
+		worker->stopping = 1;
+		worker_signal_change( worker );
+		worker_unlock( worker );
+#if defined( THREAD_HELPER_WIN32 )
+		WaitForSingleObject( worker->thread, INFINITE );
+		CloseHandle( worker->thread );
+		DeleteCriticalSection( &worker->lock );
+#elif defined( THREAD_HELPER_PTHREADS )
+		pthread_join( worker->thread, NULL );
+		pthread_cond_destroy( &worker->changed );
+		pthread_mutex_destroy( &worker->lock );
+#endif
+	}
+	free( worker->jobs );
+	free( worker );
+}
@@ -0,0 +1,173 @@
+/*
+    Thread helper functions
+
+    Minimal portable threading used to spread the heavy image
+    work (DXT compression and the like) over the available cores,
+    and to run work like saving screenshots in the background.
+    Define SOIL_NO_THREADS to run everything on the calling thread.
+
+    MIT license
+*/
+
+#ifndef HEADER_THREAD_HELPER
+#define HEADER_THREAD_HELPER
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+	Storage class for per thread variables.  It is empty with
+	SOIL_NO_THREADS, or for a compiler without thread locals.
+**/
+#if defined( SOIL_NO_THREADS )
+	#define SOIL_THREAD_LOCAL
+#elif defined( __cplusplus ) && ( __cplusplus >= 201103L )
+	#define SOIL_THREAD_LOCAL thread_local
+#elif defined( _MSC_VER )
+	#define SOIL_THREAD_LOCAL __declspec( thread )
+#elif defined( __STDC_VERSION__ ) && ( __STDC_VERSION__ >= 201112L ) && !defined( __STDC_NO_THREADS__ )
+	#define SOIL_THREAD_LOCAL _Thread_local
+#elif defined( __GNUC__ )
+	#define SOIL_THREAD_LOCAL __thread
+#else
+	#define SOIL_THREAD_LOCAL
+#endif
+
+/**
+	A flag for run_once, initialize it with THREAD_ONCE_INIT.
+**/
+typedef struct
+{
+	volatile long state;
+}
+thread_once_flag;
+
+#define THREAD_ONCE_INIT	{ 0 }
+
+/**
+	A unit of parallel work.  It is called once for every
+	job_index in [0, job_count) with the user supplied arg.
+**/
+typedef void (*parallel_job_func)( void *arg, int job_index );
+
+/**
+	\return the number of hardware threads available to the
+	process ( always at least 1 )
+**/
+int
+	get_hardware_thread_count
+	(
+		void
+	);
+
+/**
+	Runs job( arg, i ) for every i in [0, job_count), spreading
+	the jobs over at most max_threads threads ( the calling thread
+	included ).  Returns once every job has completed.
+	\param max_threads 0 to use get_hardware_thread_count()
+**/
+void
+	run_parallel_jobs
+	(
+		int job_count,
+		int max_threads,
+		parallel_job_func job,
+		void *arg
+	);
+
+/**
+	Calls func the first time it is reached for this flag.  Other
+	threads reaching it meanwhile wait until func has returned, so
+	whatever func sets up is visible to every caller afterwards.
+**/
+void
+	run_once
+	(
+		thread_once_flag *flag,
+		void (*func)( void )
+	);
+
+/**
+	Adds 1 to a counter that other threads read with atomic_read.
+**/
+void
+	atomic_increment
+	(
+		volatile long *value
+	);
+
+/**
+	\return the value of a counter updated with atomic_increment
+**/
+long
+	atomic_read
+	(
+		volatile long *value
+	);
+
+/**
+	A thread of its own that runs the jobs handed to it one after
+	the other, in order.  Made by create_background_worker.
+**/
+typedef struct background_worker background_worker;
+
+/**
+	A job for a background_worker, called once with the user
+	supplied arg.
+**/
+typedef void (*background_job_func)( void *arg );
+
+/**
+	Starts a background worker.  If no thread can be started
+	( or with SOIL_NO_THREADS ) the jobs run on the submitting
+	thread instead.
+	\param max_pending how many jobs may wait for the worker at
+	most, at least 1
+	\return the worker, or NULL if out of memory
+**/
+background_worker *
+	create_background_worker
+	(
+		int max_pending
+	);
+
+/**
+	Queues job( arg ) for the worker.  When max_pending jobs are
+	already waiting it blocks until the worker takes one if wait is
+	set, and gives up otherwise.
+	\return 1 if the job was queued ( or ran ), 0 if it was not
+**/
+int
+	submit_background_job
+	(
+		background_worker *worker,
+		background_job_func job,
+		void *arg,
+		int wait
+	);
+
+/**
+	Blocks until the worker has finished every queued job.
+**/
+void
+	wait_background_worker
+	(
+		background_worker *worker
+	);
+
+/**
+	Finishes the queued jobs, then stops the thread and frees
+	the worker.
+**/
+void
+	destroy_background_worker
+	(
+		background_worker *worker
+	);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HEADER_THREAD_HELPER	*/